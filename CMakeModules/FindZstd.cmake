@@ -0,0 +1,29 @@
+# - Find zstd
+# Find the Zstandard compression library
+# This module defines
+# ZSTD_INCLUDE_DIR, where to find zstd.h
+# ZSTD_LIBRARIES, the libraries needed to use zstd
+# ZSTD_FOUND, whether zstd was found
+
+FIND_PACKAGE(PkgConfig QUIET)
+PKG_CHECK_MODULES(PC_ZSTD QUIET libzstd)
+
+FIND_PATH(ZSTD_INCLUDE_DIR NAMES zstd.h
+    HINTS
+        ${PC_ZSTD_INCLUDEDIR}
+        ${PC_ZSTD_INCLUDE_DIRS}
+        ${CMAKE_INSTALL_INCLUDEDIR}
+)
+
+FIND_LIBRARY(ZSTD_LIBRARIES NAMES zstd
+    HINTS
+        ${PC_ZSTD_LIBDIR}
+        ${PC_ZSTD_LIBRARY_DIRS}
+        ${CMAKE_INSTALL_LIBDIR}
+)
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(Zstd
+    REQUIRED_VARS ZSTD_LIBRARIES ZSTD_INCLUDE_DIR)
+
+MARK_AS_ADVANCED(ZSTD_INCLUDE_DIR ZSTD_LIBRARIES)
@@ -108,6 +108,52 @@ Tomahawk.dumpResult = function (result) {
     Tomahawk.log("Done.");
 };
 
+/**
+ * Resolve a batch of queries in a single call from the C++ side.
+ *
+ * Resolvers may implement resolveBatch(queries) themselves, otherwise every
+ * query is passed to resolve() or search() one after the other. Returns the
+ * list of synchronous answers in query order, async resolvers return empty
+ * objects. Queries that threw are answered without results.
+ */
+Tomahawk.resolveBatch = function (queries) {
+    var instance = Tomahawk.resolver.instance,
+        answers = [],
+        i;
+
+    if (typeof instance.resolveBatch === "function") {
+        return instance.resolveBatch(queries);
+    }
+
+    for (i = 0; i < queries.length; i++) {
+        var q = queries[i],
+            answer;
+
+        // One broken query must not cost the rest of the batch
+        try {
+            if (q.fulltext !== undefined) {
+                answer = instance._adapter_search ? instance._adapter_search(q.qid, q.fulltext)
+                                                  : instance.search(q.qid, q.fulltext);
+            } else {
+                answer = instance._adapter_resolve ? instance._adapter_resolve(q.qid, q.artist, q.album, q.track)
+                                                   : instance.resolve(q.qid, q.artist, q.album, q.track);
+            }
+        } catch (e) {
+            Tomahawk.log("Failed to resolve query " + q.qid + ": " + e);
+            answer = { results: [] };
+        }
+
+        // Legacy resolvers don't repeat the qid in their synchronous answers
+        if (answer && typeof answer === "object" && answer.qid === undefined) {
+            answer.qid = q.qid;
+        }
+
+        answers.push(answer || {});
+    }
+
+    return answers;
+};
+
 // javascript part of Tomahawk-Object API
 Tomahawk.extend = function (object, members) {
     var F = function () {};
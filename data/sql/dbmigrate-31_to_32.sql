@@ -0,0 +1,7 @@
+-- Script to migate from db version 31 to 32.
+
+-- Playlist revisions can be stored as deltas against their previous revision
+ALTER TABLE playlist_revision ADD COLUMN delta TEXT;
+ALTER TABLE playlist_revision ADD COLUMN snapshot_distance INTEGER NOT NULL DEFAULT 0;
+
+UPDATE settings SET v = '32' WHERE k == 'schema_version';
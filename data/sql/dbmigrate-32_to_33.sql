@@ -0,0 +1,22 @@
+-- Script to migate from db version 32 to 33.
+
+-- Daily play counts, so charts don't have to scan the whole playback_log
+CREATE TABLE IF NOT EXISTS playback_log_daily (
+    day INTEGER NOT NULL,
+    source INTEGER REFERENCES source(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
+    track INTEGER REFERENCES track(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
+    artist INTEGER REFERENCES artist(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
+    plays INTEGER NOT NULL DEFAULT 0,
+    secs_played INTEGER NOT NULL DEFAULT 0
+);
+
+CREATE INDEX playback_log_daily_day_track ON playback_log_daily(day, track);
+CREATE INDEX playback_log_daily_track ON playback_log_daily(track);
+CREATE INDEX playback_log_daily_artist ON playback_log_daily(artist);
+
+INSERT INTO playback_log_daily(day, source, track, artist, plays, secs_played)
+    SELECT playback_log.playtime / 86400, playback_log.source, playback_log.track, track.artist, COUNT(*), SUM(playback_log.secs_played)
+    FROM playback_log JOIN track ON track.id = playback_log.track
+    GROUP BY playback_log.playtime / 86400, playback_log.source, playback_log.track;
+
+UPDATE settings SET v = '33' WHERE k == 'schema_version';
@@ -523,6 +523,8 @@ HatchetSipPlugin::sendOplog( const QVariantMap& valMap ) const
 {
     tDebug() << Q_FUNC_INFO;
     Tomahawk::DatabaseCommand_loadOps* cmd = new Tomahawk::DatabaseCommand_loadOps( SourceList::instance()->getLocal(), valMap[ "lastrevision" ].toString() );
+    // The server only knows full playlist revisions
+    cmd->setExpandPlaylistDeltas( true );
     connect( cmd, SIGNAL( done( QString, QString, QList< dbop_ptr > ) ), SLOT( oplogFetched( QString, QString, QList< dbop_ptr > ) ) );
     Tomahawk::Database::instance()->enqueue( Tomahawk::dbcmd_ptr( cmd ) );
 }
@@ -34,6 +34,11 @@
 
 #define DEFAULT_CONCURRENT_QUERIES 4
 #define MAX_CONCURRENT_QUERIES 16
+#define QUERY_WINDOW_FACTOR 8
+#define MIN_RESOLVER_BUDGET 1
+#define MAX_RESOLVER_BUDGET 256
+#define MAX_BATCH_SIZE 100
+#define DEFAULT_TARGET_LATENCY 1000
 #define CLEANUP_TIMEOUT 5 * 60 * 1000
 #define MINSCORE 0.5
 
@@ -56,8 +61,12 @@ Pipeline::Pipeline( QObject* parent )
     Q_D( Pipeline );
     PipelinePrivate::s_instance = this;
 
-    d->maxConcurrentQueries = qBound( DEFAULT_CONCURRENT_QUERIES, QThread::idealThreadCount(), MAX_CONCURRENT_QUERIES );
-    tDebug() << Q_FUNC_INFO << "Using" << d->maxConcurrentQueries << "threads";
+    // Each resolver starts with one slot per thread and adapts from there.
+    // The window of active queries is larger, so fast resolvers can keep
+    // working while a slow one is still busy with its own backlog.
+    d->defaultResolverBudget = qBound( DEFAULT_CONCURRENT_QUERIES, QThread::idealThreadCount(), MAX_CONCURRENT_QUERIES );
+    d->maxConcurrentQueries = d->defaultResolverBudget * QUERY_WINDOW_FACTOR;
+    tDebug() << Q_FUNC_INFO << "Using" << d->defaultResolverBudget << "slots per resolver and" << d->maxConcurrentQueries << "active queries";
 
     d->temporaryQueryTimer.setInterval( CLEANUP_TIMEOUT );
     connect( &d->temporaryQueryTimer, SIGNAL( timeout() ), SLOT( onTemporaryQueryTimer() ) );
@@ -96,7 +105,7 @@ unsigned int
 Pipeline::pendingQueryCount() const
 {
     Q_D( const Pipeline );
-    return d->queries_pending.count();
+    return d->queries_interactive.count() + d->queries_background.count();
 }
 
 
@@ -108,6 +117,42 @@ Pipeline::activeQueryCount() const
 }
 
 
+unsigned int
+Pipeline::queueDepth( bool interactive ) const
+{
+    Q_D( const Pipeline );
+    return interactive ? d->queries_interactive.count() : d->queries_background.count();
+}
+
+
+QList< Pipeline::ResolverStats >
+Pipeline::resolverStats() const
+{
+    Q_D( const Pipeline );
+    QMutexLocker lock( &d->mut );
+
+    QList< ResolverStats > stats;
+    foreach ( Resolver* r, d->resolvers )
+    {
+        const ResolverState state = d->resolverState.value( r );
+
+        ResolverStats s;
+        s.name = r->name();
+        s.inFlight = state.inFlight;
+        s.budget = state.budget;
+        s.backlog = state.interactive.count() + state.background.count();
+        s.averageLatency = state.latency;
+        s.dispatched = state.dispatched;
+        s.completed = state.completed;
+        s.timeouts = state.timeouts;
+
+        stats << s;
+    }
+
+    return stats;
+}
+
+
 void
 Pipeline::databaseReady()
 {
@@ -121,7 +166,7 @@ Pipeline::start()
 {
     Q_D( Pipeline );
 
-    tDebug() << Q_FUNC_INFO << "Shunting" << d->queries_pending.size() << "queries!";
+    tDebug() << Q_FUNC_INFO << "Shunting" << pendingQueryCount() << "queries!";
     d->running = true;
     emit running();
 
@@ -142,14 +187,40 @@ void
 Pipeline::removeResolver( Resolver* r )
 {
     Q_D( Pipeline );
-    QMutexLocker lock( &d->mut );
+    QList< query_ptr > orphans;
+    {
+        QMutexLocker lock( &d->mut );
+
+        tDebug() << "Removed resolver:" << r->name();
+        d->resolvers.removeAll( r );
+
+        // Queries still waiting for this resolver will never hear back from it
+        const ResolverState state = d->resolverState.take( r );
+        foreach ( const query_ptr& q, state.interactive + state.background )
+        {
+            QHash< QID, QSet< Resolver* > >::iterator it = d->qidsQueued.find( q->id() );
+            if ( it != d->qidsQueued.end() && it.value().remove( r ) )
+                orphans << q;
+        }
 
-    tDebug() << "Removed resolver:" << r->name();
-    d->resolvers.removeAll( r );
-    if ( d->running ) {
-        // Only notify if Pipeline is still active.
-        emit resolverRemoved( r );
+        QMutableHashIterator< QID, QHash< Resolver*, qint64 > > it( d->qidsDispatched );
+        while ( it.hasNext() )
+        {
+            it.next();
+            if ( it.value().remove( r ) && d->qids.contains( it.key() ) )
+                orphans << d->qids.value( it.key() );
+            if ( it.value().isEmpty() )
+                it.remove();
+        }
+
+        if ( d->running ) {
+            // Only notify if Pipeline is still active.
+            emit resolverRemoved( r );
+        }
     }
+
+    foreach ( const query_ptr& q, orphans )
+        decQIDState( q );
 }
 
 
@@ -161,6 +232,11 @@ Pipeline::addResolver( Resolver* r )
 
     tDebug() << "Adding resolver" << r->name();
     d->resolvers.append( r );
+
+    ResolverState state;
+    state.budget = d->defaultResolverBudget;
+    d->resolverState.insert( r, state );
+
     emit resolverAdded( r );
 }
 
@@ -267,11 +343,21 @@ Pipeline::resolve( const QList<query_ptr>& qlist, bool prioritized, bool tempora
                 continue;
             if ( d->qidsState.contains( q->id() ) )
                 continue;
-            if ( d->queries_pending.contains( q ) )
+            if ( d->queries_interactive.contains( q ) )
+            {
+                if ( prioritized )
+                {
+                    d->queries_interactive.insert( i++, d->queries_interactive.takeAt( d->queries_interactive.indexOf( q ) ) );
+                }
+                continue;
+            }
+            if ( d->queries_background.contains( q ) )
             {
                 if ( prioritized )
                 {
-                    d->queries_pending.insert( i++, d->queries_pending.takeAt( d->queries_pending.indexOf( q ) ) );
+                    // promote it to the interactive lane
+                    d->queries_background.removeAll( q );
+                    d->queries_interactive.insert( i++, q );
                 }
                 continue;
             }
@@ -280,9 +366,9 @@ Pipeline::resolve( const QList<query_ptr>& qlist, bool prioritized, bool tempora
                 d->qids.insert( q->id(), q );
 
             if ( prioritized )
-                d->queries_pending.insert( i++, q );
+                d->queries_interactive.insert( i++, q );
             else
-                d->queries_pending << q;
+                d->queries_background << q;
 
             if ( temporaryQuery )
             {
@@ -328,11 +414,16 @@ Pipeline::resolve( QID qid, bool prioritized, bool temporaryQuery )
 
 
 void
-Pipeline::reportResults( QID qid, const QList< result_ptr >& results )
+Pipeline::reportResults( QID qid, Tomahawk::Resolver* r, const QList< result_ptr >& results )
 {
     Q_D( Pipeline );
     if ( !d->running )
         return;
+
+    // A resolver that already timed out on this query still gets its results
+    // added, but must not count towards the query's state a second time
+    const bool counted = r ? finishDispatch( qid, r, false ) : true;
+
     if ( !d->qids.contains( qid ) )
     {
         if ( results.length() > 0 && !results[0]->resolvedBy().isNull() )
@@ -364,8 +455,12 @@ Pipeline::reportResults( QID qid, const QList< result_ptr >& results )
             cleanResults << r;
     }
 
-    const ResultUrlChecker* checker = new ResultUrlChecker( q, httpResults );
-    connect( checker, SIGNAL( done() ), SLOT( onResultUrlCheckerDone() ) );
+    if ( !httpResults.isEmpty() )
+    {
+        ResultUrlChecker* checker = new ResultUrlChecker( q, httpResults );
+        checker->setProperty( "counted", counted );
+        connect( checker, SIGNAL( done() ), SLOT( onResultUrlCheckerDone() ) );
+    }
 
     addResultsToQuery( q, cleanResults );
     if ( q->solved() && !q->isFullTextQuery() )
@@ -374,7 +469,7 @@ Pipeline::reportResults( QID qid, const QList< result_ptr >& results )
         return;
     }
 
-    if ( httpResults.isEmpty() )
+    if ( httpResults.isEmpty() && counted )
         decQIDState( q );
 }
 
@@ -420,14 +515,19 @@ Pipeline::onResultUrlCheckerDone()
     checker->deleteLater();
 
     const query_ptr q = checker->query();
+    if ( q.isNull() )
+        return;
+
     addResultsToQuery( q, checker->validResults() );
-    if ( q && !q->isFullTextQuery() )
+    if ( q->solved() && !q->isFullTextQuery() )
     {
         setQIDState( q, 0 );
         return;
     }
 
-    decQIDState( q );
+    // Results of a resolver that already timed out were counted back then
+    if ( checker->property( "counted" ).toBool() )
+        decQIDState( q );
 }
 
 
@@ -495,111 +595,234 @@ void
 Pipeline::shuntNext()
 {
     Q_D( Pipeline );
+    d->shuntScheduled = false;
     if ( !d->running )
         return;
 
-    unsigned int rc;
-    query_ptr q;
+    QHash< Resolver*, QList< query_ptr > > batches;
+    QList< query_ptr > admitted;
+    bool isIdle = false;
     {
         QMutexLocker lock( &d->mut );
 
-        rc = d->resolvers.count();
-        if ( d->queries_pending.isEmpty() )
+        // Let every resolver with spare budget pick up its own backlog first
+        foreach ( Resolver* r, d->resolvers )
         {
-            if ( d->qidsState.isEmpty() )
-                emit idle();
-            return;
+            ResolverState& state = d->resolverState[ r ];
+            while ( state.inFlight < state.budget && ( !state.interactive.isEmpty() || !state.background.isEmpty() ) )
+            {
+                const query_ptr q = state.interactive.isEmpty() ? state.background.takeFirst() : state.interactive.takeFirst();
+
+                QHash< QID, QSet< Resolver* > >::iterator it = d->qidsQueued.find( q->id() );
+                if ( it == d->qidsQueued.end() || !it.value().remove( r ) )
+                {
+                    // query got solved while it was waiting for this resolver
+                    continue;
+                }
+                if ( it.value().isEmpty() )
+                    d->qidsQueued.erase( it );
+
+                q->setCurrentResolver( r );
+                state.inFlight++;
+                state.dispatched++;
+                d->qidsDispatched[ q->id() ].insert( r, d->clock.elapsed() );
+                batches[ r ] << q;
+            }
         }
 
-        // Check if we are ready to dispatch more queries
-        if ( d->qidsState.count() >= d->maxConcurrentQueries )
-            return;
+        // Then admit new queries, interactive ones before background ones
+        while ( d->qidsState.count() < d->maxConcurrentQueries &&
+              ( !d->queries_interactive.isEmpty() || !d->queries_background.isEmpty() ) )
+        {
+            query_ptr q;
+            if ( !d->queries_interactive.isEmpty() )
+            {
+                q = d->queries_interactive.takeFirst();
+                d->qidsInteractive.insert( q->id() );
+            }
+            else
+                q = d->queries_background.takeFirst();
+
+            // reserve the slot, shunt() sets the real state
+            d->qidsState.insert( q->id(), 1 );
+            admitted << q;
+        }
+
+        isIdle = d->qidsState.isEmpty() && d->queries_interactive.isEmpty() && d->queries_background.isEmpty();
+    }
 
-        /*
-            Since resolvers are async, we now dispatch to the highest weighted ones
-            and after timeout, dispatch to next highest etc, aborting when solved
-        */
-        q = d->queries_pending.takeFirst();
-        q->setCurrentResolver( 0 );
+    foreach ( const query_ptr& q, admitted )
+        shunt( q, batches );
+
+    // Hand every resolver its share in as few calls as possible
+    QHash< Resolver*, QList< query_ptr > >::const_iterator it = batches.constBegin();
+    for ( ; it != batches.constEnd(); ++it )
+    {
+        const QList< query_ptr >& queries = it.value();
+        for ( int i = 0; i < queries.count(); i += MAX_BATCH_SIZE )
+            dispatch( queries.mid( i, MAX_BATCH_SIZE ), it.key() );
     }
 
-    setQIDState( q, rc );
+    if ( isIdle )
+        emit idle();
+}
+
+
+void
+Pipeline::scheduleShunt()
+{
+    Q_D( Pipeline );
+    if ( d->shuntScheduled )
+        return;
+
+    d->shuntScheduled = true;
+    new FuncTimeout( 0, std::bind( &Pipeline::shuntNext, this ), this );
 }
 
 
 void
-Pipeline::timeoutShunt( const query_ptr& q )
+Pipeline::timeoutShunt( const QList< query_ptr >& queries, Tomahawk::Resolver* r )
 {
     Q_D( Pipeline );
     if ( !d->running )
         return;
 
-    // are we still waiting for a timeout?
-    if ( d->qidsTimeout.contains( q->id() ) )
+    foreach ( const query_ptr& q, queries )
     {
-        decQIDState( q );
+        // are we still waiting for this resolver?
+        if ( finishDispatch( q->id(), r, true ) )
+        {
+            tDebug( LOGVERBOSE ) << "Resolver" << r->name() << "timed out for" << q->toString();
+            decQIDState( q );
+        }
     }
 }
 
 
 void
-Pipeline::shunt( const query_ptr& q )
+Pipeline::shunt( const query_ptr& q, QHash< Resolver*, QList< query_ptr > >& batches )
 {
     Q_D( Pipeline );
     if ( !d->running )
         return;
 
-    Resolver* r = 0;
-    if ( !q->resolvingFinished() )
-        r = nextResolver( q );
-
-    if ( r )
+    /*
+        Since resolvers are async, we fan the query out to all of them at once.
+        Resolvers without a free slot queue it up and pick it up as soon as
+        they finish something else. Once a result solves the query, whatever is
+        still queued for it gets dropped.
+    */
+    int state = 0;
     {
-        tLog( LOGVERBOSE ) << "Dispatching to resolver" << r->name() << q->toString() << q->solved() << q->id();
-
-        q->setCurrentResolver( r );
-        r->resolve( q );
-        emit resolving( q );
+        QMutexLocker lock( &d->mut );
 
-        if ( r->timeout() > 0 )
+        if ( !q->resolvingFinished() )
         {
-            d->qidsTimeout.insert( q->id(), true );
-            new FuncTimeout( r->timeout(), std::bind( &Pipeline::timeoutShunt, this, q ), this );
+            const bool interactive = d->qidsInteractive.contains( q->id() );
+            const QList< QPointer< Resolver > > resolvedBy = q->resolvedBy();
+
+            foreach ( Resolver* r, d->resolvers )
+            {
+                if ( resolvedBy.contains( r ) )
+                    continue;
+
+                state++;
+
+                ResolverState& rs = d->resolverState[ r ];
+                if ( rs.inFlight < rs.budget )
+                {
+                    q->setCurrentResolver( r );
+                    rs.inFlight++;
+                    rs.dispatched++;
+                    d->qidsDispatched[ q->id() ].insert( r, d->clock.elapsed() );
+                    batches[ r ] << q;
+                }
+                else
+                {
+                    d->qidsQueued[ q->id() ].insert( r );
+                    if ( interactive )
+                        rs.interactive << q;
+                    else
+                        rs.background << q;
+                }
+            }
         }
     }
-    else
+
+    if ( !state )
     {
-        // we get here if we disable a resolver while a query is resolving
+        // we get here if we disable all resolvers while a query is resolving
         setQIDState( q, 0 );
         return;
     }
 
-    shuntNext();
+    setQIDState( q, state );
+    emit resolving( q );
 }
 
 
-Tomahawk::Resolver*
-Pipeline::nextResolver( const Tomahawk::query_ptr& query ) const
+void
+Pipeline::dispatch( const QList< query_ptr >& queries, Tomahawk::Resolver* r )
 {
-    Q_D( const Pipeline );
-    Resolver* newResolver = 0;
+    if ( queries.isEmpty() )
+        return;
 
-    foreach ( Resolver* r, d->resolvers )
+    tLog( LOGVERBOSE ) << "Dispatching" << queries.count() << "queries to resolver" << r->name();
+
+    if ( r->timeout() > 0 )
+        new FuncTimeout( r->timeout(), std::bind( &Pipeline::timeoutShunt, this, queries, r ), this );
+
+    if ( queries.count() == 1 )
+        r->resolve( queries.first() );
+    else
+        r->resolveBatch( queries );
+}
+
+
+bool
+Pipeline::finishDispatch( const QID& qid, Tomahawk::Resolver* r, bool timedOut )
+{
+    Q_D( Pipeline );
     {
-        if ( query->resolvedBy().contains( r ) )
-            continue;
+        QMutexLocker lock( &d->mut );
+
+        QHash< QID, QHash< Resolver*, qint64 > >::iterator it = d->qidsDispatched.find( qid );
+        if ( it == d->qidsDispatched.end() || !it.value().contains( r ) )
+            return false;
 
-        if ( !newResolver )
+        const unsigned int latency = d->clock.elapsed() - it.value().take( r );
+        if ( it.value().isEmpty() )
+            d->qidsDispatched.erase( it );
+
+        QHash< Resolver*, ResolverState >::iterator sit = d->resolverState.find( r );
+        if ( sit != d->resolverState.end() )
         {
-            newResolver = r;
-            continue;
-        }
+            ResolverState& state = sit.value();
+            state.inFlight--;
+
+            // Resolvers answering well within their target latency get more
+            // slots, slow ones get fewer. A timeout halves the budget.
+            const unsigned int target = r->timeout() > 0 ? r->timeout() / 4 : DEFAULT_TARGET_LATENCY;
+            if ( timedOut )
+            {
+                state.timeouts++;
+                state.budget = qMax( (unsigned int)MIN_RESOLVER_BUDGET, state.budget / 2 );
+            }
+            else
+            {
+                state.completed++;
+                state.latency = state.latency ? ( state.latency * 7 + latency ) / 8 : qMax( 1u, latency );
 
-        if ( r->weight() > newResolver->weight() )
-            newResolver = r;
+                if ( state.latency < target / 2 && state.budget < MAX_RESOLVER_BUDGET )
+                    state.budget++;
+                else if ( state.latency > target && state.budget > MIN_RESOLVER_BUDGET )
+                    state.budget--;
+            }
+        }
     }
 
-    return newResolver;
+    scheduleShunt();
+    return true;
 }
 
 
@@ -609,24 +832,30 @@ Pipeline::setQIDState( const Tomahawk::query_ptr& query, int state )
     Q_D( Pipeline );
     QMutexLocker lock( &d->mut );
 
-    if ( d->qidsTimeout.contains( query->id() ) )
-        d->qidsTimeout.remove( query->id() );
-
     if ( state > 0 )
     {
         d->qidsState.insert( query->id(), state );
-
-        new FuncTimeout( 0, std::bind( &Pipeline::shunt, this, query ), this );
     }
     else
     {
+        // Late results may still solve a query that is done already
+        if ( !d->qidsState.contains( query->id() ) )
+            return;
+
         d->qidsState.remove( query->id() );
+        d->qidsInteractive.remove( query->id() );
+
+        // Drop the query from all resolver backlogs. Resolvers it has already
+        // been dispatched to keep their slot until they answer or time out.
+        d->qidsQueued.remove( query->id() );
+
         query->onResolvingFinished();
 
         if ( !d->queries_temporary.contains( query ) )
             d->qids.remove( query->id() );
 
-        new FuncTimeout( 0, std::bind( &Pipeline::shuntNext, this ), this );
+        lock.unlock();
+        scheduleShunt();
     }
 }
 
@@ -26,6 +26,7 @@
 #include "Query.h"
 
 #include <QObject>
+#include <QHash>
 #include <QList>
 #include <QStringList>
 
@@ -44,6 +45,18 @@ class DLLEXPORT Pipeline : public QObject
 Q_OBJECT
 
 public:
+    struct ResolverStats
+    {
+        QString name;
+        unsigned int inFlight;      // queries currently dispatched to this resolver
+        unsigned int budget;        // adaptive concurrency budget
+        unsigned int backlog;       // queries waiting for a free slot on this resolver
+        unsigned int averageLatency; // moving average in ms
+        quint64 dispatched;
+        quint64 completed;
+        quint64 timeouts;
+    };
+
     static Pipeline* instance();
 
     explicit Pipeline( QObject* parent = nullptr );
@@ -53,8 +66,10 @@ public:
 
     unsigned int pendingQueryCount() const;
     unsigned int activeQueryCount() const;
+    unsigned int queueDepth( bool interactive ) const;
+    QList< ResolverStats > resolverStats() const;
 
-    void reportResults( QID qid, const QList< result_ptr >& results );
+    void reportResults( QID qid, Tomahawk::Resolver* r, const QList< result_ptr >& results );
     void reportAlbums( QID qid, const QList< album_ptr >& albums );
     void reportArtists( QID qid, const QList< artist_ptr >& artists );
 
@@ -94,8 +109,7 @@ protected:
     QScopedPointer<PipelinePrivate> d_ptr;
 
 private slots:
-    void timeoutShunt( const query_ptr& q );
-    void shunt( const query_ptr& q );
+    void timeoutShunt( const QList< query_ptr >& queries, Tomahawk::Resolver* r );
     void shuntNext();
 
     void onTemporaryQueryTimer();
@@ -105,7 +119,10 @@ private:
     Q_DECLARE_PRIVATE( Pipeline )
 
     void addResultsToQuery( const query_ptr& query, const QList< result_ptr >& results );
-    Tomahawk::Resolver* nextResolver( const Tomahawk::query_ptr& query ) const;
+    void shunt( const query_ptr& q, QHash< Tomahawk::Resolver*, QList< query_ptr > >& batches );
+    void dispatch( const QList< query_ptr >& queries, Tomahawk::Resolver* r );
+    bool finishDispatch( const QID& qid, Tomahawk::Resolver* r, bool timedOut );
+    void scheduleShunt();
 
     void setQIDState( const Tomahawk::query_ptr& query, int state );
     int incQIDState( const Tomahawk::query_ptr& query );
@@ -23,19 +23,52 @@
 
 #include "Pipeline.h"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QMutex>
+#include <QSet>
 #include <QTimer>
 
 namespace Tomahawk
 {
 
+// Per-resolver scheduling state. Each resolver gets its own queue and a
+// concurrency budget that grows while it answers quickly and shrinks when it
+// gets slow or times out, so a slow resolver only holds up its own queue.
+class ResolverState
+{
+public:
+    ResolverState()
+        : inFlight( 0 )
+        , budget( 0 )
+        , latency( 0 )
+        , dispatched( 0 )
+        , completed( 0 )
+        , timeouts( 0 )
+    {
+    }
+
+    QList< query_ptr > interactive;
+    QList< query_ptr > background;
+
+    unsigned int inFlight;
+    unsigned int budget;
+    unsigned int latency;
+    quint64 dispatched;
+    quint64 completed;
+    quint64 timeouts;
+};
+
+
 class PipelinePrivate
 {
 public:
     PipelinePrivate( Pipeline* q )
         : q_ptr( q )
         , running( false )
+        , shuntScheduled( false )
     {
+        clock.start();
     }
 
     Pipeline* q_ptr;
@@ -45,21 +78,31 @@ private:
     QList< Resolver* > resolvers;
     QList< QPointer<Tomahawk::ExternalResolver> > scriptResolvers;
     QList< ResolverFactoryFunc > resolverFactories;
-    QMap< QID, bool > qidsTimeout;
+    QHash< Resolver*, ResolverState > resolverState;
+    // resolvers a query is queued for but not yet dispatched to
+    QHash< QID, QSet< Resolver* > > qidsQueued;
+    // resolvers a query is currently dispatched to, with the dispatch time
+    QHash< QID, QHash< Resolver*, qint64 > > qidsDispatched;
+    QSet< QID > qidsInteractive;
     QMap< QID, unsigned int > qidsState;
     QMap< QID, query_ptr > qids;
     QMap< RID, result_ptr > rids;
 
-    QMutex mut; // for m_qids, m_rids
+    mutable QMutex mut; // for m_qids, m_rids and the scheduling state
 
-    // store queries here until DB index is loaded, then shunt them all
-    QList< query_ptr > queries_pending;
+    // store queries here until DB index is loaded, then shunt them all.
+    // Interactive queries are always admitted before background ones.
+    QList< query_ptr > queries_interactive;
+    QList< query_ptr > queries_background;
     // store temporary queries here and clean up after timeout threshold
     QList< query_ptr > queries_temporary;
 
     int maxConcurrentQueries;
+    unsigned int defaultResolverBudget;
     bool running;
+    bool shuntScheduled;
     QTimer temporaryQueryTimer;
+    QElapsedTimer clock;
 
     static Pipeline* s_instance;
 };
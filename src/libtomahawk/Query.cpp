@@ -30,6 +30,7 @@
 #include "database/DatabaseCommand_SocialAction.h"
 #include "database/DatabaseCommand_TrackStats.h"
 #include "resolvers/Resolver.h"
+#include "utils/EditDistance.h"
 #include "utils/Logger.h"
 
 #include "Album.h"
@@ -129,6 +130,10 @@ Query::Query( const track_ptr& track, const result_ptr& result )
 Query::Query( const QString& query, const QID& qid )
     : d_ptr( new QueryPrivate( this, query, qid ) )
 {
+    Q_D( Query );
+    d->fullTextSortname = DatabaseImpl::sortname( query );
+    d->fullTextArtistSortname = DatabaseImpl::sortname( query, true );
+
     init();
 
     if ( !qid.isEmpty() )
@@ -612,8 +617,8 @@ Query::howSimilar( const Tomahawk::result_ptr& r )
 
     if ( isFullTextQuery() )
     {
-        qArtistname = DatabaseImpl::sortname( d->fullTextQuery, true );
-        qAlbumname = DatabaseImpl::sortname( d->fullTextQuery );
+        qArtistname = d->fullTextArtistSortname;
+        qAlbumname = d->fullTextSortname;
         qTrackname = qAlbumname;
     }
     else
@@ -624,9 +629,9 @@ Query::howSimilar( const Tomahawk::result_ptr& r )
     }
 
     // normal edit distance
-    int artdist = TomahawkUtils::levenshtein( qArtistname, rArtistname );
-    int albdist = TomahawkUtils::levenshtein( qAlbumname, rAlbumname );
-    int trkdist = TomahawkUtils::levenshtein( qTrackname, rTrackname );
+    int artdist = TomahawkUtils::editDistance( qArtistname, rArtistname );
+    int albdist = TomahawkUtils::editDistance( qAlbumname, rAlbumname );
+    int trkdist = TomahawkUtils::editDistance( qTrackname, rTrackname );
 
     // max length of name
     int mlart = qMax( qArtistname.length(), rArtistname.length() );
@@ -640,10 +645,10 @@ Query::howSimilar( const Tomahawk::result_ptr& r )
 
     if ( isFullTextQuery() )
     {
-        const QString artistTrackname = DatabaseImpl::sortname( fullTextQuery() );
+        const QString& artistTrackname = d->fullTextSortname;
         const QString rArtistTrackname  = DatabaseImpl::sortname( r->track()->artist() + " " + r->track()->track() );
 
-        int atrdist = TomahawkUtils::levenshtein( artistTrackname, rArtistTrackname );
+        int atrdist = TomahawkUtils::editDistance( artistTrackname, rArtistTrackname );
         int mlatr = qMax( artistTrackname.length(), rArtistTrackname.length() );
         float dcatr = (float)( mlatr - atrdist ) / mlatr;
 
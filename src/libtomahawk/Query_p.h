@@ -46,6 +46,9 @@ private:
     mutable QID qid;
 
     QString fullTextQuery;
+    // sortnames of fullTextQuery, howSimilar() needs them for every result
+    QString fullTextSortname;
+    QString fullTextArtistSortname;
 
     QString resultHint;
     bool saveResultHint;
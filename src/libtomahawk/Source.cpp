@@ -753,6 +753,35 @@ Source::executeCommands()
 }
 
 
+bool
+Source::canRefetchOp( const QString& guid ) const
+{
+    Q_D( const Source );
+
+    QMutexLocker lock( &d->cmdMutex );
+    return !d->refetchedOps.contains( guid );
+}
+
+
+void
+Source::refetchOps( const QString& guid )
+{
+    Q_D( Source );
+
+    {
+        QMutexLocker lock( &d->cmdMutex );
+        tLog() << Q_FUNC_INFO << "Fetching op" << guid << "again, dropping" << d->cmds.count() << "queued ops of" << friendlyName();
+        d->refetchedOps.insert( guid );
+
+        // They come again with the next fetch, which starts from the lastop in the database
+        d->cmds.clear();
+        d->lastCmdGuid.clear();
+    }
+
+    emit opsRejected();
+}
+
+
 void
 Source::reportSocialAttributesChanged( DatabaseCommand_SocialAction* action )
 {
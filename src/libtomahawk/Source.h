@@ -122,6 +122,8 @@ signals:
 
     void stateChanged();
     void commandsFinished();
+    // the ops from the last fetch have to be fetched again, with full playlist revisions
+    void opsRejected();
 
     void socialAttributesChanged( const QString& action );
 
@@ -132,6 +134,9 @@ public slots:
     void setStats( const QVariantMap& m );
     QString lastCmdGuid() const;
 
+    // false if the op was already fetched again and still couldn't be applied
+    bool canRefetchOp( const QString& guid ) const;
+
 private slots:
     void setLastCmdGuid( const QString& guid );
     void dbLoaded( unsigned int id, const QString& fname );
@@ -149,6 +154,7 @@ private slots:
 
     void executeCommands();
     void addCommand( const dbcmd_ptr& command );
+    void refetchOps( const QString& guid );
 
 private:
     Q_DECLARE_PRIVATE( Source )
@@ -23,6 +23,7 @@
 
 #include "Source.h"
 
+#include <QSet>
 #include <QTimer>
 
 namespace Tomahawk
@@ -73,6 +74,8 @@ private:
     QList< Tomahawk::dbcmd_ptr > cmds;
     int commandCount;
     QString lastCmdGuid;
+    // ops we asked the peer for again, see refetchOps()
+    QSet< QString > refetchedOps;
     QMutex setControlConnectionMutex;
     QMutex mutex;
 
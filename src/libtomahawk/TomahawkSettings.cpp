@@ -716,6 +716,20 @@ TomahawkSettings::infoSystemCacheVersion() const
 }
 
 
+void
+TomahawkSettings::setInfoSystemNegativeCacheTime( uint seconds )
+{
+    setValue( "infosystem/negativecachetime", seconds );
+}
+
+
+uint
+TomahawkSettings::infoSystemNegativeCacheTime() const
+{
+    return value( "infosystem/negativecachetime", 600 ).toUInt();
+}
+
+
 void
 TomahawkSettings::setGenericCacheVersion( uint version )
 {
@@ -883,6 +897,34 @@ TomahawkSettings::setVolume( unsigned int volume )
 }
 
 
+unsigned int
+TomahawkSettings::prefetchTime() const
+{
+    return value( "audio/prefetchtime", 20 ).toUInt();
+}
+
+
+void
+TomahawkSettings::setPrefetchTime( unsigned int seconds )
+{
+    setValue( "audio/prefetchtime", seconds );
+}
+
+
+unsigned int
+TomahawkSettings::streamCacheSize() const
+{
+    return value( "network/streamcachesize", 2048 ).toUInt();
+}
+
+
+void
+TomahawkSettings::setStreamCacheSize( unsigned int megabytes )
+{
+    setValue( "network/streamcachesize", megabytes );
+}
+
+
 QString
 TomahawkSettings::proxyHost() const
 {
@@ -1416,6 +1458,34 @@ TomahawkSettings::setExternalPort(int externalPort)
 }
 
 
+uint
+TomahawkSettings::streamUploadLimit() const
+{
+    return value( "network/stream-upload-limit", 0 ).toUInt();
+}
+
+
+void
+TomahawkSettings::setStreamUploadLimit( uint kbytesPerSecond )
+{
+    setValue( "network/stream-upload-limit", kbytesPerSecond );
+}
+
+
+uint
+TomahawkSettings::streamSendWindow() const
+{
+    return value( "network/stream-send-window", 256 ).toUInt();
+}
+
+
+void
+TomahawkSettings::setStreamSendWindow( uint kbytes )
+{
+    setValue( "network/stream-send-window", kbytes );
+}
+
+
 QString
 TomahawkSettings::xmppBotServer() const
 {
@@ -1539,7 +1609,7 @@ TomahawkSettings::updateIndex()
 
     tDebug() << Q_FUNC_INFO << "Updating fuzzy index.";
 
-    Tomahawk::DatabaseCommand* cmd = new Tomahawk::DatabaseCommand_UpdateSearchIndex();
+    Tomahawk::DatabaseCommand* cmd = new Tomahawk::DatabaseCommand_UpdateSearchIndex( true );
     Database::instance()->enqueue( QSharedPointer<Tomahawk::DatabaseCommand>( cmd ) );
 }
 
@@ -59,6 +59,16 @@ public:
 
     uint infoSystemCacheVersion() const;
     void setInfoSystemCacheVersion( uint version );
+    /**
+     * Seconds to remember that the infosystem found nothing for a request,
+     * 0 disables it.
+     *
+     * Plugins answer a failed network request the same way as a real miss,
+     * with an empty QVariant, so a request that failed e.g. while offline
+     * isn't asked again until this expired either.
+     */
+    uint infoSystemNegativeCacheTime() const;
+    void setInfoSystemNegativeCacheTime( uint seconds );
     uint genericCacheVersion() const;
     void setGenericCacheVersion( uint version );
 
@@ -97,6 +107,12 @@ public:
     /// Audio stuff
     unsigned int volume() const;
     void setVolume( unsigned int volume );
+    // Seconds before the end of a track at which the next one is opened, 0 disables prefetching
+    unsigned int prefetchTime() const;
+    void setPrefetchTime( unsigned int seconds );
+    // MiB of streamed tracks kept on disk, 0 disables the stream cache
+    unsigned int streamCacheSize() const;
+    void setStreamCacheSize( unsigned int megabytes );
 
     /// Playlist stuff
     QByteArray playlistColumnSizes( const QString& playlistid ) const;
@@ -164,6 +180,13 @@ public:
     int externalPort() const;
     void setExternalPort( int externalPort );
 
+    /// KiB/s a single stream to a peer may use, 0 for no limit
+    uint streamUploadLimit() const;
+    void setStreamUploadLimit( uint kbytesPerSecond );
+    /// KiB of a stream to a peer we keep queued for the socket
+    uint streamSendWindow() const;
+    void setStreamSendWindow( uint kbytes );
+
     QString proxyHost() const;
     void setProxyHost( const QString& host );
     QString proxyNoProxyHosts() const;
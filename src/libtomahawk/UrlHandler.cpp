@@ -21,7 +21,9 @@
 
 #include "UrlHandler_p.h"
 
+#include "utils/MmapIODevice.h"
 #include "utils/NetworkAccessManager.h"
+#include "utils/StreamCache.h"
 #include "Result.h"
 
 #include <QFile>
@@ -80,6 +82,14 @@ getIODeviceForUrl( const Tomahawk::result_ptr& result, const QString& url,
         return;
     }
 
+    // We streamed this one before, read it from disk instead
+    const QString cached = StreamCache::instance()->lookup( result );
+    if ( !cached.isEmpty() )
+    {
+        localFileIODeviceFactory( result, "file://" + cached, callback );
+        return;
+    }
+
     // JSResolverHelper::customIODeviceFactory is async!
     iofactories.value( proto )( result, url, callback );
 }
@@ -90,9 +100,9 @@ localFileIODeviceFactory( const Tomahawk::result_ptr&, const QString& url,
                           IODeviceCallback callback )
 {
     // ignore "file://" at front of url
-    QFile* io = new QFile( url.mid( strlen( "file://" ) ) );
-    if ( io )
-        io->open( QIODevice::ReadOnly );
+    QIODevice* io = MmapIODevice::openFile( url.mid( strlen( "file://" ) ) );
+    if ( !io )
+        tLog() << Q_FUNC_INFO << "Could not open" << url;
 
     // std::functions cannot accept temporaries as parameters
     QSharedPointer< QIODevice > sp( io );
@@ -23,6 +23,7 @@
 
 #include "config.h"
 
+#include "audio/MediaStream.h"
 #include "audio/Qnr_IoDeviceStream.h"
 #include "filemetadata/MusicScanner.h"
 #include "jobview/JobStatusView.h"
@@ -32,6 +33,7 @@
 #include "playlist/SingleTrackPlaylistInterface.h"
 #include "utils/Closure.h"
 #include "utils/Logger.h"
+#include "utils/StreamCache.h"
 
 #include "Album.h"
 #include "Artist.h"
@@ -52,6 +54,18 @@ static const uint_fast8_t UNDERRUNTHRESHOLD = 2;
 static QString s_aeInfoIdentifier = QString( "AUDIOENGINE" );
 
 
+// Whether the url has to be opened through UrlHandler instead of being passed to VLC
+static bool
+needsIODevice( const result_ptr& result, const QString& url )
+{
+    // VLC plays HTTP streams just fine, unless they are in or should end up in the stream cache
+    if ( TomahawkUtils::isHttpResult( url ) )
+        return StreamCache::instance()->isCacheable( result );
+
+    return !TomahawkUtils::isLocalResult( url ) && !TomahawkUtils::isRtmpResult( url );
+}
+
+
 void
 AudioEnginePrivate::onStateChanged( AudioOutput::AudioState newState, AudioOutput::AudioState oldState )
 {
@@ -81,6 +95,15 @@ AudioEnginePrivate::onStateChanged( AudioOutput::AudioState newState, AudioOutpu
     }
     if ( newState == AudioOutput::Playing )
     {
+        if ( switchTimer.isValid() )
+        {
+            const qint64 elapsed = switchTimer.elapsed();
+            switchTimer.invalidate();
+
+            tDebug( LOGVERBOSE ) << "Track started after" << elapsed << "ms, prefetched:" << switchPrefetched;
+            emit q_ptr->trackSwitchTime( currentTrack, elapsed, switchPrefetched );
+        }
+
         bool emitSignal = false;
         if ( q_ptr->state() != AudioEngine::Paused && q_ptr->state() != AudioEngine::Playing )
         {
@@ -156,6 +179,14 @@ AudioEnginePrivate::onStateChanged( AudioOutput::AudioState newState, AudioOutpu
 }
 
 
+void
+AudioEnginePrivate::onPrefetchInputComplete()
+{
+    if ( prefetchIO && sender() == prefetchIO.data() )
+        prefetchComplete = true;
+}
+
+
 AudioEngine* AudioEnginePrivate::s_instance = 0;
 
 
@@ -294,6 +325,9 @@ AudioEngine::stop( AudioErrorCode errorCode )
     else
         setState( Error );
 
+    d->switchTimer.invalidate();
+    clearPrefetch();
+
     if ( d->audioOutput->state() != AudioOutput::Stopped )
         d->audioOutput->stop();
 
@@ -594,8 +628,37 @@ AudioEngine::loadTrack( const Tomahawk::result_ptr& result )
 
     setCurrentTrack( result );
 
-    if ( !TomahawkUtils::isLocalResult( d->currentTrack->url() ) && !TomahawkUtils::isHttpResult( d->currentTrack->url() )
-         && !TomahawkUtils::isRtmpResult( d->currentTrack->url() ) )
+    d->switchTimer.start();
+    d->switchPrefetched = false;
+    d->prefetchStarted = false;
+    d->prefetchTime = (qint64)TomahawkSettings::instance()->prefetchTime() * 1000;
+
+    if ( d->prefetchResult && d->prefetchResult == result )
+    {
+        d->switchPrefetched = true;
+
+        if ( d->prefetchIO )
+        {
+            QSharedPointer< QIODevice > io = d->prefetchIO;
+            const QString url = d->prefetchUrl;
+            const bool complete = d->prefetchComplete;
+            clearPrefetch();
+
+            d->inputComplete = complete;
+            performLoadTrack( result, url, io );
+        }
+        else
+        {
+            // Still being opened, onPrefetchReady() takes it from here
+            d->prefetchWaiting = true;
+        }
+        return;
+    }
+
+    clearPrefetch();
+    d->inputComplete = false;
+
+    if ( needsIODevice( d->currentTrack, d->currentTrack->url() ) )
     {
         performLoadIODevice( d->currentTrack, d->currentTrack->url() );
     }
@@ -612,8 +675,7 @@ AudioEngine::performLoadIODevice( const result_ptr& result, const QString& url )
 {
     tDebug( LOGEXTRA ) << Q_FUNC_INFO << ( result.isNull() ? QString() : url );
 
-    if ( !TomahawkUtils::isLocalResult( url ) && !TomahawkUtils::isHttpResult( url )
-         && !TomahawkUtils::isRtmpResult( url ) )
+    if ( needsIODevice( result, url ) )
     {
         std::function< void ( const QString, QSharedPointer< QIODevice > ) > callback =
                 std::bind( &AudioEngine::performLoadTrack, this, result,
@@ -673,7 +735,10 @@ AudioEngine::performLoadTrack( const Tomahawk::result_ptr result, const QString
                 QSharedPointer<QNetworkReply> qnr = io.objectCast<QNetworkReply>();
                 if ( !qnr.isNull() )
                 {
-                    d->audioOutput->setCurrentSource( new QNR_IODeviceStream( qnr, this ) );
+                    MediaStream* stream = new QNR_IODeviceStream( qnr, this );
+                    stream->setCacheWriter( StreamCache::instance()->writer( result ) );
+
+                    d->audioOutput->setCurrentSource( stream );
                     // We keep track of the QNetworkReply in QNR_IODeviceStream
                     // and AudioOutput handles the deletion of the
                     // QNR_IODeviceStream object
@@ -682,9 +747,16 @@ AudioEngine::performLoadTrack( const Tomahawk::result_ptr result, const QString
                 }
                 else
                 {
-                    d->audioOutput->setCurrentSource( io.data() );
-                    // We handle the deletion via tracking in d->input
-                    d->audioOutput->setAutoDelete( false );
+                    MediaStream* stream = new MediaStream( io.data() );
+                    // A prefetched transfer may have finished before the stream listened for it
+                    if ( d->inputComplete )
+                        stream->bufferingFinished();
+                    stream->setCacheWriter( StreamCache::instance()->writer( result ) );
+
+                    d->audioOutput->setCurrentSource( stream );
+                    // AudioOutput only deletes the stream, the device itself
+                    // is tracked in d->input
+                    d->audioOutput->setAutoDelete( true );
                 }
             }
             else
@@ -713,6 +785,9 @@ AudioEngine::performLoadTrack( const Tomahawk::result_ptr result, const QString
 
                     tLog( LOGVERBOSE ) << "Passing to VLC:" << QUrl::fromLocalFile( furl );
                     d->audioOutput->setCurrentSource( QUrl::fromLocalFile( furl ) );
+
+                    // VLC opens the file itself, don't keep a device for it around
+                    ioToKeep.clear();
                 }
 
                 d->audioOutput->setAutoDelete( true );
@@ -735,6 +810,8 @@ AudioEngine::performLoadTrack( const Tomahawk::result_ptr result, const QString
         }
     }
 
+    d->inputComplete = false;
+
     if ( err )
     {
         stop();
@@ -837,6 +914,125 @@ AudioEngine::loadNextTrack()
 }
 
 
+void
+AudioEngine::prefetchNextTrack()
+{
+    Q_D( AudioEngine );
+
+    if ( d->stopAfterTrack && d->currentTrack && d->stopAfterTrack->track()->equals( d->currentTrack->track() ) )
+    {
+        d->prefetchStarted = true;
+        return;
+    }
+
+    // Same choice loadNextTrack() is going to make, without moving on yet
+    Tomahawk::result_ptr result;
+    if ( d->queue && d->queue->trackCount() )
+    {
+        query_ptr query = d->queue->tracks().first();
+        if ( query && query->numResults() )
+            result = query->results().first();
+    }
+
+    if ( result.isNull() && !d->playlist.isNull() )
+    {
+        result = d->playlist->nextResult();
+        if ( result.isNull() )
+        {
+            // Give the resolvers a head start and try again on the next tick
+            const qint64 idx = d->playlist->siblingIndex( 1 );
+            const query_ptr query = idx >= 0 ? d->playlist->queryAt( idx ) : query_ptr();
+            if ( query && query != d->prefetchQuery && !query->resolvingFinished() )
+            {
+                tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Resolving next track ahead of time:" << query->toString();
+                d->prefetchQuery = query;
+                Pipeline::instance()->resolve( query );
+            }
+            return;
+        }
+    }
+
+    d->prefetchStarted = true;
+    if ( result.isNull() || result == d->prefetchResult )
+        return;
+
+    clearPrefetch();
+
+    // VLC opens local files and rtmp streams itself, there is nothing to win
+    const QString url = result->url();
+    if ( TomahawkUtils::isLocalResult( url ) || TomahawkUtils::isRtmpResult( url ) )
+        return;
+
+    tDebug() << Q_FUNC_INFO << "Prefetching next track:" << url;
+    d->prefetchResult = result;
+    d->prefetchUrl = url;
+
+    std::function< void ( const QString, QSharedPointer< QIODevice > ) > callback =
+            std::bind( &AudioEngine::onPrefetchReady, this, result,
+                       std::placeholders::_1,
+                       std::placeholders::_2 );
+    Tomahawk::UrlHandler::getIODeviceForUrl( result, url, callback );
+}
+
+
+void
+AudioEngine::onPrefetchReady( const Tomahawk::result_ptr result, const QString url, QSharedPointer< QIODevice > io )
+{
+    if ( QThread::currentThread() != thread() )
+    {
+        QMetaObject::invokeMethod( this, "onPrefetchReady", Qt::QueuedConnection,
+                                   Q_ARG( const Tomahawk::result_ptr, result ),
+                                   Q_ARG( const QString, url ),
+                                   Q_ARG( QSharedPointer< QIODevice >, io )
+                                   );
+        return;
+    }
+
+    Q_D( AudioEngine );
+    if ( d->prefetchResult != result )
+    {
+        // Skipped or cleared in the meantime
+        return;
+    }
+
+    if ( d->prefetchWaiting )
+    {
+        // The track was already started, just play it
+        clearPrefetch();
+        performLoadTrack( result, url, io );
+        return;
+    }
+
+    if ( !io )
+    {
+        tLog() << Q_FUNC_INFO << "Could not prefetch" << url;
+        clearPrefetch();
+        return;
+    }
+
+    // The device keeps buffering the start of the track until it is played
+    d->prefetchUrl = url;
+    d->prefetchIO = io;
+    connect( io.data(), SIGNAL( readChannelFinished() ), d, SLOT( onPrefetchInputComplete() ) );
+}
+
+
+void
+AudioEngine::clearPrefetch()
+{
+    Q_D( AudioEngine );
+
+    if ( d->prefetchIO )
+        disconnect( d->prefetchIO.data(), SIGNAL( readChannelFinished() ), d, SLOT( onPrefetchInputComplete() ) );
+
+    d->prefetchResult.clear();
+    d->prefetchUrl.clear();
+    d->prefetchIO.clear();
+    d->prefetchComplete = false;
+    d->prefetchWaiting = false;
+}
+
+
 void
 AudioEngine::play( const QUrl& url )
 {
@@ -1052,6 +1248,13 @@ AudioEngine::timerTriggered( qint64 time )
 
     emit timerMilliSeconds( time );
 
+    if ( !d->prefetchStarted && d->prefetchTime > 0 && !d->currentTrack.isNull() )
+    {
+        const qint64 total = currentTrackTotalTime();
+        if ( total > 0 && total - time <= d->prefetchTime )
+            prefetchNextTrack();
+    }
+
     if ( d->timeElapsed != time / 1000 )
     {
         d->timeElapsed = time / 1000;
@@ -177,12 +177,21 @@ signals:
 
     void error( AudioEngine::AudioErrorCode errorCode );
 
+    /**
+     * Time it took from switching to a track until it started playing.
+     *
+     * prefetched is true if the track had been opened before the previous
+     * one ended.
+     */
+    void trackSwitchTime( const Tomahawk::result_ptr track, qint64 msecs, bool prefetched );
+
 private slots:
     void loadTrack( const Tomahawk::result_ptr& result ); //async!
     void performLoadIODevice( const Tomahawk::result_ptr& result, const QString& url ); //only call from loadTrack kthxbi
     void performLoadTrack( const Tomahawk::result_ptr result, const QString url, QSharedPointer< QIODevice > io ); //only call from loadTrack or performLoadIODevice kthxbi
     void loadPreviousTrack();
     void loadNextTrack();
+    void onPrefetchReady( const Tomahawk::result_ptr result, const QString url, QSharedPointer< QIODevice > io );
 
     void onAboutToFinish();
     void onVolumeChanged( qreal volume );
@@ -198,6 +207,8 @@ private slots:
 private:
     void setState( AudioState state );
     void setCurrentTrackPlaylist( const Tomahawk::playlistinterface_ptr& playlist );
+    void prefetchNextTrack();
+    void clearPrefetch();
 
 //    void audioDataArrived( QMap< AudioEngine::AudioChannel, QVector< qint16 > >& data );
 
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QTimer>
 #include <QQueue>
@@ -16,6 +17,12 @@ public:
         : q_ptr ( q )
         , underrunCount( 0 )
         , underrunNotified( false )
+        , prefetchTime( 0 )
+        , prefetchStarted( false )
+        , prefetchComplete( false )
+        , prefetchWaiting( false )
+        , inputComplete( false )
+        , switchPrefetched( false )
     {
     }
     AudioEngine* q_ptr;
@@ -24,6 +31,7 @@ public:
 
 public slots:
     void onStateChanged( AudioOutput::AudioState newState, AudioOutput::AudioState oldState );
+    void onPrefetchInputComplete();
 
 private:
     QSharedPointer<QIODevice> input;
@@ -49,5 +57,22 @@ private:
 
     QTemporaryFile* coverTempFile;
 
+    // The next track, opened while the current one is still playing so
+    // switching to it doesn't have to wait for resolvers and the network
+    qint64 prefetchTime;
+    bool prefetchStarted;
+    Tomahawk::query_ptr prefetchQuery;
+    Tomahawk::result_ptr prefetchResult;
+    QString prefetchUrl;
+    QSharedPointer<QIODevice> prefetchIO;
+    bool prefetchComplete;
+    // the next track was started before its device arrived
+    bool prefetchWaiting;
+    // input of the device about to be played already finished, it won't signal that again
+    bool inputComplete;
+
+    QElapsedTimer switchTimer;
+    bool switchPrefetched;
+
     static AudioEngine* s_instance;
 };
@@ -21,6 +21,8 @@
 #include "MediaStream.h"
 
 #include "utils/Logger.h"
+#include "utils/MmapIODevice.h"
+#include "utils/StreamCache.h"
 
 #define BLOCK_SIZE 1048576
 
@@ -47,11 +49,17 @@ MediaStream::MediaStream( QIODevice* device )
     , m_ioDevice ( device )
 {
     QObject::connect( m_ioDevice, SIGNAL( readChannelFinished() ), this, SLOT( bufferingFinished() ) );
+
+    // Local files are complete from the start and never tell us they are finished
+    m_mappedDevice = qobject_cast< MmapIODevice* >( device );
+    if ( m_mappedDevice || qobject_cast< QFile* >( device ) )
+        m_bufferingFinished = true;
 }
 
 
 MediaStream::~MediaStream()
 {
+    delete m_cacheWriter;
 }
 
 
@@ -83,6 +91,14 @@ MediaStream::setStreamSize( qint64 size )
 }
 
 
+void
+MediaStream::setCacheWriter( Tomahawk::StreamCacheWriter* writer )
+{
+    delete m_cacheWriter;
+    m_cacheWriter = writer;
+}
+
+
 void
 MediaStream::endOfData()
 {
@@ -97,6 +113,34 @@ MediaStream::bufferingFinished()
 }
 
 
+bool
+MediaStream::transferSucceeded( qint64& transferSize ) const
+{
+    transferSize = 0;
+    return true;
+}
+
+
+void
+MediaStream::finishCache()
+{
+    if ( !m_cacheWriter )
+        return;
+
+    qint64 transferSize = 0;
+    if ( transferSucceeded( transferSize ) )
+    {
+        m_cacheWriter->finish( transferSize );
+    }
+    else
+    {
+        tDebug() << Q_FUNC_INFO << "Transfer failed, not caching it";
+        delete m_cacheWriter;
+        m_cacheWriter = nullptr;
+    }
+}
+
+
 int
 MediaStream::readCallback ( const char* cookie, int64_t* dts, int64_t* pts, unsigned* flags, size_t* bufferSize, void** buffer )
 {
@@ -110,13 +154,22 @@ MediaStream::readCallback ( const char* cookie, int64_t* dts, int64_t* pts, unsi
 
     if ( m_eos == true )
     {
+        finishCache();
         return -1;
     }
 
+    const qint64 offset = ( m_type == IODevice ) ? m_ioDevice->pos() : m_pos;
     if ( m_type == Stream )
     {
         bufsize = needData( buffer );
     }
+    else if ( m_type == IODevice && m_mappedDevice )
+    {
+        // imem only reads from the buffer, so VLC can take the data straight from the mapping
+        const char* data = nullptr;
+        bufsize = m_mappedDevice->readPointer( &data, BLOCK_SIZE );
+        *buffer = const_cast< char* >( data );
+    }
     else if ( m_type == IODevice )
     {
         bufsize = m_ioDevice->read( m_buffer, BLOCK_SIZE );
@@ -126,14 +179,22 @@ MediaStream::readCallback ( const char* cookie, int64_t* dts, int64_t* pts, unsi
     if ( bufsize > 0 )
     {
         m_started = true;
+
+        if ( m_cacheWriter )
+            m_cacheWriter->write( offset, static_cast< const char* >( *buffer ), bufsize );
     }
     if ( m_type == IODevice && bufsize == 0 && m_started && m_bufferingFinished == true )
     {
         m_eos = true;
+        finishCache();
         return -1;
     }
     if ( bufsize < 0 )
     {
+        // Read error, what we have so far is of no use to the cache
+        delete m_cacheWriter;
+        m_cacheWriter = nullptr;
+
         m_eos = true;
         return -1;
     }
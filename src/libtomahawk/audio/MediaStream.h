@@ -27,6 +27,13 @@
 #include <QUrl>
 #include <QIODevice>
 
+class MmapIODevice;
+
+namespace Tomahawk
+{
+    class StreamCacheWriter;
+}
+
 class DLLEXPORT MediaStream : public QObject
 {
     Q_OBJECT
@@ -51,6 +58,9 @@ public:
     void setStreamSize( qint64 size );
     qint64 streamSize() const;
 
+    // Copies everything VLC reads into the stream cache, takes ownership of the writer
+    void setCacheWriter( Tomahawk::StreamCacheWriter* writer );
+
     virtual void seekStream( qint64 offset ) { (void)offset; }
     virtual qint64 needData ( void** buffer ) { (void)buffer; return 0; }
 
@@ -64,18 +74,30 @@ public slots:
 protected:
     void endOfData();
 
+    /**
+     * Whether the transfer we read from ended successfully, e.g. not with
+     * an error page of the server. Only then it goes into the stream cache.
+     * Sets transferSize if the transfer announced its size.
+     */
+    virtual bool transferSucceeded( qint64& transferSize ) const;
+
     MediaType m_type;
     QUrl m_url;
     QIODevice* m_ioDevice;
+    // set if m_ioDevice is mapped, we hand out pointers into the mapping then
+    MmapIODevice* m_mappedDevice = nullptr;
 
     bool m_started = false;
     bool m_bufferingFinished = false;
     bool m_eos = false;
     qint64 m_pos = 0;
     qint64 m_streamSize = 0;
+    Tomahawk::StreamCacheWriter* m_cacheWriter = nullptr;
 
     char m_buffer[1048576];
 private:
+    void finishCache();
+
     Q_DISABLE_COPY( MediaStream )
 };
 
@@ -103,6 +103,26 @@ QNR_IODeviceStream::needData ( void** buffer )
     return data.size();
 }
 
+bool
+QNR_IODeviceStream::transferSucceeded( qint64& transferSize ) const
+{
+    transferSize = 0;
+    if ( !m_networkReply->isFinished() || m_networkReply->error() != QNetworkReply::NoError )
+        return false;
+
+    // Error pages come with a body, too
+    const QVariant status = m_networkReply->attribute( QNetworkRequest::HttpStatusCodeAttribute );
+    if ( status.isValid() && ( status.toInt() < 200 || status.toInt() >= 300 ) )
+        return false;
+
+    const QVariant contentLength = m_networkReply->header( QNetworkRequest::ContentLengthHeader );
+    if ( contentLength.isValid() )
+        transferSize = contentLength.toLongLong();
+
+    return true;
+}
+
+
 void
 QNR_IODeviceStream::readyRead()
 {
@@ -49,6 +49,9 @@ public:
     virtual void seekStream( qint64 offset );
     virtual qint64 needData ( void** buffer );
 
+protected:
+    virtual bool transferSucceeded( qint64& transferSize ) const;
+
 private slots:
     void readyRead();
 
@@ -127,8 +127,12 @@ Database::Database( const QString& dbname, QObject* parent )
     {
         QPointer< DatabaseWorkerThread > workerThread( new DatabaseWorkerThread( this, false ) );
         Q_ASSERT( workerThread );
+        {
+            // register before starting, impl() needs to know it's a reader
+            QMutexLocker lock( &m_mutex );
+            m_workerThreads << workerThread;
+        }
         workerThread.data()->start();
-        m_workerThreads << workerThread;
     }
     m_idWorker->start();
 }
@@ -291,8 +295,19 @@ Database::impl()
     QThread* thread = QThread::currentThread();
     if ( !m_implHash.contains( thread ) )
     {
-        tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Creating database impl for thread" << QThread::currentThread();
-        DatabaseImpl* impl = m_impl->clone();
+        // The read-only workers each get their own connection that can't write
+        bool readOnly = false;
+        foreach ( const QPointer< DatabaseWorkerThread >& workerThread, m_workerThreads )
+        {
+            if ( workerThread.data() == thread )
+            {
+                readOnly = true;
+                break;
+            }
+        }
+
+        tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Creating" << ( readOnly ? "read-only" : "read-write" ) << "database impl for thread" << QThread::currentThread();
+        DatabaseImpl* impl = m_impl->clone( readOnly );
         m_implHash.insert( thread, impl );
     }
 
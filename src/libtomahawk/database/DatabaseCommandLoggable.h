@@ -43,6 +43,12 @@ public:
     {}
 
     virtual bool loggable() const { return true; }
+
+    /**
+     * True if an op of a peer couldn't be applied to our copy of its data.
+     * Our lastop for the peer then stays in front of it, so it's fetched again.
+     */
+    virtual bool needsRefetch() const { return false; }
 };
 
 }
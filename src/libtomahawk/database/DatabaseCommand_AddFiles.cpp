@@ -26,15 +26,214 @@
 
 #include "Album.h"
 #include "Artist.h"
+#include "DatabaseCommand_UpdateSearchIndex.h"
 #include "DatabaseImpl.h"
 #include "PlaylistEntry.h"
 #include "SourceList.h"
 
+#include <QSqlError>
 #include <QSqlQuery>
+#include <QVector>
+
+// Imports at least this big drop the secondary indices and rebuild them afterwards
+#define DEFER_INDICES_MIN_FILES 10000
 
 using namespace Tomahawk;
 
 
+namespace
+{
+
+struct FileRow
+{
+    FileRow()
+        : mtime( 0 ), size( 0 ), duration( 0 ), bitrate( 0 ), albumpos( 0 ), discnumber( 0 ), year( 0 )
+        , fileId( 0 ), artistId( 0 ), albumartistId( 0 ), albumId( 0 ), trackId( 0 ), composerId( 0 )
+    {}
+
+    QString url;
+    int mtime;
+    uint size;
+    QString hash;
+    QString mimetype;
+    uint duration;
+    uint bitrate;
+    QString artist;
+    QString albumartist;
+    QString album;
+    QString track;
+    uint albumpos;
+    QString composer;
+    uint discnumber;
+    int year;
+
+    int fileId;
+    int artistId;
+    int albumartistId;
+    int albumId;
+    int trackId;
+    int composerId;
+};
+
+
+// Drops the non-unique indices of tables and returns the statements to recreate them
+QStringList
+dropSecondaryIndices( DatabaseImpl* dbi, const QStringList& tables )
+{
+    QStringList placeholders;
+    for ( int i = 0; i < tables.count(); i++ )
+        placeholders << "?";
+
+    TomahawkSqlQuery query = dbi->newquery();
+    query.prepare( QString( "SELECT name, sql FROM sqlite_master WHERE type = 'index' AND sql IS NOT NULL "
+                            "AND sql NOT LIKE 'CREATE UNIQUE%' AND tbl_name IN (%1)" ).arg( placeholders.join( "," ) ) );
+    foreach ( const QString& table, tables )
+        query.addBindValue( table );
+    query.exec();
+
+    QStringList names, statements;
+    while ( query.next() )
+    {
+        names << query.value( 0 ).toString();
+        statements << query.value( 1 ).toString();
+    }
+
+    foreach ( const QString& name, names )
+        query.exec( QString( "DROP INDEX IF EXISTS %1" ).arg( name ) );
+
+    tDebug() << "Deferring indices" << names;
+    return statements;
+}
+
+
+// Rolls back the whole import if an index can't be recreated, that brings back the dropped ones
+void
+createIndices( DatabaseImpl* dbi, const QStringList& statements )
+{
+    TomahawkSqlQuery query = dbi->newquery();
+    foreach ( const QString& statement, statements )
+    {
+        if ( !query.exec( statement ) )
+        {
+            tLog() << "Could not recreate index:" << statement << query.lastError().text();
+            throw "Failed to recreate index";
+        }
+    }
+}
+
+
+void
+bindFile( TomahawkSqlQuery& query, const QVariant& srcid, const FileRow& row )
+{
+    query.addBindValue( srcid );
+    query.addBindValue( row.url );
+    query.addBindValue( row.size );
+    query.addBindValue( row.mtime );
+    query.addBindValue( row.hash );
+    query.addBindValue( row.mimetype );
+    query.addBindValue( row.duration );
+    query.addBindValue( row.bitrate );
+}
+
+
+// Inserts the files and sets their fileId. Files that already exist keep a fileId of 0.
+void
+insertFiles( DatabaseImpl* dbi, const QVariant& srcid, QVector< FileRow >& rows )
+{
+    TomahawkSqlQuery query = dbi->newquery();
+    query.exec( "SELECT MAX(id) FROM file" );
+    int lastId = query.next() ? query.value( 0 ).toInt() : 0;
+
+    const int batch = DatabaseImpl::maxInsertRows( 8 );
+    for ( int i = 0; i < rows.count(); i += batch )
+    {
+        const int count = qMin( batch, rows.count() - i );
+
+        query.prepare( DatabaseImpl::insertRowsSql( "INSERT OR IGNORE INTO file(source, url, size, mtime, md5, mimetype, duration, bitrate)", 8, count ) );
+        for ( int j = i; j < i + count; j++ )
+            bindFile( query, srcid, rows.at( j ) );
+
+        if ( !query.exec() )
+        {
+            // Insert them one by one, so only the broken ones are missing
+            tDebug() << "Failed to batch insert files, falling back to single inserts";
+            for ( int j = i; j < i + count; j++ )
+            {
+                query.prepare( DatabaseImpl::insertRowsSql( "INSERT OR IGNORE INTO file(source, url, size, mtime, md5, mimetype, duration, bitrate)", 8, 1 ) );
+                bindFile( query, srcid, rows.at( j ) );
+                if ( !query.exec() )
+                    tLog() << "Failed to insert file" << rows.at( j ).url;
+            }
+        }
+
+        // The new rows got ascending ids in the order they were selected
+        query.prepare( "SELECT id, url FROM file WHERE id > ? ORDER BY id" );
+        query.addBindValue( lastId );
+        query.exec();
+
+        int j = i;
+        while ( query.next() )
+        {
+            const QString url = query.value( 1 ).toString();
+            while ( j < i + count && rows.at( j ).url != url )
+                j++;
+            if ( j == i + count )
+                break;
+
+            rows[ j++ ].fileId = query.value( 0 ).toInt();
+            lastId = query.value( 0 ).toInt();
+        }
+
+        tDebug( LOGVERBOSE ) << "Inserted" << i + count << "files";
+    }
+}
+
+
+void
+insertFileJoins( DatabaseImpl* dbi, const QVector< const FileRow* >& rows )
+{
+    TomahawkSqlQuery query = dbi->newquery();
+
+    int batch = DatabaseImpl::maxInsertRows( 7 );
+    for ( int i = 0; i < rows.count(); i += batch )
+    {
+        const int count = qMin( batch, rows.count() - i );
+
+        query.prepare( DatabaseImpl::insertRowsSql( "INSERT INTO file_join(file, artist, album, track, albumpos, composer, discnumber)", 7, count ) );
+        for ( int j = i; j < i + count; j++ )
+        {
+            const FileRow* row = rows.at( j );
+            query.addBindValue( row->fileId );
+            query.addBindValue( row->artistId );
+            query.addBindValue( row->albumId > 0 ? row->albumId : QVariant( QVariant::Int ) );
+            query.addBindValue( row->trackId );
+            query.addBindValue( row->albumpos );
+            query.addBindValue( row->composerId > 0 ? row->composerId : QVariant( QVariant::Int ) );
+            query.addBindValue( row->discnumber );
+        }
+        if ( !query.exec() )
+            tDebug() << "Error inserting into file_join table";
+    }
+
+    batch = DatabaseImpl::maxInsertRows( 3 );
+    for ( int i = 0; i < rows.count(); i += batch )
+    {
+        const int count = qMin( batch, rows.count() - i );
+
+        query.prepare( DatabaseImpl::insertRowsSql( "INSERT INTO track_attributes(id, k, v)", 3, count ) );
+        for ( int j = i; j < i + count; j++ )
+        {
+            query.addBindValue( rows.at( j )->trackId );
+            query.addBindValue( "releaseyear" );
+            query.addBindValue( rows.at( j )->year );
+        }
+        query.exec();
+    }
+}
+
+}
+
+
 // remove file paths when making oplog/for network transmission
 QVariantList
 DatabaseCommand_AddFiles::files() const
@@ -65,6 +264,11 @@ DatabaseCommand_AddFiles::postCommitHook()
 
     emit notify( m_ids );
 
+    // Index the new tracks and albums right away instead of waiting for the
+    // collection to ask for it. Not inline, that would hold up the worker.
+    if ( !m_ids.isEmpty() )
+        Database::instance()->enqueue( Tomahawk::dbcmd_ptr( new DatabaseCommand_UpdateSearchIndex() ) );
+
     if ( source()->isLocal() )
         Servent::instance()->triggerDBSync();
 }
@@ -76,103 +280,113 @@ DatabaseCommand_AddFiles::exec( DatabaseImpl* dbi )
     qDebug() << Q_FUNC_INFO;
     Q_ASSERT( !source().isNull() );
 
-    TomahawkSqlQuery query_file = dbi->newquery();
-    TomahawkSqlQuery query_filejoin = dbi->newquery();
-    TomahawkSqlQuery query_trackattr = dbi->newquery();
-
-    query_file.prepare( "INSERT INTO file(source, url, size, mtime, md5, mimetype, duration, bitrate) VALUES (?, ?, ?, ?, ?, ?, ?, ?)" );
-    query_filejoin.prepare( "INSERT INTO file_join(file, artist, album, track, albumpos, composer, discnumber) VALUES (?, ?, ?, ?, ?, ?, ?)" );
-    query_trackattr.prepare( "INSERT INTO track_attributes(id, k, v) VALUES (?, ?, ?)" );
-
-    int added = 0;
     QVariant srcid = source()->isLocal() ? QVariant( QVariant::Int ) : source()->id();
     qDebug() << "Adding" << m_files.length() << "files to db for source" << srcid;
 
-    QList<QVariant>::iterator it;
-    for ( it = m_files.begin(); it != m_files.end(); ++it )
+    QVector< FileRow > rows;
+    rows.reserve( m_files.count() );
+    foreach ( const QVariant& v, m_files )
     {
-        QVariant& v = *it;
-        QVariantMap m = v.toMap();
+        const QVariantMap m = v.toMap();
 
-        int fileid = 0, artistid = 0, albumartistid = 0, albumid = 0, trackid = 0, composerid = 0;
-
-        const QString url         = m.value( "url" ).toString();
-        const int mtime           = m.value( "mtime" ).toInt();
-        const uint size           = m.value( "size" ).toUInt();
-        const QString hash        = m.value( "hash" ).toString();
-        const QString mimetype    = m.value( "mimetype" ).toString();
-        const uint duration       = m.value( "duration" ).toUInt();
-        const uint bitrate        = m.value( "bitrate" ).toUInt();
-        const QString artist      = m.value( "artist" ).toString();
-        const QString albumartist = m.value( "albumartist" ).toString();
-        const QString album       = m.value( "album" ).toString();
-        const QString track       = m.value( "track" ).toString();
-        const uint albumpos       = m.value( "albumpos" ).toUInt();
-        const QString composer    = m.value( "composer" ).toString();
-        const uint discnumber     = m.value( "discnumber" ).toUInt();
-        const int year            = m.value( "year" ).toInt();
-
-        query_file.bindValue( 0, srcid );
-        query_file.bindValue( 1, url );
-        query_file.bindValue( 2, size );
-        query_file.bindValue( 3, mtime );
-        query_file.bindValue( 4, hash );
-        query_file.bindValue( 5, mimetype );
-        query_file.bindValue( 6, duration );
-        query_file.bindValue( 7, bitrate );
-        query_file.exec();
-
-        if ( added % 1000 == 0 )
-            qDebug() << "Inserted" << added;
-
-        // get internal IDs for art/alb/trk
-        fileid = query_file.lastInsertId().toInt();
-        m.insert( "id", fileid );
-        // this is the qvariant(map) the remote will get
-        v = m;
-
-        // add the album artist to the artist database.
-        if ( !albumartist.trimmed().isEmpty() )
-            albumartistid = dbi->artistId( albumartist, true );
-        
-        if ( !artist.trimmed().isEmpty() )
-            artistid = dbi->artistId( artist, true );
-        if ( artistid < 1 )
-            continue;
-        trackid = dbi->trackId( artistid, track, true );
-        if ( trackid < 1 )
+        FileRow row;
+        row.url         = m.value( "url" ).toString();
+        row.mtime       = m.value( "mtime" ).toInt();
+        row.size        = m.value( "size" ).toUInt();
+        row.hash        = m.value( "hash" ).toString();
+        row.mimetype    = m.value( "mimetype" ).toString();
+        row.duration    = m.value( "duration" ).toUInt();
+        row.bitrate     = m.value( "bitrate" ).toUInt();
+        row.artist      = m.value( "artist" ).toString();
+        row.albumartist = m.value( "albumartist" ).toString();
+        row.album       = m.value( "album" ).toString();
+        row.track       = m.value( "track" ).toString();
+        row.albumpos    = m.value( "albumpos" ).toUInt();
+        row.composer    = m.value( "composer" ).toString();
+        row.discnumber  = m.value( "discnumber" ).toUInt();
+        row.year        = m.value( "year" ).toInt();
+        rows << row;
+    }
+
+    // Rebuilding indices once is cheaper than updating them for every row of a big import
+    QStringList deferredIndices;
+    if ( rows.count() >= DEFER_INDICES_MIN_FILES )
+        deferredIndices = dropSecondaryIndices( dbi, QStringList() << "file_join" << "track_attributes" );
+
+    insertFiles( dbi, srcid, rows );
+
+    // Resolve all artists at once, then tracks and albums per artist, in batches
+    QStringList artists;
+    foreach ( const FileRow& row, rows )
+    {
+        if ( !row.artist.trimmed().isEmpty() )
+            artists << row.artist;
+        if ( !row.albumartist.trimmed().isEmpty() )
+            artists << row.albumartist;
+        if ( !row.composer.trimmed().isEmpty() )
+            artists << row.composer;
+    }
+    const QHash< QString, int > artistIds = dbi->artistIds( artists, true );
+
+    QMap< int, QStringList > tracksByArtist;
+    QMap< int, QStringList > albumsByArtist;
+    for ( int i = 0; i < rows.count(); i++ )
+    {
+        FileRow& row = rows[ i ];
+        if ( !row.albumartist.trimmed().isEmpty() )
+            row.albumartistId = artistIds.value( row.albumartist );
+        if ( !row.artist.trimmed().isEmpty() )
+            row.artistId = artistIds.value( row.artist );
+        if ( !row.composer.trimmed().isEmpty() )
+            row.composerId = artistIds.value( row.composer );
+        if ( row.artistId < 1 )
             continue;
+
+        tracksByArtist[ row.artistId ] << row.track;
         // If there's an album artist, use it. Otherwise use the track artist
-        albumid = dbi->albumId( albumartistid > 0 ? albumartistid : artistid, album, true );
-
-        if ( !composer.trimmed().isEmpty() )
-            composerid = dbi->artistId( composer, true );
-
-        // Now add the association
-        query_filejoin.bindValue( 0, fileid );
-        query_filejoin.bindValue( 1, artistid );
-        query_filejoin.bindValue( 2, albumid > 0 ? albumid : QVariant( QVariant::Int ) );
-        query_filejoin.bindValue( 3, trackid );
-        query_filejoin.bindValue( 4, albumpos );
-        query_filejoin.bindValue( 5, composerid > 0 ? composerid : QVariant( QVariant::Int ) );
-        query_filejoin.bindValue( 6, discnumber );
-        if ( !query_filejoin.exec() )
-        {
-            qDebug() << "Error inserting into file_join table";
+        albumsByArtist[ row.albumartistId > 0 ? row.albumartistId : row.artistId ] << row.album;
+    }
+
+    QHash< int, QHash< QString, int > > trackIds;
+    for ( QMap< int, QStringList >::const_iterator it = tracksByArtist.constBegin(); it != tracksByArtist.constEnd(); ++it )
+        trackIds.insert( it.key(), dbi->trackIds( it.key(), it.value(), true ) );
+
+    QHash< int, QHash< QString, int > > albumIds;
+    for ( QMap< int, QStringList >::const_iterator it = albumsByArtist.constBegin(); it != albumsByArtist.constEnd(); ++it )
+        albumIds.insert( it.key(), dbi->albumIds( it.key(), it.value(), true ) );
+
+    QVector< const FileRow* > joined;
+    joined.reserve( rows.count() );
+    for ( int i = 0; i < rows.count(); i++ )
+    {
+        FileRow& row = rows[ i ];
+
+        // this is the qvariant(map) the remote will get
+        QVariantMap m = m_files.at( i ).toMap();
+        m.insert( "id", row.fileId );
+        m_files[ i ] = m;
+
+        if ( row.fileId < 1 || row.artistId < 1 )
             continue;
-        }
 
-        query_trackattr.bindValue( 0, trackid );
-        query_trackattr.bindValue( 1, "releaseyear" );
-        query_trackattr.bindValue( 2, year );
-        query_trackattr.exec();
+        row.trackId = trackIds.value( row.artistId ).value( row.track );
+        if ( row.trackId < 1 )
+            continue;
 
-        m_ids << fileid;
-        added++;
+        row.albumId = albumIds.value( row.albumartistId > 0 ? row.albumartistId : row.artistId ).value( row.album );
+        joined << &row;
     }
 
-    qDebug() << "Inserted" << added << "tracks to database";
-    tDebug() << "Committing" << added << "tracks...";
+    insertFileJoins( dbi, joined );
+
+    foreach ( const FileRow* row, joined )
+        m_ids << row->fileId;
+
+    if ( !deferredIndices.isEmpty() )
+        createIndices( dbi, deferredIndices );
+
+    qDebug() << "Inserted" << m_ids.count() << "tracks to database";
+    tDebug() << "Committing" << m_ids.count() << "tracks...";
 
     emit done( m_files, source()->dbCollection() );
 }
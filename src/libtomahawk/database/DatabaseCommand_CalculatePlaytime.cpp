@@ -19,6 +19,7 @@
 #include "DatabaseCommand_CalculatePlaytime_p.h"
 
 #include "database/DatabaseImpl.h"
+#include "database/PlaybackAggregates.h"
 #include "Source.h"
 #include "Track.h"
 
@@ -96,9 +97,9 @@ DatabaseCommand_CalculatePlaytime::exec( DatabaseImpl *dbi )
     {
         sql = QString(
                     " SELECT SUM(pl.secs_played) "
-                    " FROM playback_log pl "
-                    " WHERE track in ( %1 ) AND playtime >= %2 AND playtime <= %3 "
-                    ).arg( d->trackIds.join(", ") ).arg( d->from.toTime_t() ).arg( d->to.toTime_t() );
+                    " FROM ( %1 ) pl "
+                    ).arg( PlaybackAggregates::timespanSql( d->from.toTime_t(), d->to.toTime_t(),
+                                                            QString( "track IN ( %1 )" ).arg( d->trackIds.join(", ") ) ) );
     }
     else
     {
@@ -113,13 +114,11 @@ DatabaseCommand_CalculatePlaytime::exec( DatabaseImpl *dbi )
                     " FROM playlist_item pi "
                     " JOIN track t ON pi.trackname = t.name "
                     " JOIN artist a ON a.name = pi.artistname AND t.artist = a.id "
-                    " JOIN playback_log pl ON pl.track = t.id "
+                    " JOIN ( %2 ) pl ON pl.track = t.id "
                     " WHERE pi.guid IN (%1) "
-                    " AND pl.playtime >= %2 AND pl.playtime <= %3 "
                     )
                 .arg( d->plEntryIds.join(", ") )
-                .arg( d->from.toTime_t() )
-                .arg( d->to.toTime_t() );
+                .arg( PlaybackAggregates::timespanSql( d->from.toTime_t(), d->to.toTime_t() ) );
 
     }
 
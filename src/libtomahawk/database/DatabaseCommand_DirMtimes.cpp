@@ -82,7 +82,19 @@ DatabaseCommand_DirMtimes::execUpdate( DatabaseImpl* dbi )
 {
     qDebug() << "Saving mtimes...";
     TomahawkSqlQuery query = dbi->newquery();
-    query.exec( "DELETE FROM dirs_scanned" );
+    if ( m_prefixes.isEmpty() )
+        query.exec( "DELETE FROM dirs_scanned" );
+
+    foreach ( const QString& prefix, m_prefixes )
+    {
+        const QString dir = QDir::cleanPath( prefix );
+        query.prepare( "DELETE FROM dirs_scanned WHERE name = ? OR substr(name, 1, ?) = ?" );
+        query.addBindValue( dir );
+        query.addBindValue( dir.length() + 1 );
+        query.addBindValue( dir + "/" );
+        query.exec();
+    }
+
     query.prepare( "INSERT INTO dirs_scanned(name, mtime) VALUES(?, ?)" );
 
     foreach( const QString& k, m_tosave.keys() )
@@ -51,6 +51,11 @@ public:
         : DatabaseCommand( parent ), m_update( true ), m_tosave( tosave )
     {}
 
+    // Only replaces the rows for these directories and everything below them
+    explicit DatabaseCommand_DirMtimes( const QStringList& prefixes, QMap<QString, unsigned int> tosave, QObject* parent = 0 )
+        : DatabaseCommand( parent ), m_prefixes( prefixes ), m_update( true ), m_tosave( tosave )
+    {}
+
     virtual void exec( DatabaseImpl* );
     virtual bool doesMutates() const { return m_update; }
     virtual QString commandname() const { return "dirmtimes"; }
@@ -69,13 +69,23 @@ DatabaseCommand_FileMtimes::execSelect( DatabaseImpl* dbi )
 void
 DatabaseCommand_FileMtimes::execSelectPath( DatabaseImpl *dbi, const QDir& path, QMap<QString, QMap< unsigned int, unsigned int > > &mtimes )
 {
+    // The path might be gone already, we still want what used to be there
+    QString url = path.canonicalPath();
+    if ( url.isEmpty() )
+        url = QDir::cleanPath( path.absolutePath() );
+    url.prepend( "file://" );
+
+    // Either the file itself or anything below the directory. A range instead of
+    // LIKE, which would treat % and _ in names as wildcards and can't use the index.
     TomahawkSqlQuery query = dbi->newquery();
     query.prepare( QString( "SELECT url, id, mtime "
                             "FROM file "
                             "WHERE source IS NULL "
-                            "AND url LIKE :prefix" ) );
+                            "AND ( url = ? OR ( url >= ? AND url < ? ) )" ) );
 
-    query.bindValue( ":prefix", "file://" + path.canonicalPath() + "%" );
+    query.addBindValue( url );
+    query.addBindValue( url + "/" );
+    query.addBindValue( url + "0" ); // '0' sorts right after '/'
     query.exec();
 
     while( query.next() )
@@ -24,6 +24,7 @@
 #include "DatabaseImpl.h"
 #include "Playlist.h"
 #include "PlaylistEntry.h"
+#include "PlaylistRevisionDelta.h"
 #include "Source.h"
 
 #include <QSqlQuery>
@@ -100,7 +101,12 @@ DatabaseCommand_LoadAllPlaylists::exec( DatabaseImpl* dbi )
 
         if ( d->returnPlEntryIds )
         {
-            QStringList trackIds = TomahawkUtils::parseJson( query.value( 8 ).toByteArray() ).toStringList();
+            QStringList trackIds;
+            if ( !query.value( 8 ).isNull() )
+                trackIds = TomahawkUtils::parseJson( query.value( 8 ).toByteArray() ).toStringList();
+            else // stored as delta
+                PlaylistRevisionDelta::loadEntries( dbi, p->currentrevision(), trackIds );
+
             phash.insert( p, trackIds );
         }
     }
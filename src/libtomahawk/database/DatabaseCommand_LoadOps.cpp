@@ -19,10 +19,15 @@
 #include "DatabaseCommand_LoadOps.h"
 
 #include "DatabaseImpl.h"
+#include "PlaylistRevisionDelta.h"
 #include "TomahawkSqlQuery.h"
 #include "Source.h"
+#include "utils/Json.h"
 #include "utils/Logger.h"
 
+// Same threshold DatabaseWorker uses when writing the oplog
+#define OP_COMPRESS_THRESHOLD 512
+
 namespace Tomahawk
 {
 
@@ -53,10 +58,12 @@ DatabaseCommand_loadOps::exec( DatabaseImpl* dbi )
                    "FROM oplog "
                    "WHERE source %1 "
                    "AND id > coalesce((SELECT id FROM oplog WHERE guid = ?),0) "
-                   "ORDER BY id ASC"
+                   "ORDER BY id ASC "
+                   "LIMIT ?"
                    ).arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) )
                   );
     query.addBindValue( m_since );
+    query.addBindValue( m_limit > 0 ? m_limit : -1 ); // negative means no limit in sqlite
     query.exec();
 
     QString lastguid = m_since;
@@ -69,6 +76,10 @@ DatabaseCommand_loadOps::exec( DatabaseImpl* dbi )
         op->compressed = query.value( 3 ).toBool();
         op->singleton = query.value( 4 ).toBool();
 
+        if ( m_expandPlaylistDeltas &&
+             ( op->command == "setplaylistrevision" || op->command == "setdynamicplaylistrevision" ) )
+            expandPlaylistDelta( dbi, op );
+
         lastguid = op->guid;
         ops << op;
     }
@@ -77,4 +88,33 @@ DatabaseCommand_loadOps::exec( DatabaseImpl* dbi )
     emit done( m_since, lastguid, ops );
 }
 
+
+void
+DatabaseCommand_loadOps::expandPlaylistDelta( DatabaseImpl* dbi, const dbop_ptr& op ) const
+{
+    QVariantMap m = TomahawkUtils::parseJson( op->compressed ? qUncompress( op->payload ) : op->payload ).toMap();
+    if ( !m.value( "delta" ).toMap().contains( "ops" ) )
+        return;
+
+    QStringList guids;
+    if ( !PlaylistRevisionDelta::loadEntries( dbi, m.value( "newrev" ).toString(), guids ) )
+    {
+        // The playlist is gone, a later op deletes it anyway
+        tLog() << "Can't expand playlist revision delta in op" << op->guid;
+        return;
+    }
+
+    QVariantList orderedguids;
+    foreach ( const QString& guid, guids )
+        orderedguids << guid;
+
+    m.insert( "orderedguids", orderedguids );
+    m.remove( "delta" );
+
+    op->payload = TomahawkUtils::toJson( m );
+    op->compressed = ( op->payload.length() >= OP_COMPRESS_THRESHOLD );
+    if ( op->compressed )
+        op->payload = qCompress( op->payload, 9 );
+}
+
 }
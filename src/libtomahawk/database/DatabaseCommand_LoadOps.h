@@ -33,12 +33,22 @@ class DLLEXPORT DatabaseCommand_loadOps : public DatabaseCommand
 {
 Q_OBJECT
 public:
-    explicit DatabaseCommand_loadOps( const Tomahawk::source_ptr& src, QString since, QObject* parent = 0 )
-        : DatabaseCommand( src ), m_since( since )
+    /**
+     * Loads the ops after since. With a limit only that many ops are loaded,
+     * pass the returned lastguid as since to get the next page.
+     */
+    explicit DatabaseCommand_loadOps( const Tomahawk::source_ptr& src, QString since, int limit = 0, QObject* parent = 0 )
+        : DatabaseCommand( src ), m_since( since ), m_limit( limit ), m_expandPlaylistDeltas( false )
     {
         Q_UNUSED( parent );
     }
 
+    /**
+     * Replace playlist revision deltas with the full entry lists, for peers
+     * that don't understand deltas.
+     */
+    void setExpandPlaylistDeltas( bool expand ) { m_expandPlaylistDeltas = expand; }
+
     virtual void exec( DatabaseImpl* db );
     virtual bool doesMutates() const { return false; }
     virtual QString commandname() const { return "loadops"; }
@@ -47,7 +57,11 @@ signals:
     void done( QString sinceguid, QString lastguid, QList< dbop_ptr > ops );
 
 private:
+    void expandPlaylistDelta( DatabaseImpl* dbi, const dbop_ptr& op ) const;
+
     QString m_since; // guid to load from
+    int m_limit;
+    bool m_expandPlaylistDeltas;
 };
 
 }
@@ -25,6 +25,7 @@
 #include "utils/Logger.h"
 
 #include "DatabaseImpl.h"
+#include "PlaybackAggregates.h"
 #include "PlaylistEntry.h"
 
 #include <QDateTime>
@@ -119,7 +120,8 @@ DatabaseCommand_LogPlayback::exec( DatabaseImpl* dbi )
     query.bindValue( 2, m_playtime );
     query.bindValue( 3, m_secsPlayed );
 
-    query.exec();
+    if ( query.exec() )
+        PlaybackAggregates::addPlayback( dbi, srcid, trkid, artid, m_playtime, m_secsPlayed );
 }
 
 
@@ -20,6 +20,7 @@
 
 #include "Track.h"
 #include "DatabaseImpl.h"
+#include "PlaybackAggregates.h"
 #include "TomahawkSqlQuery.h"
 
 // Forward Declarations breaking QSharedPointer
@@ -59,23 +60,21 @@ DatabaseCommand_NetworkCharts::exec( DatabaseImpl * dbi )
     {
         limit = QString( "LIMIT 0, %1" ).arg( m_amount );
     }
-    QString timespan;
+    const QString filter = "source IS NOT NULL"; // exclude self
+    QString plays;
     if ( m_from.isValid() && m_to.isValid() )
-    {
-        timespan = QString(
-                    " AND playback_log.playtime >= %1 AND playback_log.playtime <= %2 "
-                    ).arg( m_from.toTime_t() ).arg( m_to.toTime_t() );
-    }
+        plays = PlaybackAggregates::timespanSql( m_from.toTime_t(), m_to.toTime_t(), filter );
+    else
+        plays = PlaybackAggregates::allTimeSql( filter );
 
     QString sql = QString(
-                "SELECT COUNT(*) as counter, track.name, artist.name "
-                " FROM playback_log, track, artist "
-                " WHERE track.id = playback_log.track AND artist.id = track.artist "
-                " AND playback_log.source IS NOT NULL %1 " // exclude self
-                " GROUP BY playback_log.track "
+                "SELECT SUM(plays.plays) as counter, track.name, artist.name "
+                " FROM ( %1 ) plays, track, artist "
+                " WHERE track.id = plays.track AND artist.id = plays.artist "
+                " GROUP BY plays.track "
                 " ORDER BY counter DESC "
                 " %2"
-                ).arg( timespan ).arg( limit );
+                ).arg( plays ).arg( limit );
 
     query.prepare( sql );
     query.exec();
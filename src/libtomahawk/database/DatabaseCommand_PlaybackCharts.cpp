@@ -23,6 +23,7 @@
 
 #include "Artist.h"
 #include "DatabaseImpl.h"
+#include "PlaybackAggregates.h"
 #include "PlaylistEntry.h"
 #include "Source.h"
 
@@ -51,18 +52,16 @@ DatabaseCommand_PlaybackCharts::exec( DatabaseImpl* dbi )
     QString sourceToken;
 
     if ( source() )
-        sourceToken = QString( "AND playback_log.source %1" ).arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) );
+        sourceToken = QString( "source %1" ).arg( source()->isLocal() ? "IS NULL" : QString( "= %1" ).arg( source()->id() ) );
 
     QString sql = QString(
-            "SELECT artist.id, artist.name, COUNT(*) AS counter "
-            "FROM playback_log, artist, track "
-            "WHERE playback_log.track = track.id "
-            "AND artist.id = track.artist "
-            "%1 "
+            "SELECT artist.id, artist.name, SUM(plays.plays) AS counter "
+            "FROM ( %1 ) plays, artist "
+            "WHERE artist.id = plays.artist "
             "GROUP BY artist.id "
             "ORDER BY counter DESC "
             "%2"
-            ).arg( sourceToken )
+            ).arg( PlaybackAggregates::allTimeSql( sourceToken ) )
              .arg( m_amount > 0 ? QString( "LIMIT 0, %1" ).arg( m_amount ) : QString() );
 
     query.prepare( sql );
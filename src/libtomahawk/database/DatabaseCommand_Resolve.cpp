@@ -32,10 +32,18 @@ using namespace Tomahawk;
 
 DatabaseCommand_Resolve::DatabaseCommand_Resolve( const query_ptr& query )
     : DatabaseCommand()
-    , m_query( query )
 {
     // FIXME: We need to run tests of this DbCmd without a Pipeline
     // Q_ASSERT( Pipeline::instance()->isRunning() );
+
+    m_queries << query;
+}
+
+
+DatabaseCommand_Resolve::DatabaseCommand_Resolve( const QList< query_ptr >& queries )
+    : DatabaseCommand()
+    , m_queries( queries )
+{
 }
 
 
@@ -52,51 +60,79 @@ DatabaseCommand_Resolve::exec( DatabaseImpl* lib )
      *        1) find list of trk/art/alb IDs that are reasonable matches to the metadata given
      *        2) find files in database by permitted sources and calculate score, ignoring
      *           results that are less than MINSCORE
+     *
+     *        Track queries of a batch share both stages: one index search pass and
+     *        a single SQL query for all their candidates.
      */
 
-    if ( !m_query->resultHint().isEmpty() )
+    QList< query_ptr > trackQueries;
+    foreach ( const query_ptr& query, m_queries )
     {
-        tDebug() << "Using result-hint to speed up resolving:" << m_query->resultHint();
-
-        Tomahawk::result_ptr result = lib->resultFromHint( m_query );
-        if ( result && ( !result->collection() || result->collection()->source()->isOnline() ) )
+        if ( !query->resultHint().isEmpty() )
         {
-            QList<Tomahawk::result_ptr> res;
-            res << result;
-            emit results( m_query->id(), res );
-            return;
+            tDebug() << "Using result-hint to speed up resolving:" << query->resultHint();
+
+            Tomahawk::result_ptr result = lib->resultFromHint( query );
+            if ( result && ( !result->collection() || result->collection()->source()->isOnline() ) )
+            {
+                QList<Tomahawk::result_ptr> res;
+                res << result;
+                emit results( query->id(), res );
+                continue;
+            }
         }
+
+        if ( query->isFullTextQuery() )
+            fullTextResolve( lib, query );
+        else
+            trackQueries << query;
     }
 
-    if ( m_query->isFullTextQuery() )
-        fullTextResolve( lib );
-    else
-        resolve( lib );
+    if ( !trackQueries.isEmpty() )
+        resolve( lib, trackQueries );
 }
 
 
 void
-DatabaseCommand_Resolve::resolve( DatabaseImpl* lib )
+DatabaseCommand_Resolve::resolve( DatabaseImpl* lib, const QList< query_ptr >& queries )
 {
-    QList<Tomahawk::result_ptr> res;
+    QHash< QID, QList<Tomahawk::result_ptr> > res;
 
     // STEP 1
-    QList< QPair<int, float> > tracks = lib->search( m_query );
+    const QHash< QID, QList< QPair<int, float> > > candidates = lib->search( queries );
 
-    if ( tracks.length() == 0 )
+    // map every candidate track back to the queries it was found for
+    QHash< int, QList< QID > > trackQids;
+    QStringList trksl;
+    foreach ( const query_ptr& query, queries )
+    {
+        const QList< QPair<int, float> > tracks = candidates.value( query->id() );
+        if ( tracks.length() == 0 )
+        {
+            qDebug() << "No candidates found in first pass, aborting resolve" << query->queryTrack()->toString();
+            continue;
+        }
+
+        for ( int k = 0; k < tracks.count(); k++ )
+        {
+            const int trackId = tracks.at( k ).first;
+            if ( !trackQids.contains( trackId ) )
+                trksl.append( QString::number( trackId ) );
+
+            trackQids[ trackId ] << query->id();
+        }
+    }
+
+    if ( trksl.isEmpty() )
     {
-        qDebug() << "No candidates found in first pass, aborting resolve" << m_query->queryTrack()->toString();
-        emit results( m_query->id(), res );
+        foreach ( const query_ptr& query, queries )
+            emit results( query->id(), QList<Tomahawk::result_ptr>() );
         return;
     }
 
     // STEP 2
     TomahawkSqlQuery files_query = lib->newquery();
 
-    QStringList trksl;
-    for ( int k = 0; k < tracks.count(); k++ )
-        trksl.append( QString::number( tracks.at( k ).first ) );
-
     QString trksToken = QString( "file_join.track IN (%1)" ).arg( trksl.join( "," ) );
 
     QString sql = QString( "SELECT "
@@ -130,6 +166,10 @@ DatabaseCommand_Resolve::resolve( DatabaseImpl* lib )
 
     while ( files_query.next() )
     {
+        const QList< QID > qids = trackQids.value( files_query.value( 9 ).toInt() );
+        if ( qids.isEmpty() )
+            continue;
+
         QString url = files_query.value( 0 ).toString();
         source_ptr s = SourceList::instance()->get( files_query.value( 16 ).toUInt() );
         if ( !s )
@@ -144,68 +184,70 @@ DatabaseCommand_Resolve::resolve( DatabaseImpl* lib )
         if ( result )
         {
             tDebug( LOGVERBOSE ) << "Result already cached:" << result->toString();
-            res << result;
-            continue;
+        }
+        else
+        {
+            track_ptr track = Track::get( files_query.value( 9 ).toUInt(), files_query.value( 12 ).toString(), files_query.value( 14 ).toString(),
+                                          files_query.value( 13 ).toString(), files_query.value( 22 ).toString(), files_query.value( 5 ).toUInt(),
+                                          files_query.value( 15 ).toString(), files_query.value( 17 ).toUInt(), files_query.value( 11 ).toUInt() );
+            if ( !track )
+                continue;
+            track->loadAttributes();
+
+            result = Result::get( url, track );
+            if ( !result )
+                continue;
+
+            result->setModificationTime( files_query.value( 1 ).toUInt() );
+            result->setSize( files_query.value( 2 ).toUInt() );
+            result->setMimetype( files_query.value( 4 ).toString() );
+            result->setBitrate( files_query.value( 6 ).toUInt() );
+            result->setRID( uuid() );
+            result->setCollection( s->dbCollection() );
         }
 
-        track_ptr track = Track::get( files_query.value( 9 ).toUInt(), files_query.value( 12 ).toString(), files_query.value( 14 ).toString(),
-                                      files_query.value( 13 ).toString(), files_query.value( 22 ).toString(), files_query.value( 5 ).toUInt(),
-                                      files_query.value( 15 ).toString(), files_query.value( 17 ).toUInt(), files_query.value( 11 ).toUInt() );
-        if ( !track )
-            continue;
-        track->loadAttributes();
-
-        result = Result::get( url, track );
-        if ( !result )
-            continue;
-
-        result->setModificationTime( files_query.value( 1 ).toUInt() );
-        result->setSize( files_query.value( 2 ).toUInt() );
-        result->setMimetype( files_query.value( 4 ).toString() );
-        result->setBitrate( files_query.value( 6 ).toUInt() );
-        result->setRID( uuid() );
-        result->setCollection( s->dbCollection() );
-
-        res << result;
+        foreach ( const QID& qid, qids )
+            res[ qid ] << result;
     }
 
-    emit results( m_query->id(), res );
+    foreach ( const query_ptr& query, queries )
+        emit results( query->id(), res.value( query->id() ) );
 }
 
 
 void
-DatabaseCommand_Resolve::fullTextResolve( DatabaseImpl* lib )
+DatabaseCommand_Resolve::fullTextResolve( DatabaseImpl* lib, const query_ptr& query )
 {
     QList<Tomahawk::result_ptr> res;
     typedef QPair<int, float> scorepair_t;
 
     // STEP 1
-    QList< QPair<int, float> > trackPairs = lib->search( m_query );
-    QList< QPair<int, float> > albumPairs = lib->searchAlbum( m_query, 20 );
+    QList< QPair<int, float> > trackPairs = lib->search( query );
+    QList< QPair<int, float> > albumPairs = lib->searchAlbum( query, 20 );
 
-    TomahawkSqlQuery query = lib->newquery();
-    query.prepare( "SELECT album.name, artist.id, artist.name FROM album, artist WHERE artist.id = album.artist AND album.id = ?" );
+    TomahawkSqlQuery albumQuery = lib->newquery();
+    albumQuery.prepare( "SELECT album.name, artist.id, artist.name FROM album, artist WHERE artist.id = album.artist AND album.id = ?" );
 
     foreach ( const scorepair_t& albumPair, albumPairs )
     {
-        query.bindValue( 0, albumPair.first );
-        query.exec();
+        albumQuery.bindValue( 0, albumPair.first );
+        albumQuery.exec();
 
         QList<Tomahawk::album_ptr> albumList;
-        while ( query.next() )
+        while ( albumQuery.next() )
         {
-            Tomahawk::artist_ptr artist = Tomahawk::Artist::get( query.value( 1 ).toUInt(), query.value( 2 ).toString() );
-            Tomahawk::album_ptr album = Tomahawk::Album::get( albumPair.first, query.value( 0 ).toString(), artist );
+            Tomahawk::artist_ptr artist = Tomahawk::Artist::get( albumQuery.value( 1 ).toUInt(), albumQuery.value( 2 ).toString() );
+            Tomahawk::album_ptr album = Tomahawk::Album::get( albumPair.first, albumQuery.value( 0 ).toString(), artist );
             albumList << album;
         }
 
-        emit albums( m_query->id(), albumList );
+        emit albums( query->id(), albumList );
     }
 
     if ( trackPairs.length() == 0 )
     {
-        qDebug() << "No candidates found in first pass, aborting resolve" << m_query->fullTextQuery();
-        emit results( m_query->id(), res );
+        qDebug() << "No candidates found in first pass, aborting resolve" << query->fullTextQuery();
+        emit results( query->id(), res );
         return;
     }
 
@@ -291,5 +333,5 @@ DatabaseCommand_Resolve::fullTextResolve( DatabaseImpl* lib )
         res << result;
     }
 
-    emit results( m_query->id(), res );
+    emit results( query->id(), res );
 }
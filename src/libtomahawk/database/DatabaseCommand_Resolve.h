@@ -37,6 +37,7 @@ class DLLEXPORT DatabaseCommand_Resolve : public DatabaseCommand
 Q_OBJECT
 public:
     explicit DatabaseCommand_Resolve( const Tomahawk::query_ptr& query );
+    explicit DatabaseCommand_Resolve( const QList< Tomahawk::query_ptr >& queries );
     virtual ~DatabaseCommand_Resolve();
 
     QString commandname() const override { return "dbresolve"; }
@@ -52,10 +53,10 @@ signals:
 private:
     DatabaseCommand_Resolve();
 
-    void fullTextResolve( DatabaseImpl* lib );
-    void resolve( DatabaseImpl* lib );
+    void fullTextResolve( DatabaseImpl* lib, const Tomahawk::query_ptr& query );
+    void resolve( DatabaseImpl* lib, const QList< Tomahawk::query_ptr >& queries );
 
-    Tomahawk::query_ptr m_query;
+    QList< Tomahawk::query_ptr > m_queries;
 };
 
 }
@@ -99,6 +99,12 @@ DatabaseCommand_SetDynamicPlaylistRevision::postCommitHook()
         return;
     }
 
+    if ( m_failed )
+    {
+        refetchIfNeeded();
+        return;
+    }
+
     QStringList orderedentriesguids;
     foreach( const QVariant& v, orderedguids() )
         orderedentriesguids << v.toString();
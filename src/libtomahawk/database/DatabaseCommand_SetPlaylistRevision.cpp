@@ -25,6 +25,7 @@
 
 #include "DatabaseImpl.h"
 #include "PlaylistEntry.h"
+#include "PlaylistRevisionDelta.h"
 #include "Source.h"
 #include "TomahawkSqlQuery.h"
 #include "Track.h"
@@ -45,11 +46,13 @@ DatabaseCommand_SetPlaylistRevision::DatabaseCommand_SetPlaylistRevision(
     : DatabaseCommandLoggable( s )
     , m_failed( false )
     , m_applied( false )
+    , m_needsRefetch( false )
     , m_newrev( newrev )
     , m_oldrev( oldrev )
     , m_addedentries( addedentries )
     , m_entries( entries )
     , m_metadataUpdate( false )
+    , m_deltaEncoded( false )
 {
     Q_ASSERT( !newrev.isEmpty() );
     m_localOnly = ( newrev == oldrev );
@@ -74,10 +77,12 @@ DatabaseCommand_SetPlaylistRevision::DatabaseCommand_SetPlaylistRevision(
     : DatabaseCommandLoggable( s )
     , m_failed( false )
     , m_applied( false )
+    , m_needsRefetch( false )
     , m_newrev( newrev )
     , m_oldrev( oldrev )
     , m_entries( entriesToUpdate )
     , m_metadataUpdate( true )
+    , m_deltaEncoded( false )
 {
     Q_ASSERT( !newrev.isEmpty() );
     m_localOnly = false;
@@ -98,6 +103,12 @@ DatabaseCommand_SetPlaylistRevision::postCommitHook()
     if ( m_localOnly )
         return;
 
+    if ( m_failed )
+    {
+        refetchIfNeeded();
+        return;
+    }
+
     QStringList orderedentriesguids;
     foreach( const QVariant& v, m_orderedguids )
         orderedentriesguids << v.toString();
@@ -125,6 +136,15 @@ DatabaseCommand_SetPlaylistRevision::postCommitHook()
 }
 
 
+void
+DatabaseCommand_SetPlaylistRevision::refetchIfNeeded()
+{
+    // Ask the peer for this revision again, as a full list
+    if ( m_needsRefetch )
+        QMetaObject::invokeMethod( source().data(), "refetchOps", Qt::QueuedConnection, Q_ARG( QString, guid() ) );
+}
+
+
 void
 DatabaseCommand_SetPlaylistRevision::exec( DatabaseImpl* lib )
 {
@@ -147,8 +167,45 @@ DatabaseCommand_SetPlaylistRevision::exec( DatabaseImpl* lib )
         return;
     }
 
-    QVariantList vlist = m_orderedguids;
-    const QByteArray entries = TomahawkUtils::toJson( vlist );
+    // The previous revision is what the delta is made against. The playlist
+    // also needs it to work out what changed.
+    QStringList previousGuids;
+    int previousDistance = 0;
+    const bool hasPrevious = !m_localOnly && !m_oldrev.isEmpty() &&
+                             PlaylistRevisionDelta::loadEntries( lib, m_oldrev, previousGuids, &previousDistance );
+
+    QStringList orderedGuids;
+    bool hasDelta = false;
+    if ( m_deltaEncoded )
+    {
+        // Sent to us as ops, rebuild the full list from our copy of oldrev
+        if ( !hasPrevious || !PlaylistRevisionDelta::apply( previousGuids, QList< QVariantList >() << m_delta, orderedGuids ) )
+        {
+            tLog() << "ERROR: Can't apply playlist revision delta, base revision missing or different:" << m_oldrev << m_newrev;
+            m_failed = true;
+            // Once is enough, the peer might not have the full list either
+            m_needsRefetch = !source()->isLocal() && source()->canRefetchOp( guid() );
+            return;
+        }
+
+        m_orderedguids.clear();
+        foreach ( const QString& guid, orderedGuids )
+            m_orderedguids << guid;
+
+        hasDelta = true;
+    }
+    else if ( !m_localOnly )
+    {
+        foreach ( const QVariant& v, m_orderedguids )
+            orderedGuids << v.toString();
+
+        hasDelta = hasPrevious && PlaylistRevisionDelta::diff( previousGuids, orderedGuids, m_delta );
+        if ( !hasDelta )
+            m_delta.clear();
+
+        // Only worth sending to peers if it's smaller than the list
+        m_deltaEncoded = hasDelta && m_delta.count() < orderedGuids.count();
+    }
 
     // add any new items:
     TomahawkSqlQuery adde = lib->newquery();
@@ -224,18 +281,23 @@ DatabaseCommand_SetPlaylistRevision::exec( DatabaseImpl* lib )
         }
     }
 
-    // add / update the revision:
+    // add / update the revision, storing either the full list or the delta:
+    const bool snapshot = !hasDelta ||
+                          PlaylistRevisionDelta::isSnapshotDue( previousDistance + 1, m_delta.count(), orderedGuids.count() );
+
     TomahawkSqlQuery query = lib->newquery();
-    QString sql = "INSERT INTO playlist_revision(guid, playlist, entries, author, timestamp, previous_revision) "
-                  "VALUES(?, ?, ?, ?, ?, ?)";
+    QString sql = "INSERT INTO playlist_revision(guid, playlist, entries, author, timestamp, previous_revision, delta, snapshot_distance) "
+                  "VALUES(?, ?, ?, ?, ?, ?, ?, ?)";
     query.prepare( sql );
 
     query.addBindValue( m_newrev );
     query.addBindValue( m_playlistguid );
-    query.addBindValue( entries );
+    query.addBindValue( snapshot ? TomahawkUtils::toJson( m_orderedguids ) : QVariant(QVariant::String) );
     query.addBindValue( source()->isLocal() ? QVariant(QVariant::Int) : source()->id() );
     query.addBindValue( 0 ); //ts
     query.addBindValue( m_oldrev.isEmpty() ? QVariant(QVariant::String) : m_oldrev );
+    query.addBindValue( snapshot ? QVariant(QVariant::String) : TomahawkUtils::toJson( m_delta ) );
+    query.addBindValue( snapshot ? 0 : previousDistance + 1 );
     query.exec();
 
     tDebug() << "Currentrevision:" << currentRevision << "oldrev:" << m_oldrev;
@@ -252,22 +314,8 @@ DatabaseCommand_SetPlaylistRevision::exec( DatabaseImpl* lib )
 
         m_applied = true;
 
-        // load previous revision entries, which we need to pass on
-        // so the change can be diffed
-        TomahawkSqlQuery query_entries = lib->newquery();
-        query_entries.prepare( "SELECT entries, playlist, author, timestamp, previous_revision "
-                               "FROM playlist_revision "
-                               "WHERE guid = :guid" );
-        query_entries.bindValue( ":guid", m_oldrev );
-        query_entries.exec();
-        if ( query_entries.next() )
-        {
-            bool ok;
-            QVariant v = TomahawkUtils::parseJson( query_entries.value( 0 ).toByteArray(), &ok );
-            Q_ASSERT( ok && v.type() == QVariant::List ); //TODO
-
-            m_previous_rev_orderedguids = v.toStringList();
-        }
+        // pass on the previous revision entries, so the change can be diffed
+        m_previous_rev_orderedguids = previousGuids;
     }
     else if ( !m_oldrev.isEmpty() )
     {
@@ -308,3 +356,32 @@ DatabaseCommand_SetPlaylistRevision::addedentriesV() const
     }
     return vlist;
 }
+
+
+QVariantList
+DatabaseCommand_SetPlaylistRevision::orderedguidsV() const
+{
+    if ( m_deltaEncoded )
+        return QVariantList();
+
+    return m_orderedguids;
+}
+
+
+void
+DatabaseCommand_SetPlaylistRevision::setDeltaV( const QVariantMap& delta )
+{
+    m_deltaEncoded = delta.contains( "ops" );
+    m_delta = delta.value( "ops" ).toList();
+}
+
+
+QVariantMap
+DatabaseCommand_SetPlaylistRevision::deltaV() const
+{
+    QVariantMap delta;
+    if ( m_deltaEncoded )
+        delta.insert( "ops", m_delta );
+
+    return delta;
+}
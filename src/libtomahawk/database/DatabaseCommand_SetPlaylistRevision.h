@@ -25,6 +25,7 @@
 #include "DllMacro.h"
 
 #include <QStringList>
+#include <QVariantMap>
 
 namespace Tomahawk
 {
@@ -35,17 +36,20 @@ Q_OBJECT
 Q_PROPERTY( QString playlistguid      READ playlistguid  WRITE setPlaylistguid )
 Q_PROPERTY( QString newrev            READ newrev        WRITE setNewrev )
 Q_PROPERTY( QString oldrev            READ oldrev        WRITE setOldrev )
-Q_PROPERTY( QVariantList orderedguids READ orderedguids  WRITE setOrderedguids )
+Q_PROPERTY( QVariantList orderedguids READ orderedguidsV WRITE setOrderedguids )
 Q_PROPERTY( QVariantList addedentries READ addedentriesV WRITE setAddedentriesV )
 Q_PROPERTY( bool metadataUpdate       READ metadataUpdate WRITE setMetadataUpdate )
+Q_PROPERTY( QVariantMap delta         READ deltaV        WRITE setDeltaV )
 
 public:
     explicit DatabaseCommand_SetPlaylistRevision( QObject* parent = 0 )
         : DatabaseCommandLoggable( parent )
         , m_failed( false )
         , m_applied( false )
+        , m_needsRefetch( false )
         , m_localOnly( false )
         , m_metadataUpdate( false )
+        , m_deltaEncoded( false )
     {}
 
     // Constructor for inserting or removing entries
@@ -74,6 +78,7 @@ public:
     virtual bool doesMutates() const { return true; }
     virtual bool localOnly() const { return m_localOnly; }
     virtual bool groupable() const { return true; }
+    virtual bool needsRefetch() const { return m_needsRefetch; }
 
     void setAddedentriesV( const QVariantList& vlist );
 
@@ -92,9 +97,23 @@ public:
     void setOrderedguids( const QVariantList& l ) { m_orderedguids = l; }
     QVariantList orderedguids() const { return m_orderedguids; }
 
+    /**
+     * Once executed, the command is sent to peers as the ops against oldrev
+     * rather than the full orderedguids, if that is smaller. Peers that don't
+     * understand deltas get the full list, see DatabaseCommand_loadOps.
+     */
+    QVariantList orderedguidsV() const;
+    void setDeltaV( const QVariantMap& delta );
+    QVariantMap deltaV() const;
+
 protected:
+    // after a failed exec, fetches the op again from the peer if that can help
+    void refetchIfNeeded();
+
     bool m_failed;
     bool m_applied;
+    // the delta didn't apply, the peer has to send the full list
+    bool m_needsRefetch;
     QStringList m_previous_rev_orderedguids;
     QString m_playlistguid;
     QString m_newrev, m_oldrev;
@@ -105,6 +124,10 @@ private:
     QList<Tomahawk::plentry_ptr> m_addedentries, m_entries;
 
     bool m_localOnly, m_metadataUpdate;
+
+    // ops against oldrev, only sent instead of m_orderedguids if m_deltaEncoded
+    QVariantList m_delta;
+    bool m_deltaEncoded;
 };
 
 }
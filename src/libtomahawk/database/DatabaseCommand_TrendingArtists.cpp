@@ -19,6 +19,7 @@
 #include "DatabaseCommand_TrendingArtists_p.h"
 
 #include "database/DatabaseImpl.h"
+#include "database/PlaybackAggregates.h"
 #include "Artist.h"
 
 #include <QDateTime>
@@ -59,10 +60,8 @@ DatabaseCommand_TrendingArtists::exec( DatabaseImpl* dbi )
 
         QString peersLastWeekSql = QString(
                     " SELECT COUNT(DISTINCT source ) "
-                    " FROM playback_log "
-                    " WHERE playback_log.source IS NOT NULL " // exclude self
-                    " AND playback_log.playtime >= %1 "
-                    ).arg( _1WeekAgo.toTime_t() );
+                    " FROM ( %1 ) "
+                    ).arg( PlaybackAggregates::timespanSql( _1WeekAgo.toTime_t(), -1, "source IS NOT NULL" ) ); // exclude self
         TomahawkSqlQuery query = dbi->newquery();
         query.prepare( peersLastWeekSql );
         query.exec();
@@ -74,16 +73,13 @@ DatabaseCommand_TrendingArtists::exec( DatabaseImpl* dbi )
 
 
     QString timespanSql = QString(
-                " SELECT COUNT(*) as counter, track.artist as artistid "
-                " FROM playback_log "
-                " JOIN track ON track.id = playback_log.track "
-                " WHERE playback_log.source IS NOT NULL " // exclude self
-                " AND playback_log.playtime >= %1 AND playback_log.playtime <= %2 "
-                " GROUP BY track.artist "
+                " SELECT SUM(plays) as counter, artist as artistid "
+                " FROM ( %1 ) "
+                " GROUP BY artist "
                 " HAVING counter > 0 "
                 );
-    QString lastWeekSql = timespanSql.arg( _1WeekAgo.toTime_t() ).arg( now.toTime_t() );
-    QString _1BeforeLastWeekSql = timespanSql.arg( _2WeeksAgo.toTime_t() ).arg( _1WeekAgo.toTime_t() );
+    QString lastWeekSql = timespanSql.arg( PlaybackAggregates::timespanSql( _1WeekAgo.toTime_t(), now.toTime_t(), "source IS NOT NULL" ) ); // exclude self
+    QString _1BeforeLastWeekSql = timespanSql.arg( PlaybackAggregates::timespanSql( _2WeeksAgo.toTime_t(), _1WeekAgo.toTime_t(), "source IS NOT NULL" ) );
     QString formula = QString(
                 " (  lastweek.counter /  weekbefore.counter ) "
                 " * "
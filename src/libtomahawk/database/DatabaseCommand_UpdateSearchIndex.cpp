@@ -20,6 +20,7 @@
 #include "DatabaseCommand_UpdateSearchIndex.h"
 
 #include <QSqlRecord>
+#include <QTime>
 
 #include "DatabaseImpl.h"
 #include "Source.h"
@@ -31,10 +32,11 @@
 namespace Tomahawk
 {
 
-DatabaseCommand_UpdateSearchIndex::DatabaseCommand_UpdateSearchIndex()
+DatabaseCommand_UpdateSearchIndex::DatabaseCommand_UpdateSearchIndex( bool rebuild )
     : DatabaseCommand()
+    , m_rebuild( rebuild )
 {
-    tDebug() << Q_FUNC_INFO << "Updating index.";
+    tDebug() << Q_FUNC_INFO << "Updating index. Rebuild:" << rebuild;
 }
 
 
@@ -47,10 +49,17 @@ DatabaseCommand_UpdateSearchIndex::~DatabaseCommand_UpdateSearchIndex()
 void
 DatabaseCommand_UpdateSearchIndex::exec( DatabaseImpl* db )
 {
-    db->m_fuzzyIndex->beginIndexing();
+    QTime t;
+    t.start();
 
+    db->m_fuzzyIndex->beginIndexing( m_rebuild );
+
+    // Rows in track and album are only ever appended, so everything above
+    // the highest indexed id is new
     TomahawkSqlQuery q = db->newquery();
-    q.exec( "SELECT track.id, track.name, artist.name, artist.id FROM track, artist WHERE artist.id = track.artist" );
+    q.prepare( "SELECT track.id, track.name, artist.name, artist.id FROM track, artist WHERE artist.id = track.artist AND track.id > ?" );
+    q.addBindValue( db->m_fuzzyIndex->lastTrackId() );
+    q.exec();
     while ( q.next() )
     {
         IndexData ida;
@@ -62,7 +71,9 @@ DatabaseCommand_UpdateSearchIndex::exec( DatabaseImpl* db )
         db->m_fuzzyIndex->appendFields( ida );
     }
 
-    q.exec( "SELECT album.id, album.name FROM album" );
+    q.prepare( "SELECT album.id, album.name FROM album WHERE album.id > ?" );
+    q.addBindValue( db->m_fuzzyIndex->lastAlbumId() );
+    q.exec();
     while ( q.next() )
     {
         IndexData ida;
@@ -72,9 +83,9 @@ DatabaseCommand_UpdateSearchIndex::exec( DatabaseImpl* db )
         db->m_fuzzyIndex->appendFields( ida );
     }
 
-    tDebug( LOGVERBOSE ) << "Building index finished.";
-
     db->m_fuzzyIndex->endIndexing();
+
+    tDebug( LOGVERBOSE ) << "Building index finished in" << t.elapsed() << "ms";
 }
 
 }
@@ -39,12 +39,19 @@ class DLLEXPORT DatabaseCommand_UpdateSearchIndex : public DatabaseCommand
 {
 Q_OBJECT
 public:
-    explicit DatabaseCommand_UpdateSearchIndex();
+    /**
+     * By default only tracks and albums that were added since the last update
+     * get indexed. A rebuild re-indexes everything from scratch.
+     */
+    explicit DatabaseCommand_UpdateSearchIndex( bool rebuild = false );
     virtual ~DatabaseCommand_UpdateSearchIndex();
 
     virtual QString commandname() const { return "updatesearchindex"; }
     virtual bool doesMutates() const { return true; }
     virtual void exec( DatabaseImpl* db );
+
+private:
+    bool m_rebuild;
 };
 
 }
@@ -48,9 +48,18 @@
 */
 #include "Schema.sql.h"
 
-#define CURRENT_SCHEMA_VERSION 31
+#define CURRENT_SCHEMA_VERSION 33
+#define BUSY_TIMEOUT 5000
+#define WAL_SIZE_LIMIT 64 * 1024 * 1024
+// SQLite allows at most 999 host parameters per statement
+#define MAX_ID_BATCH 500
+#define MAX_HOST_PARAMETERS 999
+// ... and at most 500 SELECTs in a compound statement
+#define MAX_COMPOUND_SELECT 500
 
 Tomahawk::DatabaseImpl::DatabaseImpl( const QString& dbname )
+    : m_idCache( new IdCache() )
+    , m_inTransaction( false )
 {
     QTime t;
     t.start();
@@ -81,7 +90,16 @@ Tomahawk::DatabaseImpl::DatabaseImpl( const QString& dbname )
     tLog() << "Database ID:" << m_dbid;
     init();
     query.exec( "PRAGMA auto_vacuum = FULL" );
+
+    // With a write-ahead log readers work on a snapshot and never wait for
+    // the writer, so long read-only commands keep running during big scans.
+    // The journal mode is persistent, secondary connections pick it up.
+    query.exec( "PRAGMA journal_mode = WAL" );
+    if ( query.next() && query.value( 0 ).toString().toLower() != "wal" )
+        tLog() << "Could not enable write-ahead logging, journal mode is" << query.value( 0 ).toString();
+
     query.exec( "PRAGMA synchronous = NORMAL" );
+    query.exec( QString( "PRAGMA journal_size_limit = %1" ).arg( WAL_SIZE_LIMIT ) );
 
     tDebug( LOGVERBOSE ) << "Tweaked db pragmas:" << t.elapsed();
 
@@ -100,29 +118,38 @@ Tomahawk::DatabaseImpl::DatabaseImpl( const QString& dbname )
 }
 
 
-Tomahawk::DatabaseImpl::DatabaseImpl( const QString& dbname, bool internal )
+Tomahawk::DatabaseImpl::DatabaseImpl( const QString& dbname, bool readOnly )
+    : m_idCache( new IdCache() )
+    , m_inTransaction( false )
 {
-    Q_UNUSED( internal );
     openDatabase( dbname, false );
-    init();
+    init( readOnly );
 }
 
 
 void
-Tomahawk::DatabaseImpl::init()
+Tomahawk::DatabaseImpl::init( bool readOnly )
 {
-    m_lastartid = m_lastalbid = m_lasttrkid = 0;
-
     TomahawkSqlQuery query = newquery();
 
      // make sqlite behave how we want:
     query.exec( "PRAGMA foreign_keys = ON" );
+
+    if ( readOnly )
+    {
+        // Connections of the read-only workers must never take the write lock
+        query.exec( "PRAGMA query_only = ON" );
+    }
 }
 
 
 Tomahawk::DatabaseImpl::~DatabaseImpl()
 {
-    tDebug() << "Shutting down database connection.";
+    tDebug() << "Shutting down database connection. Statement cache hits:" << m_statementCache.hits()
+             << "misses:" << m_statementCache.misses();
+
+    // cached statements have to be finalized before the connection goes away
+    m_statementCache.clear();
 
 /*
 #ifdef TOMAHAWK_QUERY_ANALYZE
@@ -144,7 +171,7 @@ TomahawkSqlQuery
 Tomahawk::DatabaseImpl::newquery()
 {
     QMutexLocker lock( &m_mutex );
-    return TomahawkSqlQuery( m_db );
+    return TomahawkSqlQuery( m_db, &m_statementCache );
 }
 
 
@@ -156,14 +183,57 @@ Tomahawk::DatabaseImpl::database()
 }
 
 
+bool
+Tomahawk::DatabaseImpl::beginTransaction()
+{
+    m_inTransaction = database().transaction();
+    return m_inTransaction;
+}
+
+
+bool
+Tomahawk::DatabaseImpl::commitTransaction()
+{
+    const bool ok = newquery().commitTransaction();
+    m_inTransaction = false;
+
+    if ( ok )
+    {
+        QHash< IdCache::Key, int >::const_iterator it = m_stagedIds.constBegin();
+        for ( ; it != m_stagedIds.constEnd(); ++it )
+        {
+            if ( it.value() )
+                m_idCache->insert( it.key().kind, it.key().artistId, it.key().sortname, it.value() );
+            else
+                m_idCache->insertMissing( it.key().kind, it.key().artistId, it.key().sortname );
+        }
+    }
+
+    m_stagedIds.clear();
+    return ok;
+}
+
+
+void
+Tomahawk::DatabaseImpl::rollbackTransaction()
+{
+    database().rollback();
+
+    // ids of rows inserted by the failed transaction are gone
+    m_inTransaction = false;
+    m_stagedIds.clear();
+}
+
+
 Tomahawk::DatabaseImpl*
-Tomahawk::DatabaseImpl::clone() const
+Tomahawk::DatabaseImpl::clone( bool readOnly ) const
 {
     QMutexLocker lock( &m_mutex );
 
-    DatabaseImpl* impl = new DatabaseImpl( m_db.databaseName(), true );
+    DatabaseImpl* impl = new DatabaseImpl( m_db.databaseName(), readOnly );
     impl->setDatabaseID( m_dbid );
     impl->setFuzzyIndex( m_fuzzyIndex );
+    impl->setIdCache( m_idCache );
     return impl;
 }
 
@@ -334,142 +404,348 @@ Tomahawk::DatabaseImpl::file( int fid )
 int
 Tomahawk::DatabaseImpl::artistId( const QString& name_orig, bool autoCreate )
 {
-    if ( m_lastart == name_orig )
-        return m_lastartid;
+    return lookupId( IdCache::Artist, 0, name_orig, autoCreate );
+}
 
-    int id = 0;
-    QString sortname = Tomahawk::DatabaseImpl::sortname( name_orig );
 
-    TomahawkSqlQuery query = newquery();
-    query.prepare( "SELECT id FROM artist WHERE sortname = ?" );
-    query.addBindValue( sortname );
-    query.exec();
-    if ( query.next() )
+int
+Tomahawk::DatabaseImpl::trackId( int artistid, const QString& name_orig, bool autoCreate )
+{
+    return lookupId( IdCache::Track, artistid, name_orig, autoCreate );
+}
+
+
+int
+Tomahawk::DatabaseImpl::albumId( int artistid, const QString& name_orig, bool autoCreate )
+{
+    if ( name_orig.isEmpty() )
     {
-        id = query.value( 0 ).toInt();
+        //qDebug() << Q_FUNC_INFO << "empty album name";
+        return 0;
     }
-    if ( id )
+
+    return lookupId( IdCache::Album, artistid, name_orig, autoCreate );
+}
+
+
+QHash< QString, int >
+Tomahawk::DatabaseImpl::artistIds( const QStringList& names, bool autoCreate )
+{
+    return lookupIds( IdCache::Artist, 0, names, autoCreate );
+}
+
+
+QHash< QString, int >
+Tomahawk::DatabaseImpl::trackIds( int artistid, const QStringList& names, bool autoCreate )
+{
+    return lookupIds( IdCache::Track, artistid, names, autoCreate );
+}
+
+
+QHash< QString, int >
+Tomahawk::DatabaseImpl::albumIds( int artistid, const QStringList& names, bool autoCreate )
+{
+    return lookupIds( IdCache::Album, artistid, names, autoCreate );
+}
+
+
+static QString
+idTable( Tomahawk::IdCache::Kind kind )
+{
+    switch ( kind )
     {
-        m_lastart = name_orig;
-        m_lastartid = id;
-        return id;
+        case Tomahawk::IdCache::Artist:
+            return "artist";
+        case Tomahawk::IdCache::Album:
+            return "album";
+        case Tomahawk::IdCache::Track:
+            return "track";
     }
 
-    if ( autoCreate )
+    return QString();
+}
+
+
+bool
+Tomahawk::DatabaseImpl::cachedId( IdCache::Kind kind, int artistid, const QString& sortname, int& id ) const
+{
+    if ( m_inTransaction )
     {
-        // not found, insert it.
-        query.prepare( "INSERT INTO artist(id,name,sortname) VALUES(NULL,?,?)" );
-        query.addBindValue( name_orig );
-        query.addBindValue( sortname );
-        if ( !query.exec() )
+        const IdCache::Key key = { kind, artistid, sortname };
+        QHash< IdCache::Key, int >::const_iterator it = m_stagedIds.constFind( key );
+        if ( it != m_stagedIds.constEnd() )
         {
-            tDebug() << "Failed to insert artist:" << name_orig;
-            return 0;
+            id = it.value();
+            return true;
         }
-
-        id = query.lastInsertId().toInt();
-        m_lastart = name_orig;
-        m_lastartid = id;
     }
 
-    return id;
+    return m_idCache->lookup( kind, artistid, sortname, id );
+}
+
+
+void
+Tomahawk::DatabaseImpl::cacheId( IdCache::Kind kind, int artistid, const QString& sortname, int id )
+{
+    // Even rows we only selected may be uncommitted ones of this transaction
+    if ( m_inTransaction )
+    {
+        const IdCache::Key key = { kind, artistid, sortname };
+        m_stagedIds.insert( key, id );
+    }
+    else if ( id )
+        m_idCache->insert( kind, artistid, sortname, id );
+    else
+        m_idCache->insertMissing( kind, artistid, sortname );
 }
 
 
 int
-Tomahawk::DatabaseImpl::trackId( int artistid, const QString& name_orig, bool autoCreate )
+Tomahawk::DatabaseImpl::lookupId( IdCache::Kind kind, int artistid, const QString& name_orig, bool autoCreate )
 {
+    const QString sortname = Tomahawk::DatabaseImpl::sortname( name_orig );
+
+    // A cached miss still has to go to the database when we may create the row
     int id = 0;
-    QString sortname = Tomahawk::DatabaseImpl::sortname( name_orig );
-    //if( ( id = m_artistcache[sortname] ) ) return id;
+    if ( cachedId( kind, artistid, sortname, id ) && ( id || !autoCreate ) )
+        return id;
 
     TomahawkSqlQuery query = newquery();
-    query.prepare( "SELECT id FROM track WHERE artist = ? AND sortname = ?" );
-    query.addBindValue( artistid );
+    if ( kind == IdCache::Artist )
+    {
+        query.prepare( "SELECT id FROM artist WHERE sortname = ?" );
+    }
+    else
+    {
+        query.prepare( QString( "SELECT id FROM %1 WHERE artist = ? AND sortname = ?" ).arg( idTable( kind ) ) );
+        query.addBindValue( artistid );
+    }
     query.addBindValue( sortname );
     query.exec();
-
     if ( query.next() )
     {
         id = query.value( 0 ).toInt();
     }
-    if ( id )
+
+    if ( !id && autoCreate )
+        id = insertId( kind, artistid, name_orig, sortname );
+
+    if ( id || !autoCreate )
+        cacheId( kind, artistid, sortname, id );
+
+    return id;
+}
+
+
+QHash< QString, int >
+Tomahawk::DatabaseImpl::lookupIds( IdCache::Kind kind, int artistid, const QStringList& names, bool autoCreate )
+{
+    QHash< QString, int > ids;
+
+    // Names that only differ in case or articles share a sortname and thus a row
+    QHash< QString, QStringList > pending;
+    foreach ( const QString& name, names )
     {
-        //m_trackcache[sortname]=id;
-        return id;
+        if ( ids.contains( name ) )
+            continue;
+
+        if ( kind == IdCache::Album && name.isEmpty() )
+        {
+            ids.insert( name, 0 );
+            continue;
+        }
+
+        const QString sortname = Tomahawk::DatabaseImpl::sortname( name );
+        int id = 0;
+        if ( cachedId( kind, artistid, sortname, id ) && ( id || !autoCreate ) )
+            ids.insert( name, id );
+        else if ( !pending[ sortname ].contains( name ) )
+            pending[ sortname ] << name;
     }
 
-    if ( autoCreate )
+    // Sorted, so each batch touches neighbouring pages of the sortname index
+    QStringList sortnames = pending.keys();
+    qSort( sortnames );
+    for ( int i = 0; i < sortnames.count(); i += MAX_ID_BATCH )
     {
-        // not found, insert it.
-        query.prepare( "INSERT INTO track(id,artist,name,sortname) VALUES(NULL,?,?,?)" );
-        query.addBindValue( artistid );
-        query.addBindValue( name_orig );
-        query.addBindValue( sortname );
-        if ( !query.exec() )
+        const QStringList chunk = sortnames.mid( i, MAX_ID_BATCH );
+
+        QStringList placeholders;
+        for ( int j = 0; j < chunk.count(); j++ )
+            placeholders << "?";
+
+        TomahawkSqlQuery query = newquery();
+        if ( kind == IdCache::Artist )
+        {
+            query.prepare( QString( "SELECT id, sortname FROM artist WHERE sortname IN (%1)" )
+                              .arg( placeholders.join( "," ) ) );
+        }
+        else
         {
-            tDebug() << "Failed to insert track:" << name_orig;
-            return 0;
+            query.prepare( QString( "SELECT id, sortname FROM %1 WHERE artist = ? AND sortname IN (%2)" )
+                              .arg( idTable( kind ) )
+                              .arg( placeholders.join( "," ) ) );
+            query.addBindValue( artistid );
         }
+        foreach ( const QString& sortname, chunk )
+            query.addBindValue( sortname );
+        query.exec();
+
+        while ( query.next() )
+        {
+            const int id = query.value( 0 ).toInt();
+            const QString sortname = query.value( 1 ).toString();
+
+            QHash< QString, QStringList >::iterator it = pending.find( sortname );
+            if ( it == pending.end() )
+                continue;
 
-        id = query.lastInsertId().toInt();
+            cacheId( kind, artistid, sortname, id );
+            foreach ( const QString& name, it.value() )
+                ids.insert( name, id );
+
+            pending.erase( it );
+        }
     }
 
-    return id;
+    // Whatever is left does not exist yet
+    QHash< QString, int > inserted;
+    if ( autoCreate && !pending.isEmpty() )
+        inserted = insertIds( kind, artistid, pending );
+
+    QHash< QString, QStringList >::const_iterator it = pending.constBegin();
+    for ( ; it != pending.constEnd(); ++it )
+    {
+        const int id = inserted.value( it.key() );
+        if ( id || !autoCreate )
+            cacheId( kind, artistid, it.key(), id );
+
+        foreach ( const QString& name, it.value() )
+            ids.insert( name, id );
+    }
+
+    return ids;
 }
 
 
-int
-Tomahawk::DatabaseImpl::albumId( int artistid, const QString& name_orig, bool autoCreate )
+QHash< QString, int >
+Tomahawk::DatabaseImpl::insertIds( IdCache::Kind kind, int artistid, const QHash< QString, QStringList >& names )
 {
-    if ( name_orig.isEmpty() )
+    QHash< QString, int > ids;
+
+    QStringList sortnames = names.keys();
+    qSort( sortnames );
+
+    const int columns = ( kind == IdCache::Artist ) ? 2 : 3;
+    const int batch = maxInsertRows( columns );
+    for ( int i = 0; i < sortnames.count(); i += batch )
     {
-        //qDebug() << Q_FUNC_INFO << "empty album name";
-        return 0;
+        const QStringList chunk = sortnames.mid( i, batch );
+
+        TomahawkSqlQuery query = newquery();
+        if ( kind == IdCache::Artist )
+            query.prepare( insertRowsSql( "INSERT INTO artist(name,sortname)", columns, chunk.count() ) );
+        else
+            query.prepare( insertRowsSql( QString( "INSERT INTO %1(artist,name,sortname)" ).arg( idTable( kind ) ), columns, chunk.count() ) );
+
+        foreach ( const QString& sortname, chunk )
+        {
+            if ( kind != IdCache::Artist )
+                query.addBindValue( artistid );
+            query.addBindValue( names.value( sortname ).first() );
+            query.addBindValue( sortname );
+        }
+
+        if ( !query.exec() )
+        {
+            // Insert them one by one, so only the broken ones are missing
+            tDebug() << "Failed to batch insert" << idTable( kind ) << "rows, falling back to single inserts";
+            foreach ( const QString& sortname, chunk )
+            {
+                const int id = insertId( kind, artistid, names.value( sortname ).first(), sortname );
+                if ( id )
+                    ids.insert( sortname, id );
+            }
+            continue;
+        }
+
+        // Read back the new ids
+        QStringList placeholders;
+        for ( int j = 0; j < chunk.count(); j++ )
+            placeholders << "?";
+
+        if ( kind == IdCache::Artist )
+        {
+            query.prepare( QString( "SELECT id, sortname FROM artist WHERE sortname IN (%1)" )
+                              .arg( placeholders.join( "," ) ) );
+        }
+        else
+        {
+            query.prepare( QString( "SELECT id, sortname FROM %1 WHERE artist = ? AND sortname IN (%2)" )
+                              .arg( idTable( kind ) )
+                              .arg( placeholders.join( "," ) ) );
+            query.addBindValue( artistid );
+        }
+        foreach ( const QString& sortname, chunk )
+            query.addBindValue( sortname );
+        query.exec();
+
+        while ( query.next() )
+            ids.insert( query.value( 1 ).toString(), query.value( 0 ).toInt() );
     }
 
-    if ( m_lastartid == artistid && m_lastalb == name_orig )
-        return m_lastalbid;
+    return ids;
+}
 
-    int id = 0;
-    QString sortname = Tomahawk::DatabaseImpl::sortname( name_orig );
-    //if( ( id = m_albumcache[sortname] ) ) return id;
 
+QString
+Tomahawk::DatabaseImpl::insertRowsSql( const QString& insertInto, int columns, int rows )
+{
+    QStringList placeholders;
+    for ( int i = 0; i < columns; i++ )
+        placeholders << "?";
+
+    // INSERT ... SELECT ... UNION ALL SELECT ... also works with SQLite versions
+    // that don't know about multiple rows in VALUES
+    const QString select = QString( "SELECT %1" ).arg( placeholders.join( "," ) );
+    QStringList selects;
+    for ( int i = 0; i < rows; i++ )
+        selects << select;
+
+    return QString( "%1 %2" ).arg( insertInto ).arg( selects.join( " UNION ALL " ) );
+}
+
+
+int
+Tomahawk::DatabaseImpl::maxInsertRows( int columns )
+{
+    return qMax( 1, qMin( MAX_COMPOUND_SELECT, MAX_HOST_PARAMETERS / qMax( 1, columns ) ) );
+}
+
+
+int
+Tomahawk::DatabaseImpl::insertId( IdCache::Kind kind, int artistid, const QString& name_orig, const QString& sortname )
+{
     TomahawkSqlQuery query = newquery();
-    query.prepare( "SELECT id FROM album WHERE artist = ? AND sortname = ?" );
-    query.addBindValue( artistid );
-    query.addBindValue( sortname );
-    query.exec();
-    if ( query.next() )
+    if ( kind == IdCache::Artist )
     {
-        id = query.value( 0 ).toInt();
+        query.prepare( "INSERT INTO artist(id,name,sortname) VALUES(NULL,?,?)" );
     }
-    if ( id )
+    else
     {
-        m_lastalb = name_orig;
-        m_lastalbid = id;
-        return id;
+        query.prepare( QString( "INSERT INTO %1(id,artist,name,sortname) VALUES(NULL,?,?,?)" ).arg( idTable( kind ) ) );
+        query.addBindValue( artistid );
     }
+    query.addBindValue( name_orig );
+    query.addBindValue( sortname );
 
-    if ( autoCreate )
+    if ( !query.exec() )
     {
-        // not found, insert it.
-        query.prepare( "INSERT INTO album(id,artist,name,sortname) VALUES(NULL,?,?,?)" );
-        query.addBindValue( artistid );
-        query.addBindValue( name_orig );
-        query.addBindValue( sortname );
-        if( !query.exec() )
-        {
-            tDebug() << "Failed to insert album:" << name_orig;
-            return 0;
-        }
-
-        id = query.lastInsertId().toInt();
-        m_lastalb = name_orig;
-        m_lastalbid = id;
+        tDebug() << "Failed to insert" << idTable( kind ) << ":" << name_orig;
+        return 0;
     }
 
-    return id;
+    return query.lastInsertId().toInt();
 }
 
 
@@ -498,6 +774,32 @@ Tomahawk::DatabaseImpl::search( const Tomahawk::query_ptr& query, uint limit )
 }
 
 
+QHash< Tomahawk::QID, QList< QPair<int, float> > >
+Tomahawk::DatabaseImpl::search( const QList< Tomahawk::query_ptr >& queries, uint limit )
+{
+    QHash< Tomahawk::QID, QList< QPair<int, float> > > resultshash;
+
+    const QHash< Tomahawk::QID, QMap< int, float > > resultsmaps = m_fuzzyIndex->search( queries );
+    QHash< Tomahawk::QID, QMap< int, float > >::const_iterator it = resultsmaps.constBegin();
+    for ( ; it != resultsmaps.constEnd(); ++it )
+    {
+        QList< QPair<int, float> > resultslist;
+        foreach ( int i, it.value().keys() )
+        {
+            resultslist << QPair<int, float>( i, (float)it.value().value( i ) );
+        }
+        qSort( resultslist.begin(), resultslist.end(), Tomahawk::DatabaseImpl::scorepairSorter );
+
+        if ( limit && resultslist.count() > (int)limit )
+            resultslist = resultslist.mid( 0, limit );
+
+        resultshash.insert( it.key(), resultslist );
+    }
+
+    return resultshash;
+}
+
+
 QList< QPair<int, float> >
 Tomahawk::DatabaseImpl::searchAlbum( const Tomahawk::query_ptr& query, uint limit )
 {
@@ -760,7 +1062,9 @@ Tomahawk::DatabaseImpl::openDatabase( const QString& dbname, bool checkSchema )
 
         QSqlDatabase db = QSqlDatabase::addDatabase( sqlDriver, connName );
         db.setDatabaseName( dbname );
-        db.setConnectOptions( "QSQLITE_ENABLE_SHARED_CACHE=1" );
+        // No shared cache: it serializes all connections on table locks and
+        // would make readers wait for the writer despite the WAL journal.
+        db.setConnectOptions( QString( "QSQLITE_BUSY_TIMEOUT=%1" ).arg( BUSY_TIMEOUT ) );
         if ( !db.open() )
         {
             tLog() << "Failed to open database" << dbname << "with driver" << sqlDriver;
@@ -32,8 +32,12 @@
 #include <QSqlQuery>
 #include <QHash>
 #include <QThread>
+#include <QSharedPointer>
+#include <QStringList>
 
 #include "DllMacro.h"
+#include "IdCache.h"
+#include "SqlStatementCache.h"
 #include "TomahawkSqlQuery.h"
 #include "Typedefs.h"
 
@@ -55,16 +59,41 @@ public:
     DatabaseImpl( const QString& dbname );
     ~DatabaseImpl();
 
-    DatabaseImpl* clone() const;
+    DatabaseImpl* clone( bool readOnly = false ) const;
 
     TomahawkSqlQuery newquery();
     QSqlDatabase& database();
+    const SqlStatementCache& statementCache() const { return m_statementCache; }
 
     int artistId( const QString& name_orig, bool autoCreate ); //also for composers!
     int trackId( int artistid, const QString& name_orig, bool autoCreate );
     int albumId( int artistid, const QString& name_orig, bool autoCreate );
 
+    // Batched versions of the above, one query per few hundred names. Keyed by the given names.
+    QHash< QString, int > artistIds( const QStringList& names, bool autoCreate );
+    QHash< QString, int > trackIds( int artistid, const QStringList& names, bool autoCreate );
+    QHash< QString, int > albumIds( int artistid, const QStringList& names, bool autoCreate );
+    IdCache* idCache() const { return m_idCache.data(); }
+
+    /**
+     * Transaction of the writer. Ids looked up or created while it is open
+     * only reach the shared IdCache once it committed, so other connections
+     * never see rows they can't read yet.
+     */
+    bool beginTransaction();
+    bool commitTransaction();
+    void rollbackTransaction();
+
+    /**
+     * Statement inserting several rows at once, each with the given number of
+     * bound values. insertInto names the table, e.g. "INSERT INTO file_join(file, artist)".
+     */
+    static QString insertRowsSql( const QString& insertInto, int columns, int rows );
+    // How many rows of that many columns fit into a single insertRowsSql() statement
+    static int maxInsertRows( int columns );
+
     QList< QPair<int, float> > search( const Tomahawk::query_ptr& query, uint limit = 0 );
+    QHash< Tomahawk::QID, QList< QPair<int, float> > > search( const QList< Tomahawk::query_ptr >& queries, uint limit = 0 );
     QList< QPair<int, float> > searchAlbum( const Tomahawk::query_ptr& query, uint limit = 0 );
     QList< int > getTrackFids( int tid );
 
@@ -94,21 +123,33 @@ signals:
     void schemaUpdateDone();
 
 private:
-    DatabaseImpl( const QString& dbname, bool internal );
+    DatabaseImpl( const QString& dbname, bool readOnly );
     void setFuzzyIndex( DatabaseFuzzyIndex* fi ) { m_fuzzyIndex = fi; }
     void setDatabaseID( const QString& dbid ) { m_dbid = dbid; }
+    void setIdCache( const QSharedPointer< IdCache >& cache ) { m_idCache = cache; }
 
-    void init();
+    void init( bool readOnly = false );
     bool openDatabase( const QString& dbname, bool checkSchema = true );
     bool updateSchema( int oldVersion );
     void dumpDatabase();
     QString cleanSql( const QString& sql );
 
+    int lookupId( IdCache::Kind kind, int artistid, const QString& name_orig, bool autoCreate );
+    QHash< QString, int > lookupIds( IdCache::Kind kind, int artistid, const QStringList& names, bool autoCreate );
+    int insertId( IdCache::Kind kind, int artistid, const QString& name_orig, const QString& sortname );
+    // Inserts a row per sortname, named after the first of its names. Returns the ids keyed by sortname.
+    QHash< QString, int > insertIds( IdCache::Kind kind, int artistid, const QHash< QString, QStringList >& names );
+    bool cachedId( IdCache::Kind kind, int artistid, const QString& sortname, int& id ) const;
+    void cacheId( IdCache::Kind kind, int artistid, const QString& sortname, int id );
+
     bool m_ready;
     QSqlDatabase m_db;
+    SqlStatementCache m_statementCache;
 
-    QString m_lastart, m_lastalb, m_lasttrk;
-    int m_lastartid, m_lastalbid, m_lasttrkid;
+    QSharedPointer< IdCache > m_idCache;
+    // ids of the open transaction, published on commit. 0 for missing rows.
+    bool m_inTransaction;
+    QHash< IdCache::Key, int > m_stagedIds;
 
     QString m_dbid;
     Tomahawk::DatabaseFuzzyIndex* m_fuzzyIndex;
@@ -39,6 +39,7 @@ public:
 
 public slots:
     virtual void resolve( const Tomahawk::query_ptr& query );
+    virtual void resolveBatch( const QList< Tomahawk::query_ptr >& queries );
 
 private slots:
     void gotResults( const Tomahawk::QID qid, QList< Tomahawk::result_ptr> results );
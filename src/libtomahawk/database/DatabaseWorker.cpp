@@ -158,12 +158,14 @@ DatabaseWorker::doWork()
     DatabaseImpl* impl = Database::instance()->impl();
     if ( cmd->doesMutates() )
     {
-        bool transok = impl->database().transaction();
+        bool transok = impl->beginTransaction();
         Q_ASSERT( transok );
         Q_UNUSED( transok );
     }
 
     unsigned int completed = 0;
+    // an op of the group has to be fetched again, so must all after it
+    bool refetch = false;
     try
     {
         bool finished = false;
@@ -189,10 +191,16 @@ DatabaseWorker::doWork()
                     }
                     else
                     {
+                        if ( ((DatabaseCommandLoggable*)cmd.data())->needsRefetch() )
+                        {
+                            tLog() << "Op" << cmd->guid() << "of source" << cmd->source()->id() << "has to be fetched again";
+                            refetch = true;
+                        }
+
                         // Make a note of the last guid we applied for this source
                         // so we can always request just the newer ops in future.
                         //
-                        if ( !cmd->singletonCmd() )
+                        if ( !cmd->singletonCmd() && !refetch )
                         {
                             TomahawkSqlQuery query = impl->newquery();
                             query.prepare( "UPDATE source SET lastop = ? WHERE id = ?" );
@@ -227,7 +235,7 @@ DatabaseWorker::doWork()
             if ( cmd->doesMutates() )
             {
                 qDebug() << "Committing" << cmd->commandname() << cmd->guid();
-                if ( !impl->newquery().commitTransaction() )
+                if ( !impl->commitTransaction() )
                 {
                     tDebug() << "FAILED TO COMMIT TRANSACTION*";
                     throw "commit failed";
@@ -258,7 +266,9 @@ DatabaseWorker::doWork()
                  << endl;
 
         if ( cmd->doesMutates() )
-            impl->database().rollback();
+        {
+            impl->rollbackTransaction();
+        }
 
         Q_ASSERT( false );
     }
@@ -266,7 +276,9 @@ DatabaseWorker::doWork()
     {
         qDebug() << "Uncaught exception processing dbcmd";
         if ( cmd->doesMutates() )
-            impl->database().rollback();
+        {
+            impl->rollbackTransaction();
+        }
 
         Q_ASSERT( false );
         throw;
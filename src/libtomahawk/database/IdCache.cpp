@@ -0,0 +1,92 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "IdCache.h"
+
+using namespace Tomahawk;
+
+
+IdCache::IdCache( int shardCapacity )
+    : m_shardCapacity( shardCapacity )
+{
+}
+
+
+IdCache::Shard&
+IdCache::shard( const Key& key ) const
+{
+    return m_shards[ qHash( key ) % ShardCount ];
+}
+
+
+bool
+IdCache::lookup( Kind kind, int artistId, const QString& sortname, int& id ) const
+{
+    const Key key = { kind, artistId, sortname };
+    Shard& s = shard( key );
+
+    QReadLocker lock( &s.lock );
+    QHash< Key, int >::const_iterator it = s.ids.constFind( key );
+    if ( it == s.ids.constEnd() )
+        return false;
+
+    id = it.value();
+    return true;
+}
+
+
+void
+IdCache::insert( Kind kind, int artistId, const QString& sortname, int id )
+{
+    const Key key = { kind, artistId, sortname };
+    Shard& s = shard( key );
+
+    QWriteLocker lock( &s.lock );
+    // Cheaper than tracking recency, a full shard simply starts over
+    if ( s.ids.count() >= m_shardCapacity && !s.ids.contains( key ) )
+        s.ids.clear();
+
+    s.ids.insert( key, id );
+}
+
+
+void
+IdCache::insertMissing( Kind kind, int artistId, const QString& sortname )
+{
+    const Key key = { kind, artistId, sortname };
+    Shard& s = shard( key );
+
+    QWriteLocker lock( &s.lock );
+    if ( s.ids.contains( key ) )
+        return;
+
+    if ( s.ids.count() >= m_shardCapacity )
+        s.ids.clear();
+
+    s.ids.insert( key, 0 );
+}
+
+
+void
+IdCache::clear()
+{
+    for ( int i = 0; i < ShardCount; i++ )
+    {
+        QWriteLocker lock( &m_shards[ i ].lock );
+        m_shards[ i ].ids.clear();
+    }
+}
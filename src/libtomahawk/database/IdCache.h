@@ -0,0 +1,100 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef IDCACHE_H
+#define IDCACHE_H
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+#include "DllMacro.h"
+
+namespace Tomahawk
+{
+
+/**
+ * Thread-safe sortname -> id cache for the artist, album and track tables,
+ * shared by all connections of a database.
+ *
+ * Entries are spread over independently locked shards so lookups from the
+ * worker threads don't contend. Names known to be missing are cached with
+ * id 0; inserting the row later replaces that entry. The writer only
+ * stores ids once their transaction committed, see DatabaseImpl.
+ */
+class DLLEXPORT IdCache
+{
+public:
+    enum Kind
+    {
+        Artist = 0,
+        Album,
+        Track
+    };
+
+    explicit IdCache( int shardCapacity = 8192 );
+
+    /**
+     * Returns true if the cache knows the entry. id is 0 if the row is
+     * known not to exist.
+     */
+    bool lookup( Kind kind, int artistId, const QString& sortname, int& id ) const;
+
+    void insert( Kind kind, int artistId, const QString& sortname, int id );
+    // Does not override an id another connection has already stored
+    void insertMissing( Kind kind, int artistId, const QString& sortname );
+
+    // Forgets everything
+    void clear();
+
+    struct Key
+    {
+        Kind kind;
+        int artistId;
+        QString sortname;
+
+        bool operator==( const Key& other ) const
+        {
+            return kind == other.kind && artistId == other.artistId && sortname == other.sortname;
+        }
+    };
+
+private:
+    enum { ShardCount = 16 };
+
+    struct Shard
+    {
+        mutable QReadWriteLock lock;
+        QHash< Key, int > ids;
+    };
+
+    Shard& shard( const Key& key ) const;
+
+    int m_shardCapacity;
+    mutable Shard m_shards[ ShardCount ];
+};
+
+
+inline uint
+qHash( const IdCache::Key& key )
+{
+    return qHash( key.sortname ) ^ ( uint( key.artistId ) * 31 + uint( key.kind ) );
+}
+
+}
+
+#endif // IDCACHE_H
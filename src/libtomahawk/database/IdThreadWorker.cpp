@@ -27,6 +27,8 @@
 #include "PlaylistEntry.h"
 #include "Source.h"
 
+#include <QSet>
+
 #define ID_THREAD_DEBUG 0
 
 #include <QtCore/qfutureinterface.h>
@@ -175,55 +177,15 @@ IdThreadWorker::run()
 
         while ( !s_workQueue.isEmpty() )
         {
-            QueueItem* item = s_workQueue.dequeue();
+            // Take everything that piled up, it gets resolved in one go
+            QList< QueueItem* > items = s_workQueue;
+            s_workQueue.clear();
             s_mutex.unlock();
 
 #if ID_THREAD_DEBUG
-            switch ( item->type )
-            {
-                case ArtistType:
-                {
-                    tDebug() << "WITH CONTENTS:" << item->artist->name();
-                    break;
-                }
-                case AlbumType:
-                {
-                    tDebug() << "WITH CONTENTS:" << item->album->artist()->name() + " _ " + item->album->name();
-                    break;
-                }
-                case TrackType:
-                {
-                    tDebug() << "WITH CONTENTS:" << item->track->artist() + " _ " + item->track->track();
-                    break;
-                }
-            }
+            tDebug() << "WITH" << items.count() << "ITEMS";
 #endif
-            if ( item->type == ArtistType )
-            {
-                unsigned int id = m_impl->artistId( item->artist->name(), item->create );
-                item->promise.reportFinished( &id );
-
-                item->artist->id();
-                delete item;
-            }
-            else if ( item->type == AlbumType )
-            {
-                unsigned int artistId = m_impl->artistId( item->album->artist()->name(), item->create );
-                unsigned int albumId = m_impl->albumId( artistId, item->album->name(), item->create );
-                item->promise.reportFinished( &albumId );
-
-                item->album->id();
-                delete item;
-            }
-            else if ( item->type == TrackType )
-            {
-                unsigned int artistId = m_impl->artistId( item->track->artist(), item->create );
-                unsigned int trackId = m_impl->trackId( artistId, item->track->track(), item->create );
-                item->promise.reportFinished( &trackId );
-
-                item->track->trackId();
-                delete item;
-            }
+            processItems( items );
 
             s_mutex.lock();
         }
@@ -231,3 +193,87 @@ IdThreadWorker::run()
         s_mutex.unlock();
     }
 }
+
+
+static QString
+artistName( const QueueItem* item )
+{
+    switch ( item->type )
+    {
+        case ArtistType:
+            return item->artist->name();
+        case AlbumType:
+            return item->album->artist()->name();
+        case TrackType:
+            return item->track->artist();
+    }
+
+    return QString();
+}
+
+
+void
+IdThreadWorker::processItems( const QList< QueueItem* >& items )
+{
+    // Duplicate requests are only looked up once. Names that some request
+    // wants created are resolved with autoCreate, everything else without.
+    QSet< QString > createArtists, lookupArtists;
+    foreach ( const QueueItem* item, items )
+    {
+        if ( item->create )
+            createArtists << artistName( item );
+        else
+            lookupArtists << artistName( item );
+    }
+    lookupArtists.subtract( createArtists );
+
+    QHash< QString, int > artistIds = m_impl->artistIds( createArtists.toList(), true );
+    artistIds.unite( m_impl->artistIds( lookupArtists.toList(), false ) );
+
+    // Albums and tracks are batched per artist
+    typedef QPair< int, bool > ArtistKey;
+    QHash< ArtistKey, QSet< QString > > albums, tracks;
+    foreach ( const QueueItem* item, items )
+    {
+        const int artistId = artistIds.value( artistName( item ) );
+        if ( item->type == AlbumType )
+            albums[ ArtistKey( artistId, item->create ) ] << item->album->name();
+        else if ( item->type == TrackType )
+            tracks[ ArtistKey( artistId, item->create ) ] << item->track->track();
+    }
+
+    QHash< ArtistKey, QHash< QString, int > > albumIds, trackIds;
+    foreach ( const ArtistKey& key, albums.keys() )
+        albumIds[ key ] = m_impl->albumIds( key.first, albums.value( key ).toList(), key.second );
+    foreach ( const ArtistKey& key, tracks.keys() )
+        trackIds[ key ] = m_impl->trackIds( key.first, tracks.value( key ).toList(), key.second );
+
+    foreach ( QueueItem* item, items )
+    {
+        const ArtistKey key( artistIds.value( artistName( item ) ), item->create );
+
+        if ( item->type == ArtistType )
+        {
+            unsigned int id = key.first;
+            item->promise.reportFinished( &id );
+
+            item->artist->id();
+        }
+        else if ( item->type == AlbumType )
+        {
+            unsigned int albumId = albumIds.value( key ).value( item->album->name() );
+            item->promise.reportFinished( &albumId );
+
+            item->album->id();
+        }
+        else if ( item->type == TrackType )
+        {
+            unsigned int trackId = trackIds.value( key ).value( item->track->track() );
+            item->promise.reportFinished( &trackId );
+
+            item->track->trackId();
+        }
+
+        delete item;
+    }
+}
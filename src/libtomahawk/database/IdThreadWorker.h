@@ -48,6 +48,8 @@ public:
     static void getTrackId( const trackdata_ptr& trackData, bool autoCreate = false );
 
 private:
+    void processItems( const QList< QueueItem* >& items );
+
     Database* m_db;
     DatabaseImpl* m_impl;
     bool m_stop;
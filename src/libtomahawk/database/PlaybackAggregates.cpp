@@ -0,0 +1,107 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PlaybackAggregates.h"
+
+#include "DatabaseImpl.h"
+#include "TomahawkSqlQuery.h"
+
+#define SECS_PER_DAY 86400
+
+using namespace Tomahawk;
+
+
+void
+PlaybackAggregates::addPlayback( DatabaseImpl* dbi, const QVariant& source, int trackId, int artistId,
+                                 uint playtime, uint secsPlayed )
+{
+    const qint64 day = playtime / SECS_PER_DAY;
+
+    TomahawkSqlQuery query = dbi->newquery();
+    query.prepare( "UPDATE playback_log_daily SET plays = plays + 1, secs_played = secs_played + ? "
+                   "WHERE day = ? AND track = ? AND source IS ?" );
+    query.bindValue( 0, secsPlayed );
+    query.bindValue( 1, day );
+    query.bindValue( 2, trackId );
+    query.bindValue( 3, source );
+    query.exec();
+
+    if ( query.numRowsAffected() > 0 )
+        return;
+
+    query.prepare( "INSERT INTO playback_log_daily(day, source, track, artist, plays, secs_played) "
+                   "VALUES (?, ?, ?, ?, 1, ?)" );
+    query.bindValue( 0, day );
+    query.bindValue( 1, source );
+    query.bindValue( 2, trackId );
+    query.bindValue( 3, artistId );
+    query.bindValue( 4, secsPlayed );
+    query.exec();
+}
+
+
+QString
+PlaybackAggregates::timespanSql( qint64 from, qint64 to, const QString& filter )
+{
+    const QString filterToken = filter.isEmpty() ? QString() : QString( "AND ( %1 ) " ).arg( filter );
+    const QString logSql = QString(
+                "SELECT playback_log.source AS source, playback_log.track AS track, track.artist AS artist, "
+                "1 AS plays, playback_log.secs_played AS secs_played "
+                "FROM playback_log JOIN track ON track.id = playback_log.track "
+                "WHERE ( %1 ) %2"
+                );
+
+    from = qMax( (qint64)0, from );
+    const qint64 firstDay = ( from + SECS_PER_DAY - 1 ) / SECS_PER_DAY;
+    const qint64 lastDay = to < 0 ? -1 : ( to + 1 ) / SECS_PER_DAY - 1;
+
+    if ( to >= 0 && firstDay > lastDay )
+    {
+        // Not a single whole day
+        return logSql.arg( QString( "playback_log.playtime >= %1 AND playback_log.playtime <= %2" ).arg( from ).arg( to ) )
+                     .arg( filterToken );
+    }
+
+    QString daysToken = QString( "day >= %1" ).arg( firstDay );
+    QString edgesToken = QString( "playback_log.playtime >= %1 AND playback_log.playtime < %2" ).arg( from ).arg( firstDay * SECS_PER_DAY );
+    if ( to >= 0 )
+    {
+        daysToken += QString( " AND day <= %1" ).arg( lastDay );
+        edgesToken = QString( "( %1 ) OR ( playback_log.playtime >= %2 AND playback_log.playtime <= %3 )" )
+                        .arg( edgesToken ).arg( ( lastDay + 1 ) * SECS_PER_DAY ).arg( to );
+    }
+
+    return QString(
+            "SELECT source, track, artist, plays, secs_played "
+            "FROM playback_log_daily "
+            "WHERE %1 %2"
+            "UNION ALL "
+            "%3"
+            ).arg( daysToken )
+             .arg( filterToken )
+             .arg( logSql.arg( edgesToken ).arg( filterToken ) );
+}
+
+
+QString
+PlaybackAggregates::allTimeSql( const QString& filter )
+{
+    return QString(
+            "SELECT source, track, artist, plays, secs_played "
+            "FROM playback_log_daily "
+            "%1"
+            ).arg( filter.isEmpty() ? QString() : QString( "WHERE %1" ).arg( filter ) );
+}
@@ -0,0 +1,61 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PLAYBACKAGGREGATES_H
+#define PLAYBACKAGGREGATES_H
+
+#include <QString>
+#include <QVariant>
+
+#include "DllMacro.h"
+
+namespace Tomahawk
+{
+
+class DatabaseImpl;
+
+/**
+ * The playback_log_daily table sums up the playback_log per day, source
+ * and track, so charts only have to read a row per track and day instead
+ * of every single play.
+ */
+class DLLEXPORT PlaybackAggregates
+{
+public:
+    /// Accounts for a play that was just inserted into the playback_log
+    static void addPlayback( DatabaseImpl* dbi, const QVariant& source, int trackId, int artistId,
+                             uint playtime, uint secsPlayed );
+
+    /**
+     * A subquery with the columns source, track, artist, plays and
+     * secs_played for all plays between from and to (both inclusive).
+     * Whole days come from playback_log_daily, only the partial days at both
+     * ends of the timespan are read from the playback_log, so the result is
+     * the same as counting the playback_log.
+     *
+     * A negative to means no upper limit. filter is applied to both, it may
+     * refer to source, track and artist.
+     */
+    static QString timespanSql( qint64 from, qint64 to, const QString& filter = QString() );
+
+    /// Same as timespanSql(), but for all plays ever
+    static QString allTimeSql( const QString& filter = QString() );
+};
+
+}
+
+#endif // PLAYBACKAGGREGATES_H
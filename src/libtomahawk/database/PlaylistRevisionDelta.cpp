@@ -0,0 +1,291 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PlaylistRevisionDelta.h"
+
+#include "utils/Json.h"
+#include "utils/Logger.h"
+
+#include "DatabaseImpl.h"
+#include "TomahawkSqlQuery.h"
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+// Store the full list at least every that many revisions
+#define SNAPSHOT_INTERVAL 32
+// Give up on revision chains longer than that, they can only be broken
+#define MAX_DELTA_CHAIN 1024
+
+using namespace Tomahawk;
+
+namespace
+{
+    struct Link
+    {
+        QString prev;
+        QString next;
+    };
+
+    // Doubly linked list of guids, closed into a ring by the empty guid which
+    // stands for the front of the playlist
+    typedef QHash< QString, Link > LinkedGuids;
+
+    void
+    unlinkGuid( LinkedGuids& links, const QString& guid )
+    {
+        const Link link = links.take( guid );
+        links[ link.prev ].next = link.next;
+        links[ link.next ].prev = link.prev;
+    }
+
+    bool
+    insertGuidAfter( LinkedGuids& links, const QString& guid, const QString& after )
+    {
+        LinkedGuids::iterator it = links.find( after );
+        if ( it == links.end() )
+            return false;
+
+        Link link;
+        link.prev = after;
+        link.next = it->next;
+        it->next = guid;
+        links[ link.next ].prev = guid;
+        links.insert( guid, link );
+        return true;
+    }
+
+
+    QVariant
+    makeOp( const QString& type, const QString& guid, const QString& after = QString() )
+    {
+        QVariantList op;
+        op << type << guid;
+        if ( type != "-" )
+            op << after;
+
+        return op;
+    }
+}
+
+
+bool
+PlaylistRevisionDelta::diff( const QStringList& from, const QStringList& to, QVariantList& ops )
+{
+    ops.clear();
+
+    QHash< QString, int > toPositions;
+    toPositions.reserve( to.count() );
+    for ( int i = 0; i < to.count(); i++ )
+    {
+        if ( to.at( i ).isEmpty() || toPositions.contains( to.at( i ) ) )
+            return false;
+
+        toPositions.insert( to.at( i ), i );
+    }
+
+    // Removals first, and the positions in to of all entries we keep, in the order of from
+    QSet< QString > fromGuids;
+    fromGuids.reserve( from.count() );
+    QVector< int > kept;
+    kept.reserve( from.count() );
+    foreach ( const QString& guid, from )
+    {
+        if ( guid.isEmpty() || fromGuids.contains( guid ) )
+            return false;
+        fromGuids.insert( guid );
+
+        QHash< QString, int >::const_iterator it = toPositions.constFind( guid );
+        if ( it == toPositions.constEnd() )
+            ops << makeOp( "-", guid );
+        else
+            kept << it.value();
+    }
+
+    // The longest run of kept entries that is still in order stays where it
+    // is, all other kept entries get moved
+    QVector< int > tails;
+    QVector< int > previous( kept.count(), -1 );
+    for ( int i = 0; i < kept.count(); i++ )
+    {
+        int lo = 0;
+        int hi = tails.count();
+        while ( lo < hi )
+        {
+            const int mid = ( lo + hi ) / 2;
+            if ( kept.at( tails.at( mid ) ) < kept.at( i ) )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if ( lo > 0 )
+            previous[ i ] = tails.at( lo - 1 );
+        if ( lo == tails.count() )
+            tails << i;
+        else
+            tails[ lo ] = i;
+    }
+
+    QVector< bool > inPlace( to.count(), false );
+    for ( int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at( i ) )
+        inPlace[ kept.at( i ) ] = true;
+
+    // Walking to in order, every entry's predecessor is already in place
+    for ( int i = 0; i < to.count(); i++ )
+    {
+        if ( inPlace.at( i ) )
+            continue;
+
+        const QString& guid = to.at( i );
+        ops << makeOp( fromGuids.contains( guid ) ? ">" : "+", guid, i > 0 ? to.at( i - 1 ) : QString() );
+    }
+
+    return true;
+}
+
+
+bool
+PlaylistRevisionDelta::apply( const QStringList& base, const QList< QVariantList >& deltas, QStringList& result )
+{
+    LinkedGuids links;
+    links.reserve( base.count() + 1 );
+    links.insert( QString(), Link() );
+
+    QString last;
+    foreach ( const QString& guid, base )
+    {
+        if ( guid.isEmpty() || links.contains( guid ) )
+            return false;
+
+        insertGuidAfter( links, guid, last );
+        last = guid;
+    }
+
+    foreach ( const QVariantList& ops, deltas )
+    {
+        foreach ( const QVariant& v, ops )
+        {
+            const QVariantList op = v.toList();
+            const QString type = op.value( 0 ).toString();
+            const QString guid = op.value( 1 ).toString();
+            if ( guid.isEmpty() )
+                return false;
+
+            const bool known = links.contains( guid );
+            if ( type == "-" )
+            {
+                if ( !known )
+                    return false;
+
+                unlinkGuid( links, guid );
+            }
+            else if ( type == "+" || type == ">" )
+            {
+                if ( known != ( type == ">" ) )
+                    return false;
+
+                if ( known )
+                    unlinkGuid( links, guid );
+                if ( !insertGuidAfter( links, guid, op.value( 2 ).toString() ) )
+                    return false;
+            }
+            else
+                return false;
+        }
+    }
+
+    result.clear();
+    result.reserve( links.count() - 1 );
+    for ( QString guid = links.value( QString() ).next; !guid.isEmpty(); guid = links.value( guid ).next )
+        result << guid;
+
+    return true;
+}
+
+
+bool
+PlaylistRevisionDelta::isSnapshotDue( int distance, int opCount, int entryCount )
+{
+    return distance >= SNAPSHOT_INTERVAL || opCount * 2 >= entryCount;
+}
+
+
+bool
+PlaylistRevisionDelta::loadEntries( DatabaseImpl* dbi, const QString& revisionGuid, QStringList& guids, int* distance )
+{
+    guids.clear();
+    if ( distance )
+        *distance = 0;
+
+    TomahawkSqlQuery query = dbi->newquery();
+    query.prepare( "SELECT entries, delta, previous_revision FROM playlist_revision WHERE guid = ?" );
+
+    QStringList base;
+    QList< QVariantList > deltas;
+    QString revision = revisionGuid;
+    while ( true )
+    {
+        query.bindValue( 0, revision );
+        if ( !query.exec() || !query.next() )
+        {
+            if ( !deltas.isEmpty() )
+                tLog() << "Missing revision" << revision << "to load playlist revision" << revisionGuid;
+            return false;
+        }
+
+        // Revisions stored before deltas existed have neither, they are empty
+        if ( !query.value( 0 ).isNull() || query.value( 1 ).isNull() )
+        {
+            base = TomahawkUtils::parseJson( query.value( 0 ).toByteArray() ).toStringList();
+            break;
+        }
+
+        bool ok;
+        const QVariant delta = TomahawkUtils::parseJson( query.value( 1 ).toByteArray(), &ok );
+        if ( !ok || delta.type() != QVariant::List )
+        {
+            tLog() << "Invalid delta in playlist revision" << revision;
+            return false;
+        }
+
+        deltas.prepend( delta.toList() );
+        revision = query.value( 2 ).toString();
+        if ( revision.isEmpty() || deltas.count() > MAX_DELTA_CHAIN )
+        {
+            tLog() << "No full entry list found for playlist revision" << revisionGuid;
+            return false;
+        }
+    }
+
+    if ( distance )
+        *distance = deltas.count();
+
+    if ( deltas.isEmpty() )
+    {
+        guids = base;
+        return true;
+    }
+
+    if ( !PlaylistRevisionDelta::apply( base, deltas, guids ) )
+    {
+        tLog() << "Failed to apply deltas to load playlist revision" << revisionGuid;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,73 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PLAYLISTREVISIONDELTA_H
+#define PLAYLISTREVISIONDELTA_H
+
+#include <QList>
+#include <QStringList>
+#include <QVariantList>
+
+#include "DllMacro.h"
+
+namespace Tomahawk
+{
+
+class DatabaseImpl;
+
+/**
+ * Playlist revisions are stored (and synced) as the ordered changes against
+ * their previous revision. Every few revisions the full list of entry guids
+ * is stored again, so loading a revision never has to apply many deltas.
+ *
+ * A delta is a list of ops, each op being a list itself:
+ *   [ "-", guid ]         removes the entry
+ *   [ "+", guid, after ]  inserts the entry after the entry after
+ *   [ ">", guid, after ]  moves the entry after the entry after
+ * An empty after means the front of the playlist. Ops are applied in order.
+ */
+class DLLEXPORT PlaylistRevisionDelta
+{
+public:
+    /**
+     * Computes the ops turning from into to, moving as few entries as
+     * possible. Fails if either list has empty or duplicate guids.
+     */
+    static bool diff( const QStringList& from, const QStringList& to, QVariantList& ops );
+
+    /**
+     * Applies the deltas one after another to base. Fails if an op refers
+     * to an entry that isn't (or already is) there.
+     */
+    static bool apply( const QStringList& base, const QList< QVariantList >& deltas, QStringList& result );
+
+    /**
+     * Whether a revision should store the full list instead of ops, given the
+     * number of deltas since the last full list and the size of both.
+     */
+    static bool isSnapshotDue( int distance, int opCount, int entryCount );
+
+    /**
+     * Loads the ordered entry guids of a revision, applying the deltas stored
+     * since the last full list. distance is set to the number of those deltas.
+     */
+    static bool loadEntries( DatabaseImpl* dbi, const QString& revisionGuid, QStringList& guids, int* distance = 0 );
+};
+
+}
+
+#endif // PLAYLISTREVISIONDELTA_H
@@ -98,10 +98,12 @@ CREATE INDEX playlist_item_artistname ON playlist_item(artistname);
 CREATE TABLE IF NOT EXISTS playlist_revision (
     guid TEXT PRIMARY KEY,
     playlist TEXT NOT NULL REFERENCES playlist(guid) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
-    entries TEXT, -- qlist( guid, guid... )
+    entries TEXT, -- qlist( guid, guid... ), NULL if stored as delta
     author INTEGER REFERENCES source(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
     timestamp INTEGER NOT NULL DEFAULT 0,
-    previous_revision TEXT REFERENCES playlist_revision(guid) DEFERRABLE INITIALLY DEFERRED
+    previous_revision TEXT REFERENCES playlist_revision(guid) DEFERRABLE INITIALLY DEFERRED,
+    delta TEXT, -- ops against previous_revision, see PlaylistRevisionDelta
+    snapshot_distance INTEGER NOT NULL DEFAULT 0 -- deltas since the last revision with entries
 );
 
 --INSERT INTO playlist_revision(guid, playlist, entries)
@@ -278,6 +280,21 @@ CREATE INDEX playback_log_source ON playback_log(source);
 CREATE INDEX playback_log_track ON playback_log(track);
 CREATE INDEX playback_log_playtime ON playback_log(playtime);
 
+-- plays per day, source and track, kept up to date along with playback_log
+-- day is the playtime in days since the epoch (UTC)
+CREATE TABLE IF NOT EXISTS playback_log_daily (
+    day INTEGER NOT NULL,
+    source INTEGER REFERENCES source(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
+    track INTEGER REFERENCES track(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
+    artist INTEGER REFERENCES artist(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,
+    plays INTEGER NOT NULL DEFAULT 0,
+    secs_played INTEGER NOT NULL DEFAULT 0
+);
+
+CREATE INDEX playback_log_daily_day_track ON playback_log_daily(day, track);
+CREATE INDEX playback_log_daily_track ON playback_log_daily(track);
+CREATE INDEX playback_log_daily_artist ON playback_log_daily(artist);
+
 
 
 -- auth information for http clients
@@ -300,4 +317,4 @@ CREATE TABLE IF NOT EXISTS settings (
     v TEXT NOT NULL DEFAULT ''
 );
 
-INSERT INTO settings(k,v) VALUES('schema_version', '31');
+INSERT INTO settings(k,v) VALUES('schema_version', '33');
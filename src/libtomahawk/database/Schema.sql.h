@@ -1,5 +1,5 @@
 /*
-    This file was automatically generated from ./Schema.sql on Tue Jul 30 12:51:06 CEST 2013.
+    This file was automatically generated from ./Schema.sql on Sun Oct 18 05:49:21 UTC 2026.
 */
 
 static const char * tomahawk_schema_sql = 
@@ -77,7 +77,9 @@ static const char * tomahawk_schema_sql =
 "    entries TEXT, "
 "    author INTEGER REFERENCES source(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,"
 "    timestamp INTEGER NOT NULL DEFAULT 0,"
-"    previous_revision TEXT REFERENCES playlist_revision(guid) DEFERRABLE INITIALLY DEFERRED"
+"    previous_revision TEXT REFERENCES playlist_revision(guid) DEFERRABLE INITIALLY DEFERRED,"
+"    delta TEXT, "
+"    snapshot_distance INTEGER NOT NULL DEFAULT 0 "
 ");"
 "CREATE TABLE IF NOT EXISTS dynamic_playlist ("
 "    guid TEXT NOT NULL REFERENCES playlist(guid) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,"
@@ -185,6 +187,17 @@ static const char * tomahawk_schema_sql =
 "CREATE INDEX playback_log_source ON playback_log(source);"
 "CREATE INDEX playback_log_track ON playback_log(track);"
 "CREATE INDEX playback_log_playtime ON playback_log(playtime);"
+"CREATE TABLE IF NOT EXISTS playback_log_daily ("
+"    day INTEGER NOT NULL,"
+"    source INTEGER REFERENCES source(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,"
+"    track INTEGER REFERENCES track(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,"
+"    artist INTEGER REFERENCES artist(id) ON DELETE CASCADE ON UPDATE CASCADE DEFERRABLE INITIALLY DEFERRED,"
+"    plays INTEGER NOT NULL DEFAULT 0,"
+"    secs_played INTEGER NOT NULL DEFAULT 0"
+");"
+"CREATE INDEX playback_log_daily_day_track ON playback_log_daily(day, track);"
+"CREATE INDEX playback_log_daily_track ON playback_log_daily(track);"
+"CREATE INDEX playback_log_daily_artist ON playback_log_daily(artist);"
 "CREATE TABLE IF NOT EXISTS http_client_auth ("
 "    token TEXT NOT NULL PRIMARY KEY,"
 "    website TEXT NOT NULL,"
@@ -197,7 +210,7 @@ static const char * tomahawk_schema_sql =
 "    k TEXT NOT NULL PRIMARY KEY,"
 "    v TEXT NOT NULL DEFAULT ''"
 ");"
-"INSERT INTO settings(k,v) VALUES('schema_version', '31');"
+"INSERT INTO settings(k,v) VALUES('schema_version', '33');"
     ;
 
 const char * get_tomahawk_sql()
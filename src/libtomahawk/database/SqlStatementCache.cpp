@@ -0,0 +1,83 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SqlStatementCache.h"
+
+#include <QMutexLocker>
+
+using namespace Tomahawk;
+
+
+SqlStatementCache::SqlStatementCache( int capacity )
+    : m_statements( capacity )
+    , m_hits( 0 )
+    , m_misses( 0 )
+{
+}
+
+
+bool
+SqlStatementCache::take( const QString& sql, QSqlQuery& statement )
+{
+    QMutexLocker lock( &m_mutex );
+
+    QSqlQuery* cached = m_statements.take( sql );
+    if ( !cached )
+    {
+        m_misses++;
+        return false;
+    }
+
+    m_hits++;
+    statement = *cached;
+    delete cached;
+
+    return true;
+}
+
+
+void
+SqlStatementCache::give( const QString& sql, const QSqlQuery& statement )
+{
+    QMutexLocker lock( &m_mutex );
+
+    // If another query prepared the same SQL meanwhile, the newer one wins
+    m_statements.insert( sql, new QSqlQuery( statement ) );
+}
+
+
+void
+SqlStatementCache::clear()
+{
+    QMutexLocker lock( &m_mutex );
+    m_statements.clear();
+}
+
+
+quint64
+SqlStatementCache::hits() const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_hits;
+}
+
+
+quint64
+SqlStatementCache::misses() const
+{
+    QMutexLocker lock( &m_mutex );
+    return m_misses;
+}
@@ -0,0 +1,64 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SQLSTATEMENTCACHE_H
+#define SQLSTATEMENTCACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include <QSqlQuery>
+#include <QString>
+
+#include "DllMacro.h"
+
+namespace Tomahawk
+{
+
+/**
+ * LRU cache of prepared statements for one database connection, keyed by
+ * their SQL text.
+ *
+ * A statement is taken out of the cache while a TomahawkSqlQuery uses it and
+ * put back once the query is done, so a statement is never shared between
+ * two live queries.
+ */
+class DLLEXPORT SqlStatementCache
+{
+public:
+    explicit SqlStatementCache( int capacity = 64 );
+
+    /**
+     * Take a prepared statement for the given SQL out of the cache.
+     * Returns false and leaves statement untouched on a miss.
+     */
+    bool take( const QString& sql, QSqlQuery& statement );
+    void give( const QString& sql, const QSqlQuery& statement );
+
+    void clear();
+
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    mutable QMutex m_mutex;
+    QCache< QString, QSqlQuery > m_statements;
+    quint64 m_hits;
+    quint64 m_misses;
+};
+
+}
+
+#endif // SQLSTATEMENTCACHE_H
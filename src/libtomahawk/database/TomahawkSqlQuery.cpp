@@ -21,6 +21,7 @@
 #include "collection/Collection.h"
 #include "database/Database.h"
 #include "database/DatabaseImpl.h"
+#include "database/SqlStatementCache.h"
 #include "utils/TomahawkUtils.h"
 #include "utils/Logger.h"
 #include "Source.h"
@@ -34,19 +35,82 @@
 #define QUERY_THRESHOLD 60
 
 
+struct TomahawkSqlQuery::CachedStatement
+{
+    CachedStatement( Tomahawk::SqlStatementCache* c, const QString& q, const QSqlQuery& s )
+        : cache( c )
+        , sql( q )
+        , statement( s )
+        , broken( false )
+    {
+    }
+
+    ~CachedStatement()
+    {
+        if ( broken )
+            return;
+
+        statement.finish();
+        cache->give( sql, statement );
+    }
+
+    Tomahawk::SqlStatementCache* cache;
+    QString sql;
+    QSqlQuery statement;
+    // don't hand a broken statement to the next query
+    bool broken;
+};
+
+
 TomahawkSqlQuery::TomahawkSqlQuery()
     : QSqlQuery()
+    , m_cache( 0 )
 {
 }
 
 
-TomahawkSqlQuery::TomahawkSqlQuery( const QSqlDatabase& db )
+TomahawkSqlQuery::TomahawkSqlQuery( const QSqlDatabase& db, Tomahawk::SqlStatementCache* cache )
     : QSqlQuery( db )
     , m_db( db )
+    , m_cache( cache )
 {
 }
 
 
+TomahawkSqlQuery::TomahawkSqlQuery( const TomahawkSqlQuery& other )
+    : QSqlQuery( other )
+    , m_db( other.m_db )
+    , m_query( other.m_query )
+    , m_cache( other.m_cache )
+    , m_cachedStatement( other.m_cachedStatement )
+{
+}
+
+
+TomahawkSqlQuery::~TomahawkSqlQuery()
+{
+    releaseStatement( false );
+}
+
+
+TomahawkSqlQuery&
+TomahawkSqlQuery::operator=( const TomahawkSqlQuery& other )
+{
+    if ( this == &other )
+        return *this;
+
+    releaseStatement( false );
+
+    QSqlQuery::operator=( other );
+    m_db = other.m_db;
+    m_query = other.m_query;
+    m_cache = other.m_cache;
+    m_cachedStatement = other.m_cachedStatement;
+
+    return *this;
+}
+
+
 QString
 TomahawkSqlQuery::escape( QString identifier )
 {
@@ -57,16 +121,37 @@ TomahawkSqlQuery::escape( QString identifier )
 bool
 TomahawkSqlQuery::prepare( const QString& query )
 {
+    releaseStatement( true );
     m_query = query;
-    return QSqlQuery::prepare( query );
+
+    if ( m_cache )
+    {
+        QSqlQuery statement;
+        if ( m_cache->take( query, statement ) )
+        {
+            QSqlQuery::operator=( statement );
+            m_cachedStatement = QSharedPointer< CachedStatement >( new CachedStatement( m_cache, query, *this ) );
+            return true;
+        }
+    }
+
+    const bool ok = QSqlQuery::prepare( query );
+    if ( ok && m_cache )
+        m_cachedStatement = QSharedPointer< CachedStatement >( new CachedStatement( m_cache, query, *this ) );
+
+    return ok;
 }
 
 
 bool
 TomahawkSqlQuery::exec( const QString& query )
 {
+    // One-off statements usually carry their values inline, don't cache them
+    releaseStatement( true );
+    m_query = query;
+
 //     bool prepareResult =
-    prepare( query );
+    QSqlQuery::prepare( query );
 //     tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Query preparation successful?" << ( prepareResult ? "true" : "false" );
     return exec();
 }
@@ -94,7 +179,7 @@ TomahawkSqlQuery::exec()
             tDebug() << Q_FUNC_INFO << "Re-preparing query!";
 
             QMap< QString, QVariant > bv = boundValues();
-            prepare( m_query );
+            QSqlQuery::prepare( m_query );
 
             foreach ( const QString& key, bv.keys() )
             {
@@ -112,7 +197,14 @@ TomahawkSqlQuery::exec()
 
     bool ret = ( retries < 10 );
     if ( !ret )
+    {
+        if ( m_cachedStatement )
+        {
+            m_cachedStatement->broken = true;
+            m_cachedStatement.clear();
+        }
         showError();
+    }
 
     int e = t.elapsed();
     if ( log || e >= QUERY_THRESHOLD )
@@ -146,6 +238,21 @@ TomahawkSqlQuery::commitTransaction()
 }
 
 
+void
+TomahawkSqlQuery::releaseStatement( bool detach )
+{
+    if ( !m_cachedStatement )
+        return;
+
+    // Goes back into the cache once no copy uses it anymore
+    m_cachedStatement.clear();
+
+    // The cache or another copy shares our statement, we must not prepare anything else on it
+    if ( detach )
+        QSqlQuery::operator=( QSqlQuery( m_db ) );
+}
+
+
 void
 TomahawkSqlQuery::showError()
 {
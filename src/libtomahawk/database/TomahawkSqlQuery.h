@@ -21,6 +21,7 @@
 
 // subclass QSqlQuery so that it prints the error msg if a query fails
 
+#include <QSharedPointer>
 #include <QSqlDriver>
 #include <QSqlQuery>
 
@@ -28,12 +29,26 @@
 
 #include "DllMacro.h"
 
+namespace Tomahawk
+{
+    class SqlStatementCache;
+}
+
 class DLLEXPORT TomahawkSqlQuery : public QSqlQuery
 {
 
 public:
     TomahawkSqlQuery();
-    TomahawkSqlQuery( const QSqlDatabase& db );
+    /**
+     * With a cache, statements compiled by prepare() are kept around and
+     * reused by later queries preparing the same SQL on this connection.
+     */
+    TomahawkSqlQuery( const QSqlDatabase& db, Tomahawk::SqlStatementCache* cache = 0 );
+    // Copies share the statement, the last one of them puts it back into the cache
+    TomahawkSqlQuery( const TomahawkSqlQuery& other );
+    ~TomahawkSqlQuery();
+
+    TomahawkSqlQuery& operator=( const TomahawkSqlQuery& other );
 
     static QString escape( QString identifier );
 
@@ -44,12 +59,17 @@ public:
     bool commitTransaction();
 
 private:
+    struct CachedStatement;
+
     bool isBusyError( const QSqlError& error ) const;
+    void releaseStatement( bool detach );
 
     void showError();
 
     QSqlDatabase m_db;
     QString m_query;
+    Tomahawk::SqlStatementCache* m_cache;
+    QSharedPointer< CachedStatement > m_cachedStatement;
 };
 
 #endif // TOMAHAWKSQLQUERY_H
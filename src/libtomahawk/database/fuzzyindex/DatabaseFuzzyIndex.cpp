@@ -38,7 +38,8 @@ DatabaseFuzzyIndex::DatabaseFuzzyIndex( QObject* parent, bool wipe )
 void
 DatabaseFuzzyIndex::updateIndex()
 {
-    Tomahawk::DatabaseCommand* cmd = new Tomahawk::DatabaseCommand_UpdateSearchIndex();
+    // Called after the index got wiped
+    Tomahawk::DatabaseCommand* cmd = new Tomahawk::DatabaseCommand_UpdateSearchIndex( true );
     Tomahawk::Database::instance()->enqueue( Tomahawk::dbcmd_ptr( cmd ) );
 }
 
@@ -25,17 +25,85 @@
 #include "Source.h"
 #include "Track.h"
 
+#include <QCache>
 #include <QDir>
+#include <QThreadStorage>
 #include <QTime>
 #include <QTimer>
 
 #include <lucene++/FuzzyQuery.h>
 
+// Bump when the document layout changes, older indexes get rebuilt
+#define INDEX_VERSION L"2"
+
+// Lucene queries built per thread, and results kept per index snapshot
+#define QUERY_CACHE_SIZE 256
+#define RESULT_CACHE_SIZE 512
+
 using namespace Lucene;
 
+static QThreadStorage< QCache< QString, QueryPtr >* > s_queryCache;
+
+
+/**
+ * A reader and its searcher. Searches hold on to the snapshot they started
+ * with, it is closed once the last of them is done with it.
+ *
+ * Recent results live in the snapshot as well, so they are dropped together
+ * with it whenever the index changes.
+ */
+struct FuzzyIndex::Searcher
+{
+    explicit Searcher( const IndexReaderPtr& r )
+        : reader( r )
+        , searcher( newLucene<IndexSearcher>( r ) )
+        , results( RESULT_CACHE_SIZE )
+    {
+    }
+
+    bool cachedResults( const QString& key, QMap< int, float >& resultsmap )
+    {
+        QMutexLocker lock( &resultsMutex );
+        QMap< int, float >* cached = results.object( key );
+        if ( !cached )
+            return false;
+
+        resultsmap = *cached;
+        return true;
+    }
+
+    void cacheResults( const QString& key, const QMap< int, float >& resultsmap )
+    {
+        QMutexLocker lock( &resultsMutex );
+        results.insert( key, new QMap< int, float >( resultsmap ) );
+    }
+
+    ~Searcher()
+    {
+        try
+        {
+            searcher->close();
+            reader->close();
+        }
+        catch ( LuceneException& error )
+        {
+            tDebug() << "Caught Lucene error:" << QString::fromWCharArray( error.getError().c_str() );
+        }
+    }
+
+    IndexReaderPtr reader;
+    IndexSearcherPtr searcher;
+
+    QMutex resultsMutex;
+    QCache< QString, QMap< int, float > > results;
+};
+
 
 FuzzyIndex::FuzzyIndex( QObject* parent, const QString& filename, bool wipe )
     : QObject( parent )
+    , m_appendOnly( false )
+    , m_lastTrackId( 0 )
+    , m_lastAlbumId( 0 )
 {
     m_lucenePath = TomahawkUtils::appDataDir().absoluteFilePath( filename );
 
@@ -45,8 +113,22 @@ FuzzyIndex::FuzzyIndex( QObject* parent, const QString& filename, bool wipe )
     {
         m_analyzer = newLucene<SimpleAnalyzer>();
         m_luceneDir = FSDirectory::open( m_lucenePath.toStdWString() );
-        m_luceneReader = IndexReader::open( m_luceneDir );
-        m_luceneSearcher = newLucene<IndexSearcher>( m_luceneReader );
+        IndexReaderPtr reader = IndexReader::open( m_luceneDir, true );
+
+        // Older indexes don't have their ids indexed and can't be updated in place
+        MapStringString userData = reader->getCommitUserData();
+        if ( !userData.contains( L"version" ) || userData.get( L"version" ) != INDEX_VERSION )
+        {
+            tLog() << "Outdated fuzzy index, rebuilding:" << m_lucenePath;
+            reader->close();
+            failed = true;
+        }
+        else
+        {
+            m_lastTrackId = QString::fromStdWString( userData.get( L"lasttrackid" ) ).toUInt();
+            m_lastAlbumId = QString::fromStdWString( userData.get( L"lastalbumid" ) ).toUInt();
+            setSearcher( reader );
+        }
     }
     catch ( LuceneException& error )
     {
@@ -68,6 +150,18 @@ FuzzyIndex::FuzzyIndex( QObject* parent, const QString& filename, bool wipe )
 FuzzyIndex::~FuzzyIndex()
 {
     tLog( LOGVERBOSE ) << Q_FUNC_INFO;
+
+    if ( m_luceneWriter )
+    {
+        try
+        {
+            m_luceneWriter->close();
+        }
+        catch ( LuceneException& error )
+        {
+            tDebug() << "Caught Lucene error:" << QString::fromWCharArray( error.getError().c_str() );
+        }
+    }
 }
 
 
@@ -75,7 +169,7 @@ bool
 FuzzyIndex::wipeIndex()
 {
     tLog( LOGVERBOSE ) << "Wiping fuzzy index:" << m_lucenePath;
-    beginIndexing();
+    beginIndexing( true );
     endIndexing();
 
     QTimer::singleShot( 0, this, SLOT( updateIndexSlot() ) );
@@ -92,15 +186,31 @@ FuzzyIndex::updateIndexSlot()
 
 
 void
-FuzzyIndex::beginIndexing()
+FuzzyIndex::beginIndexing( bool wipe )
 {
     emit indexStarted();
     m_mutex.lock();
 
     try
     {
-        tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Starting indexing:" << m_lucenePath;
-        m_luceneWriter = newLucene<IndexWriter>( m_luceneDir, m_analyzer, true, IndexWriter::MaxFieldLengthLIMITED );
+        tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Starting indexing:" << m_lucenePath << "wipe:" << wipe;
+        if ( !m_luceneWriter )
+        {
+            // The writer stays open, later updates only append new segments
+            const bool create = ( wipe || !IndexReader::indexExists( m_luceneDir ) );
+            m_luceneWriter = newLucene<IndexWriter>( m_luceneDir, m_analyzer, create, IndexWriter::MaxFieldLengthLIMITED );
+            m_luceneWriter->setRAMBufferSizeMB( 32 );
+        }
+        else if ( wipe )
+        {
+            m_luceneWriter->deleteAll();
+        }
+
+        if ( wipe )
+            m_lastTrackId = m_lastAlbumId = 0;
+
+        // Nothing to replace in an empty index
+        m_appendOnly = ( wipe || m_luceneWriter->maxDoc() == 0 );
     }
     catch( LuceneException& error )
     {
@@ -114,24 +224,70 @@ void
 FuzzyIndex::endIndexing()
 {
     tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Finishing indexing:" << m_lucenePath;
-    m_luceneWriter->optimize();
-    m_luceneWriter->close();
-    m_luceneWriter.reset();
 
-    m_luceneReader = IndexReader::open( m_luceneDir );
-    m_luceneSearcher = newLucene<IndexSearcher>( m_luceneReader );
+    try
+    {
+        MapStringString userData = MapStringString::newInstance();
+        userData.put( L"version", INDEX_VERSION );
+        userData.put( L"lasttrackid", QString::number( m_lastTrackId ).toStdWString() );
+        userData.put( L"lastalbumid", QString::number( m_lastAlbumId ).toStdWString() );
+
+        // No optimize() here, the merge scheduler merges segments in the background
+        m_luceneWriter->commit( userData );
+
+        // Near real-time reader, shares all unchanged segments with the old one
+        setSearcher( m_luceneWriter->getReader() );
+    }
+    catch( LuceneException& error )
+    {
+        tDebug() << "Caught Lucene error:" << QString::fromWCharArray( error.getError().c_str() );
+    }
 
     m_mutex.unlock();
     emit indexReady();
 }
 
 
+unsigned int
+FuzzyIndex::lastTrackId() const
+{
+    return m_lastTrackId;
+}
+
+
+unsigned int
+FuzzyIndex::lastAlbumId() const
+{
+    return m_lastAlbumId;
+}
+
+
+std::shared_ptr< FuzzyIndex::Searcher >
+FuzzyIndex::searcher() const
+{
+    return std::atomic_load( &m_searcher );
+}
+
+
+void
+FuzzyIndex::setSearcher( const IndexReaderPtr& reader )
+{
+    std::shared_ptr< Searcher > s;
+    if ( reader )
+        s = std::make_shared< Searcher >( reader );
+
+    // The previous snapshot closes when the last search drops it
+    std::atomic_store( &m_searcher, s );
+}
+
+
 void
 FuzzyIndex::appendFields( const Tomahawk::IndexData& data )
 {
     try
     {
         DocumentPtr doc = newLucene<Document>();
+        TermPtr idTerm;
 
         if ( !data.track.isEmpty() )
         {
@@ -148,7 +304,10 @@ FuzzyIndex::appendFields( const Tomahawk::IndexData& data )
                                        Field::STORE_YES, Field::INDEX_NO ) );
 
             doc->add(newLucene<Field>( L"trackid", QString::number( data.id ).toStdWString(),
-                                       Field::STORE_YES, Field::INDEX_NO ) );
+                                       Field::STORE_YES, Field::INDEX_NOT_ANALYZED_NO_NORMS ) );
+
+            idTerm = newLucene<Term>( L"trackid", QString::number( data.id ).toStdWString() );
+            m_lastTrackId = qMax( m_lastTrackId, data.id );
         }
         else if ( !data.album.isEmpty() )
         {
@@ -156,12 +315,18 @@ FuzzyIndex::appendFields( const Tomahawk::IndexData& data )
                                        Field::STORE_NO, Field::INDEX_NOT_ANALYZED_NO_NORMS ) );
 
             doc->add(newLucene<Field>( L"albumid", QString::number( data.id ).toStdWString(),
-                                       Field::STORE_YES, Field::INDEX_NO ) );
+                                       Field::STORE_YES, Field::INDEX_NOT_ANALYZED_NO_NORMS ) );
+
+            idTerm = newLucene<Term>( L"albumid", QString::number( data.id ).toStdWString() );
+            m_lastAlbumId = qMax( m_lastAlbumId, data.id );
         }
         else
             return;
 
-        m_luceneWriter->addDocument( doc );
+        if ( m_appendOnly )
+            m_luceneWriter->addDocument( doc );
+        else
+            m_luceneWriter->updateDocument( idTerm, doc );
     }
     catch( LuceneException& error )
     {
@@ -175,16 +340,24 @@ FuzzyIndex::appendFields( const Tomahawk::IndexData& data )
 void
 FuzzyIndex::deleteIndex()
 {
-    if ( m_luceneReader )
-    {
-        tDebug( LOGVERBOSE ) << "Deleting old lucene stuff.";
+    tDebug( LOGVERBOSE ) << "Deleting old lucene stuff.";
+    setSearcher( IndexReaderPtr() );
 
-        m_luceneSearcher->close();
-        m_luceneReader->close();
-        m_luceneSearcher.reset();
-        m_luceneReader.reset();
+    if ( m_luceneWriter )
+    {
+        try
+        {
+            m_luceneWriter->rollback();
+        }
+        catch ( LuceneException& error )
+        {
+            tDebug() << "Caught Lucene error:" << QString::fromWCharArray( error.getError().c_str() );
+        }
+        m_luceneWriter.reset();
     }
 
+    m_lastTrackId = m_lastAlbumId = 0;
+
     TomahawkUtils::removeDirectory( m_lucenePath );
 }
 
@@ -203,63 +376,101 @@ FuzzyIndex::loadLuceneIndex()
 }
 
 
-QMap< int, float >
-FuzzyIndex::search( const Tomahawk::query_ptr& query )
+static QCache< QString, QueryPtr >&
+queryCache()
 {
-//    QMutexLocker lock( &m_mutex );
-    QMap< int, float > resultsmap;
-    if ( !m_luceneReader || !m_luceneSearcher )
-        return resultsmap;
+    if ( !s_queryCache.hasLocalData() )
+        s_queryCache.setLocalData( new QCache< QString, QueryPtr >( QUERY_CACHE_SIZE ) );
 
-    try
+    return *s_queryCache.localData();
+}
+
+
+static QueryPtr
+trackQuery( const Tomahawk::query_ptr& query, QString& key )
+{
+    QString q, track, artist;
+    if ( query->isFullTextQuery() )
     {
-//        float minScore = 0.00;
-        Collection<String> fields; // = newCollection<String>();
-        MultiFieldQueryParserPtr parser = newLucene<MultiFieldQueryParser>( LuceneVersion::LUCENE_CURRENT, fields, m_analyzer );
-        BooleanQueryPtr qry = newLucene<BooleanQuery>();
+        q = Tomahawk::DatabaseImpl::sortname( query->fullTextQuery() );
+        key = QString( "f\t%1" ).arg( q );
+    }
+    else
+    {
+        track = Tomahawk::DatabaseImpl::sortname( query->queryTrack()->track() );
+        artist = Tomahawk::DatabaseImpl::sortname( query->queryTrack()->artist() );
+        key = QString( "t\t%1\t%2" ).arg( artist ).arg( track );
+    }
 
-        if ( query->isFullTextQuery() )
-        {
-            const QString q = Tomahawk::DatabaseImpl::sortname( query->fullTextQuery() );
+    QCache< QString, QueryPtr >& cache = queryCache();
+    if ( QueryPtr* cached = cache.object( key ) )
+        return *cached;
 
-            FuzzyQueryPtr fqry = newLucene<FuzzyQuery>( newLucene<Term>( L"track", q.toStdWString() ) );
-            qry->add( boost::dynamic_pointer_cast<Query>( fqry ), BooleanClause::SHOULD );
+    BooleanQueryPtr qry = newLucene<BooleanQuery>();
+    if ( query->isFullTextQuery() )
+    {
+        FuzzyQueryPtr fqry = newLucene<FuzzyQuery>( newLucene<Term>( L"track", q.toStdWString() ) );
+        qry->add( boost::dynamic_pointer_cast<Query>( fqry ), BooleanClause::SHOULD );
 
-            FuzzyQueryPtr fqry2 = newLucene<FuzzyQuery>( newLucene<Term>( L"artist", q.toStdWString() ) );
-            qry->add( boost::dynamic_pointer_cast<Query>( fqry2 ), BooleanClause::SHOULD );
+        FuzzyQueryPtr fqry2 = newLucene<FuzzyQuery>( newLucene<Term>( L"artist", q.toStdWString() ) );
+        qry->add( boost::dynamic_pointer_cast<Query>( fqry2 ), BooleanClause::SHOULD );
 
-            FuzzyQueryPtr fqry3 = newLucene<FuzzyQuery>( newLucene<Term>( L"fulltext", q.toStdWString() ) );
-            qry->add( boost::dynamic_pointer_cast<Query>( fqry3 ), BooleanClause::SHOULD );
-        }
-        else
-        {
-            const QString track = Tomahawk::DatabaseImpl::sortname( query->queryTrack()->track() );
-            const QString artist = Tomahawk::DatabaseImpl::sortname( query->queryTrack()->artist() );
-            //QString album = Tomahawk::DatabaseImpl::sortname( query->queryTrack()->album() );
+        FuzzyQueryPtr fqry3 = newLucene<FuzzyQuery>( newLucene<Term>( L"fulltext", q.toStdWString() ) );
+        qry->add( boost::dynamic_pointer_cast<Query>( fqry3 ), BooleanClause::SHOULD );
+    }
+    else
+    {
+        FuzzyQueryPtr fqry = newLucene<FuzzyQuery>( newLucene<Term>( L"track", track.toStdWString() ), 0.5, 3 );
+        qry->add( boost::dynamic_pointer_cast<Query>( fqry ), BooleanClause::MUST );
 
-            FuzzyQueryPtr fqry = newLucene<FuzzyQuery>( newLucene<Term>( L"track", track.toStdWString() ), 0.5, 3 );
-            qry->add( boost::dynamic_pointer_cast<Query>( fqry ), BooleanClause::MUST );
+        FuzzyQueryPtr fqry2 = newLucene<FuzzyQuery>( newLucene<Term>( L"artist", artist.toStdWString() ), 0.5, 3 );
+        qry->add( boost::dynamic_pointer_cast<Query>( fqry2 ), BooleanClause::MUST );
+    }
+
+    QueryPtr result = boost::dynamic_pointer_cast<Query>( qry );
+    cache.insert( key, new QueryPtr( result ) );
+    return result;
+}
+
+
+QMap< int, float >
+FuzzyIndex::search( const Tomahawk::query_ptr& query )
+{
+    const std::shared_ptr< Searcher > s = searcher();
+    if ( !s )
+        return QMap< int, float >();
+
+    return search( query, *s );
+}
 
-            FuzzyQueryPtr fqry2 = newLucene<FuzzyQuery>( newLucene<Term>( L"artist", artist.toStdWString() ), 0.5, 3 );
-            qry->add( boost::dynamic_pointer_cast<Query>( fqry2 ), BooleanClause::MUST );
-        }
+
+QMap< int, float >
+FuzzyIndex::search( const Tomahawk::query_ptr& query, Searcher& s )
+{
+    QMap< int, float > resultsmap;
+
+    try
+    {
+        QString key;
+        QueryPtr qry = trackQuery( query, key );
+        if ( s.cachedResults( key, resultsmap ) )
+            return resultsmap;
 
         TopScoreDocCollectorPtr collector = TopScoreDocCollector::create( 20, true );
-        m_luceneSearcher->search( qry, collector );
+        s.searcher->search( qry, collector );
         Collection<ScoreDocPtr> hits = collector->topDocs()->scoreDocs;
 
         for ( int i = 0; i < collector->getTotalHits() && i < 20; i++ )
         {
-            DocumentPtr d = m_luceneSearcher->doc( hits[i]->doc );
+            DocumentPtr d = s.searcher->doc( hits[i]->doc );
             const float score = hits[i]->score;
             const int id = QString::fromStdWString( d->get( L"trackid" ) ).toInt();
 
-//            if ( score > minScore )
-            {
-                resultsmap.insert( id, score );
-//                tDebug() << "Index hit:" << id << score << QString::fromWCharArray( ((Query*)qry)->toString() );
-            }
+            resultsmap.insert( id, score );
+//            tDebug() << "Index hit:" << id << score << QString::fromWCharArray( qry->toString() );
         }
+
+        s.cacheResults( key, resultsmap );
     }
     catch( LuceneException& error )
     {
@@ -270,29 +481,58 @@ FuzzyIndex::search( const Tomahawk::query_ptr& query )
 }
 
 
+QHash< Tomahawk::QID, QMap< int, float > >
+FuzzyIndex::search( const QList< Tomahawk::query_ptr >& queries )
+{
+    QHash< Tomahawk::QID, QMap< int, float > > resultsmap;
+    const std::shared_ptr< Searcher > s = searcher();
+    if ( !s )
+        return resultsmap;
+
+    // All queries of a batch run against the same snapshot
+    foreach ( const Tomahawk::query_ptr& query, queries )
+        resultsmap.insert( query->id(), search( query, *s ) );
+
+    return resultsmap;
+}
+
+
 QMap< int, float >
 FuzzyIndex::searchAlbum( const Tomahawk::query_ptr& query )
 {
     Q_ASSERT( query->isFullTextQuery() );
 
-//    QMutexLocker lock( &m_mutex );
     QMap< int, float > resultsmap;
-    if ( !m_luceneReader || !m_luceneSearcher )
+    const std::shared_ptr< Searcher > s = searcher();
+    if ( !s )
         return resultsmap;
 
     try
     {
-        QueryParserPtr parser = newLucene<QueryParser>( LuceneVersion::LUCENE_CURRENT, L"album", m_analyzer );
         const QString q = Tomahawk::DatabaseImpl::sortname( query->fullTextQuery() );
+        const QString key = QString( "a\t%1" ).arg( q );
+        if ( s->cachedResults( key, resultsmap ) )
+            return resultsmap;
+
+        QCache< QString, QueryPtr >& cache = queryCache();
+        QueryPtr qry;
+        if ( QueryPtr* cached = cache.object( key ) )
+        {
+            qry = *cached;
+        }
+        else
+        {
+            qry = boost::dynamic_pointer_cast<Query>( newLucene<FuzzyQuery>( newLucene<Term>( L"album", q.toStdWString() ) ) );
+            cache.insert( key, new QueryPtr( qry ) );
+        }
 
-        FuzzyQueryPtr qry = newLucene<FuzzyQuery>( newLucene<Term>( L"album", q.toStdWString() ) );
         TopScoreDocCollectorPtr collector = TopScoreDocCollector::create( 99999, false );
-        m_luceneSearcher->search( boost::dynamic_pointer_cast<Query>( qry ), collector );
+        s->searcher->search( qry, collector );
         Collection<ScoreDocPtr> hits = collector->topDocs()->scoreDocs;
 
         for ( int i = 0; i < collector->getTotalHits(); i++ )
         {
-            DocumentPtr d = m_luceneSearcher->doc( hits[i]->doc );
+            DocumentPtr d = s->searcher->doc( hits[i]->doc );
             float score = hits[i]->score;
             int id = QString::fromStdWString( d->get( L"albumid" ) ).toInt();
 
@@ -302,6 +542,8 @@ FuzzyIndex::searchAlbum( const Tomahawk::query_ptr& query )
 //                tDebug() << "Index hit:" << id << score;
             }
         }
+
+        s->cacheResults( key, resultsmap );
     }
     catch( LuceneException& error )
     {
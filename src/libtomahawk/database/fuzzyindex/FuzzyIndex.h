@@ -25,12 +25,15 @@
 #include <QString>
 #include <QMutex>
 
+#include <memory>
+
 #include <lucene++/LuceneHeaders.h>
 
+#include "DllMacro.h"
 #include "Query.h"
 #include "database/DatabaseCommand_UpdateSearchIndex.h"
 
-class FuzzyIndex : public QObject
+class DLLEXPORT FuzzyIndex : public QObject
 {
 Q_OBJECT
 
@@ -38,10 +41,24 @@ public:
     explicit FuzzyIndex( QObject* parent, const QString& filename, bool wipe = false );
     virtual ~FuzzyIndex();
 
-    void beginIndexing();
+    /**
+     * Start adding documents. Unless wipe is set, documents are added to the
+     * existing index and replace older documents with the same id.
+     *
+     * Searches keep using the previous state of the index until endIndexing()
+     * committed the changes.
+     */
+    void beginIndexing( bool wipe = false );
     void endIndexing();
     void appendFields( const Tomahawk::IndexData& data );
 
+    /**
+     * Highest track and album ids added so far, everything above still needs
+     * to be indexed.
+     */
+    unsigned int lastTrackId() const;
+    unsigned int lastAlbumId() const;
+
     /**
      * Delete the index from the harddrive.
      *
@@ -60,20 +77,32 @@ public slots:
     bool wipeIndex();
 
     QMap< int, float > search( const Tomahawk::query_ptr& query );
+    QHash< Tomahawk::QID, QMap< int, float > > search( const QList< Tomahawk::query_ptr >& queries );
     QMap< int, float > searchAlbum( const Tomahawk::query_ptr& query );
 
 private slots:
     void updateIndexSlot();
 
 private:
+    struct Searcher;
+
+    QMap< int, float > search( const Tomahawk::query_ptr& query, Searcher& searcher );
+    std::shared_ptr< Searcher > searcher() const;
+    void setSearcher( const Lucene::IndexReaderPtr& reader );
+
+    // Held by the writer from beginIndexing() to endIndexing(). Searches
+    // never lock, they work on an atomically swapped snapshot.
     QMutex m_mutex;
     QString m_lucenePath;
 
     boost::shared_ptr<Lucene::SimpleAnalyzer> m_analyzer;
     Lucene::IndexWriterPtr m_luceneWriter;
-    Lucene::IndexReaderPtr m_luceneReader;
     Lucene::FSDirectoryPtr m_luceneDir;
-    Lucene::IndexSearcherPtr m_luceneSearcher;
+    std::shared_ptr< Searcher > m_searcher;
+
+    bool m_appendOnly;
+    unsigned int m_lastTrackId;
+    unsigned int m_lastAlbumId;
 };
 
 #endif // FUZZYINDEX_H
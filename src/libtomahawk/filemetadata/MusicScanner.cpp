@@ -35,72 +35,124 @@
 
 #include "config.h"
 
+#include <QRunnable>
+
+// files handed out by the DirLister at once
+#define LISTER_CHUNK_SIZE 64
+// how long the DirLister waits for capacity before checking whether it should stop
+#define LISTER_POLL_INTERVAL 100
+// files in flight between the DirLister and the database, on top of two batches
+#define MAX_FILES_IN_FLIGHT 2000
+#define DEFAULT_BATCH_SIZE 5000
+#define DEFAULT_IO_THREADS 4
+
 using namespace Tomahawk;
 
-void
-DirLister::go()
+
+namespace
 {
-    foreach ( const QString& dir, m_dirs )
+
+// Reads the tags of a single file on the reader pool and hands them back to the scanner
+class TagReaderTask : public QRunnable
+{
+public:
+    TagReaderTask( MusicScanner* scanner, const QFileInfo& fi )
+        : m_scanner( scanner )
+        , m_fileInfo( fi )
     {
-        m_opcount++;
-        QMetaObject::invokeMethod( this, "scanDir", Qt::QueuedConnection, Q_ARG( QDir, QDir( dir, 0 ) ), Q_ARG( int, 0 ) );
     }
+
+    void run()
+    {
+        QThread::currentThread()->setPriority( QThread::IdlePriority );
+
+        const QVariant m = MusicScanner::readTags( m_fileInfo );
+        QMetaObject::invokeMethod( m_scanner, "tagsRead", Qt::QueuedConnection,
+                                   Q_ARG( QFileInfo, m_fileInfo ), Q_ARG( QVariant, m ) );
+    }
+
+private:
+    MusicScanner* m_scanner;
+    QFileInfo m_fileInfo;
+};
+
 }
 
 
 void
-DirLister::scanDir( QDir dir, int depth )
+DirLister::go()
 {
-    if ( isDeleting() )
+    QStringList dirs = m_dirs;
+    QFileInfoList files;
+
+    // Depth first, one directory listing per directory
+    while ( !dirs.isEmpty() )
     {
-        m_opcount--;
-        if ( m_opcount == 0 )
-            emit finished();
+        if ( isDeleting() )
+            break;
 
-        return;
-    }
+        QDir dir( dirs.takeLast() );
+        tDebug( LOGVERBOSE ) << "DirLister::go scanning:" << dir.canonicalPath();
+        if ( !dir.exists() || m_processedDirs.contains( dir.canonicalPath() ) )
+        {
+            tDebug( LOGVERBOSE ) << "Dir no longer exists or already scanned, ignoring";
+            continue;
+        }
 
-    tDebug( LOGVERBOSE ) << "DirLister::scanDir scanning:" << dir.canonicalPath();
-    if ( !dir.exists() || m_processedDirs.contains( dir.canonicalPath() ) )
-    {
-        tDebug( LOGVERBOSE ) << "Dir no longer exists or already scanned, ignoring";
+        m_processedDirs << dir.canonicalPath();
 
-        m_opcount--;
-        if ( m_opcount == 0 )
-            emit finished();
+        dir.setFilter( QDir::Files | QDir::Dirs | QDir::Readable | QDir::NoDotAndDotDot );
+        dir.setSorting( QDir::Name );
 
-        return;
+        QStringList subdirs;
+        foreach ( const QFileInfo& di, dir.entryInfoList() )
+        {
+            if ( di.isDir() )
+            {
+                subdirs.prepend( di.canonicalFilePath() );
+                continue;
+            }
+
+            files << di;
+            if ( files.count() >= LISTER_CHUNK_SIZE && !flush( files ) )
+                break;
+        }
+
+        dirs << subdirs;
     }
 
-    m_processedDirs << dir.canonicalPath();
+    if ( !isDeleting() )
+        flush( files );
 
-    QFileInfoList filteredEntries;
-    dir.setFilter( QDir::Files | QDir::Readable | QDir::NoDotAndDotDot );
-    dir.setSorting( QDir::Name );
-    filteredEntries = dir.entryInfoList();
-    foreach ( const QFileInfo& di, filteredEntries )
-        emit fileToScan( di );
+    tDebug() << Q_FUNC_INFO << "emitting finished";
+    emit finished();
+}
 
-    dir.setFilter( QDir::Dirs | QDir::Readable | QDir::NoDotAndDotDot );
-    filteredEntries = dir.entryInfoList();
-    foreach ( const QFileInfo& di, filteredEntries )
-    {
-        const QString canonical = di.canonicalFilePath();
-        m_opcount++;
-        QMetaObject::invokeMethod( this, "scanDir", Qt::QueuedConnection, Q_ARG( QDir, di.canonicalFilePath() ), Q_ARG( int, depth + 1 ) );
-    }
 
-    m_opcount--;
-    if ( m_opcount == 0 )
+bool
+DirLister::flush( QFileInfoList& files )
+{
+    if ( files.isEmpty() )
+        return true;
+
+    // Wait until the scanner is done with enough of the files we handed out before
+    while ( !m_capacity->tryAcquire( files.count(), LISTER_POLL_INTERVAL ) )
     {
-        tDebug() << Q_FUNC_INFO << "emitting finished";
-        emit finished();
+        if ( isDeleting() )
+            return false;
     }
+
+    emit filesToScan( files );
+    files.clear();
+
+    return true;
 }
 
 
 DirListerThreadController::DirListerThreadController( QObject *parent )
     : QThread( parent )
+    , m_capacity( 0 )
+    , m_stopped( false )
 {
     tDebug( LOGVERBOSE ) << Q_FUNC_INFO;
 }
@@ -112,20 +164,39 @@ DirListerThreadController::~DirListerThreadController()
 }
 
 
+void
+DirListerThreadController::stop()
+{
+    QMutexLocker locker( &m_stopMutex );
+    m_stopped = true;
+
+    if ( !m_dirLister.isNull() )
+        m_dirLister.data()->setIsDeleting();
+}
+
+
 void
 DirListerThreadController::run()
 {
-    m_dirLister = QPointer< DirLister >( new DirLister( m_paths ) );
-    connect( m_dirLister.data(), SIGNAL( fileToScan( QFileInfo ) ),
-             parent(), SLOT( scanFile( QFileInfo ) ), Qt::QueuedConnection );
+    {
+        QMutexLocker locker( &m_stopMutex );
+        m_dirLister = QPointer< DirLister >( new DirLister( m_paths, m_capacity ) );
+        if ( m_stopped )
+            m_dirLister.data()->setIsDeleting();
+    }
+
+    connect( m_dirLister.data(), SIGNAL( filesToScan( QFileInfoList ) ),
+             parent(), SLOT( filesListed( QFileInfoList ) ), Qt::QueuedConnection );
 
-    // queued, so will only fire after all dirs have been scanned:
+    // queued, so will only fire after all files have been handed out:
     connect( m_dirLister.data(), SIGNAL( finished() ),
-             parent(), SLOT( postOps() ), Qt::QueuedConnection );
+             parent(), SLOT( listingFinished() ), Qt::QueuedConnection );
 
     QMetaObject::invokeMethod( m_dirLister.data(), "go", Qt::QueuedConnection );
 
     exec();
+
+    QMutexLocker locker( &m_stopMutex );
     if ( !m_dirLister.isNull() )
         delete m_dirLister.data();
 }
@@ -139,8 +210,14 @@ MusicScanner::MusicScanner( MusicScanner::ScanMode scanMode, const QStringList&
     , m_dryRun( false )
     , m_verbose( false )
     , m_cmdQueue( 0 )
-    , m_batchsize( bs )
+    , m_batchsize( bs ? bs : DEFAULT_BATCH_SIZE )
     , m_dirListerThreadController( 0 )
+    , m_cpuThreads( qMax( 1, QThread::idealThreadCount() ) )
+    , m_ioThreads( DEFAULT_IO_THREADS )
+    , m_capacity( 0 )
+    , m_pendingReads( 0 )
+    , m_listingDone( false )
+    , m_scanDone( false )
 {
 }
 
@@ -151,12 +228,19 @@ MusicScanner::~MusicScanner()
 
     if ( m_dirListerThreadController )
     {
+        m_dirListerThreadController->stop();
         m_dirListerThreadController->quit();
         m_dirListerThreadController->wait( 60000 );
 
         delete m_dirListerThreadController;
         m_dirListerThreadController = 0;
     }
+
+    // The readers post their results to us, they have to be gone first
+    m_readerPool.clear();
+    m_readerPool.waitForDone();
+
+    delete m_capacity;
 }
 
 
@@ -188,6 +272,16 @@ MusicScanner::verbose()
 }
 
 
+void
+MusicScanner::setReaderThreads( int cpuThreads, int ioThreads )
+{
+    if ( cpuThreads > 0 )
+        m_cpuThreads = cpuThreads;
+    if ( ioThreads >= 0 )
+        m_ioThreads = ioThreads;
+}
+
+
 void
 MusicScanner::startScan()
 {
@@ -201,7 +295,16 @@ MusicScanner::startScan()
     //FIXME: For multiple collection support make sure the right prefix gets passed in...or not...
     //bear in mind that simply passing in the top-level of a defined collection means it will not return items that need
     //to be removed that aren't in that root any longer -- might have to do the filtering in setMTimes based on strings
-    DatabaseCommand_FileMtimes *cmd = new DatabaseCommand_FileMtimes();
+    if ( m_scanMode == MusicScanner::FileScan && m_paths.isEmpty() )
+    {
+        // No prefix would load the whole collection and count it as deleted
+        setFileMtimes( QMap< QString, QMap< unsigned int, unsigned int > >() );
+        return;
+    }
+
+    // A file scan only needs what we know about its own paths
+    DatabaseCommand_FileMtimes *cmd = m_scanMode == MusicScanner::FileScan ? new DatabaseCommand_FileMtimes( m_paths )
+                                                                           : new DatabaseCommand_FileMtimes();
     connect( cmd, SIGNAL( done( QMap< QString, QMap< unsigned int, unsigned int > > ) ),
                     SLOT( setFileMtimes( QMap< QString, QMap< unsigned int, unsigned int > > ) ) );
 
@@ -224,49 +327,131 @@ MusicScanner::scan()
 {
     tDebug( LOGVERBOSE ) << "Num saved file mtimes from last scan:" << m_filemtimes.size();
 
+    qRegisterMetaType< QFileInfo >( "QFileInfo" );
+    qRegisterMetaType< QFileInfoList >( "QFileInfoList" );
+
+    // Both fill a static on first use, do that before the readers run in parallel
+    TomahawkUtils::supportedExtensions();
+    TomahawkUtils::extensionToMimetype( QString() );
+
     connect( this, SIGNAL( batchReady( QVariantList, QVariantList ) ),
-                     SLOT( commitBatch( QVariantList, QVariantList ) ), Qt::DirectConnection );
+                     SLOT( commitBatch( QVariantList, QVariantList ) ), Qt::UniqueConnection );
+
+    m_readerPool.setMaxThreadCount( m_cpuThreads + m_ioThreads );
+    m_pendingReads = 0;
+    m_listingDone = false;
+    m_scanDone = false;
+
+    m_timer.start();
+    m_listerStats = m_readerStats = m_committerStats = ScanStageStats();
+    m_listerStats.start( 0 );
 
+    // Room for a batch waiting to be committed, one being filled and the files in between
+    int capacity = MAX_FILES_IN_FLIGHT + 2 * m_batchsize;
+    if ( m_scanMode == MusicScanner::FileScan )
+        capacity = qMax( capacity, m_paths.count() );
+
+    delete m_capacity;
+    m_capacity = new QSemaphore( capacity );
+
+    QStringList dirs = m_paths;
     if ( m_scanMode == MusicScanner::FileScan )
     {
-        scanFilePaths();
-        return;
+        dirs = scanFilePaths();
+        if ( dirs.isEmpty() )
+        {
+            listingFinished();
+            return;
+        }
     }
 
     m_dirListerThreadController = new DirListerThreadController( this );
-    m_dirListerThreadController->setPaths( m_paths );
+    m_dirListerThreadController->setPaths( dirs );
+    m_dirListerThreadController->setCapacity( m_capacity );
     m_dirListerThreadController->start( QThread::IdlePriority );
 }
 
 
-void
+QStringList
 MusicScanner::scanFilePaths()
 {
     tDebug( LOGVERBOSE ) << Q_FUNC_INFO;
+
+    // Files go straight to the readers, directories to the DirLister
+    QFileInfoList files;
+    QStringList dirs;
     foreach( QString path, m_paths )
     {
         QFileInfo fi( path );
-        if ( fi.exists() && fi.isReadable() )
-            scanFile( fi );
+        if ( !fi.exists() || !fi.isReadable() )
+            continue;
+
+        if ( fi.isDir() )
+            dirs << fi.canonicalFilePath();
+        else
+            files << fi;
     }
 
-    QMetaObject::invokeMethod( this, "postOps", Qt::QueuedConnection );
+    m_capacity->acquire( files.count() );
+    filesListed( files );
+
+    return dirs;
 }
 
 
 void
-MusicScanner::postOps()
+MusicScanner::filesListed( const QFileInfoList& files )
 {
-    tDebug( LOGVERBOSE ) << Q_FUNC_INFO;
+    m_listerStats.add( m_timer.elapsed(), files.count() );
 
-    if ( m_scanMode == MusicScanner::DirScan )
+    foreach ( const QFileInfo& fi, files )
     {
-        // any remaining stuff that wasnt emitted as a batch:
-        foreach( const QString& key, m_filemtimes.keys() )
+        if ( !needsScan( fi ) )
         {
-            if ( !m_filemtimes[ key ].keys().isEmpty() )
-                m_filesToDelete << m_filemtimes[ key ].keys().first();
+            m_capacity->release();
+            continue;
         }
+
+        m_readerStats.start( m_timer.elapsed() );
+        m_pendingReads++;
+        m_readerPool.start( new TagReaderTask( this, fi ) );
+    }
+}
+
+
+void
+MusicScanner::listingFinished()
+{
+    tDebug( LOGVERBOSE ) << Q_FUNC_INFO << m_listerStats.files << "files listed";
+    m_listingDone = true;
+
+    checkFinished();
+}
+
+
+void
+MusicScanner::checkFinished()
+{
+    if ( !m_listingDone || m_pendingReads )
+        return;
+
+    // Only once per scan
+    m_listingDone = false;
+    postOps();
+}
+
+
+void
+MusicScanner::postOps()
+{
+    tDebug( LOGVERBOSE ) << Q_FUNC_INFO;
+
+    // Whatever we knew about but didn't come across is gone. For file scans
+    // that is only what used to be below the given paths.
+    foreach( const QString& key, m_filemtimes.keys() )
+    {
+        if ( !m_filemtimes[ key ].keys().isEmpty() )
+            m_filesToDelete << m_filemtimes[ key ].keys().first();
     }
 
     tDebug( LOGINFO ) << "Scanning complete, saving to database. ( deleted" << m_filesToDelete.count() << "- scanned" << m_scanned << "- skipped" << m_skipped << ")";
@@ -281,12 +466,18 @@ MusicScanner::postOps()
             SourceList::instance()->getLocal()->updateIndexWhenSynced();
             commitBatch( m_scannedfiles, m_filesToDelete );
         }
+        else
+        {
+            m_committerStats.add( m_timer.elapsed(), m_scannedfiles.count() );
+        }
         m_scannedfiles.clear();
         m_filesToDelete.clear();
     }
 
     m_processedFiles.clear();
 
+    // Batches committed during the scan may still be running
+    m_scanDone = true;
     if ( !m_cmdQueue )
         cleanup();
 }
@@ -321,17 +512,26 @@ MusicScanner::commitBatch( const QVariantList& tracks, const QVariantList& delet
     if ( tracks.length() )
     {
         tDebug( LOGINFO ) << Q_FUNC_INFO << "adding" << tracks.length() << "tracks";
-        executeCommand( dbcmd_ptr( new DatabaseCommand_AddFiles( tracks, SourceList::instance()->getLocal() ) ) );
+        executeCommand( dbcmd_ptr( new DatabaseCommand_AddFiles( tracks, SourceList::instance()->getLocal() ) ), tracks.length() );
     }
 }
 
 
 void
-MusicScanner::executeCommand( dbcmd_ptr cmd )
+MusicScanner::executeCommand( dbcmd_ptr cmd, int files )
 {
     tDebug() << Q_FUNC_INFO << m_cmdQueue;
     m_cmdQueue++;
+    m_committerStats.start( m_timer.elapsed() );
+    m_commitSizes.insert( cmd.data(), files );
     connect( cmd.data(), SIGNAL( finished() ), SLOT( commandFinished() ) );
+    runCommand( cmd );
+}
+
+
+void
+MusicScanner::runCommand( const dbcmd_ptr& cmd )
+{
     Database::instance()->enqueue( cmd );
 }
 
@@ -341,17 +541,25 @@ MusicScanner::commandFinished()
 {
     tDebug() << Q_FUNC_INFO << m_cmdQueue;
 
-    if ( --m_cmdQueue == 0 )
+    // The files of this batch are out of the pipeline now
+    const int files = m_commitSizes.take( sender() );
+    if ( files )
+    {
+        m_committerStats.add( m_timer.elapsed(), files );
+        m_capacity->release( files );
+    }
+
+    if ( --m_cmdQueue == 0 && m_scanDone )
         cleanup();
 }
 
 
-void
-MusicScanner::scanFile( const QFileInfo& fi )
+bool
+MusicScanner::needsScan( const QFileInfo& fi )
 {
     // Don't process a single file twice, this might happen if you add a subfolder of another collection folder to your collection
     if ( m_processedFiles.contains( fi.canonicalFilePath() ) )
-        return;
+        return false;
     else
         m_processedFiles << fi.canonicalFilePath();
 
@@ -362,7 +570,7 @@ MusicScanner::scanFile( const QFileInfo& fi )
                 fi.lastModified().toUTC().toTime_t() == m_filemtimes.value( "file://" + fi.canonicalFilePath() ).values().first() )
         {
             m_filemtimes.remove( "file://" + fi.canonicalFilePath() );
-            return;
+            return false;
         }
 
         if ( !m_filemtimes.value( "file://" + fi.canonicalFilePath() ).keys().isEmpty() )
@@ -370,18 +578,60 @@ MusicScanner::scanFile( const QFileInfo& fi )
         m_filemtimes.remove( "file://" + fi.canonicalFilePath() );
     }
 
-    //tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Scanning file:" << fi.canonicalFilePath();
-    QVariant m = readFile( fi );
+    // Not worth a trip to the reader pool
+    if ( !TomahawkUtils::supportedExtensions().contains( fi.suffix().toLower() ) )
+    {
+        m_skippedFiles << fi.canonicalFilePath();
+        m_skipped++;
+        return false;
+    }
+
+    return true;
+}
+
+
+void
+MusicScanner::tagsRead( const QFileInfo& fi, const QVariant& m )
+{
+    m_pendingReads--;
+    m_readerStats.add( m_timer.elapsed() );
+
+    if ( m_scanned )
+        if ( m_scanned % 3 == 0 )
+            emit progress( m_scanned );
+
+    if ( m_scanned % 100 == 0 || m_verbose )
+      tDebug( LOGINFO ) << "Scanning file:" << m_scanned << fi.canonicalFilePath();
+
     if ( m.toMap().isEmpty() )
-        return;
+    {
+        m_skippedFiles << fi.canonicalFilePath();
+        m_skipped++;
+        m_capacity->release();
+    }
+    else
+    {
+        m_scanned++;
+        m_scannedfiles << m;
+    }
 
-    m_scannedfiles << m;
-    if ( m_batchsize != 0 && (quint32)m_scannedfiles.length() >= m_batchsize )
+    if ( (quint32)m_scannedfiles.length() >= m_batchsize )
     {
-        emit batchReady( m_scannedfiles, m_filesToDelete );
+        if ( !m_dryRun )
+        {
+            emit batchReady( m_scannedfiles, m_filesToDelete );
+        }
+        else
+        {
+            m_committerStats.add( m_timer.elapsed(), m_scannedfiles.count() );
+            m_capacity->release( m_scannedfiles.count() );
+        }
+
         m_scannedfiles.clear();
         m_filesToDelete.clear();
     }
+
+    checkFinished();
 }
 
 
@@ -446,30 +696,3 @@ MusicScanner::readTags( const QFileInfo& fi )
 
     return m;
 }
-
-
-QVariant
-MusicScanner::readFile( const QFileInfo& fi )
-{
-    const QVariant m = readTags( fi );
-
-    if ( m_scanned )
-        if ( m_scanned % 3 == 0 )
-            emit progress( m_scanned );
-
-    if ( m_scanned % 100 == 0 || m_verbose )
-      tDebug( LOGINFO ) << "Scanning file:" << m_scanned << fi.canonicalFilePath();
-
-    if ( m.toMap().isEmpty() )
-    {
-        m_skippedFiles << fi.canonicalFilePath();
-        m_skipped++;
-    }
-    else
-    {
-        m_scanned++;
-    }
-
-    return m;
-}
-
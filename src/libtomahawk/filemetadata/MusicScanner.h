@@ -30,26 +30,29 @@
 
 #include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QHash>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QPointer>
+#include <QSemaphore>
 #include <QString>
 #include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QVariantMap>
 
-// descend dir tree comparing dir mtimes to last known mtime
-// emit signal for any dir with new content, so we can scan it.
-// finally, emit the list of new mtimes we observed.
+// descend the dir tree and hand out the files found in chunks.
+// blocks while the rest of the pipeline has too many files in flight.
 class DirLister : public QObject
 {
 Q_OBJECT
 
 public:
 
-    DirLister( const QStringList& dirs )
-        : QObject(), m_dirs( dirs ), m_opcount( 0 ), m_deleting( false )
+    DirLister( const QStringList& dirs, QSemaphore* capacity )
+        : QObject(), m_dirs( dirs ), m_capacity( capacity ), m_deleting( false )
     {
         qDebug() << Q_FUNC_INFO;
     }
@@ -63,18 +66,19 @@ public:
     void setIsDeleting() { QMutexLocker locker( &m_deletingMutex ); m_deleting = true; };
 
 signals:
-    void fileToScan( QFileInfo );
+    void filesToScan( const QFileInfoList& files );
     void finished();
 
 private slots:
     void go();
-    void scanDir( QDir dir, int depth );
 
 private:
+    bool flush( QFileInfoList& files );
+
     QStringList m_dirs;
     QSet< QString > m_processedDirs;
+    QSemaphore* m_capacity;
 
-    uint m_opcount;
     QMutex m_deletingMutex;
     bool m_deleting;
 };
@@ -88,13 +92,45 @@ public:
     virtual ~DirListerThreadController();
 
     void setPaths( const QStringList& paths ) { m_paths = paths; }
+    void setCapacity( QSemaphore* capacity ) { m_capacity = capacity; }
+    // Makes the lister give up, even while it waits for capacity
+    void stop();
     void run();
 
 private:
     QPointer< DirLister > m_dirLister;
     QStringList m_paths;
+    QSemaphore* m_capacity;
+
+    QMutex m_stopMutex;
+    bool m_stopped;
+};
+
+/**
+ * Throughput of one stage of the scan pipeline. Times are in ms since the scan started.
+ */
+struct ScanStageStats
+{
+    ScanStageStats() : files( 0 ), started( -1 ), finished( 0 ) {}
+
+    void start( qint64 now ) { if ( started < 0 ) started = now; }
+    void add( qint64 now, unsigned int count = 1 ) { start( now ); files += count; finished = now; }
+
+    qint64 elapsed() const { return started < 0 ? 0 : finished - started; }
+    double filesPerSecond() const { return elapsed() > 0 ? files * 1000.0 / elapsed() : 0.0; }
+
+    unsigned int files;
+    qint64 started;
+    qint64 finished;
 };
 
+/**
+ * Scans in three stages: a DirLister thread enumerates the files, a pool of
+ * workers reads their tags and the scanner itself batches the results into
+ * DatabaseCommand_AddFiles. Only a limited number of files may be in flight
+ * between enumeration and commit, so a slow disk or database holds back the
+ * stages in front of it.
+ */
 class DLLEXPORT MusicScanner : public QObject
 {
 Q_OBJECT
@@ -124,6 +160,25 @@ public:
     void setVerbose( bool _verbose );
     bool verbose();
 
+    /**
+     * Size the tag reader pool. cpuThreads keep the cores busy parsing tags,
+     * ioThreads are added on top so there are still reads in flight while
+     * other workers wait for the disk or network share. Negative values keep
+     * the defaults.
+     */
+    void setReaderThreads( int cpuThreads, int ioThreads );
+
+    ScanStageStats listerStats() const { return m_listerStats; }
+    ScanStageStats readerStats() const { return m_readerStats; }
+    ScanStageStats committerStats() const { return m_committerStats; }
+
+protected:
+    /**
+     * Runs a command of the commit stage, by default on the Database.
+     * The scanner is done once all of them finished after the last read.
+     */
+    virtual void runCommand( const Tomahawk::dbcmd_ptr& cmd );
+
 signals:
     //void fileScanned( QVariantMap );
     void finished();
@@ -131,12 +186,13 @@ signals:
     void progress( unsigned int files );
 
 private:
-    QVariant readFile( const QFileInfo& fi );
-    void executeCommand( Tomahawk::dbcmd_ptr cmd );
+    void executeCommand( Tomahawk::dbcmd_ptr cmd, int files = 0 );
 
 private slots:
     void postOps();
-    void scanFile( const QFileInfo& fi );
+    void filesListed( const QFileInfoList& files );
+    void listingFinished();
+    void tagsRead( const QFileInfo& fi, const QVariant& m );
     void setFileMtimes( const QMap< QString, QMap< unsigned int, unsigned int > >& m );
     void startScan();
     void scan();
@@ -145,7 +201,9 @@ private slots:
     void commandFinished();
 
 private:
-    void scanFilePaths();
+    QStringList scanFilePaths();
+    bool needsScan( const QFileInfo& fi );
+    void checkFinished();
 
     MusicScanner::ScanMode m_scanMode;
     QStringList m_paths;
@@ -158,6 +216,8 @@ private:
     QMap<QString, QMap< unsigned int, unsigned int > > m_filemtimes;
 
     unsigned int m_cmdQueue;
+    // files of each running AddFiles command, released once it is done
+    QHash< QObject*, int > m_commitSizes;
 
     QSet< QString > m_processedFiles;
     QVariantList m_scannedfiles;
@@ -165,6 +225,19 @@ private:
     quint32 m_batchsize;
 
     DirListerThreadController* m_dirListerThreadController;
+    QThreadPool m_readerPool;
+    int m_cpuThreads;
+    int m_ioThreads;
+    QSemaphore* m_capacity;
+    unsigned int m_pendingReads;
+    bool m_listingDone;
+    // listing and reads are done, only commands may still be running
+    bool m_scanDone;
+
+    QElapsedTimer m_timer;
+    ScanStageStats m_listerStats;
+    ScanStageStats m_readerStats;
+    ScanStageStats m_committerStats;
 };
 
 #endif
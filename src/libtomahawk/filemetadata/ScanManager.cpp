@@ -27,6 +27,7 @@
 
 #include "MusicScanner.h"
 #include "PlaylistEntry.h"
+#include "ScanWatcher.h"
 #include "SourceList.h"
 #include "TomahawkSettings.h"
 
@@ -82,6 +83,8 @@ ScanManager::ScanManager( QObject* parent )
     , m_currScannerPaths()
     , m_cachedScannerDirs()
     , m_queuedScanType( MusicScanner::None )
+    , m_watcher( 0 )
+    , m_watcherThread( 0 )
     , m_updateGUI( true )
 {
     s_instance = this;
@@ -96,6 +99,8 @@ ScanManager::~ScanManager()
 {
     qDebug() << Q_FUNC_INFO;
 
+    stopWatcher();
+
     if ( m_musicScannerThreadController )
     {
         m_musicScannerThreadController->quit();
@@ -119,8 +124,61 @@ ScanManager::init()
         m_cachedScannerDirs = TomahawkSettings::instance()->scannerPaths();
         m_scanTimer->start();
         if ( TomahawkSettings::instance()->watchForChanges() )
+        {
+            startWatcher();
             QTimer::singleShot( 1000, this, SLOT( runStartupScan() ) );
+        }
+    }
+}
+
+
+void
+ScanManager::startWatcher()
+{
+    if ( !ScanWatcher::isSupported() )
+        return;
+
+    if ( !m_watcher )
+    {
+        ScanWatcher* watcher = new ScanWatcher();
+        if ( !watcher->isActive() )
+        {
+            // Without a watcher the scan timer keeps rescanning everything
+            tLog() << Q_FUNC_INFO << "Not watching for changes, falling back to periodic rescans";
+            delete watcher;
+            return;
+        }
+
+        m_watcherThread = new QThread( this );
+        m_watcher = watcher;
+        m_watcher->moveToThread( m_watcherThread );
+
+        // Its socket notifier and timers belong to the watcher thread, so it has to be deleted in there
+        connect( m_watcherThread, SIGNAL( finished() ), m_watcher, SLOT( deleteLater() ) );
+
+        connect( m_watcher, SIGNAL( changed( QStringList ) ), SLOT( runFileScan( QStringList ) ), Qt::QueuedConnection );
+        connect( m_watcher, SIGNAL( overflowed() ), SLOT( runNormalScan() ), Qt::QueuedConnection );
+
+        m_watcherThread->start( QThread::IdlePriority );
     }
+
+    QMetaObject::invokeMethod( m_watcher, "setPaths", Qt::QueuedConnection, Q_ARG( QStringList, m_cachedScannerDirs ) );
+}
+
+
+void
+ScanManager::stopWatcher()
+{
+    if ( !m_watcher )
+        return;
+
+    // Deletes the watcher on its way out
+    m_watcherThread->quit();
+    m_watcherThread->wait( 60000 );
+
+    m_watcher = 0;
+    delete m_watcherThread;
+    m_watcherThread = 0;
 }
 
 
@@ -129,6 +187,8 @@ ScanManager::onSettingsChanged()
 {
     if ( !TomahawkSettings::instance()->watchForChanges() && m_scanTimer->isActive() )
         m_scanTimer->stop();
+    if ( !TomahawkSettings::instance()->watchForChanges() )
+        stopWatcher();
 
     m_scanTimer->setInterval( TomahawkSettings::instance()->scannerTime() * 1000 );
 
@@ -136,11 +196,15 @@ ScanManager::onSettingsChanged()
         m_cachedScannerDirs != TomahawkSettings::instance()->scannerPaths() )
     {
         m_cachedScannerDirs = TomahawkSettings::instance()->scannerPaths();
+        if ( m_watcher )
+            startWatcher();
         runNormalScan();
     }
 
     if ( TomahawkSettings::instance()->watchForChanges() && !m_scanTimer->isActive() )
         m_scanTimer->start();
+    if ( TomahawkSettings::instance()->watchForChanges() && !m_watcher && TomahawkSettings::instance()->hasScannerPaths() )
+        startWatcher();
 }
 
 
@@ -163,6 +227,10 @@ ScanManager::scanTimerTimeout()
          !Database::instance() ||
          ( Database::instance() && !Database::instance()->isReady() ) )
         return;
+
+    // The watcher reports changes as they happen, only what it can't watch needs checking
+    if ( m_watcher )
+        QMetaObject::invokeMethod( m_watcher, "poll", Qt::QueuedConnection );
     else
         runNormalScan();
 }
@@ -320,7 +388,7 @@ ScanManager::scannerFinished()
             QMetaObject::invokeMethod( this, "runNormalScan", Qt::QueuedConnection, Q_ARG( bool, m_queuedScanType == MusicScanner::Full ) );
             break;
         case MusicScanner::File:
-            QMetaObject::invokeMethod( this, "", Qt::QueuedConnection, Q_ARG( QStringList, QStringList() ) );
+            QMetaObject::invokeMethod( this, "runFileScan", Qt::QueuedConnection, Q_ARG( QStringList, QStringList() ) );
             break;
         default:
             break;
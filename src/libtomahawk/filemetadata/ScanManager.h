@@ -35,6 +35,7 @@
 
 class QFileSystemWatcher;
 class QTimer;
+class ScanWatcher;
 
 class MusicScannerThreadController : public QThread
 {
@@ -91,6 +92,9 @@ private slots:
     void filesDeleted();
 
 private:
+    void startWatcher();
+    void stopWatcher();
+
     static ScanManager* s_instance;
 
     MusicScanner::ScanMode m_currScanMode;
@@ -101,6 +105,10 @@ private:
     QTimer* m_scanTimer;
     MusicScanner::ScanType m_queuedScanType;
 
+    // With a watcher, only the paths it reports get scanned after startup
+    ScanWatcher* m_watcher;
+    QThread* m_watcherThread;
+
     bool m_updateGUI;
 };
 
@@ -0,0 +1,373 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ScanWatcher.h"
+
+#include "database/Database.h"
+#include "database/DatabaseCommand_DirMtimes.h"
+#include "utils/Logger.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#ifdef Q_OS_LINUX
+    #include <errno.h>
+    #include <string.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+// report changes once nothing happened for this long
+#define QUIET_PERIOD 2000
+// but don't wait longer than this while files keep changing, e.g. during a big copy
+#define MAX_REPORT_DELAY 30000
+#define EVENT_BUFFER_SIZE 64 * 1024
+
+#ifdef Q_OS_LINUX
+    #define WATCH_MASK ( IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR )
+#endif
+
+using namespace Tomahawk;
+
+
+ScanWatcher::ScanWatcher( QObject* parent )
+    : QObject( parent )
+    , m_fd( -1 )
+    , m_notifier( 0 )
+    , m_dirMtimesLoaded( false )
+    , m_dirMtimesLoading( false )
+{
+    m_quietTimer = new QTimer( this );
+    m_quietTimer->setSingleShot( true );
+    m_quietTimer->setInterval( QUIET_PERIOD );
+    connect( m_quietTimer, SIGNAL( timeout() ), SLOT( flush() ) );
+
+    m_maxDelayTimer = new QTimer( this );
+    m_maxDelayTimer->setSingleShot( true );
+    m_maxDelayTimer->setInterval( MAX_REPORT_DELAY );
+    connect( m_maxDelayTimer, SIGNAL( timeout() ), SLOT( flush() ) );
+
+#ifdef Q_OS_LINUX
+    m_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( m_fd < 0 )
+        tLog() << Q_FUNC_INFO << "Could not initialize inotify:" << strerror( errno );
+#endif
+}
+
+
+ScanWatcher::~ScanWatcher()
+{
+    delete m_notifier;
+
+#ifdef Q_OS_LINUX
+    if ( m_fd >= 0 )
+        close( m_fd );
+#endif
+}
+
+
+bool
+ScanWatcher::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void
+ScanWatcher::setPaths( const QStringList& paths )
+{
+    if ( m_fd < 0 )
+        return;
+
+    if ( !m_notifier )
+    {
+        m_notifier = new QSocketNotifier( m_fd, QSocketNotifier::Read, this );
+        connect( m_notifier, SIGNAL( activated( int ) ), SLOT( readEvents() ) );
+    }
+
+    foreach ( const QString& dir, m_watchedDirs.keys() )
+        unwatchTree( dir );
+
+    m_unwatched.clear();
+    m_dirMtimes.clear();
+    m_dirMtimesLoaded = false;
+
+    foreach ( const QString& path, paths )
+    {
+        const QString canonical = QFileInfo( path ).canonicalFilePath();
+        if ( !canonical.isEmpty() )
+            watchTree( canonical );
+    }
+
+    tDebug() << Q_FUNC_INFO << "Watching" << m_watches.count() << "directories," << m_unwatched.count() << "subtrees left to polling";
+}
+
+
+void
+ScanWatcher::watchTree( const QString& root )
+{
+#ifdef Q_OS_LINUX
+    QStringList dirs;
+    dirs << root;
+
+    while ( !dirs.isEmpty() )
+    {
+        const QString path = dirs.takeLast();
+        if ( m_watchedDirs.contains( path ) )
+            continue;
+
+        const int wd = inotify_add_watch( m_fd, QFile::encodeName( path ).constData(), WATCH_MASK );
+        if ( wd < 0 )
+        {
+            if ( errno == ENOSPC )
+            {
+                // Out of watches, the whole subtree falls back to polling its mtimes
+                tLog() << Q_FUNC_INFO << "inotify watch limit reached, polling" << path << "instead";
+                m_unwatched << path;
+            }
+            continue;
+        }
+
+        m_watches.insert( wd, path );
+        m_watchedDirs.insert( path, wd );
+
+        QDir dir( path );
+        dir.setFilter( QDir::Dirs | QDir::Readable | QDir::NoDotAndDotDot );
+        foreach ( const QFileInfo& di, dir.entryInfoList() )
+            dirs << di.canonicalFilePath();
+    }
+#else
+    Q_UNUSED( root );
+#endif
+}
+
+
+void
+ScanWatcher::unwatchTree( const QString& root )
+{
+#ifdef Q_OS_LINUX
+    const QString prefix = root + "/";
+
+    foreach ( const QString& path, m_watchedDirs.keys() )
+    {
+        if ( path != root && !path.startsWith( prefix ) )
+            continue;
+
+        const int wd = m_watchedDirs.take( path );
+        m_watches.remove( wd );
+        inotify_rm_watch( m_fd, wd );
+    }
+#else
+    Q_UNUSED( root );
+#endif
+}
+
+
+void
+ScanWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+    char buffer[ EVENT_BUFFER_SIZE ] __attribute__ ( ( aligned( __alignof__( struct inotify_event ) ) ) );
+
+    forever
+    {
+        const ssize_t len = read( m_fd, buffer, sizeof( buffer ) );
+        if ( len <= 0 )
+            break;
+
+        for ( char* p = buffer; p < buffer + len; )
+        {
+            const struct inotify_event* event = reinterpret_cast< const struct inotify_event* >( p );
+            p += sizeof( struct inotify_event ) + event->len;
+
+            if ( event->mask & IN_Q_OVERFLOW )
+            {
+                tLog() << Q_FUNC_INFO << "inotify queue overflowed, changes were lost";
+                m_changes.clear();
+                m_quietTimer->stop();
+                m_maxDelayTimer->stop();
+                emit overflowed();
+                continue;
+            }
+
+            const QString dir = m_watches.value( event->wd );
+            if ( dir.isEmpty() )
+                continue;
+
+            if ( event->mask & IN_IGNORED )
+            {
+                // The kernel dropped the watch, the directory is gone
+                m_watches.remove( event->wd );
+                m_watchedDirs.remove( dir );
+                continue;
+            }
+
+            if ( event->mask & IN_DELETE_SELF )
+            {
+                addChange( dir );
+                continue;
+            }
+
+            if ( !event->len )
+                continue;
+
+            const QString path = dir + "/" + QFile::decodeName( event->name );
+            if ( event->mask & IN_ISDIR )
+            {
+                // A directory moved in brings files we never got events for,
+                // one that moved out leaves watches under its old name behind
+                if ( event->mask & ( IN_CREATE | IN_MOVED_TO ) )
+                    watchTree( path );
+                else if ( event->mask & IN_MOVED_FROM )
+                    unwatchTree( path );
+            }
+
+            addChange( path );
+        }
+    }
+#endif
+}
+
+
+void
+ScanWatcher::addChange( const QString& path )
+{
+    m_changes << path;
+
+    m_quietTimer->start();
+    if ( !m_maxDelayTimer->isActive() )
+        m_maxDelayTimer->start();
+}
+
+
+void
+ScanWatcher::flush()
+{
+    m_quietTimer->stop();
+    m_maxDelayTimer->stop();
+
+    if ( m_changes.isEmpty() )
+        return;
+
+    // Scanning a directory covers everything below it
+    QStringList coalesced;
+    foreach ( const QString& path, m_changes )
+    {
+        bool covered = false;
+        for ( int i = path.lastIndexOf( '/' ); i > 0 && !covered; i = path.lastIndexOf( '/', i - 1 ) )
+            covered = m_changes.contains( path.left( i ) );
+
+        if ( !covered )
+            coalesced << path;
+    }
+    m_changes.clear();
+
+    tDebug() << Q_FUNC_INFO << coalesced.count() << "changed paths";
+    emit changed( coalesced );
+}
+
+
+void
+ScanWatcher::poll()
+{
+    if ( m_unwatched.isEmpty() )
+        return;
+
+    if ( !m_dirMtimesLoaded )
+    {
+        if ( !m_dirMtimesLoading && Database::instance() )
+        {
+            m_dirMtimesLoading = true;
+
+            DatabaseCommand_DirMtimes* cmd = new DatabaseCommand_DirMtimes( m_unwatched );
+            connect( cmd, SIGNAL( done( QMap< QString, unsigned int > ) ),
+                          SLOT( onDirMtimesLoaded( QMap< QString, unsigned int > ) ), Qt::QueuedConnection );
+            Database::instance()->enqueue( Tomahawk::dbcmd_ptr( cmd ) );
+        }
+        return;
+    }
+
+    QMap< QString, unsigned int > mtimes;
+    foreach ( const QString& root, m_unwatched )
+        dirMtimes( root, mtimes );
+
+    if ( mtimes == m_dirMtimes )
+        return;
+
+    // Without anything to compare with, the current state is just the baseline
+    if ( !m_dirMtimes.isEmpty() )
+    {
+        QMap< QString, unsigned int >::const_iterator it = mtimes.constBegin();
+        for ( ; it != mtimes.constEnd(); ++it )
+        {
+            if ( !m_dirMtimes.contains( it.key() ) || m_dirMtimes.value( it.key() ) != it.value() )
+                addChange( it.key() );
+        }
+
+        foreach ( const QString& dir, m_dirMtimes.keys() )
+        {
+            if ( !mtimes.contains( dir ) )
+                addChange( dir );
+        }
+    }
+
+    m_dirMtimes = mtimes;
+    Database::instance()->enqueue( Tomahawk::dbcmd_ptr( new DatabaseCommand_DirMtimes( m_unwatched, mtimes ) ) );
+}
+
+
+void
+ScanWatcher::onDirMtimesLoaded( const QMap< QString, unsigned int >& mtimes )
+{
+    m_dirMtimes = mtimes;
+    m_dirMtimesLoaded = true;
+    m_dirMtimesLoading = false;
+
+    poll();
+}
+
+
+void
+ScanWatcher::dirMtimes( const QString& root, QMap< QString, unsigned int >& mtimes ) const
+{
+    QStringList dirs;
+    dirs << root;
+
+    while ( !dirs.isEmpty() )
+    {
+        const QString path = dirs.takeLast();
+        if ( mtimes.contains( path ) )
+            continue;
+
+        const QFileInfo fi( path );
+        if ( !fi.isDir() )
+            continue;
+
+        mtimes.insert( path, fi.lastModified().toUTC().toTime_t() );
+
+        QDir dir( path );
+        dir.setFilter( QDir::Dirs | QDir::Readable | QDir::NoDotAndDotDot );
+        foreach ( const QFileInfo& di, dir.entryInfoList() )
+            dirs << di.canonicalFilePath();
+    }
+}
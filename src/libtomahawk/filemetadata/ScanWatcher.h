@@ -0,0 +1,97 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCANWATCHER_H
+#define SCANWATCHER_H
+
+#include "DllMacro.h"
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * Watches the collection directories with inotify and reports the files and
+ * directories that were created, changed, moved or removed, so only those
+ * need to be rescanned.
+ *
+ * Changes are collected until things have been quiet for a moment and then
+ * reported at once, without paths that are below another reported directory.
+ *
+ * Directories that can't be watched because the kernel watch limit is used
+ * up are compared against their mtimes in dirs_scanned on every poll()
+ * instead.
+ *
+ * Lives in its own thread, all slots need to be invoked queued.
+ */
+class DLLEXPORT ScanWatcher : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit ScanWatcher( QObject* parent = 0 );
+    virtual ~ScanWatcher();
+
+    // false if this platform has no inotify, the caller has to keep rescanning everything
+    static bool isSupported();
+    // false if inotify could not be set up, e.g. because the instance limit is reached
+    bool isActive() const { return m_fd >= 0; }
+
+public slots:
+    // Replaces all watches with ones for these directories and everything below them
+    void setPaths( const QStringList& paths );
+    // Checks the directories that could not be watched
+    void poll();
+
+signals:
+    void changed( const QStringList& paths );
+    // Events were lost, everything needs to be rescanned
+    void overflowed();
+
+private slots:
+    void readEvents();
+    void flush();
+    void onDirMtimesLoaded( const QMap< QString, unsigned int >& mtimes );
+
+private:
+    void watchTree( const QString& root );
+    void unwatchTree( const QString& root );
+    void addChange( const QString& path );
+    void dirMtimes( const QString& root, QMap< QString, unsigned int >& mtimes ) const;
+
+    int m_fd;
+    QSocketNotifier* m_notifier;
+
+    QHash< int, QString > m_watches;
+    QHash< QString, int > m_watchedDirs;
+    // roots of the subtrees we ran out of watches for
+    QStringList m_unwatched;
+
+    bool m_dirMtimesLoaded;
+    bool m_dirMtimesLoading;
+    QMap< QString, unsigned int > m_dirMtimes;
+
+    QSet< QString > m_changes;
+    QTimer* m_quietTimer;
+    QTimer* m_maxDelayTimer;
+};
+
+#endif // SCANWATCHER_H
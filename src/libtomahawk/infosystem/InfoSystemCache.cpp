@@ -25,9 +25,18 @@
 #include "utils/Logger.h"
 #include "Source.h"
 
+#include <QDataStream>
 #include <QDir>
-#include <QSettings>
 #include <QCryptographicHash>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#define CACHE_CONNECTION_NAME "InfoSystemCache"
+#define PRUNE_INTERVAL 300000
+// Upper bound for the cache file, evicting brings it down to 90% of that
+#define MAX_CACHE_SIZE 256 * 1024 * 1024
+// Reads only refresh an entry's last access when it is older than this, saves a write per hit
+#define ACCESS_RESOLUTION 3600000
 
 namespace Tomahawk
 {
@@ -35,21 +44,58 @@ namespace Tomahawk
 namespace InfoSystem
 {
 
-const int InfoSystemCache::s_infosystemCacheVersion = 4;
+const int InfoSystemCache::s_infosystemCacheVersion = 5;
+
+
+static QString
+dataCacheKey( InfoType type, const QString& hash )
+{
+    return QString::number( (int)type ) + '/' + hash;
+}
+
+
+static QByteArray
+serialize( const QVariant& output )
+{
+    QByteArray data;
+    QDataStream stream( &data, QIODevice::WriteOnly );
+    stream.setVersion( QDataStream::Qt_4_8 );
+    stream << output;
+
+    return data;
+}
+
+
+static QVariant
+deserialize( const QByteArray& data )
+{
+    QVariant output;
+    QDataStream stream( data );
+    stream.setVersion( QDataStream::Qt_4_8 );
+    stream >> output;
+
+    return output;
+}
+
 
 InfoSystemCache::InfoSystemCache( QObject* parent )
     : QObject( parent )
     , m_cacheBaseDir( TomahawkSettings::instance()->storageCacheLocation() + "/InfoSystemCache/" )
+    , m_totalSize( 0 )
 {
     tDebug() << Q_FUNC_INFO;
 
+    // Also gets rid of the per-entry files older versions kept in there
     if ( TomahawkSettings::instance()->infoSystemCacheVersion() < s_infosystemCacheVersion )
     {
         TomahawkUtils::removeDirectory( m_cacheBaseDir );
         TomahawkSettings::instance()->setInfoSystemCacheVersion( s_infosystemCacheVersion );
     }
 
-    m_pruneTimer.setInterval( 300000 );
+    if ( !openDatabase() )
+        tLog() << "Failed to open the infosystem cache, running without it";
+
+    m_pruneTimer.setInterval( PRUNE_INTERVAL );
     m_pruneTimer.setSingleShot( false );
     connect( &m_pruneTimer, SIGNAL( timeout() ), SLOT( pruneTimerFired() ) );
     m_pruneTimer.start();
@@ -59,6 +105,58 @@ InfoSystemCache::InfoSystemCache( QObject* parent )
 InfoSystemCache::~InfoSystemCache()
 {
     tDebug() << Q_FUNC_INFO;
+
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase( CACHE_CONNECTION_NAME );
+}
+
+
+bool
+InfoSystemCache::openDatabase()
+{
+    QDir dir( m_cacheBaseDir );
+    if ( !dir.exists() && !dir.mkpath( m_cacheBaseDir ) )
+    {
+        tLog() << "Failed to create cache dir" << m_cacheBaseDir;
+        return false;
+    }
+
+    m_db = QSqlDatabase::addDatabase( "QSQLITE", CACHE_CONNECTION_NAME );
+    m_db.setDatabaseName( m_cacheBaseDir + "cache.db" );
+    if ( !m_db.open() )
+    {
+        tLog() << "Failed to open cache database:" << m_db.lastError().text();
+        return false;
+    }
+
+    // Losing the last few writes on a crash is fine for a cache
+    QSqlQuery query( m_db );
+    query.exec( "PRAGMA journal_mode = WAL" );
+    query.exec( "PRAGMA synchronous = NORMAL" );
+
+    if ( !query.exec( "CREATE TABLE IF NOT EXISTS cache ("
+                      "type INTEGER NOT NULL, "
+                      "hash TEXT NOT NULL, "
+                      "expires INTEGER NOT NULL, "
+                      "accessed INTEGER NOT NULL, "
+                      "size INTEGER NOT NULL, "
+                      "data BLOB NOT NULL, "
+                      "PRIMARY KEY ( type, hash ) )" ) )
+    {
+        tLog() << "Failed to create cache table:" << query.lastError().text();
+        m_db.close();
+        return false;
+    }
+    query.exec( "CREATE INDEX IF NOT EXISTS cache_expires ON cache( expires )" );
+    query.exec( "CREATE INDEX IF NOT EXISTS cache_accessed ON cache( accessed )" );
+
+    query.exec( "SELECT COALESCE( SUM( size ), 0 ) FROM cache" );
+    if ( query.next() )
+        m_totalSize = query.value( 0 ).toLongLong();
+
+    tDebug() << Q_FUNC_INFO << "Cache holds" << m_totalSize << "bytes";
+    return true;
 }
 
 
@@ -66,29 +164,34 @@ void
 InfoSystemCache::pruneTimerFired()
 {
     qDebug() << Q_FUNC_INFO << "Pruning infosystemcache";
-    qlonglong currentMSecsSinceEpoch = QDateTime::currentMSecsSinceEpoch();
+    if ( !m_db.isOpen() )
+        return;
 
-    for ( int i = InfoNoInfo; i <= InfoLastInfo; i++ )
+    const qlonglong currentMSecsSinceEpoch = QDateTime::currentMSecsSinceEpoch();
+
+    // Only touches the expired rows, thanks to the index on expires
+    QSqlQuery query( m_db );
+    query.prepare( "SELECT type, hash, size FROM cache WHERE expires < ?" );
+    query.addBindValue( currentMSecsSinceEpoch );
+    query.exec();
+
+    int removed = 0;
+    while ( query.next() )
     {
-        InfoType type = (InfoType)(i);
-        QHash< QString, QString > fileLocationHash = m_fileLocationCache[type];
-        const QString cacheDirName = m_cacheBaseDir + QString::number( (int)type );
-        QFileInfoList fileList = QDir( cacheDirName ).entryInfoList( QDir::Files | QDir::NoDotAndDotDot );
-        foreach ( QFileInfo file, fileList )
-        {
-            QString baseName = file.baseName();
-            if ( file.suffix().toLongLong() < currentMSecsSinceEpoch )
-            {
-                if ( !QFile::remove( file.canonicalFilePath() ) )
-                    tLog() << "Failed to remove stale cache file" << file.canonicalFilePath();
-                else
-                    qDebug() << "Removed stale cache file" << file.canonicalFilePath();
-            }
-            if ( fileLocationHash.contains( baseName ) )
-                fileLocationHash.remove( baseName );
-        }
-        m_fileLocationCache[type] = fileLocationHash;
+        m_dataCache.remove( dataCacheKey( (InfoType)query.value( 0 ).toInt(), query.value( 1 ).toString() ) );
+        m_totalSize -= query.value( 2 ).toLongLong();
+        removed++;
     }
+
+    if ( !removed )
+        return;
+
+    query.prepare( "DELETE FROM cache WHERE expires < ?" );
+    query.addBindValue( currentMSecsSinceEpoch );
+    if ( !query.exec() )
+        tLog() << "Failed to remove stale cache entries:" << query.lastError().text();
+    else
+        qDebug() << "Removed" << removed << "stale cache entries";
 }
 
 
@@ -96,92 +199,60 @@ void
 InfoSystemCache::getCachedInfoSlot( Tomahawk::InfoSystem::InfoStringHash criteria, qint64 newMaxAge, Tomahawk::InfoSystem::InfoRequestData requestData )
 {
     QObject* sendingObj = sender();
-    const QString criteriaHashVal = criteriaMd5( criteria );
-    const QString criteriaHashValWithType = criteriaMd5( criteria, requestData.type );
-    QHash< QString, QString > fileLocationHash = m_fileLocationCache[ requestData.type ];
-    if ( !fileLocationHash.contains( criteriaHashVal ) )
+    if ( !m_db.isOpen() )
     {
-        if ( !fileLocationHash.isEmpty() )
-        {
-            //We already know of some values, so no need to re-read the directory again as it's already happened
-            //qDebug() << Q_FUNC_INFO << "notInCache -- filelocationhash empty";
-            notInCache( sendingObj, criteria, requestData );
-            return;
-        }
-
-        const QString cacheDir = m_cacheBaseDir + QString::number( (int)requestData.type );
-        QDir dir( cacheDir );
-        if ( !dir.exists() )
-        {
-            //Dir doesn't exist so clearly not in cache
-            //qDebug() << Q_FUNC_INFO << "notInCache -- dir doesn't exist";
-            notInCache( sendingObj, criteria, requestData );
-            return;
-        }
-
-        QFileInfoList fileList = dir.entryInfoList( QDir::Files | QDir::NoDotAndDotDot );
-        foreach ( QFileInfo file, fileList )
-        {
-            QString baseName = file.baseName();
-            fileLocationHash[ baseName ] = file.canonicalFilePath();
-        }
-
-        //Store what we've loaded up
-        m_fileLocationCache[ requestData.type ] = fileLocationHash;
-        if ( !fileLocationHash.contains( criteriaHashVal ) )
-        {
-            //Still didn't find it? It's really not in the cache then
-            //qDebug() << Q_FUNC_INFO << "notInCache -- filelocationhash doesn't contain criteria val";
-            notInCache( sendingObj, criteria, requestData );
-            return;
-        }
+        notInCache( sendingObj, criteria, requestData );
+        return;
     }
 
-    QFileInfo file( fileLocationHash[ criteriaHashVal ] );
-    qlonglong currMaxAge = file.suffix().toLongLong();
+    const QString criteriaHashVal = criteriaMd5( criteria );
+    const QString dataKey = dataCacheKey( requestData.type, criteriaHashVal );
+    const qlonglong now = QDateTime::currentMSecsSinceEpoch();
 
-    if ( currMaxAge < QDateTime::currentMSecsSinceEpoch() )
-    {
-        if ( !QFile::remove( file.canonicalFilePath() ) )
-            tLog() << "Failed to remove stale cache file" << file.canonicalFilePath();
-        else
-            qDebug() << "Removed stale cache file" << file.canonicalFilePath();
+    // No need to read the data again if we still have it in memory
+    const bool inMemory = m_dataCache.contains( dataKey );
 
-        fileLocationHash.remove( criteriaHashVal );
-        m_fileLocationCache[ requestData.type ] = fileLocationHash;
-        m_dataCache.remove( criteriaHashValWithType );
+    QSqlQuery query( m_db );
+    query.prepare( inMemory ? "SELECT expires, accessed FROM cache WHERE type = ? AND hash = ?"
+                            : "SELECT expires, accessed, data FROM cache WHERE type = ? AND hash = ?" );
+    query.addBindValue( (int)requestData.type );
+    query.addBindValue( criteriaHashVal );
+    query.exec();
 
-        qDebug() << Q_FUNC_INFO << "notInCache -- file was stale";
+    if ( !query.next() )
+    {
+        m_dataCache.remove( dataKey );
         notInCache( sendingObj, criteria, requestData );
         return;
     }
-    else if ( newMaxAge > 0 )
-    {
-        const QString newFilePath = QString( file.dir().canonicalPath() + '/' + criteriaHashVal + '.' + QString::number( QDateTime::currentMSecsSinceEpoch() + newMaxAge ) );
 
-        if ( !QFile::rename( file.canonicalFilePath(), newFilePath ) )
-        {
-            qDebug() << Q_FUNC_INFO << "notInCache -- failed to move old cache file to new location";
-            notInCache( sendingObj, criteria, requestData );
-            return;
-        }
+    const qlonglong currMaxAge = query.value( 0 ).toLongLong();
+    const qlonglong accessed = query.value( 1 ).toLongLong();
+    QVariant output = inMemory ? *( m_dataCache[ dataKey ] ) : deserialize( query.value( 2 ).toByteArray() );
 
-        fileLocationHash[ criteriaHashVal ] = newFilePath;
-        m_fileLocationCache[ requestData.type ] = fileLocationHash;
-    }
-
-    if ( !m_dataCache.contains( criteriaHashValWithType ) )
+    if ( currMaxAge < now )
     {
-        QSettings cachedSettings( fileLocationHash[ criteriaHashVal ], QSettings::IniFormat );
-        QVariant output = cachedSettings.value( "data" );
-        m_dataCache.insert( criteriaHashValWithType, new QVariant( output ) );
+        removeEntry( requestData.type, criteriaHashVal );
 
-        emit info( requestData, output );
+        qDebug() << Q_FUNC_INFO << "notInCache -- entry was stale";
+        notInCache( sendingObj, criteria, requestData );
+        return;
     }
-    else
+
+    if ( newMaxAge > 0 || accessed + ACCESS_RESOLUTION < now )
     {
-        emit info( requestData, QVariant( *( m_dataCache[ criteriaHashValWithType ] ) ) );
+        query.prepare( "UPDATE cache SET expires = ?, accessed = ? WHERE type = ? AND hash = ?" );
+        query.addBindValue( newMaxAge > 0 ? now + newMaxAge : currMaxAge );
+        query.addBindValue( now );
+        query.addBindValue( (int)requestData.type );
+        query.addBindValue( criteriaHashVal );
+        query.exec();
     }
+
+    if ( !inMemory )
+        m_dataCache.insert( dataKey, new QVariant( output ) );
+
+    emit info( requestData, output );
 }
 
 
@@ -195,57 +266,98 @@ InfoSystemCache::notInCache( QObject *receiver, Tomahawk::InfoSystem::InfoString
 void
 InfoSystemCache::updateCacheSlot( Tomahawk::InfoSystem::InfoStringHash criteria, qint64 maxAge, Tomahawk::InfoSystem::InfoType type, QVariant output )
 {
-    const QString criteriaHashVal = criteriaMd5( criteria );
-    const QString criteriaHashValWithType = criteriaMd5( criteria, type );
-    const QString cacheDir = m_cacheBaseDir + QString::number( (int)type );
-    const QString settingsFilePath( cacheDir + '/' + criteriaHashVal + '.' + QString::number( QDateTime::currentMSecsSinceEpoch() + maxAge ) );
+    if ( !m_db.isOpen() )
+        return;
 
-    QHash< QString, QString > fileLocationHash = m_fileLocationCache[ type ];
-    if ( fileLocationHash.contains( criteriaHashVal ) )
+    const QString criteriaHashVal = criteriaMd5( criteria );
+    const qlonglong now = QDateTime::currentMSecsSinceEpoch();
+    const QByteArray data = serialize( output );
+
+    QSqlQuery query( m_db );
+    query.prepare( "SELECT size FROM cache WHERE type = ? AND hash = ?" );
+    query.addBindValue( (int)type );
+    query.addBindValue( criteriaHashVal );
+    query.exec();
+    const qint64 oldSize = query.next() ? query.value( 0 ).toLongLong() : 0;
+
+    query.prepare( "INSERT OR REPLACE INTO cache( type, hash, expires, accessed, size, data ) VALUES( ?, ?, ?, ?, ?, ? )" );
+    query.addBindValue( (int)type );
+    query.addBindValue( criteriaHashVal );
+    query.addBindValue( now + maxAge );
+    query.addBindValue( now );
+    query.addBindValue( data.size() );
+    query.addBindValue( data );
+    if ( !query.exec() )
     {
-        if ( !QFile::rename( fileLocationHash[ criteriaHashVal ], settingsFilePath ) )
-        {
-            tLog() << "Failed to move old cache file to new location!";
-            return;
-        }
-        fileLocationHash[ criteriaHashVal ] = settingsFilePath;
-        m_fileLocationCache[ type ] = fileLocationHash;
+        tLog() << "Failed to write cache entry:" << query.lastError().text();
+        return;
+    }
 
-        QSettings cachedSettings( fileLocationHash[ criteriaHashVal ], QSettings::IniFormat );
-        cachedSettings.setValue( "data", output );
+    m_totalSize += data.size() - oldSize;
+    m_dataCache.insert( dataCacheKey( type, criteriaHashVal ), new QVariant( output ) );
 
-        m_dataCache.insert( criteriaHashValWithType, new QVariant( output ) );
+    if ( m_totalSize > MAX_CACHE_SIZE )
+        evict();
+}
 
-        return;
+
+void
+InfoSystemCache::removeEntry( InfoType type, const QString& hash )
+{
+    m_dataCache.remove( dataCacheKey( type, hash ) );
+
+    QSqlQuery query( m_db );
+    query.prepare( "SELECT size FROM cache WHERE type = ? AND hash = ?" );
+    query.addBindValue( (int)type );
+    query.addBindValue( hash );
+    query.exec();
+    if ( query.next() )
+        m_totalSize -= query.value( 0 ).toLongLong();
+
+    query.prepare( "DELETE FROM cache WHERE type = ? AND hash = ?" );
+    query.addBindValue( (int)type );
+    query.addBindValue( hash );
+    if ( !query.exec() )
+        tLog() << "Failed to remove stale cache entry:" << query.lastError().text();
+}
+
+
+void
+InfoSystemCache::evict()
+{
+    const qint64 target = (qint64)( MAX_CACHE_SIZE ) / 10 * 9;
+    tDebug() << Q_FUNC_INFO << "Cache holds" << m_totalSize << "bytes, evicting down to" << target;
+
+    QSqlQuery query( m_db );
+    query.exec( "SELECT type, hash, size, accessed FROM cache ORDER BY accessed" );
+
+    qint64 size = m_totalSize;
+    qlonglong accessed = 0;
+    while ( size > target && query.next() )
+    {
+        m_dataCache.remove( dataCacheKey( (InfoType)query.value( 0 ).toInt(), query.value( 1 ).toString() ) );
+        size -= query.value( 2 ).toLongLong();
+        accessed = query.value( 3 ).toLongLong();
     }
+    query.finish();
 
-    QDir dir( cacheDir );
-    if( !dir.exists( cacheDir ) )
+    // Entries accessed at the same time as the last one we dropped go as well
+    query.prepare( "DELETE FROM cache WHERE accessed <= ?" );
+    query.addBindValue( accessed );
+    if ( !query.exec() )
     {
-        qDebug() << "Creating cache directory" << cacheDir;
-        if( !dir.mkpath( cacheDir ) )
-        {
-            tLog() << "Failed to create cache dir! Bailing...";
-            return;
-        }
+        tLog() << "Failed to evict cache entries:" << query.lastError().text();
+        return;
     }
 
-    QSettings cachedSettings( settingsFilePath, QSettings::IniFormat );
-    QStringList keys = criteria.keys();
-    cachedSettings.beginGroup( "criteria" );
-    for( int i = 0; i < criteria.size(); i++ )
-        cachedSettings.setValue( keys.at( i ), criteria[keys.at( i )] );
-    cachedSettings.endGroup();
-    cachedSettings.setValue( "data", output );
-
-    fileLocationHash[criteriaHashVal] = settingsFilePath;
-    m_fileLocationCache[type] = fileLocationHash;
-    m_dataCache.insert( criteriaHashValWithType, new QVariant( output ) );
+    query.exec( "SELECT COALESCE( SUM( size ), 0 ) FROM cache" );
+    if ( query.next() )
+        m_totalSize = query.value( 0 ).toLongLong();
 }
 
 
-const QString
-InfoSystemCache::criteriaMd5( const Tomahawk::InfoSystem::InfoStringHash &criteria, Tomahawk::InfoSystem::InfoType type ) const
+QString
+InfoSystemCache::criteriaMd5( const Tomahawk::InfoSystem::InfoStringHash &criteria, Tomahawk::InfoSystem::InfoType type )
 {
     QCryptographicHash md5( QCryptographicHash::Md5 );
     QStringList keys = criteria.keys();
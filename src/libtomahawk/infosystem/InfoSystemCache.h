@@ -23,6 +23,7 @@
 #include <QCache>
 #include <QDateTime>
 #include <QObject>
+#include <QSqlDatabase>
 #include <QtDebug>
 #include <QTimer>
 
@@ -34,6 +35,12 @@ namespace Tomahawk
 namespace InfoSystem
 {
 
+/**
+ * Keeps the infosystem responses in a single SQLite file. Entries are
+ * keyed by type and criteria hash and hold the output as a serialized
+ * QVariant. Pruning goes through an index on the expiry time, and once the
+ * file grows past its size limit the least recently used entries are evicted.
+ */
 class DLLEXPORT InfoSystemCache : public QObject
 {
 Q_OBJECT
@@ -43,6 +50,12 @@ public:
 
     virtual ~InfoSystemCache();
 
+    /**
+     * Hash identifying the criteria of a request. Pass the type to tell apart
+     * requests for different types with the same criteria.
+     */
+    static QString criteriaMd5( const Tomahawk::InfoSystem::InfoStringHash &criteria, Tomahawk::InfoSystem::InfoType type = Tomahawk::InfoSystem::InfoNoInfo );
+
 signals:
     void info( Tomahawk::InfoSystem::InfoRequestData requestData, QVariant output );
 
@@ -62,11 +75,17 @@ private:
     static const int s_infosystemCacheVersion;
 
     void notInCache( QObject *receiver, Tomahawk::InfoSystem::InfoStringHash criteria, Tomahawk::InfoSystem::InfoRequestData requestData );
-    const QString criteriaMd5( const Tomahawk::InfoSystem::InfoStringHash &criteria, Tomahawk::InfoSystem::InfoType type = Tomahawk::InfoSystem::InfoNoInfo ) const;
+
+    bool openDatabase();
+    void removeEntry( Tomahawk::InfoSystem::InfoType type, const QString& hash );
+    // Drops the least recently used entries until the cache fits its size limit again
+    void evict();
 
     QString m_cacheBaseDir;
-    QHash< InfoType, QHash< QString, QString > > m_fileLocationCache;
+    QSqlDatabase m_db;
+    qint64 m_totalSize;
     QTimer m_pruneTimer;
+    // keyed by type and criteria hash
     QCache< QString, QVariant > m_dataCache;
 };
 
@@ -32,20 +32,35 @@
 #include "utils/PluginLoader.h"
 #include "utils/Closure.h"
 #include "Source.h"
+#include "TomahawkSettings.h"
 
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QNetworkConfiguration>
 #include <QNetworkProxy>
 
+// Requests don't join one that has been waiting for an answer longer than this
+#define MAX_IN_FLIGHT_AGE 60000
+// Expired negative cache entries are only cleaned up once there are this many
+#define MAX_NOT_FOUND_ENTRIES 10000
+
 namespace Tomahawk
 {
 
 namespace InfoSystem
 {
 
+static bool
+isEmptyAnswer( const QVariant& output )
+{
+    return !output.isValid() || output.isNull() || ( output.type() == QVariant::Map && output.toMap().isEmpty() );
+}
+
+
 InfoSystemWorker::InfoSystemWorker()
     : QObject()
     , m_cache( 0 )
+    , m_negativeCacheTime( 0 )
 {
     tDebug() << Q_FUNC_INFO;
 
@@ -81,6 +96,7 @@ InfoSystemWorker::init( Tomahawk::InfoSystem::InfoSystemCache* cache )
     tDebug() << Q_FUNC_INFO;
     m_shortLinksWaiting = 0;
     m_cache = cache;
+    m_negativeCacheTime = (qint64)TomahawkSettings::instance()->infoSystemNegativeCacheTime() * 1000;
 
     loadInfoPlugins();
 }
@@ -241,6 +257,33 @@ InfoSystemWorker::getInfo( Tomahawk::InfoSystem::InfoRequestData requestData )
     if ( !requestData.allSources )
         providers = QList< InfoPluginPtr >( providers.mid( 0, 1 ) );
 
+    const QString key = coalesceKey( requestData );
+    const QString flightKey = inFlightKey( requestData );
+    if ( !key.isEmpty() )
+    {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if ( m_notFound.contains( key ) )
+        {
+            if ( m_notFound.value( key ) > now )
+            {
+                emit info( requestData, QVariant() );
+                checkFinished( requestData );
+                return;
+            }
+
+            m_notFound.remove( key );
+        }
+
+        if ( m_inFlight.contains( flightKey ) && m_inFlight.value( flightKey ).started + MAX_IN_FLIGHT_AGE > now )
+        {
+            // Somebody already asked for the same thing, wait for that answer
+            requestData.internalId = requestData.requestId;
+            m_dataTracker[ requestData.caller ][ requestData.type ] = m_dataTracker[ requestData.caller ][ requestData.type ] + 1;
+            m_inFlight[ flightKey ].followers << requestData;
+            return;
+        }
+    }
+
     bool foundOne = false;
     foreach ( InfoPluginPtr ptr, providers )
     {
@@ -277,6 +320,25 @@ InfoSystemWorker::getInfo( Tomahawk::InfoSystem::InfoRequestData requestData )
         data->customData = requestData.customData;
         m_savedRequestMap[ requestId ] = data;
 
+        if ( !key.isEmpty() )
+        {
+            InFlightRequest inFlight;
+            inFlight.leader = requestId;
+            inFlight.key = key;
+            inFlight.started = QDateTime::currentMSecsSinceEpoch();
+
+            // The request before us is taking too long, its followers wait for our answer instead
+            if ( m_inFlight.contains( flightKey ) )
+            {
+                const InFlightRequest stale = m_inFlight.value( flightKey );
+                m_inFlightKeys.remove( stale.leader );
+                inFlight.followers = stale.followers;
+            }
+
+            m_inFlight[ flightKey ] = inFlight;
+            m_inFlightKeys[ requestId ] = flightKey;
+        }
+
         QMetaObject::invokeMethod( ptr.data(), "getInfo", Qt::QueuedConnection, Q_ARG( Tomahawk::InfoSystem::InfoRequestData, requestData ) );
     }
 
@@ -404,10 +466,77 @@ InfoSystemWorker::infoSlot( Tomahawk::InfoSystem::InfoRequestData requestData, Q
 //    qDebug() << "Current count in dataTracker for target" << requestData.caller << "and type" << requestData.type << "is" << m_dataTracker[ requestData.caller ][ requestData.type ];
     delete m_savedRequestMap[ requestId ];
     m_savedRequestMap.remove( requestId );
+
+    answerFollowers( requestId, output, true );
     checkFinished( requestData );
 }
 
 
+QString
+InfoSystemWorker::coalesceKey( const Tomahawk::InfoSystem::InfoRequestData& requestData ) const
+{
+    // Only requests for a single source and with plain criteria can share answers
+    if ( requestData.allSources || !requestData.input.canConvert< Tomahawk::InfoSystem::InfoStringHash >() )
+        return QString();
+
+    const InfoStringHash criteria = requestData.input.value< Tomahawk::InfoSystem::InfoStringHash >();
+    if ( criteria.isEmpty() )
+        return QString();
+
+    return QString::number( (int)requestData.type ) + '/' + InfoSystemCache::criteriaMd5( criteria, requestData.type );
+}
+
+
+QString
+InfoSystemWorker::inFlightKey( const Tomahawk::InfoSystem::InfoRequestData& requestData ) const
+{
+    // Followers only time out along with their leader, so they need the same timeout
+    const QString key = coalesceKey( requestData );
+    if ( key.isEmpty() )
+        return QString();
+
+    return key + '/' + QString::number( requestData.timeoutMillis );
+}
+
+
+void
+InfoSystemWorker::answerFollowers( quint64 requestId, const QVariant& output, bool cacheIfEmpty )
+{
+    if ( !m_inFlightKeys.contains( requestId ) )
+        return;
+
+    const InFlightRequest inFlight = m_inFlight.take( m_inFlightKeys.take( requestId ) );
+    const QString key = inFlight.key;
+    const QList< InfoRequestData > followers = inFlight.followers;
+
+    if ( cacheIfEmpty && m_negativeCacheTime > 0 && isEmptyAnswer( output ) )
+    {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if ( m_notFound.count() >= MAX_NOT_FOUND_ENTRIES )
+        {
+            QHash< QString, qint64 >::iterator it = m_notFound.begin();
+            while ( it != m_notFound.end() )
+            {
+                if ( it.value() <= now )
+                    it = m_notFound.erase( it );
+                else
+                    ++it;
+            }
+        }
+
+        m_notFound.insert( key, now + m_negativeCacheTime );
+    }
+
+    foreach ( const InfoRequestData& follower, followers )
+    {
+        emit info( follower, output );
+
+        m_dataTracker[ follower.caller ][ follower.type ] = m_dataTracker[ follower.caller ][ follower.type ] - 1;
+        checkFinished( follower );
+    }
+}
+
+
 void
 InfoSystemWorker::checkFinished( const Tomahawk::InfoSystem::InfoRequestData &requestData )
 {
@@ -465,6 +594,8 @@ InfoSystemWorker::checkTimeoutsTimerFired()
                 if ( !m_timeRequestMapper.count( time ) )
                     m_timeRequestMapper.remove( time );
 
+                // A timeout says nothing about whether there is something to find
+                answerFollowers( requestId, QVariant(), false );
                 checkFinished( returnData );
             }
             else
@@ -83,11 +83,32 @@ private:
     void checkFinished( const Tomahawk::InfoSystem::InfoRequestData &target );
     QList< InfoPluginPtr > determineOrderedMatches( const InfoType type ) const;
 
+    // Requests with the same key ask for the same thing. Empty if the request can't share answers.
+    QString coalesceKey( const Tomahawk::InfoSystem::InfoRequestData& requestData ) const;
+    // Requests with the same key can wait for one answer, they also have to time out together
+    QString inFlightKey( const Tomahawk::InfoSystem::InfoRequestData& requestData ) const;
+    // Hands the answer for requestId to the requests that were waiting for it
+    void answerFollowers( quint64 requestId, const QVariant& output, bool cacheIfEmpty );
+
     QHash< QString, QHash< InfoType, int > > m_dataTracker;
     QMultiMap< qint64, quint64 > m_timeRequestMapper;
     QHash< uint, bool > m_requestSatisfiedMap;
     QHash< uint, InfoRequestData* > m_savedRequestMap;
 
+    struct InFlightRequest
+    {
+        quint64 leader;
+        QString key; // coalesceKey() of the leader
+        qint64 started;
+        QList< InfoRequestData > followers;
+    };
+    // by inFlightKey(), the request that went out to a plugin and the ones waiting for it
+    QHash< QString, InFlightRequest > m_inFlight;
+    QHash< quint64, QString > m_inFlightKeys;
+    // by coalesceKey(), msecs since epoch until which we know there is nothing to find
+    QHash< QString, qint64 > m_notFound;
+    qint64 m_negativeCacheTime;
+
     // NOTE Cache object lives in a different thread, do not call methods on it directly
     InfoSystemCache* m_cache;
 
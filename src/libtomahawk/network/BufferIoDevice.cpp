@@ -28,17 +28,32 @@
 
 // Msgs are framed, this is the size each msg we send containing audio data:
 #define BLOCKSIZE 4096
+// Blocks allocated at once, as soon as the first of them arrives
+#define CHUNK_BLOCKS 64
+#define CHUNK_SIZE ( BLOCKSIZE * CHUNK_BLOCKS )
+
+
+struct BufferChunk
+{
+    char data[ CHUNK_SIZE ];
+    QAtomicInt blocks[ CHUNK_BLOCKS ];
+};
 
 
 BufferIODevice::BufferIODevice( unsigned int size, QObject* parent )
     : QIODevice( parent )
     , d_ptr( new BufferIODevicePrivate( this, size ) )
 {
+    ensureCapacity( size );
 }
 
 
 BufferIODevice::~BufferIODevice()
 {
+    Q_D( BufferIODevice );
+    for ( int i = 0; i < d->chunkCount; i++ )
+        delete d->chunks[ i ].loadAcquire();
+
     delete d_ptr;
 }
 
@@ -71,9 +86,9 @@ bool
 BufferIODevice::seek( qint64 pos )
 {
     Q_D( BufferIODevice );
-    qDebug() << Q_FUNC_INFO << pos << d->size;
+    qDebug() << Q_FUNC_INFO << pos << d->currentSize();
 
-    if ( pos >= d->size )
+    if ( pos >= d->currentSize() )
         return false;
 
     int block = blockForPos( pos );
@@ -91,7 +106,7 @@ void
 BufferIODevice::seeked( int block )
 {
     Q_D( BufferIODevice );
-    qDebug() << Q_FUNC_INFO << block << d->size;
+    qDebug() << Q_FUNC_INFO << block << d->currentSize();
 }
 
 
@@ -101,7 +116,7 @@ BufferIODevice::inputComplete( const QString& errmsg )
     Q_D( BufferIODevice );
     qDebug() << Q_FUNC_INFO;
     setErrorString( errmsg );
-    d->size = d->received;
+    d->setSize( d->received );
     emit readChannelFinished();
 }
 
@@ -117,17 +132,50 @@ void
 BufferIODevice::addData( int block, const QByteArray& ba )
 {
     Q_D( BufferIODevice );
+
+    const qint64 offset = (qint64)block * BLOCKSIZE;
+    qint64 length = ba.length();
+    if ( length == 0 )
+        return;
+
+    if ( !ensureCapacity( offset + length ) )
     {
-        QMutexLocker lock( &d->mut );
+        tLog() << Q_FUNC_INFO << "Got data past the end of the transfer, dropping it:" << block;
+        length = d->capacity - offset;
+        if ( length <= 0 )
+            return;
+    }
 
-        while ( d->buffer.count() <= block )
-            d->buffer << QByteArray();
+    qint64 copied = 0;
+    while ( copied < length )
+    {
+        const qint64 at = offset + copied;
+        const qint64 chunkOffset = at % CHUNK_SIZE;
+        const qint64 n = qMin( length - copied, (qint64)CHUNK_SIZE - chunkOffset );
 
-        d->buffer.replace( block, ba );
+        BufferChunk* chunk = d->chunks[ at / CHUNK_SIZE ].loadAcquire();
+        if ( !chunk )
+        {
+            chunk = new BufferChunk;
+            d->chunks[ at / CHUNK_SIZE ].storeRelease( chunk );
+        }
+
+        memcpy( chunk->data + chunkOffset, ba.constData() + copied, n );
+        copied += n;
     }
 
+    // Publish all blocks we now have completely. A partial block is only
+    // complete if it is the last one of the transfer.
+    const qint64 end = offset + length;
+    int lastBlock = blockForPos( end - 1 );
+    if ( offsetForPos( end ) != 0 && end < d->currentSize() )
+        lastBlock--;
+
+    for ( int i = block; i <= lastBlock; i++ )
+        d->chunks[ i / CHUNK_BLOCKS ].loadAcquire()->blocks[ i % CHUNK_BLOCKS ].storeRelease( 1 );
+
     // If this was the last block of the transfer, check if we need to fill up gaps
-    if ( block + 1 == maxBlocks() )
+    if ( lastBlock + 1 == maxBlocks() )
     {
         if ( nextEmptyBlock() >= 0 )
         {
@@ -135,8 +183,8 @@ BufferIODevice::addData( int block, const QByteArray& ba )
         }
     }
 
-    d->received += ba.count();
-    emit bytesWritten( ba.count() );
+    d->received += length;
+    emit bytesWritten( length );
     emit readyRead();
 }
 
@@ -146,7 +194,7 @@ BufferIODevice::bytesAvailable() const
 {
     Q_D( const BufferIODevice );
 
-    return d->size - d->pos;
+    return d->currentSize() - d->pos;
 }
 
 
@@ -159,14 +207,21 @@ BufferIODevice::readData( char* data, qint64 maxSize )
     if ( atEnd() )
         return 0;
 
-    QByteArray ba;
-    ba.append( getData( d->pos, maxSize ) );
-    d->pos += ba.count();
+    // Copy published blocks until the first one that is still missing
+    const qint64 end = qMin( d->pos + maxSize, d->currentSize() );
+    qint64 length = 0;
+    while ( d->pos < end && !isBlockEmpty( blockForPos( d->pos ) ) )
+    {
+        const qint64 n = qMin( (qint64)( blockForPos( d->pos ) + 1 ) * BLOCKSIZE, end ) - d->pos;
+        const BufferChunk* chunk = d->chunks[ d->pos / CHUNK_SIZE ].loadAcquire();
 
-//    qDebug() << Q_FUNC_INFO << maxSize << ba.count() << 2;
-    memcpy( data, ba.data(), ba.count() );
+        memcpy( data + length, chunk->data + d->pos % CHUNK_SIZE, n );
+        d->pos += n;
+        length += n;
+    }
 
-    return ba.count();
+//    qDebug() << Q_FUNC_INFO << maxSize << length << 2;
+    return length;
 }
 
 
@@ -185,8 +240,8 @@ qint64
 BufferIODevice::size() const
 {
     Q_D( const BufferIODevice );
-    qDebug() << Q_FUNC_INFO << d->size;
-    return d->size;
+    qDebug() << Q_FUNC_INFO << d->currentSize();
+    return d->currentSize();
 }
 
 
@@ -195,7 +250,7 @@ BufferIODevice::atEnd() const
 {
     Q_D( const BufferIODevice );
 //    qDebug() << Q_FUNC_INFO << ( m_size <= m_pos );
-    return ( d->size <= d->pos );
+    return ( d->currentSize() <= d->pos );
 }
 
 
@@ -214,7 +269,17 @@ BufferIODevice::clear()
     QMutexLocker lock( &d->mut );
 
     d->pos = 0;
-    d->buffer.clear();
+    d->received = 0;
+    d->firstEmptyBlock = 0;
+    for ( int i = 0; i < d->chunkCount; i++ )
+    {
+        BufferChunk* chunk = d->chunks[ i ].loadAcquire();
+        if ( !chunk )
+            continue;
+
+        for ( int j = 0; j < CHUNK_BLOCKS; j++ )
+            chunk->blocks[ j ].storeRelease( 0 );
+    }
 }
 
 
@@ -259,19 +324,14 @@ BufferIODevice::nextEmptyBlock() const
 {
     Q_D( const BufferIODevice );
 
-    int i = 0;
-    foreach( const QByteArray& ba, d->buffer )
-    {
-        if ( ba.isEmpty() )
-            return i;
-
-        i++;
-    }
+    while ( !isBlockEmpty( d->firstEmptyBlock ) )
+        d->firstEmptyBlock++;
 
-    if ( i == maxBlocks() )
+    // Without a known size we can't tell when we're done
+    if ( d->currentSize() > 0 && d->firstEmptyBlock >= maxBlocks() )
         return -1;
 
-    return i;
+    return d->firstEmptyBlock;
 }
 
 
@@ -280,9 +340,10 @@ BufferIODevice::maxBlocks() const
 {
     Q_D( const BufferIODevice );
 
-    int i = d->size / BLOCKSIZE;
+    const qint64 size = d->currentSize();
+    int i = size / BLOCKSIZE;
 
-    if ( ( d->size % BLOCKSIZE ) > 0 )
+    if ( ( size % BLOCKSIZE ) > 0 )
         i++;
 
     return i;
@@ -293,34 +354,42 @@ bool
 BufferIODevice::isBlockEmpty( int block ) const
 {
     Q_D( const BufferIODevice );
-    if ( block >= d->buffer.count() )
+    if ( block < 0 || block >= d->chunkCount * CHUNK_BLOCKS )
         return true;
 
-    return d->buffer.at( block ).isEmpty();
+    const BufferChunk* chunk = d->chunks[ block / CHUNK_BLOCKS ].loadAcquire();
+    return !chunk || chunk->blocks[ block % CHUNK_BLOCKS ].loadAcquire() == 0;
 }
 
 
-QByteArray
-BufferIODevice::getData( qint64 pos, qint64 size )
+bool
+BufferIODevice::ensureCapacity( qint64 bytes )
 {
     Q_D( BufferIODevice );
-//    qDebug() << Q_FUNC_INFO << pos << size << 1;
-    QByteArray ba;
-    int block = blockForPos( pos );
-    int offset = offsetForPos( pos );
+    if ( bytes <= d->capacity )
+        return true;
+
+    // The size of a transfer is fixed once known, only grow while it isn't
+    if ( d->capacity > 0 && d->currentSize() > 0 )
+        return false;
 
     QMutexLocker lock( &d->mut );
-    while( ba.count() < size )
-    {
-        if ( block > maxBlocks() )
-            break;
 
-        if ( isBlockEmpty( block ) )
-            break;
+    // Whole blocks, and with some room to spare when the size is unknown.
+    // Only the chunk table is allocated here, chunks come with their data.
+    qint64 capacity = qMax( bytes, d->capacity * 2 );
+    capacity = ( ( capacity + BLOCKSIZE - 1 ) / BLOCKSIZE ) * BLOCKSIZE;
+    const int chunkCount = ( capacity + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
 
-        ba.append( d->buffer.at( block++ ).mid( offset ) );
-    }
+    QAtomicPointer< BufferChunk >* chunks = new QAtomicPointer< BufferChunk >[ chunkCount ];
+    for ( int i = 0; i < d->chunkCount; i++ )
+        chunks[ i ].storeRelease( d->chunks[ i ].loadAcquire() );
 
-//    qDebug() << Q_FUNC_INFO << pos << size << 2;
-    return ba.left( size );
+    // Transfers of unknown size report size 0 and can't be read from until
+    // inputComplete(), so nobody is reading the old table while we swap.
+    d->chunks.reset( chunks );
+    d->capacity = capacity;
+    d->chunkCount = chunkCount;
+
+    return true;
 }
@@ -22,9 +22,11 @@
 
 #include <QIODevice>
 
+#include "DllMacro.h"
+
 class BufferIODevicePrivate;
 
-class BufferIODevice : public QIODevice
+class DLLEXPORT BufferIODevice : public QIODevice
 {
 Q_OBJECT
 
@@ -43,6 +45,10 @@ public:
     virtual bool atEnd() const;
     virtual qint64 pos() const;
 
+    /**
+     * Stores data starting at the given block. The data may span several
+     * consecutive blocks. Must always be called from the same thread.
+     */
     void addData( int block, const QByteArray& ba );
     void clear();
 
@@ -68,7 +74,7 @@ protected:
 private:
     int blockForPos( qint64 pos ) const;
     int offsetForPos( qint64 pos ) const;
-    QByteArray getData( qint64 pos, qint64 size );
+    bool ensureCapacity( qint64 bytes );
 
     Q_DECLARE_PRIVATE( BufferIODevice )
     BufferIODevicePrivate* d_ptr;
@@ -22,28 +22,54 @@
 
 #include "BufferIoDevice.h"
 
+#include <QAtomicInt>
+#include <QAtomicPointer>
 #include <QMutex>
+#include <QMutexLocker>
+#include <QScopedArrayPointer>
+
+struct BufferChunk;
 
 class BufferIODevicePrivate
 {
 public:
-    BufferIODevicePrivate( BufferIODevice* q, unsigned int size = 0 )
+    BufferIODevicePrivate( BufferIODevice* q, qint64 size = 0 )
         : q_ptr ( q )
+        , capacity( 0 )
+        , chunkCount( 0 )
+        , firstEmptyBlock( 0 )
         , size( size )
         , received( 0 )
         , pos( 0 )
-
     {
     }
     BufferIODevice* q_ptr;
     Q_DECLARE_PUBLIC ( BufferIODevice )
 
 private:
-    QList<QByteArray> buffer;
+    /*
+     * The transfer is stored in fixed size chunks, each with the flags of
+     * its blocks. Only the table of chunks is sized up front, a chunk is
+     * allocated once its first block arrives, so a bogus size from the peer
+     * doesn't allocate anything it doesn't send. Blocks get copied to their
+     * final position exactly once and are then published through their flag.
+     * Only the network thread writes data and flags and only the reading
+     * thread moves pos, so neither side has to lock.
+     */
+    QScopedArrayPointer< QAtomicPointer< BufferChunk > > chunks;
+    qint64 capacity;
+    int chunkCount;
+    mutable int firstEmptyBlock; // lowest block that may still be missing, network thread only
+
+    // 64 bit, a transfer may well be larger than 2 GiB
+    qint64 currentSize() const { QMutexLocker lock( &mut ); return size; }
+    void setSize( qint64 s ) { QMutexLocker lock( &mut ); size = s; }
+
+    // Guards size and growing the chunk table of transfers with unknown size
     mutable QMutex mut;
-    unsigned int size;
-    unsigned int received;
-    unsigned int pos;
+    qint64 size;
+    qint64 received;
+    qint64 pos;
 };
 
 #endif // BUFFERIODEVICE_P_H
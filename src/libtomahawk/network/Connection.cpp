@@ -63,6 +63,10 @@ Connection::~Connection()
     {
         d->sock->deleteLater();
     }
+    if ( !d->mux.isNull() )
+    {
+        d->mux->closeChannel( this );
+    }
 
     delete d->statstimer;
     delete d_ptr;
@@ -78,10 +82,11 @@ Connection::handleIncomingQueueEmpty()
     //         << "m_peer_disconnected" << m_peer_disconnected
     //         << "bytes rx" << bytesReceived();
 
-    if ( !d->sock.isNull() && d->sock->bytesAvailable() == 0 && d->peer_disconnected )
+    // Channels get whole msgs, there is never anything left to read
+    const bool drained = d->channel || ( !d->sock.isNull() && d->sock->bytesAvailable() == 0 );
+    if ( drained && d->peer_disconnected )
     {
         tDebug( LOGVERBOSE ) << "No more data to read, peer disconnected. shutting down connection."
-                             << "bytesavail" << d->sock->bytesAvailable()
                              << "bytesrx" << d->rx_bytes;
         shutdown();
     }
@@ -92,7 +97,12 @@ Connection::handleIncomingQueueEmpty()
 void
 Connection::setFirstMessage( const QVariant& m )
 {
-    const QByteArray ba = TomahawkUtils::toJson( m );
+    // Older peers ignore keys they don't know, so this is where we tell the
+    // other side which codecs we can decode
+    QVariantMap map = m.toMap();
+    map[ "codecs" ] = MsgProcessor::supportedCodecs();
+
+    const QByteArray ba = TomahawkUtils::toJson( map );
     //qDebug() << "first msg json len:" << ba.length();
     setFirstMessage( Msg::factory( ba, Msg::JSON ) );
 }
@@ -208,6 +218,10 @@ Connection::actualShutdown()
     {
         d->sock->disconnectFromHost();
     }
+    if ( !d->mux.isNull() )
+    {
+        d->mux->closeChannel( this );
+    }
 
 //    qDebug() << "EMITTING finished()";
     emit finished();
@@ -267,7 +281,7 @@ Connection::isRunning() const
 {
     Q_D( const Connection );
 
-    return d->sock != 0;
+    return d->sock != 0 || d->channel;
 }
 
 qint64
@@ -276,6 +290,12 @@ Connection::bytesSent() const
     return d_func()->tx_bytes;
 }
 
+qint64
+Connection::bytesQueued() const
+{
+    return d_func()->tx_bytes_requested - d_func()->tx_bytes;
+}
+
 qint64
 Connection::bytesReceived() const
 {
@@ -294,6 +314,12 @@ Connection::setMsgProcessorModeIn(quint32 m)
     d_func()->msgprocessor_in.setMode( m );
 }
 
+void
+Connection::setPeerCodecs( const QStringList& codecs )
+{
+    d_func()->peerCodecs = codecs;
+}
+
 const QHostAddress
 Connection::peerIpAddress() const
 {
@@ -425,6 +451,16 @@ Connection::doSetup()
         d->statstimer->start();
         d->statstimer_mark.start();
 
+        if ( d->channel )
+        {
+            // The connection we run in did the handshake and auth for us
+            d->ready = true;
+            tDebug( LOGVERBOSE ) << "Connection" << id() << "READY as a channel";
+            setup();
+            emit ready();
+            return;
+        }
+
         d->sock->moveToThread( thread() );
 
         connect( d->sock.data(), SIGNAL( bytesWritten( qint64 ) ),
@@ -542,6 +578,9 @@ Connection::readyRead()
 //    qDebug() << "readyRead, bytesavail:" << m_sock->bytesAvailable();
     Q_D( Connection );
 
+    if ( d->sock.isNull() )
+        return;
+
     if ( d->msg.isNull() )
     {
         if ( d->sock->bytesAvailable() < Msg::headerSize() )
@@ -593,6 +632,11 @@ Connection::handleReadMsg()
     {
         d->ready = true;
         tDebug( LOGVERBOSE ) << "Connection" << id() << "READY";
+
+        // Pick a codec before anything else is sent, unless the peer is too old to know about it
+        if ( !d->peerCodecs.isEmpty() )
+            sendCodec( true );
+
         setup();
         emit ready();
     }
@@ -614,6 +658,16 @@ Connection::handleReadMsg()
             shutdown( true );
         }
     }
+    else if ( d->ready &&
+              d->msg->is( Msg::SETUP ) &&
+              d->msg->is( Msg::JSON ) )
+    {
+        handleCodecMsg( TomahawkUtils::parseJson( d->msg->payload() ).toMap() );
+    }
+    else if ( d->ready && ConnectionMux::isFrame( d->msg ) )
+    {
+        handleFrame( d->msg );
+    }
     else
     {
         d->msgprocessor_in.append( d->msg );
@@ -623,6 +677,64 @@ Connection::handleReadMsg()
 }
 
 
+/**
+ * The codec msg marks the point in the stream from which on the peer
+ * compresses with the codec named in it. The side that accepted the
+ * connection sends it first, including its own codecs, and the other side
+ * answers with its choice.
+ */
+void
+Connection::handleCodecMsg( const QVariantMap& m )
+{
+    Q_D( Connection );
+
+    if ( m.value( "method" ).toString() != "codec" )
+    {
+        tLog() << Q_FUNC_INFO << "Unexpected setup msg after connection was ready:" << m;
+        return;
+    }
+
+    bool ok;
+    const MsgProcessor::Codec codec = MsgProcessor::codecFromName( m.value( "codec" ).toString(), &ok );
+    if ( !ok )
+    {
+        tLog() << "Peer picked a codec we don't support:" << m.value( "codec" ).toString();
+        markAsFailed();
+        return;
+    }
+
+    tDebug( LOGVERBOSE ) << "Connection" << id() << "receiving with codec" << MsgProcessor::codecName( codec );
+    d->msgprocessor_in.setCodec( codec );
+
+    if ( m.contains( "codecs" ) )
+    {
+        d->peerCodecs = m.value( "codecs" ).toStringList();
+        sendCodec( false );
+    }
+}
+
+
+void
+Connection::sendCodec( bool announce )
+{
+    Q_D( Connection );
+
+    const MsgProcessor::Codec codec = MsgProcessor::negotiateCodec( d->peerCodecs );
+
+    QVariantMap m;
+    m[ "method" ] = "codec";
+    m[ "codec" ] = MsgProcessor::codecName( codec );
+    if ( announce )
+        m[ "codecs" ] = MsgProcessor::supportedCodecs();
+
+    // Everything appended to the queue after the codec msg uses the new codec
+    sendMsg( Msg::factory( TomahawkUtils::toJson( m ), Msg::JSON | Msg::SETUP ) );
+    d->msgprocessor_out.setCodec( codec );
+
+    tDebug( LOGVERBOSE ) << "Connection" << id() << "sending with codec" << MsgProcessor::codecName( codec );
+}
+
+
 void
 Connection::sendMsg( QVariant j )
 {
@@ -647,7 +759,9 @@ Connection::sendMsg( msg_ptr msg )
         return;
     }
 
-    d_func()->tx_bytes_requested += msg->length() + Msg::headerSize();
+    // May be called from any thread, the msg remembers what we counted for sendMsg_now()
+    msg->setCountedSize( msg->length() + Msg::headerSize() );
+    d_func()->tx_bytes_requested += msg->countedSize();
     d_func()->msgprocessor_out.append( msg );
 }
 
@@ -659,6 +773,20 @@ Connection::sendMsg_now( msg_ptr msg )
     Q_ASSERT( QThread::currentThread() == thread() );
 //    Q_ASSERT( this->isRunning() );
 
+    // Compression changed the size of the msg since sendMsg() counted it
+    if ( msg->countedSize() > 0 )
+        d->tx_bytes_requested += (qint64)msg->length() + Msg::headerSize() - msg->countedSize();
+
+    if ( d->channel )
+    {
+        if ( d->mux.isNull() || !d->mux->send( this, msg ) )
+        {
+            tDebug() << "***** Channel closed, whilst in sendMsg(). Cleaning up. *****";
+            shutdown( false );
+        }
+        return;
+    }
+
     if ( d->sock.isNull() || !d->sock->isOpen() || !d->sock->isWritable() )
     {
         tDebug() << "***** Socket problem, whilst in sendMsg(). Cleaning up. *****";
@@ -679,6 +807,9 @@ void
 Connection::bytesWritten( qint64 i )
 {
     d_func()->tx_bytes += i;
+    if ( i > 0 )
+        emit written( i );
+
     // if we are waiting to shutdown, and have sent all queued data, do actual shutdown:
     if ( d_func()->do_shutdown && d_func()->tx_bytes == d_func()->tx_bytes_requested )
         actualShutdown();
@@ -699,3 +830,77 @@ Connection::calcStats()
 
     emit statsTick( d->stats_tx_bytes_per_sec, d->stats_rx_bytes_per_sec );
 }
+
+
+void
+Connection::handleFrame( msg_ptr msg )
+{
+    Q_UNUSED( msg );
+    tLog() << Q_FUNC_INFO << "Unexpected channel frame on" << id();
+}
+
+
+void
+Connection::startChannel( ConnectionMux* mux, bool outbound )
+{
+    Q_D( Connection );
+    Q_ASSERT( d->sock.isNull() );
+
+    d->mux = mux;
+    d->channel = true;
+    d->outbound = outbound;
+
+    QTimer::singleShot( 0, this, SLOT( doSetup() ) );
+}
+
+
+void
+Connection::channelMsgReceived( const msg_ptr& msg )
+{
+    Q_D( Connection );
+
+    d->rx_bytes += Msg::headerSize() + msg->length();
+    d->msg = msg;
+
+    handleReadMsg(); // process m_msg and clear() it
+}
+
+
+void
+Connection::channelClosed()
+{
+    Q_D( Connection );
+    tDebug( LOGVERBOSE ) << "CHANNEL CLOSED" << name() << id()
+                         << "shutdown will happen after incoming queue empties."
+                         << "bytesRecvd" << bytesReceived();
+
+    // Nothing to send the close to, the peer closed it or the socket is gone
+    d->mux.clear();
+    d->peer_disconnected = true;
+    emit socketClosed();
+
+    if ( d->msgprocessor_in.length() == 0 )
+    {
+        handleIncomingQueueEmpty();
+        actualShutdown();
+    }
+}
+
+
+bool
+Connection::writeFrame( const msg_ptr& msg )
+{
+    Q_D( Connection );
+
+    if ( d->do_shutdown || d->sock.isNull() || !d->sock->isWritable() )
+        return false;
+
+    d->tx_bytes_requested += msg->length() + Msg::headerSize();
+    if ( !msg->write( d->sock.data() ) )
+    {
+        shutdown( false );
+        return false;
+    }
+
+    return true;
+}
@@ -27,9 +27,11 @@
 #include <QHostAddress>
 #include <QPointer>
 #include <QString>
+#include <QStringList>
 #include <QTcpSocket>
 #include <QVariant>
 
+class ConnectionMux;
 class ConnectionPrivate;
 class Servent;
 
@@ -79,10 +81,18 @@ public:
 
     qint64 bytesSent() const;
     qint64 bytesReceived() const;
+    /// Bytes handed to sendMsg() that haven't been written to the socket yet
+    qint64 bytesQueued() const;
 
     void setMsgProcessorModeOut( quint32 m );
     void setMsgProcessorModeIn( quint32 m );
 
+    /**
+     * Compression codecs the remote peer announced in its first message,
+     * empty for peers that predate codec negotiation.
+     */
+    void setPeerCodecs( const QStringList& codecs );
+
     const QHostAddress peerIpAddress() const;
 
     QString bareName() const;
@@ -111,6 +121,8 @@ signals:
     void statsTick( qint64 tx_bytes_sec, qint64 rx_bytes_sec );
     void socketClosed();
     void socketErrored( QAbstractSocket::SocketError );
+    /// Some of the queued bytes were handed to the socket, bytesQueued() went down
+    void written( qint64 bytes );
 
 protected:
     virtual void setup() = 0;
@@ -119,6 +131,10 @@ protected slots:
     virtual void handleMsg( msg_ptr msg ) = 0;
     virtual void authCheckTimeout();
 
+protected:
+    /// Frames of connections multiplexed into ours, see ConnectionMux
+    virtual void handleFrame( msg_ptr msg );
+
 public slots:
     virtual void start( QTcpSocket* sock );
     void sendMsg( QVariant );
@@ -139,10 +155,20 @@ private slots:
     void calcStats();
 
 private:
+    friend class ConnectionMux;
     Q_DECLARE_PRIVATE( Connection )
     ConnectionPrivate* d_ptr;
 
+    // Runs this connection as a channel of mux instead of on its own socket
+    void startChannel( ConnectionMux* mux, bool outbound );
+    void channelMsgReceived( const msg_ptr& msg );
+    void channelClosed();
+    // Writes a frame of mux to our socket, past the msgs queued in msgprocessor_out
+    bool writeFrame( const msg_ptr& msg );
+
     void handleReadMsg();
+    void handleCodecMsg( const QVariantMap& m );
+    void sendCodec( bool announce );
     void actualShutdown();
 };
 
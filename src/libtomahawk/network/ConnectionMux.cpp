@@ -0,0 +1,506 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ConnectionMux.h"
+
+#include "network/ControlConnection.h"
+#include "network/DbSyncConnection.h"
+#include "network/Servent.h"
+#include "network/StreamConnection.h"
+#include "utils/Logger.h"
+
+#include "Msg.h"
+
+#include <QBuffer>
+#include <QMutexLocker>
+#include <QTcpSocket>
+#include <QtEndian>
+
+// type(1) + channel id(4)
+#define FRAME_HEADER_SIZE 5
+// Biggest piece of a channel sent in one go, a sync never holds up a stream for longer than that
+#define MAX_FRAME_SIZE 16 * 1024
+// Bytes a channel may send before the peer has to hand back credit
+#define CHANNEL_WINDOW 256 * 1024
+// Frames we keep in the socket, anything beyond that waits for its turn with us
+#define SOCKET_HIGH_WATER 64 * 1024
+
+
+static QByteArray
+frameHeader( ConnectionMux::FrameType type, quint32 id )
+{
+    char header[ FRAME_HEADER_SIZE ];
+    header[ 0 ] = (char)type;
+    qToBigEndian( id, (uchar*)header + 1 );
+
+    return QByteArray( header, FRAME_HEADER_SIZE );
+}
+
+
+ConnectionMuxChannel::ConnectionMuxChannel( quint32 id, Connection* conn, qint64 window )
+    : m_id( id )
+    , m_conn( conn )
+    , m_priority( ConnectionMux::NORMAL )
+    , m_accepted( false )
+    , m_window( window )
+    , m_queued( 0 )
+    , m_headOffset( 0 )
+    , m_sendCredit( window )
+    , m_unacked( 0 )
+{
+}
+
+
+void
+ConnectionMuxChannel::queue( const msg_ptr& msg )
+{
+    QByteArray ba;
+    QBuffer buffer( &ba );
+    buffer.open( QIODevice::WriteOnly );
+    msg->write( &buffer );
+
+    m_outbuf << ba;
+    m_queued += ba.length();
+}
+
+
+bool
+ConnectionMuxChannel::canSend() const
+{
+    return m_accepted && m_queued > 0 && m_sendCredit > 0;
+}
+
+
+QByteArray
+ConnectionMuxChannel::takeData( qint64 maxSize )
+{
+    const qint64 size = qMin( m_queued, qMin( m_sendCredit, maxSize ) );
+    if ( size <= 0 )
+        return QByteArray();
+
+    QByteArray data;
+    data.reserve( size );
+
+    while ( data.length() < size )
+    {
+        const QByteArray& head = m_outbuf.first();
+        const int length = qMin( (qint64)( head.length() - m_headOffset ), size - data.length() );
+
+        data.append( head.constData() + m_headOffset, length );
+        m_headOffset += length;
+        if ( m_headOffset == head.length() )
+        {
+            m_outbuf.removeFirst();
+            m_headOffset = 0;
+        }
+    }
+
+    m_queued -= size;
+    m_sendCredit -= size;
+
+    return data;
+}
+
+
+void
+ConnectionMuxChannel::addCredit( quint32 bytes )
+{
+    m_sendCredit += bytes;
+}
+
+
+QList< msg_ptr >
+ConnectionMuxChannel::receive( const QByteArray& data )
+{
+    m_inbuf.append( data );
+    m_unacked += data.length();
+
+    // The channel carries msgs just like a socket would
+    QList< msg_ptr > msgs;
+    int offset = 0;
+    while ( m_inbuf.length() - offset >= Msg::headerSize() )
+    {
+        msg_ptr msg = Msg::begin( m_inbuf.data() + offset );
+        if ( m_inbuf.length() - offset - Msg::headerSize() < (qint64)msg->length() )
+            break;
+
+        msg->fill( m_inbuf.mid( offset + Msg::headerSize(), msg->length() ) );
+        offset += Msg::headerSize() + msg->length();
+        msgs << msg;
+    }
+    m_inbuf.remove( 0, offset );
+
+    return msgs;
+}
+
+
+quint32
+ConnectionMuxChannel::takeAck()
+{
+    // Hand back credit in chunks rather than for every frame
+    if ( m_unacked < m_window / 2 )
+        return 0;
+
+    const quint32 ack = m_unacked;
+    m_unacked = 0;
+    return ack;
+}
+
+
+ConnectionMux::ConnectionMux( ControlConnection* cc )
+    : QObject( cc )
+    , m_cc( cc )
+    , m_nextId( cc->outbound() ? 1 : 2 ) // both ends open channels, keep their ids apart
+    , m_scheduling( false )
+{
+    connect( cc, SIGNAL( written( qint64 ) ), SLOT( schedule() ) );
+}
+
+
+ConnectionMux::~ConnectionMux()
+{
+    // Without the socket, nothing that runs in it can go on
+    foreach ( Channel* channel, m_channels.values() )
+    {
+        Connection* conn = channel->connection();
+        const bool accepted = channel->isAccepted();
+        removeChannel( channel );
+
+        if ( accepted )
+            conn->channelClosed();
+        else
+            conn->markAsFailed();
+    }
+
+    QMutexLocker locker( &m_pendingMutex );
+    for ( int i = 0; i < m_pending.count(); i++ )
+    {
+        if ( !m_pending.at( i ).first.isNull() )
+            m_pending.at( i ).first.data()->markAsFailed();
+    }
+}
+
+
+bool
+ConnectionMux::isFrame( const msg_ptr& msg )
+{
+    return msg->is( Msg::SETUP ) && msg->is( Msg::RAW );
+}
+
+
+ConnectionMux::Priority
+ConnectionMux::priorityFor( Connection* conn )
+{
+    // Playback must not wait for a bulk sync
+    if ( qobject_cast< StreamConnection* >( conn ) )
+        return HIGH;
+    if ( qobject_cast< DBSyncConnection* >( conn ) )
+        return LOW;
+
+    return NORMAL;
+}
+
+
+msg_ptr
+ConnectionMux::frame( FrameType type, quint32 id, const QByteArray& data )
+{
+    return Msg::factory( frameHeader( type, id ) + data, Msg::SETUP | Msg::RAW );
+}
+
+
+bool
+ConnectionMux::parseFrame( const msg_ptr& msg, FrameType& type, quint32& id, QByteArray& data )
+{
+    const QByteArray& payload = msg->payload();
+    if ( !isFrame( msg ) || payload.length() < FRAME_HEADER_SIZE )
+        return false;
+
+    type = (FrameType)(quint8)payload.at( 0 );
+    id = qFromBigEndian< quint32 >( (const uchar*)payload.constData() + 1 );
+    data = QByteArray::fromRawData( payload.constData() + FRAME_HEADER_SIZE, payload.length() - FRAME_HEADER_SIZE );
+
+    return true;
+}
+
+
+void
+ConnectionMux::openChannel( Connection* conn, const QString& key )
+{
+    {
+        QMutexLocker locker( &m_pendingMutex );
+        m_pending << qMakePair( QPointer< Connection >( conn ), key );
+    }
+
+    QMetaObject::invokeMethod( this, "openPending", Qt::QueuedConnection );
+}
+
+
+void
+ConnectionMux::openPending()
+{
+    QList< QPair< QPointer< Connection >, QString > > pending;
+    {
+        QMutexLocker locker( &m_pendingMutex );
+        pending = m_pending;
+        m_pending.clear();
+    }
+
+    for ( int i = 0; i < pending.count(); i++ )
+    {
+        Connection* conn = pending.at( i ).first.data();
+        if ( !conn )
+            continue;
+
+        const quint32 id = m_nextId;
+        m_nextId += 2;
+
+        tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Opening channel" << id << "to" << m_cc->name() << "for" << pending.at( i ).second;
+        addChannel( id, conn );
+        queueControlFrame( OPEN, id, pending.at( i ).second.toUtf8() );
+
+        // It may queue msgs right away, they go out once the peer accepted
+        conn->startChannel( this, true );
+    }
+}
+
+
+void
+ConnectionMux::handleFrame( const msg_ptr& msg )
+{
+    FrameType type;
+    quint32 id;
+    QByteArray data;
+    if ( !parseFrame( msg, type, id, data ) )
+    {
+        tLog() << Q_FUNC_INFO << "Invalid frame from" << m_cc->name();
+        return;
+    }
+
+    Channel* channel = m_channels.value( id );
+
+    switch ( type )
+    {
+        case OPEN:
+        {
+            if ( channel )
+            {
+                tLog() << Q_FUNC_INFO << "Peer opened channel" << id << "twice";
+                break;
+            }
+
+            const QString key = QString::fromUtf8( data );
+            Connection* conn = m_cc->servent()->claimChannelOffer( m_cc, key );
+            if ( !conn )
+            {
+                tLog() << Q_FUNC_INFO << "Refusing channel" << id << "for" << key;
+                queueControlFrame( CLOSE, id );
+                break;
+            }
+
+            tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Accepting channel" << id << "from" << m_cc->name() << "for" << key;
+            channel = addChannel( id, conn );
+            channel->setAccepted( true );
+            queueControlFrame( ACCEPT, id );
+            conn->startChannel( this, false );
+            break;
+        }
+
+        case ACCEPT:
+            if ( !channel )
+            {
+                // We gave up on it in the meantime
+                queueControlFrame( CLOSE, id );
+                break;
+            }
+
+            channel->setAccepted( true );
+            schedule();
+            break;
+
+        case DATA:
+            if ( !channel )
+            {
+                queueControlFrame( CLOSE, id );
+                break;
+            }
+
+            deliver( channel, data );
+            break;
+
+        case WINDOW:
+            if ( !channel || data.length() < (int)sizeof( quint32 ) )
+                break;
+
+            channel->addCredit( qFromBigEndian< quint32 >( (const uchar*)data.constData() ) );
+            schedule();
+            break;
+
+        case CLOSE:
+        {
+            if ( !channel )
+                break;
+
+            Connection* conn = channel->connection();
+            const bool accepted = channel->isAccepted();
+            removeChannel( channel );
+
+            // Refused channels failed, everything else ended like a socket the peer closed
+            if ( accepted )
+                conn->channelClosed();
+            else
+                conn->markAsFailed();
+            break;
+        }
+
+        default:
+            tLog() << Q_FUNC_INFO << "Unknown frame type" << (int)type << "from" << m_cc->name();
+            break;
+    }
+}
+
+
+bool
+ConnectionMux::send( Connection* conn, const msg_ptr& msg )
+{
+    Channel* channel = m_channels.value( m_ids.value( conn ) );
+    if ( !channel )
+        return false;
+
+    channel->queue( msg );
+    schedule();
+    return true;
+}
+
+
+void
+ConnectionMux::closeChannel( Connection* conn )
+{
+    Channel* channel = m_channels.value( m_ids.value( conn ) );
+    if ( !channel )
+        return;
+
+    // Whatever is still queued goes away with it, like it would in a closed socket
+    const quint32 id = channel->id();
+    removeChannel( channel );
+    queueControlFrame( CLOSE, id );
+}
+
+
+void
+ConnectionMux::schedule()
+{
+    QTcpSocket* sock = m_cc->socket().data();
+    if ( !sock || m_scheduling )
+        return;
+
+    // Frames that finish a channel's msgs can make it queue more or close,
+    // those calls come back here
+    m_scheduling = true;
+
+    while ( sock->bytesToWrite() < SOCKET_HIGH_WATER )
+    {
+        Channel* from = 0;
+        msg_ptr frame = m_controlFrames.isEmpty() ? nextDataFrame( &from ) : m_controlFrames.takeFirst();
+        if ( frame.isNull() || !m_cc->writeFrame( frame ) )
+            break;
+
+        // As far as the channel is concerned, this is what the socket took
+        if ( from )
+            from->connection()->bytesWritten( frame->length() - FRAME_HEADER_SIZE );
+    }
+
+    m_scheduling = false;
+}
+
+
+ConnectionMux::Channel*
+ConnectionMux::addChannel( quint32 id, Connection* conn )
+{
+    Channel* channel = new Channel( id, conn, CHANNEL_WINDOW );
+    channel->setPriority( priorityFor( conn ) );
+
+    m_channels.insert( id, channel );
+    m_ids.insert( conn, id );
+    m_order << id;
+
+    if ( conn->name().isEmpty() )
+        conn->setName( m_cc->name() );
+
+    return channel;
+}
+
+
+void
+ConnectionMux::removeChannel( Channel* channel )
+{
+    m_channels.remove( channel->id() );
+    m_ids.remove( channel->connection() );
+    m_order.removeAll( channel->id() );
+
+    delete channel;
+}
+
+
+void
+ConnectionMux::queueControlFrame( FrameType type, quint32 id, const QByteArray& data )
+{
+    m_controlFrames << frame( type, id, data );
+    schedule();
+}
+
+
+msg_ptr
+ConnectionMux::nextDataFrame( Channel** from )
+{
+    for ( int priority = HIGH; priority <= LOW; priority++ )
+    {
+        for ( int i = 0; i < m_order.count(); i++ )
+        {
+            Channel* channel = m_channels.value( m_order.at( i ) );
+            if ( channel->priority() != priority || !channel->canSend() )
+                continue;
+
+            // Served, the others of the same priority come first next time
+            m_order.move( i, m_order.count() - 1 );
+
+            *from = channel;
+            return frame( DATA, channel->id(), channel->takeData( MAX_FRAME_SIZE ) );
+        }
+    }
+
+    return msg_ptr();
+}
+
+
+void
+ConnectionMux::deliver( Channel* channel, const QByteArray& data )
+{
+    const QList< msg_ptr > msgs = channel->receive( data );
+
+    // Sending the credit can end up closing the channel
+    Connection* conn = channel->connection();
+
+    const quint32 ack = channel->takeAck();
+    if ( ack > 0 )
+    {
+        uchar credit[ sizeof( quint32 ) ];
+        qToBigEndian( ack, credit );
+        queueControlFrame( WINDOW, channel->id(), QByteArray( (const char*)credit, sizeof( credit ) ) );
+    }
+
+    foreach ( const msg_ptr& msg, msgs )
+        conn->channelMsgReceived( msg );
+}
@@ -0,0 +1,179 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Runs DBSyncConnections and StreamConnections as channels inside the
+    socket of their ControlConnection, instead of opening a new socket
+    for each of them.
+
+    Both peers announce support with a "mux" msg on the control
+    connection. Channel frames are SETUP | RAW msgs, which never show up
+    after a connection is ready otherwise. Their payload starts with
+    - 1 byte frame type
+    - 4 bytes channel id, big endian
+
+    OPEN carries the offer key the channel is for, the peer claims the
+    offer just like it would for a new socket and answers ACCEPT or CLOSE.
+    DATA carries a piece of the channel's msgs, framed as on a socket.
+    WINDOW hands back send credit once DATA was delivered on the other end.
+    CLOSE ends the channel, from either side.
+
+    The socket is only kept filled up to a small high-water mark, what is
+    written next is picked by priority: streams first, DB syncs last.
+*/
+
+#ifndef CONNECTIONMUX_H
+#define CONNECTIONMUX_H
+
+#include "DllMacro.h"
+#include "Typedefs.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+
+class Connection;
+class ConnectionMuxChannel;
+class ControlConnection;
+
+class DLLEXPORT ConnectionMux : public QObject
+{
+Q_OBJECT
+
+public:
+    enum FrameType
+    {
+        OPEN = 0,
+        ACCEPT = 1,
+        DATA = 2,
+        WINDOW = 3,
+        CLOSE = 4
+    };
+
+    enum Priority
+    {
+        HIGH = 0,
+        NORMAL = 1,
+        LOW = 2
+    };
+
+    explicit ConnectionMux( ControlConnection* cc );
+    virtual ~ConnectionMux();
+
+    static bool isFrame( const msg_ptr& msg );
+    static Priority priorityFor( Connection* conn );
+
+    static msg_ptr frame( FrameType type, quint32 id, const QByteArray& data = QByteArray() );
+    // false if msg is no valid frame, data points into the payload of msg
+    static bool parseFrame( const msg_ptr& msg, FrameType& type, quint32& id, QByteArray& data );
+
+    /**
+     * Runs conn as a new channel, the peer gets the offer key to claim.
+     * Safe to call from any thread.
+     */
+    void openChannel( Connection* conn, const QString& key );
+
+    void handleFrame( const msg_ptr& msg );
+
+    // Queues a msg of a channel connection, called by Connection::sendMsg_now()
+    bool send( Connection* conn, const msg_ptr& msg );
+    void closeChannel( Connection* conn );
+
+private slots:
+    void openPending();
+    void schedule();
+
+private:
+    typedef ConnectionMuxChannel Channel;
+
+    Channel* addChannel( quint32 id, Connection* conn );
+    void removeChannel( Channel* channel );
+    void queueControlFrame( FrameType type, quint32 id, const QByteArray& data = QByteArray() );
+    msg_ptr nextDataFrame( Channel** from );
+    void deliver( Channel* channel, const QByteArray& data );
+
+    ControlConnection* m_cc;
+    quint32 m_nextId;
+    bool m_scheduling;
+
+    QHash< quint32, Channel* > m_channels;
+    QHash< Connection*, quint32 > m_ids;
+    // round robin order among channels of the same priority
+    QList< quint32 > m_order;
+    QList< msg_ptr > m_controlFrames;
+
+    QMutex m_pendingMutex;
+    QList< QPair< QPointer< Connection >, QString > > m_pending;
+};
+
+
+/**
+ * The state of one channel of a ConnectionMux: the msgs it still has to
+ * send, the credit the peer gave it and what it received so far.
+ */
+class DLLEXPORT ConnectionMuxChannel
+{
+public:
+    // window is how much either end may send before it has to wait for credit
+    ConnectionMuxChannel( quint32 id, Connection* conn, qint64 window );
+
+    quint32 id() const { return m_id; }
+    Connection* connection() const { return m_conn; }
+
+    ConnectionMux::Priority priority() const { return m_priority; }
+    void setPriority( ConnectionMux::Priority priority ) { m_priority = priority; }
+
+    // Nothing is sent before the peer accepted the channel
+    bool isAccepted() const { return m_accepted; }
+    void setAccepted( bool accepted ) { m_accepted = accepted; }
+
+    void queue( const msg_ptr& msg );
+    qint64 bytesQueued() const { return m_queued; }
+    qint64 sendCredit() const { return m_sendCredit; }
+    bool canSend() const;
+
+    // Up to maxSize queued bytes, as far as the credit goes
+    QByteArray takeData( qint64 maxSize );
+    void addCredit( quint32 bytes );
+
+    // Returns the msgs data completed
+    QList< msg_ptr > receive( const QByteArray& data );
+    // Credit to hand back to the peer, 0 while it isn't worth a frame yet
+    quint32 takeAck();
+
+private:
+    quint32 m_id;
+    Connection* m_conn;
+    ConnectionMux::Priority m_priority;
+    bool m_accepted;
+    qint64 m_window;
+
+    // serialized msgs waiting to be sent
+    QList< QByteArray > m_outbuf;
+    qint64 m_queued;
+    int m_headOffset;
+    qint64 m_sendCredit;
+
+    // received bytes we didn't hand credit back for yet
+    qint64 m_unacked;
+    QByteArray m_inbuf;
+};
+
+#endif // CONNECTIONMUX_H
@@ -23,6 +23,7 @@
 
 #include "Connection.h"
 
+#include "ConnectionMux.h"
 #include "MsgProcessor.h"
 
 #include <QReadWriteLock>
@@ -36,6 +37,7 @@ public:
         : q_ptr ( q )
         , servent( _servent )
         , sock( 0 )
+        , channel( false )
         , do_shutdown( false )
         , actually_shutting_down( false )
         , peer_disconnected( false )
@@ -61,6 +63,8 @@ public:
 private:
     Servent* servent;
     QPointer<QTcpSocket> sock;
+    QPointer<ConnectionMux> mux;
+    bool channel;
     QHostAddress peerIpAddress;
     bool do_shutdown;
     bool actually_shutting_down;
@@ -78,6 +82,7 @@ private:
     mutable QReadWriteLock nodeidLock;
     msg_ptr msg;
     msg_ptr firstmsg;
+    QStringList peerCodecs;
     int peerport;
 
     QTimer* statstimer;
@@ -22,6 +22,7 @@
 
 #include "database/Database.h"
 #include "database/DatabaseCommand_CollectionStats.h"
+#include "network/ConnectionMux.h"
 #include "network/DbSyncConnection.h"
 #include "network/Msg.h"
 #include "network/MsgProcessor.h"
@@ -67,6 +68,8 @@ ControlConnection::~ControlConnection()
     }
 
     delete d->pingtimer;
+    // Closes the channels while we are still around
+    delete d->mux;
     servent()->unregisterControlConnection( this );
     if ( d->dbsyncconn )
         d->dbsyncconn->deleteLater();
@@ -143,6 +146,11 @@ ControlConnection::setup()
         d->pingtimer->start();
         d->pingtimer_mark.start();
         d->sourceLock.unlock();
+
+        // Older peers ignore this and keep getting their own sockets
+        QVariantMap m;
+        m.insert( "method", "mux" );
+        sendMsg( m );
     }
     else
     {
@@ -249,6 +257,14 @@ ControlConnection::dbSyncConnFinished( QObject* c )
 }
 
 
+ConnectionMux*
+ControlConnection::mux() const
+{
+    Q_D( const ControlConnection );
+    return d->mux;
+}
+
+
 DBSyncConnection*
 ControlConnection::dbSyncConnection()
 {
@@ -304,6 +320,14 @@ ControlConnection::handleMsg( msg_ptr msg )
             d->dbconnkey = m.value( "key" ).toString() ;
             setupDbSyncConnection();
         }
+        else if ( m.value( "method" ).toString() == "mux" )
+        {
+            if ( !d->mux )
+            {
+                tDebug( LOGVERBOSE ) << id() << "Peer supports channels, no more parallel connections";
+                d->mux = new ConnectionMux( this );
+            }
+        }
         else if ( m.value( "method" ) == "protovercheckfail" )
         {
             qDebug() << "*** Remote peer protocol version mismatch, connection closed";
@@ -321,6 +345,22 @@ ControlConnection::handleMsg( msg_ptr msg )
     tDebug() << id() << "Invalid msg:" << QString::fromLatin1( msg->payload() );
 }
 
+void
+ControlConnection::handleFrame( msg_ptr msg )
+{
+    Q_D( ControlConnection );
+
+    // Frames keep the connection alive just as well as pings
+    d->pingtimer_mark.restart();
+
+    // Only a peer that got our "mux" msg sends frames, theirs might still be on the way
+    if ( !d->mux )
+        d->mux = new ConnectionMux( this );
+
+    d->mux->handleFrame( msg );
+}
+
+
 void
 ControlConnection::authCheckTimeout()
 {
@@ -24,6 +24,9 @@
     They arrange connections/reverse connections, inform us
     when the peer goes offline, and own+setup DBSyncConnections.
 
+    If the peer supports it, DBSyncConnections and StreamConnections
+    run as channels inside the control connection, see ConnectionMux.
+
 */
 #ifndef CONTROLCONNECTION_H
 #define CONTROLCONNECTION_H
@@ -32,6 +35,7 @@
 #include "DllMacro.h"
 #include "Typedefs.h"
 
+class ConnectionMux;
 class ControlConnectionPrivate;
 class DBSyncConnection;
 class Servent;
@@ -47,6 +51,9 @@ public:
 
     DBSyncConnection* dbSyncConnection();
 
+    // 0 until the peer told us it can run connections as channels of ours
+    ConnectionMux* mux() const;
+
     Tomahawk::source_ptr source() const;
 
     /**
@@ -61,6 +68,7 @@ public:
 
 protected:
     virtual void setup();
+    virtual void handleFrame( msg_ptr msg );
 
 protected slots:
     virtual void handleMsg( msg_ptr msg );
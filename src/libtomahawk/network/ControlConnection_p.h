@@ -33,6 +33,7 @@ public:
     ControlConnectionPrivate( ControlConnection* q )
         : q_ptr ( q )
         , dbsyncconn( 0 )
+        , mux( 0 )
         , registered( false )
         , shutdownOnEmptyPeerInfos( true )
         , pingtimer( 0 )
@@ -49,6 +50,7 @@ private:
      */
     mutable QReadWriteLock sourceLock;
     DBSyncConnection* dbsyncconn;
+    ConnectionMux* mux;
 
     QString dbconnkey;
     bool registered;
@@ -21,9 +21,21 @@
     Database syncing using the oplog table.
     =======================================
     Load the last GUID we applied for the peer, tell them it.
-    In return, they send us all new ops since that guid.
+    In return, they send us a page of new ops since that guid.
 
-    We then apply those new ops to our cache of their data
+    We then apply those new ops to our cache of their data, which also
+    stores the guid of the last applied op. Then we ask again, until the
+    peer has nothing left and answers "ok". An interrupted sync therefore
+    continues after the last page we applied.
+
+    Peers that announce "batch" in their fetchops request get the ops of
+    a page packed into a few large BATCH msgs, which are compressed as a
+    whole. Everyone else gets one msg per op.
+
+    Playlist revisions are sent as deltas against the previous revision
+    to peers that announce "playlistdeltas", and as full lists otherwise.
+    If a delta doesn't apply to our copy, we fetch again from the op
+    before it without "playlistdeltas".
 
     Synced.
 
@@ -43,6 +55,15 @@
 #include "Source.h"
 #include "SourceList.h"
 
+#include <QBuffer>
+
+// Ops sent in reply to one fetchops request, the peer applies them before asking for more
+#define OPS_PER_PAGE 5000
+// Ops packed into one BATCH msg
+#define OPS_PER_BATCH 500
+// Stop loading ops while this many bytes are waiting to be sent
+#define WRITE_BUFFER_LIMIT 1024 * 1024
+
 using namespace Tomahawk;
 
 
@@ -50,6 +71,12 @@ DBSyncConnection::DBSyncConnection( Servent* s, const source_ptr& src )
     : Connection( s )
     , m_fetchCount( 0 )
     , m_source( src )
+    , m_pageSent( 0 )
+    , m_requestedOps( 0 )
+    , m_peerBatches( false )
+    , m_peerPlaylistDeltas( false )
+    , m_fetchFullPlaylists( false )
+    , m_waitingForSocket( false )
     , m_state( UNKNOWN )
 {
     qDebug() << Q_FUNC_INFO << src->id() << thread();
@@ -59,6 +86,8 @@ DBSyncConnection::DBSyncConnection( Servent* s, const source_ptr& src )
              m_source.data(),   SLOT( onStateChanged( Tomahawk::DBSyncConnectionState, Tomahawk::DBSyncConnectionState, QString ) ) );
     connect( m_source.data(), SIGNAL( commandsFinished() ),
              this,              SLOT( lastOpApplied() ) );
+    connect( m_source.data(), SIGNAL( opsRejected() ),
+             this,              SLOT( fetchFullPlaylists() ) );
 
     this->setMsgProcessorModeIn( MsgProcessor::PARSE_JSON | MsgProcessor::UNCOMPRESS_ALL );
 
@@ -90,7 +119,10 @@ DBSyncConnection::changeState( DBSyncConnectionState newstate )
 void
 DBSyncConnection::setup()
 {
-    setId( QString( "DBSyncConnection/%1" ).arg( socket()->peerAddress().toString() ) );
+    // Channels of a ControlConnection don't have a socket of their own
+    setId( QString( "DBSyncConnection/%1" ).arg( socket() ? socket()->peerAddress().toString() : name() ) );
+    connect( this, SIGNAL( written( qint64 ) ), SLOT( onBytesWritten() ), Qt::QueuedConnection );
+
     check();
 }
 
@@ -158,7 +190,19 @@ DBSyncConnection::fetchOpsData( const QString& sinceguid )
     QVariantMap msg;
     msg.insert( "method", "fetchops" );
     msg.insert( "lastop", sinceguid );
+    msg.insert( "batch", true );
+    msg.insert( "playlistdeltas", !m_fetchFullPlaylists );
     sendMsg( msg );
+
+    m_fetchFullPlaylists = false;
+}
+
+
+/// A playlist delta didn't apply, get the next page with full lists
+void
+DBSyncConnection::fetchFullPlaylists()
+{
+    m_fetchFullPlaylists = true;
 }
 
 
@@ -186,6 +230,12 @@ DBSyncConnection::handleMsg( msg_ptr msg )
         return;
     }
 
+    if ( msg->is( Msg::DBOP ) && msg->is( Msg::BATCH ) )
+    {
+        handleBatch( msg );
+        return;
+    }
+
     Q_ASSERT( msg->is( Msg::JSON ) );
 
     QVariantMap m = msg->json().toMap();
@@ -243,20 +293,81 @@ DBSyncConnection::lastOpApplied()
 }
 
 
+void
+DBSyncConnection::handleBatch( const msg_ptr& msg )
+{
+    // The payload holds complete uncompressed JSON DBOP msgs, header included
+    const QByteArray& payload = msg->payload();
+    QByteArray header;
+    int pos = 0;
+    while ( pos + Msg::headerSize() <= payload.length() )
+    {
+        header = payload.mid( pos, Msg::headerSize() );
+        msg_ptr op = Msg::begin( header.data() );
+        pos += Msg::headerSize();
+
+        if ( pos + (int)op->length() > payload.length() )
+        {
+            tLog() << "Truncated batch in dbsync from:" << m_source->id() << m_source->friendlyName();
+            break;
+        }
+
+        op->fill( payload.mid( pos, op->length() ) );
+        pos += op->length();
+
+        const QVariantMap m = op->json().toMap();
+        if ( m.isEmpty() )
+        {
+            tLog() << "Failed to parse batched op in dbsync from:" << m_source->id() << m_source->friendlyName();
+            continue;
+        }
+
+        dbcmd_ptr cmd = Database::instance()->createCommandInstance( m, m_source );
+        if ( !cmd.isNull() )
+        {
+            m_source->addCommand( cmd );
+        }
+    }
+
+    if ( !msg->is( Msg::FRAGMENT ) ) // last msg in this page
+    {
+        changeState( SAVING ); // just DB work left to complete
+        m_source->executeCommands();
+    }
+}
+
+
 /// request new copies of anything we've cached that is stale
 void
 DBSyncConnection::sendOps()
 {
     tLog() << "Will send peer" << m_source->id() << "all ops since" << m_uscache.value( "lastop" ).toString();
 
+    m_sendCursor = m_uscache.value( "lastop" ).toString();
+    m_peerBatches = m_uscache.value( "batch" ).toBool();
+    m_peerPlaylistDeltas = m_uscache.value( "playlistdeltas" ).toBool();
+    m_pageSent = 0;
+    m_waitingForSocket = false;
+
+    m_uscache.clear();
+
+    loadOps();
+}
+
+
+void
+DBSyncConnection::loadOps()
+{
     source_ptr src = SourceList::instance()->getLocal();
 
-    DatabaseCommand_loadOps* cmd = new DatabaseCommand_loadOps( src, m_uscache.value( "lastop" ).toString() );
+    // Older peers get the whole page at once, we can't split it into batches for them
+    m_requestedOps = m_peerBatches ? qMin( OPS_PER_BATCH, OPS_PER_PAGE - m_pageSent ) : OPS_PER_PAGE;
+
+    DatabaseCommand_loadOps* cmd = new DatabaseCommand_loadOps( src, m_sendCursor, m_requestedOps );
+    cmd->setExpandPlaylistDeltas( !m_peerPlaylistDeltas );
     connect( cmd, SIGNAL( done( QString, QString, QList< dbop_ptr > ) ),
                     SLOT( sendOpsData( QString, QString, QList< dbop_ptr > ) ) );
 
-    m_uscache.clear();
-
     Database::instance()->enqueue( Tomahawk::dbcmd_ptr( cmd ) );
 }
 
@@ -264,31 +375,97 @@ DBSyncConnection::sendOps()
 void
 DBSyncConnection::sendOpsData( QString sinceguid, QString lastguid, QList< dbop_ptr > ops )
 {
-    if ( m_lastSentOp == lastguid )
+    const bool pageStart = ( m_pageSent == 0 );
+    if ( pageStart && m_lastSentOp == lastguid )
         ops.clear();
 
     m_lastSentOp = lastguid;
     if ( ops.length() == 0 )
     {
-        tLog( LOGVERBOSE ) << "Sending ok" << m_source->id() << m_source->friendlyName();
-        sendMsg( Msg::factory( "ok", Msg::DBOP ) );
+        if ( pageStart )
+        {
+            tLog( LOGVERBOSE ) << "Sending ok" << m_source->id() << m_source->friendlyName();
+            sendMsg( Msg::factory( "ok", Msg::DBOP ) );
+        }
+        else
+        {
+            // The previous batch happened to end exactly with the oplog, close the page
+            sendBatch( ops, true );
+        }
         return;
     }
 
     tLog( LOGVERBOSE ) << Q_FUNC_INFO << sinceguid << lastguid << "Num ops to send:" << ops.length();
 
-    int i;
-    for( i = 0; i < ops.length(); ++i )
+    m_sendCursor = lastguid;
+    m_pageSent += ops.length();
+    const bool last = ( ops.length() < m_requestedOps || m_pageSent >= OPS_PER_PAGE );
+
+    if ( m_peerBatches )
+    {
+        sendBatch( ops, last );
+    }
+    else
     {
-        quint8 flags = Msg::JSON | Msg::DBOP;
+        int i;
+        for( i = 0; i < ops.length(); ++i )
+        {
+            quint8 flags = Msg::JSON | Msg::DBOP;
 
-        if ( ops.at( i )->compressed )
-            flags |= Msg::COMPRESSED;
-        if ( i != ops.length() - 1 )
-            flags |= Msg::FRAGMENT;
+            if ( ops.at( i )->compressed )
+                flags |= Msg::COMPRESSED;
+            if ( i != ops.length() - 1 )
+                flags |= Msg::FRAGMENT;
 
-        sendMsg( Msg::factory( ops.at( i )->payload, flags ) );
+            sendMsg( Msg::factory( ops.at( i )->payload, flags ) );
+        }
     }
+
+    if ( last )
+    {
+        m_pageSent = 0;
+        return;
+    }
+
+    // Don't pull more ops out of the database than the connection can take
+    if ( bytesQueued() > WRITE_BUFFER_LIMIT )
+        m_waitingForSocket = true;
+    else
+        loadOps();
+}
+
+
+void
+DBSyncConnection::sendBatch( const QList< dbop_ptr >& ops, bool last )
+{
+    QByteArray batch;
+    QBuffer buffer( &batch );
+    buffer.open( QIODevice::WriteOnly );
+
+    // Ops are stored compressed one by one, they compress a lot better together
+    foreach ( const dbop_ptr& op, ops )
+    {
+        const QByteArray payload = op->compressed ? qUncompress( op->payload ) : op->payload;
+        Msg::factory( payload, Msg::JSON | Msg::DBOP )->write( &buffer );
+    }
+
+    quint8 flags = Msg::DBOP | Msg::BATCH;
+    if ( !last )
+        flags |= Msg::FRAGMENT;
+
+    // COMPRESS_IF_LARGE takes care of compressing the whole batch
+    sendMsg( Msg::factory( batch, flags ) );
+}
+
+
+void
+DBSyncConnection::onBytesWritten()
+{
+    if ( !m_waitingForSocket || bytesQueued() > WRITE_BUFFER_LIMIT / 2 )
+        return;
+
+    m_waitingForSocket = false;
+    loadOps();
 }
 
 
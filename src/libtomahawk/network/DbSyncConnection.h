@@ -62,6 +62,8 @@ private slots:
     void fetchOpsData( const QString& sinceguid );
     void sendOpsData( QString sinceguid, QString lastguid, QList< dbop_ptr > ops );
     void lastOpApplied();
+    void fetchFullPlaylists();
+    void onBytesWritten();
 
     void check();
 
@@ -69,12 +71,26 @@ private:
     void synced();
     void changeState( Tomahawk::DBSyncConnectionState newstate );
 
+    void loadOps();
+    void sendBatch( const QList< dbop_ptr >& ops, bool last );
+    void handleBatch( const msg_ptr& msg );
+
     int m_fetchCount;
     Tomahawk::source_ptr m_source;
     QVariantMap m_uscache;
 
     QString m_lastSentOp;
 
+    // State of the page of ops we are currently sending to the peer
+    QString m_sendCursor;
+    int m_pageSent;
+    int m_requestedOps;
+    bool m_peerBatches;
+    bool m_peerPlaylistDeltas;
+    // the next fetchops asks for full playlist revisions
+    bool m_fetchFullPlaylists;
+    bool m_waitingForSocket;
+
     Tomahawk::DBSyncConnectionState m_state;
 };
 
@@ -71,11 +71,14 @@ bool
 Msg::write( QIODevice * device )
 {
     Q_D( Msg );
-    quint32 size  = qToBigEndian( d->length );
-    quint8  flags = d->flags;
-    if( device->write( (const char*) &size,  sizeof(quint32) ) != sizeof(quint32) ) return false;
-    if( device->write( (const char*) &flags, sizeof(quint8) )  != sizeof(quint8)  ) return false;
-    if( device->write( (const char*) d->payload.data(), d->length ) != d->length ) return false;
+
+    // One write for the whole header, one for the payload
+    char header[ sizeof(quint32) + sizeof(quint8) ];
+    qToBigEndian( d->length, (uchar*) header );
+    header[ sizeof(quint32) ] = d->flags;
+
+    if( device->write( header, sizeof(header) ) != sizeof(header) ) return false;
+    if( device->write( (const char*) d->payload.constData(), d->length ) != d->length ) return false;
     return true;
 }
 
@@ -137,3 +140,19 @@ Msg::flags() const
     Q_D( const Msg );
     return d->flags;
 }
+
+
+void
+Msg::setCountedSize( quint32 size )
+{
+    Q_D( Msg );
+    d->counted_size = size;
+}
+
+
+quint32
+Msg::countedSize() const
+{
+    Q_D( const Msg );
+    return d->counted_size;
+}
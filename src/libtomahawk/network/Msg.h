@@ -31,6 +31,7 @@
 #ifndef MSG_H
 #define MSG_H
 
+#include "DllMacro.h"
 #include "Typedefs.h"
 
 #include <QSharedPointer>
@@ -39,8 +40,9 @@ class MsgPrivate;
 class QByteArray;
 class QIODevice;
 
-class Msg
+class DLLEXPORT Msg
 {
+    friend class Connection;
     friend class MsgProcessor;
 
 public:
@@ -52,8 +54,8 @@ public:
         COMPRESSED = 8,
         DBOP = 16,
         PING = 32,
-        RESERVED_1 = 64,
-        SETUP = 128 // used to handshake/auth the connection prior to handing over to Connection subclass
+        BATCH = 64, // payload is a sequence of complete msgs, used for DBOPs
+        SETUP = 128 // used to handshake/auth the connection prior to handing over to Connection subclass, with RAW for ConnectionMux frames
     };
 
     virtual ~Msg();
@@ -102,6 +104,12 @@ private:
      */
     Msg( quint32 len, quint8 flags );
 
+    /**
+     * Size Connection::sendMsg() accounted for, before compression
+     */
+    void setCountedSize( quint32 size );
+    quint32 countedSize() const;
+
     Q_DECLARE_PRIVATE( Msg )
     MsgPrivate* d_ptr;
 };
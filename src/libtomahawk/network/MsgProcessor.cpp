@@ -24,13 +24,25 @@
 #include "utils/Logger.h"
 #include "utils/TomahawkUtils.h"
 
+#include "config.h"
+
 #include <QThread>
 #include <QFuture>
 #include <QFutureWatcher>
 #include <qtconcurrentrun.h>
 
+#ifdef ZSTD_FOUND
+    #include <zstd.h>
+#endif
+
+// Only the fallback for peers without a faster codec, level 9 costs a lot of CPU for very little gain
+#define ZLIB_LEVEL 6
+#define ZSTD_LEVEL 1
+// Refuse to inflate anything claiming to be larger than this
+#define MAX_UNCOMPRESSED_SIZE 64 * 1024 * 1024
+
 MsgProcessor::MsgProcessor( quint32 mode, quint32 t ) :
-    QObject(), m_mode( mode ), m_threshold( t ), m_totmsgsize( 0 )
+    QObject(), m_mode( mode ), m_threshold( t ), m_codec( ZLIB ), m_totmsgsize( 0 )
 {
     moveToThread( Servent::instance()->thread() );
 }
@@ -51,14 +63,15 @@ MsgProcessor::append( msg_ptr msg )
 
     m_totmsgsize += msg->payload().length();
 
-    if( m_mode & NOTHING )
+    // NOTHING is 0, so this used to be skipped and every msg took a trip through the thread pool
+    if( m_mode == NOTHING )
     {
         //qDebug() << "MsgProcessor::NOTHING";
         handleProcessedMsg( msg );
         return;
     }
 
-    QFuture<msg_ptr> fut = QtConcurrent::run(&MsgProcessor::process, msg, m_mode, m_threshold);
+    QFuture<msg_ptr> fut = QtConcurrent::run(&MsgProcessor::process, msg, m_mode, m_threshold, m_codec);
     QFutureWatcher<msg_ptr> * watcher = new QFutureWatcher<msg_ptr>;
     connect( watcher, SIGNAL( finished() ),
              this, SLOT( processed() ),
@@ -107,13 +120,13 @@ MsgProcessor::handleProcessedMsg( msg_ptr msg )
 
 /// This method is run by QtConcurrent:
 msg_ptr
-MsgProcessor::process( msg_ptr msg, quint32 mode, quint32 threshold )
+MsgProcessor::process( msg_ptr msg, quint32 mode, quint32 threshold, Codec codec )
 {
     // uncompress if needed
     if( (mode & UNCOMPRESS_ALL) && msg->is( Msg::COMPRESSED ) )
     {
 //        qDebug() << "MsgProcessor::UNCOMPRESSING";
-        msg->d_func()->payload = qUncompress( msg->payload() );
+        msg->d_func()->payload = uncompress( msg->payload(), codec );
         msg->d_func()->length  = msg->d_func()->payload.length();
         msg->d_func()->flags ^= Msg::COMPRESSED;
     }
@@ -129,15 +142,143 @@ MsgProcessor::process( msg_ptr msg, quint32 mode, quint32 threshold )
         msg->d_func()->json_parsed = true;
     }
 
+    if( !(mode & COMPRESS_IF_LARGE) )
+        return msg;
+
+    // payloads stored compressed in the database are zlib, the peer expects the negotiated codec
+    if( msg->is( Msg::COMPRESSED ) && codec != ZLIB )
+    {
+        msg->d_func()->payload = compress( qUncompress( msg->payload() ), codec );
+        msg->d_func()->length  = msg->d_func()->payload.length();
+    }
     // compress if needed
-    if( (mode & COMPRESS_IF_LARGE) &&
-        !msg->is( Msg::COMPRESSED )
-        && msg->length() > threshold )
+    else if( !msg->is( Msg::COMPRESSED ) && msg->length() > threshold )
     {
 //        qDebug() << "MsgProcessor::COMPRESSING";
-        msg->d_func()->payload = qCompress( msg->payload(), 9 );
-        msg->d_func()->length  = msg->d_func()->payload.length();
-        msg->d_func()->flags |= Msg::COMPRESSED;
+        const QByteArray compressed = compress( msg->payload(), codec );
+
+        // not worth it for payloads that don't shrink, e.g. already compressed data
+        if( !compressed.isEmpty() && compressed.length() < msg->payload().length() )
+        {
+            msg->d_func()->payload = compressed;
+            msg->d_func()->length  = msg->d_func()->payload.length();
+            msg->d_func()->flags |= Msg::COMPRESSED;
+        }
     }
     return msg;
 }
+
+
+QStringList
+MsgProcessor::supportedCodecs()
+{
+    QStringList codecs;
+#ifdef ZSTD_FOUND
+    codecs << codecName( ZSTD );
+#endif
+    codecs << codecName( ZLIB );
+
+    return codecs;
+}
+
+
+MsgProcessor::Codec
+MsgProcessor::negotiateCodec( const QStringList& peerCodecs )
+{
+    foreach ( const QString& name, supportedCodecs() )
+    {
+        if ( peerCodecs.contains( name ) )
+            return codecFromName( name );
+    }
+
+    return ZLIB;
+}
+
+
+MsgProcessor::Codec
+MsgProcessor::codecFromName( const QString& name, bool* ok )
+{
+    if ( ok )
+        *ok = supportedCodecs().contains( name );
+
+    if ( name == "zstd" )
+        return ZSTD;
+
+    return ZLIB;
+}
+
+
+QString
+MsgProcessor::codecName( Codec codec )
+{
+    switch ( codec )
+    {
+        case ZSTD:
+            return "zstd";
+        case ZLIB:
+            break;
+    }
+
+    return "zlib";
+}
+
+
+QByteArray
+MsgProcessor::compress( const QByteArray& data, Codec codec )
+{
+#ifdef ZSTD_FOUND
+    if ( codec == ZSTD )
+    {
+        QByteArray out;
+        out.resize( ZSTD_compressBound( data.length() ) );
+
+        const size_t len = ZSTD_compress( out.data(), out.length(), data.constData(), data.length(), ZSTD_LEVEL );
+        if ( ZSTD_isError( len ) )
+        {
+            tLog() << Q_FUNC_INFO << "zstd compression failed:" << ZSTD_getErrorName( len );
+            return QByteArray();
+        }
+
+        out.resize( len );
+        return out;
+    }
+#else
+    Q_UNUSED( codec );
+#endif
+
+    return qCompress( data, ZLIB_LEVEL );
+}
+
+
+QByteArray
+MsgProcessor::uncompress( const QByteArray& data, Codec codec )
+{
+#ifdef ZSTD_FOUND
+    if ( codec == ZSTD )
+    {
+        const unsigned long long size = ZSTD_getFrameContentSize( data.constData(), data.length() );
+        if ( size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN || size > MAX_UNCOMPRESSED_SIZE )
+        {
+            tLog() << Q_FUNC_INFO << "Invalid zstd frame, size:" << size;
+            return QByteArray();
+        }
+
+        QByteArray out;
+        out.resize( size );
+
+        const size_t len = ZSTD_decompress( out.data(), out.length(), data.constData(), data.length() );
+        if ( ZSTD_isError( len ) )
+        {
+            tLog() << Q_FUNC_INFO << "zstd decompression failed:" << ZSTD_getErrorName( len );
+            return QByteArray();
+        }
+
+        out.resize( len );
+        return out;
+    }
+#else
+    Q_UNUSED( codec );
+#endif
+
+    return qUncompress( data );
+}
@@ -21,7 +21,8 @@
     it emits done(msg_ptr) for each msg, preserving the order.
 
     It can be configured to auto-compress, or de-compress msgs for sending
-    or receiving.
+    or receiving. Peers agree on the codec after the connection is set up,
+    until then (and with older peers) zlib is used.
 
     It uses QtConcurrent, but preserves msg order.
 
@@ -32,10 +33,12 @@
 
 #include "Typedefs.h"
 #include "Msg.h" // Needed because we have msg_ptr in a slot
+#include "DllMacro.h"
 
 #include <QObject>
+#include <QStringList>
 
-class MsgProcessor : public QObject
+class DLLEXPORT MsgProcessor : public QObject
 {
 Q_OBJECT
 public:
@@ -47,11 +50,30 @@ public:
         PARSE_JSON = 4
     };
 
+    enum Codec
+    {
+        ZLIB = 0,
+        ZSTD = 1
+    };
+
     explicit MsgProcessor( quint32 mode = NOTHING, quint32 t = 512 );
 
     void setMode( quint32 m ) { m_mode = m ; }
 
-    static msg_ptr process( msg_ptr msg, quint32 mode, quint32 threshold );
+    Codec codec() const { return m_codec; }
+    void setCodec( Codec c ) { m_codec = c; }
+
+    static msg_ptr process( msg_ptr msg, quint32 mode, quint32 threshold, Codec codec = ZLIB );
+
+    /// Names of the codecs we can handle, best first. Always contains "zlib".
+    static QStringList supportedCodecs();
+    /// Picks the best of our codecs that the peer supports, ZLIB if there is none.
+    static Codec negotiateCodec( const QStringList& peerCodecs );
+    static Codec codecFromName( const QString& name, bool* ok = 0 );
+    static QString codecName( Codec codec );
+
+    static QByteArray compress( const QByteArray& data, Codec codec );
+    static QByteArray uncompress( const QByteArray& data, Codec codec );
 
     int length() const { return m_msgs.length(); }
 
@@ -68,6 +90,7 @@ private:
 
     quint32 m_mode;
     quint32 m_threshold;
+    Codec m_codec;
     QList<msg_ptr> m_msgs;
     QMap< Msg*, bool> m_msg_ready;
     unsigned int m_totmsgsize;
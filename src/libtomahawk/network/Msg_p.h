@@ -34,6 +34,7 @@ public:
         , flags( f )
         , incomplete( false )
         , json_parsed( false )
+        , counted_size( 0 )
     {
     }
 
@@ -43,6 +44,7 @@ public:
         , flags( flags )
         , incomplete( true )
         , json_parsed( false)
+        , counted_size( 0 )
     {
     }
 
@@ -56,6 +58,7 @@ private:
     bool incomplete;
     QVariant json;
     bool json_parsed;
+    quint32 counted_size;
 };
 
 #endif // MSG_P_H
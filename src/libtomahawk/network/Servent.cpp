@@ -27,6 +27,7 @@
 #include "network/acl/AclRegistry.h"
 #include "network/Msg.h"
 #include "network/ConnectionManager.h"
+#include "network/ConnectionMux.h"
 #include "network/DbSyncConnection.h"
 #include "sip/SipInfo.h"
 #include "sip/PeerInfo.h"
@@ -756,6 +757,7 @@ Servent::readyRead()
             registerControlConnection( qobject_cast<ControlConnection*>(conn) );
         }
 
+        conn->setPeerCodecs( m.value( "codecs" ).toStringList() );
         handoverSocket( conn, sock.data() );
         return;
     }
@@ -778,6 +780,15 @@ void
 Servent::createParallelConnection( Connection* orig_conn, Connection* new_conn, const QString& key )
 {
     tDebug( LOGVERBOSE ) << Q_FUNC_INFO << ", key:" << key << thread() << orig_conn;
+
+    // no new connection at all if the peer can take it as a channel of the one we have
+    ControlConnection* cc = qobject_cast< ControlConnection* >( orig_conn );
+    if ( cc && cc->mux() )
+    {
+        cc->mux()->openChannel( new_conn, key );
+        return;
+    }
+
     // if we can connect to them directly:
     if ( orig_conn && orig_conn->outbound() )
     {
@@ -1245,6 +1256,26 @@ Servent::claimOffer( ControlConnection* cc, const QString &nodeid, const QString
 }
 
 
+Connection*
+Servent::claimChannelOffer( ControlConnection* cc, const QString& key )
+{
+    Q_D( Servent );
+
+    if ( !key.startsWith( "FILE_REQUEST_KEY:" ) )
+    {
+        QPointer< Connection > conn = d->offers.value( key );
+        if ( conn.isNull() || qobject_cast< ControlConnection* >( conn.data() ) )
+        {
+            tLog() << Q_FUNC_INFO << "Invalid offer for a channel:" << key;
+            return NULL;
+        }
+    }
+
+    // cc is authenticated already, no need to look at the peer address
+    return claimOffer( cc, QString(), key );
+}
+
+
 void
 Servent::remoteIODeviceFactory( const Tomahawk::result_ptr& result, const QString& url,
                                 std::function< void ( const QString&, QSharedPointer< QIODevice >& ) > callback )
@@ -101,6 +101,12 @@ public:
     void initiateConnection( const SipInfo& sipInfo, Connection* conn );
     void reverseOfferRequest( ControlConnection* orig_conn, const QString &theirdbid, const QString& key, const QString& theirkey );
 
+    /**
+     * The connection for an offer the peer of cc wants to run as a channel
+     * of cc, or 0. Control connections can't run as channels.
+     */
+    Connection* claimChannelOffer( ControlConnection* cc, const QString& key );
+
     bool visibleExternally() const;
 
     /**
@@ -25,17 +25,22 @@
 #include "network/ControlConnection.h"
 #include "network/Servent.h"
 #include "utils/Logger.h"
+#include "utils/MmapIODevice.h"
 
 #include "BufferIoDevice.h"
 #include "Msg.h"
 #include "MsgProcessor.h"
 #include "Result.h"
 #include "SourceList.h"
+#include "TomahawkSettings.h"
 #include "UrlHandler.h"
 
 #include <QFile>
 #include <QTimer>
 
+// How often to look for new data if the source device doesn't tell us about it
+#define SOURCE_POLL_INTERVAL 250
+
 using namespace Tomahawk;
 
 
@@ -50,6 +55,10 @@ StreamConnection::StreamConnection( Servent* s, ControlConnection* cc, QString f
     , m_allok( false )
     , m_result( result )
     , m_transferRate( 0 )
+    , m_sendWindow( 0 )
+    , m_uploadLimit( 0 )
+    , m_sendCredit( 0 )
+    , m_throttled( false )
 {
     qDebug() << Q_FUNC_INFO;
 
@@ -82,7 +91,14 @@ StreamConnection::StreamConnection( Servent* s, ControlConnection* cc, QString f
     , m_bsent( 0 )
     , m_allok( false )
     , m_transferRate( 0 )
+    , m_sendWindow( (qint64)TomahawkSettings::instance()->streamSendWindow() * 1024 )
+    , m_uploadLimit( (qint64)TomahawkSettings::instance()->streamUploadLimit() * 1024 )
+    , m_sendCredit( 0 )
+    , m_throttled( false )
 {
+    // Less than a block would never let anything through
+    m_sendWindow = qMax( m_sendWindow, (qint64)BufferIODevice::blockSize() );
+
     Servent::instance()->registerStreamConnection( this );
     // auto delete when connection closes:
     connect( this, SIGNAL( finished() ), SLOT( deleteLater() ), Qt::QueuedConnection );
@@ -129,9 +145,11 @@ StreamConnection::showStats( qint64 tx, qint64 rx )
 {
     if ( tx > 0 || rx > 0 )
     {
+        const StreamCacheStats cache = cacheStats();
         qDebug() << id()
                  << QString( "Down: %L1 bytes/sec," ).arg( rx )
-                 << QString( "Up: %L1 bytes/sec" ).arg( tx );
+                 << QString( "Up: %L1 bytes/sec," ).arg( tx )
+                 << QString( "Cache: %1% hits, %L2 bytes saved" ).arg( (int)( cache.hitRate() * 100 ) ).arg( cache.bytesSaved );
     }
 
     m_transferRate = tx + rx;
@@ -139,6 +157,13 @@ StreamConnection::showStats( qint64 tx, qint64 rx )
 }
 
 
+StreamCacheStats
+StreamConnection::cacheStats()
+{
+    return StreamCache::instance()->stats();
+}
+
+
 void
 StreamConnection::setup()
 {
@@ -207,6 +232,12 @@ StreamConnection::reallyStartSending( const Tomahawk::result_ptr result, const Q
     }
 
     m_readdev = QSharedPointer<QIODevice>( io );
+    m_creditTimer.start();
+
+    // Refill the send window whenever the socket got rid of some data, or
+    // the source got new data while we were waiting for it
+    connect( this, SIGNAL( written( qint64 ) ), SLOT( onBytesWritten() ), Qt::QueuedConnection );
+    connect( m_readdev.data(), SIGNAL( readyRead() ), SLOT( onBytesWritten() ), Qt::QueuedConnection );
     sendSome();
 
     emit updated();
@@ -241,8 +272,13 @@ StreamConnection::handleMsg( msg_ptr msg )
     }
     else if ( msg->payload().startsWith( "data" ) )
     {
-        m_badded += msg->payload().length() - 4;
-        ( (BufferIODevice*)m_iodev.data() )->addData( m_curBlock++, msg->payload().mid( 4 ) );
+        // No need to copy the payload, addData() copies it into place
+        const QByteArray data = QByteArray::fromRawData( msg->payload().constData() + 4, msg->payload().length() - 4 );
+        m_badded += data.length();
+        ( (BufferIODevice*)m_iodev.data() )->addData( m_curBlock, data );
+
+        const int blockSize = BufferIODevice::blockSize();
+        m_curBlock += qMax( 1, ( data.length() + blockSize - 1 ) / blockSize );
     }
 
     //qDebug() << Q_FUNC_INFO << "flags" << (int) msg->flags()
@@ -274,24 +310,103 @@ StreamConnection::sendSome()
 {
     Q_ASSERT( m_type == StreamConnection::SENDING );
 
-    QByteArray ba = "data";
-    ba.append( m_readdev->read( BufferIODevice::blockSize() ) );
-    m_bsent += ba.length() - 4;
+    if ( m_throttled )
+        return;
 
-    if ( m_readdev->atEnd() )
+    // Queue up as many blocks as fit into the send window. Every block still
+    // goes out as its own msg, receivers count blocks by msgs.
+    const qint64 blockSize = BufferIODevice::blockSize();
+    MmapIODevice* mapped = qobject_cast< MmapIODevice* >( m_readdev.data() );
+    while ( bytesQueued() < m_sendWindow )
     {
-        sendMsg( Msg::factory( ba, Msg::RAW ) );
+        if ( !takeSendCredit( blockSize ) )
+            return;
+
+        // Read straight into the msg, local files are copied right out of their mapping
+        QByteArray ba;
+        qint64 length = 0;
+        if ( mapped )
+        {
+            const char* data = 0;
+            length = mapped->readPointer( &data, blockSize );
+            ba.reserve( length + 4 );
+            ba.append( "data" );
+            ba.append( data, length );
+        }
+        else
+        {
+            ba.resize( blockSize + 4 );
+            memcpy( ba.data(), "data", 4 );
+            length = qMax( (qint64)0, m_readdev->read( ba.data() + 4, blockSize ) );
+            ba.resize( length + 4 );
+        }
+
+        // Only what we actually send counts against the limit
+        if ( m_uploadLimit > 0 )
+            m_sendCredit += blockSize - length;
+
+        if ( length == 0 && !m_readdev->atEnd() )
+        {
+            // The source device has nothing for us yet. Its readyRead() gets
+            // us going again, polling is only for devices that never emit it.
+            QTimer::singleShot( SOURCE_POLL_INTERVAL, this, SLOT( onBytesWritten() ) );
+            return;
+        }
+
+        m_bsent += length;
+
+        if ( m_readdev->atEnd() )
+        {
+            sendMsg( Msg::factory( ba, Msg::RAW ) );
+            return;
+        }
+
+        // more to come -> FRAGMENT
+        sendMsg( Msg::factory( ba, Msg::RAW | Msg::FRAGMENT ) );
+    }
+}
+
+
+void
+StreamConnection::onBytesWritten()
+{
+    if ( m_readdev.isNull() || m_readdev->atEnd() || bytesQueued() > m_sendWindow / 2 )
         return;
+
+    sendSome();
+}
+
+
+void
+StreamConnection::onThrottleTimeout()
+{
+    m_throttled = false;
+    onBytesWritten();
+}
+
+
+bool
+StreamConnection::takeSendCredit( qint64 bytes )
+{
+    if ( m_uploadLimit <= 0 )
+        return true;
+
+    // Token bucket, we may send in bursts of up to a second's worth of data
+    const qint64 burst = qMax( m_uploadLimit, bytes );
+    m_sendCredit = qMin( burst, m_sendCredit + m_creditTimer.restart() * m_uploadLimit / 1000 );
+    if ( m_sendCredit >= bytes )
+    {
+        m_sendCredit -= bytes;
+        return true;
     }
-    else
+
+    if ( !m_throttled )
     {
-        // more to come -> FRAGMENT
-        sendMsg( Msg::factory( ba, Msg::RAW | Msg::FRAGMENT ) );
+        m_throttled = true;
+        QTimer::singleShot( ( bytes - m_sendCredit ) * 1000 / m_uploadLimit + 1, this, SLOT( onThrottleTimeout() ) );
     }
 
-    // HINT: change the 0 to 50 to transmit at 640Kbps, for example
-    //       (this is where upload throttling could be implemented)
-    QTimer::singleShot( 0, this, SLOT( sendSome() ) );
+    return false;
 }
 
 
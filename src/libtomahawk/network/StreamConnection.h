@@ -21,11 +21,13 @@
 #ifndef STREAMCONNECTION_H
 #define STREAMCONNECTION_H
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QSharedPointer>
 #include <QIODevice>
 
 #include "network/Connection.h"
+#include "utils/StreamCache.h"
 #include "Result.h"
 
 #include "DllMacro.h"
@@ -61,6 +63,8 @@ public:
     Tomahawk::source_ptr source() const;
     Tomahawk::result_ptr track() const { return m_result; }
     qint64 transferRate() const { return m_transferRate; }
+    // Streams that never needed a connection because they were played from disk
+    static Tomahawk::StreamCacheStats cacheStats();
 
     Type type() const { return m_type; }
     QString fid() const { return m_fid; }
@@ -75,11 +79,16 @@ private slots:
     void startSending( const Tomahawk::result_ptr& result );
     void reallyStartSending( const Tomahawk::result_ptr result, const QString url, QSharedPointer< QIODevice > io ); //only called back from startSending
     void sendSome();
+    void onBytesWritten();
+    void onThrottleTimeout();
     void showStats( qint64 tx, qint64 rx );
 
     void onBlockRequest( int pos );
 
 private:
+    // false if the upload limit doesn't allow sending that much yet, sendSome() gets called again later then
+    bool takeSendCredit( qint64 bytes );
+
     QSharedPointer<QIODevice> m_iodev;
     ControlConnection* m_cc;
     QString m_fid;
@@ -94,6 +103,14 @@ private:
     Tomahawk::source_ptr m_source;
     Tomahawk::result_ptr m_result;
     qint64 m_transferRate;
+
+    // bytes we keep queued for the socket
+    qint64 m_sendWindow;
+    // bytes/sec, 0 for no limit
+    qint64 m_uploadLimit;
+    qint64 m_sendCredit;
+    QElapsedTimer m_creditTimer;
+    bool m_throttled;
 };
 
 #endif // STREAMCONNECTION_H
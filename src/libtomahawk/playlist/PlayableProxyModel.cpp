@@ -25,11 +25,16 @@
 #include "Album.h"
 #include "PlayableItem.h"
 #include "PlayableProxyModelPlaylistInterface.h"
+#include "PlayableSortKeys.h"
 #include "Query.h"
 #include "Result.h"
 #include "Source.h"
 
 #include <QTreeView>
+#include <qtconcurrentrun.h>
+
+// Smaller models are sorted right away, like any QSortFilterProxyModel
+#define SORT_KEYS_MIN_ROWS 1000
 
 PlayableProxyModel::PlayableProxyModel( QObject* parent )
     : QSortFilterProxyModel( parent )
@@ -38,6 +43,11 @@ PlayableProxyModel::PlayableProxyModel( QObject* parent )
     , m_hideEmptyParents( true )
     , m_hideDupeItems( false )
     , m_maxVisibleItems( -1 )
+    , m_sortPositionsColumn( -1 )
+    , m_pendingSortColumn( -1 )
+    , m_pendingSortOrder( Qt::AscendingOrder )
+    , m_sortGeneration( 0 )
+    , m_pendingSortGeneration( 0 )
     , m_style( Detailed )
 {
     m_playlistInterface = Tomahawk::playlistinterface_ptr( new Tomahawk::PlayableProxyModelPlaylistInterface( this ) );
@@ -46,6 +56,8 @@ PlayableProxyModel::PlayableProxyModel( QObject* parent )
     setSortCaseSensitivity( Qt::CaseInsensitive );
     setDynamicSortFilter( true );
 
+    connect( &m_sortWatcher, SIGNAL( finished() ), SLOT( onSortKeysReady() ) );
+
     PlayableProxyModel::setSourcePlayableModel( NULL );
 
     m_headerStyle[ Fancy ]      << PlayableModel::Name;
@@ -124,8 +136,24 @@ PlayableProxyModel::setSourcePlayableModel( PlayableModel* sourceModel )
         disconnect( m_model, SIGNAL( currentIndexChanged( QModelIndex, QModelIndex ) ), this, SLOT( onCurrentIndexChanged( QModelIndex, QModelIndex ) ) );
         disconnect( m_model, SIGNAL( expandRequest( QPersistentModelIndex ) ), this, SLOT( expandRequested( QPersistentModelIndex ) ) );
         disconnect( m_model, SIGNAL( selectRequest( QPersistentModelIndex ) ), this, SLOT( selectRequested( QPersistentModelIndex ) ) );
+
+        disconnect( m_model, SIGNAL( rowsInserted( QModelIndex, int, int ) ), this, SLOT( onSourceRowsInserted( QModelIndex, int, int ) ) );
+        disconnect( m_model, SIGNAL( rowsRemoved( QModelIndex, int, int ) ), this, SLOT( clearDupeIndex() ) );
+        disconnect( m_model, SIGNAL( rowsMoved( QModelIndex, int, int, QModelIndex, int ) ), this, SLOT( clearDupeIndex() ) );
+        disconnect( m_model, SIGNAL( dataChanged( QModelIndex, QModelIndex ) ), this, SLOT( onSourceDataChanged( QModelIndex, QModelIndex ) ) );
+        disconnect( m_model, SIGNAL( layoutChanged() ), this, SLOT( clearDupeIndex() ) );
+        disconnect( m_model, SIGNAL( modelReset() ), this, SLOT( clearDupeIndex() ) );
+
+        disconnect( m_model, SIGNAL( rowsInserted( QModelIndex, int, int ) ), this, SLOT( invalidateSortKeys() ) );
+        disconnect( m_model, SIGNAL( rowsRemoved( QModelIndex, int, int ) ), this, SLOT( invalidateSortKeys() ) );
+        disconnect( m_model, SIGNAL( rowsMoved( QModelIndex, int, int, QModelIndex, int ) ), this, SLOT( invalidateSortKeys() ) );
+        disconnect( m_model, SIGNAL( layoutChanged() ), this, SLOT( invalidateSortKeys() ) );
+        disconnect( m_model, SIGNAL( modelReset() ), this, SLOT( invalidateSortKeys() ) );
     }
 
+    clearDupeIndex();
+    invalidateSortKeys();
+
     m_model = sourceModel;
     if ( m_model )
     {
@@ -137,6 +165,20 @@ PlayableProxyModel::setSourcePlayableModel( PlayableModel* sourceModel )
         connect( m_model, SIGNAL( currentIndexChanged( QModelIndex, QModelIndex ) ), SLOT( onCurrentIndexChanged( QModelIndex, QModelIndex ) ) );
         connect( m_model, SIGNAL( expandRequest( QPersistentModelIndex ) ), SLOT( expandRequested( QPersistentModelIndex ) ) );
         connect( m_model, SIGNAL( selectRequest( QPersistentModelIndex ) ), SLOT( selectRequested( QPersistentModelIndex ) ) );
+
+        // These have to be connected before QSortFilterProxyModel's own handlers, which filter the changed rows
+        connect( m_model, SIGNAL( rowsInserted( QModelIndex, int, int ) ), SLOT( onSourceRowsInserted( QModelIndex, int, int ) ) );
+        connect( m_model, SIGNAL( rowsRemoved( QModelIndex, int, int ) ), SLOT( clearDupeIndex() ) );
+        connect( m_model, SIGNAL( rowsMoved( QModelIndex, int, int, QModelIndex, int ) ), SLOT( clearDupeIndex() ) );
+        connect( m_model, SIGNAL( dataChanged( QModelIndex, QModelIndex ) ), SLOT( onSourceDataChanged( QModelIndex, QModelIndex ) ) );
+        connect( m_model, SIGNAL( layoutChanged() ), SLOT( clearDupeIndex() ) );
+        connect( m_model, SIGNAL( modelReset() ), SLOT( clearDupeIndex() ) );
+
+        connect( m_model, SIGNAL( rowsInserted( QModelIndex, int, int ) ), SLOT( invalidateSortKeys() ) );
+        connect( m_model, SIGNAL( rowsRemoved( QModelIndex, int, int ) ), SLOT( invalidateSortKeys() ) );
+        connect( m_model, SIGNAL( rowsMoved( QModelIndex, int, int, QModelIndex, int ) ), SLOT( invalidateSortKeys() ) );
+        connect( m_model, SIGNAL( layoutChanged() ), SLOT( invalidateSortKeys() ) );
+        connect( m_model, SIGNAL( modelReset() ), SLOT( invalidateSortKeys() ) );
     }
 
     QSortFilterProxyModel::setSourceModel( m_model );
@@ -161,7 +203,7 @@ PlayableProxyModel::filterAcceptsRowInternal( int sourceRow, PlayableItem* pi, c
 {
     if ( m_maxVisibleItems > 0 && !visibilityFilterAcceptsRow( sourceRow, sourceParent, memo ) )
         return false;
-    if ( m_hideDupeItems && !dupeFilterAcceptsRow( sourceRow, pi, sourceParent, memo ) )
+    if ( m_hideDupeItems && !dupeFilterAcceptsRow( sourceRow, pi, sourceParent ) )
         return false;
 
     return nameFilterAcceptsRow( sourceRow, pi, sourceParent );
@@ -169,26 +211,113 @@ PlayableProxyModel::filterAcceptsRowInternal( int sourceRow, PlayableItem* pi, c
 
 
 bool
-PlayableProxyModel::dupeFilterAcceptsRow( int sourceRow, PlayableItem* pi, const QModelIndex& sourceParent, PlayableProxyModelFilterMemo& memo ) const
+PlayableProxyModel::dupeFilterAcceptsRow( int sourceRow, PlayableItem* pi, const QModelIndex& sourceParent ) const
 {
     if ( !m_hideDupeItems )
         return true;
 
-    for ( int i = 0; i < sourceRow; i++ )
+    const QString key = dupeKey( pi );
+    if ( key.isEmpty() )
+        return true;
+
+    // setFilterRegExp() isn't virtual, so this is where we notice a new pattern
+    if ( filterRegExp().pattern() != m_dupeIndexPattern )
+    {
+        m_dupeIndexes.clear();
+        m_dupeIndexPattern = filterRegExp().pattern();
+    }
+
+    // A row is a dupe if an earlier row with the same identity is visible.
+    // Evaluate the rows we haven't seen yet, up to the one we're asked about.
+    PlayableProxyModelDupeIndex& index = m_dupeIndexes[ sourceParent.internalPointer() ];
+    for ( int i = index.rowKeys.count(); i < sourceRow; i++ )
     {
         PlayableItem* di = itemFromIndex( sourceModel()->index( i, 0, sourceParent ) );
-        if ( !di )
-            continue;
+        const QString dkey = di ? dupeKey( di ) : QString();
 
-        bool b = ( pi->query() && pi->query()->equals( di->query() ) ) ||
-                 ( pi->album() && pi->album() == di->album() ) ||
-                 ( pi->artist() && pi->artist()->name() == di->artist()->name() );
+        if ( !dkey.isEmpty() && !index.firstRows.contains( dkey ) && nameFilterAcceptsRow( i, di, sourceParent ) )
+        {
+            index.firstRows.insert( dkey, i );
+            index.rowKeys << dkey;
+        }
+        else
+        {
+            index.rowKeys << QString();
+        }
+    }
 
-        if ( b && filterAcceptsRowInternal( i, di, sourceParent, memo ) )
-            return false;
+    const QHash< QString, int >::const_iterator it = index.firstRows.constFind( key );
+    return ( it == index.firstRows.constEnd() || it.value() >= sourceRow );
+}
+
+
+QString
+PlayableProxyModel::dupeKey( PlayableItem* pi )
+{
+    // Same identities the dupe filter always compared: track metadata, album instance and artist name
+    if ( pi->query() )
+    {
+        const Tomahawk::track_ptr track = pi->query()->queryTrack();
+        return QLatin1String( "q\t" ) + track->artist() + QLatin1Char( '\t' ) + track->album() + QLatin1Char( '\t' ) + track->track();
     }
+    if ( pi->album() )
+        return QLatin1String( "a\t" ) + QString::number( (quintptr) pi->album().data() );
+    if ( pi->artist() )
+        return QLatin1String( "r\t" ) + pi->artist()->name();
 
-    return true;
+    return QString();
+}
+
+
+void
+PlayableProxyModel::truncateDupeIndex( const QModelIndex& sourceParent, int row )
+{
+    QHash< void*, PlayableProxyModelDupeIndex >::iterator it = m_dupeIndexes.find( sourceParent.internalPointer() );
+    if ( it != m_dupeIndexes.end() )
+    {
+        PlayableProxyModelDupeIndex& index = it.value();
+        for ( int i = index.rowKeys.count() - 1; i >= row; i-- )
+        {
+            if ( !index.rowKeys.at( i ).isEmpty() )
+                index.firstRows.remove( index.rowKeys.at( i ) );
+        }
+        if ( row < index.rowKeys.count() )
+            index.rowKeys.resize( qMax( 0, row ) );
+    }
+
+    // A parent's own visibility depends on its children (see m_hideEmptyParents)
+    if ( sourceParent.isValid() )
+        truncateDupeIndex( sourceParent.parent(), sourceParent.row() );
+}
+
+
+void
+PlayableProxyModel::onSourceRowsInserted( const QModelIndex& parent, int first, int last )
+{
+    Q_UNUSED( last );
+
+    // Appending rows, the common case, keeps everything that was evaluated so far
+    truncateDupeIndex( parent, first );
+}
+
+
+void
+PlayableProxyModel::onSourceDataChanged( const QModelIndex& topLeft, const QModelIndex& bottomRight )
+{
+    Q_UNUSED( bottomRight );
+
+    if ( topLeft.isValid() )
+        truncateDupeIndex( topLeft.parent(), topLeft.row() );
+
+    // The changed rows get resorted with the regular comparison
+    m_sortPositions.clear();
+}
+
+
+void
+PlayableProxyModel::clearDupeIndex()
+{
+    m_dupeIndexes.clear();
 }
 
 
@@ -210,7 +339,7 @@ PlayableProxyModel::visibilityFilterAcceptsRow( int sourceRow, const QModelIndex
     {
         PlayableItem* pi = itemFromIndex( sourceModel()->index( i, 0, sourceParent ) );
         // We will not change memo in these calls as all values needed in them are already memoized.
-        if ( pi && dupeFilterAcceptsRow( i, pi, sourceParent, memo ) && nameFilterAcceptsRow( i, pi, sourceParent ) )
+        if ( pi && dupeFilterAcceptsRow( i, pi, sourceParent ) && nameFilterAcceptsRow( i, pi, sourceParent ) )
         {
             items++;
             memo.visibilty.push_back( items ); // Sets memo.visibilty[i + 1] to items
@@ -346,6 +475,7 @@ void
 PlayableProxyModel::setShowOfflineResults( bool b )
 {
     m_showOfflineResults = b;
+    clearDupeIndex();
     invalidateFilter();
 }
 
@@ -354,6 +484,7 @@ void
 PlayableProxyModel::setHideDupeItems( bool b )
 {
     m_hideDupeItems = b;
+    clearDupeIndex();
     invalidateFilter();
 }
 
@@ -574,6 +705,14 @@ PlayableProxyModel::lessThan( const Tomahawk::album_ptr& album1, const Tomahawk:
 bool
 PlayableProxyModel::lessThan( const QModelIndex& left, const QModelIndex& right ) const
 {
+    if ( !m_sortPositions.isEmpty() &&
+         left.column() == m_sortPositionsColumn &&
+         !left.parent().isValid() && !right.parent().isValid() &&
+         left.row() < m_sortPositions.count() && right.row() < m_sortPositions.count() )
+    {
+        return m_sortPositions.at( left.row() ) < m_sortPositions.at( right.row() );
+    }
+
     PlayableItem* p1 = itemFromIndex( left );
     PlayableItem* p2 = itemFromIndex( right );
 
@@ -595,6 +734,66 @@ PlayableProxyModel::lessThan( const QModelIndex& left, const QModelIndex& right
 }
 
 
+void
+PlayableProxyModel::sort( int column, Qt::SortOrder order )
+{
+    const int rows = m_model ? m_model->rowCount( QModelIndex() ) : 0;
+    if ( column < 0 || rows < SORT_KEYS_MIN_ROWS || ( column == m_sortPositionsColumn && !m_sortPositions.isEmpty() ) )
+    {
+        QSortFilterProxyModel::sort( column, order );
+        return;
+    }
+
+    // Only for track lists, the views showing albums or artists are small
+    QVector< PlayableSortKeys::Row > keys;
+    keys.reserve( rows );
+    for ( int i = 0; i < rows; i++ )
+    {
+        PlayableItem* pi = itemFromIndex( m_model->index( i, 0, QModelIndex() ) );
+        if ( !pi || !pi->query() )
+        {
+            QSortFilterProxyModel::sort( column, order );
+            return;
+        }
+
+        keys << PlayableSortKeys::extract( column, pi->query() );
+    }
+
+    m_pendingSortColumn = column;
+    m_pendingSortOrder = order;
+    m_pendingSortGeneration = m_sortGeneration;
+
+    // A previous sort that hasn't finished yet is dropped by the watcher
+    m_sortWatcher.setFuture( QtConcurrent::run( &PlayableSortKeys::sort, keys, PlayableSortKeys::isLocaleAware( column ) ) );
+}
+
+
+void
+PlayableProxyModel::onSortKeysReady()
+{
+    if ( m_pendingSortGeneration != m_sortGeneration )
+    {
+        // Rows came or went in the meantime, the positions don't match the model anymore
+        sort( m_pendingSortColumn, m_pendingSortOrder );
+        return;
+    }
+
+    m_sortPositions = m_sortWatcher.result();
+    m_sortPositionsColumn = m_pendingSortColumn;
+
+    // Just compares the precomputed positions, in a single layout change
+    QSortFilterProxyModel::sort( m_pendingSortColumn, m_pendingSortOrder );
+}
+
+
+void
+PlayableProxyModel::invalidateSortKeys()
+{
+    m_sortGeneration++;
+    m_sortPositions.clear();
+}
+
+
 int
 PlayableProxyModel::columnCount( const QModelIndex& parent ) const
 {
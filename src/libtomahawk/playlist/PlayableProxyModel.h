@@ -20,6 +20,7 @@
 #ifndef TRACKPROXYMODEL_H
 #define TRACKPROXYMODEL_H
 
+#include <QFutureWatcher>
 #include <QSortFilterProxyModel>
 
 #include "PlaylistInterface.h"
@@ -41,6 +42,21 @@ public:
     std::vector<int> visibilty;
 };
 
+/**
+ * Dupe filter state for the children of one parent, filled in a single
+ * forward pass over the rows. Rows are only evaluated up to the last row
+ * that was asked for, changes in the source model drop everything from the
+ * first changed row on.
+ */
+class PlayableProxyModelDupeIndex
+{
+public:
+    // Identity key of every evaluated row that is the first visible one with that key, empty otherwise
+    QVector< QString > rowKeys;
+    // Identity key -> first row with that key passing the name filter
+    QHash< QString, int > firstRows;
+};
+
 class DLLEXPORT PlayableProxyModel : public QSortFilterProxyModel
 {
 Q_OBJECT
@@ -98,6 +114,12 @@ public:
     virtual void setFilter( const QString& pattern );
     virtual void updateDetailedInfo( const QModelIndex& index );
 
+    /**
+     * Large flat models are sorted by precomputed keys in a background
+     * thread, the view gets resorted in one go once that's done.
+     */
+    virtual void sort( int column, Qt::SortOrder order = Qt::AscendingOrder );
+
 signals:
     void filterChanged( const QString& filter );
 
@@ -130,10 +152,19 @@ private slots:
     void selectRequested( const QPersistentModelIndex& index );
     void onCurrentIndexChanged( const QModelIndex& newIndex, const QModelIndex& oldIndex );
 
+    void onSourceRowsInserted( const QModelIndex& parent, int first, int last );
+    void onSourceDataChanged( const QModelIndex& topLeft, const QModelIndex& bottomRight );
+    void clearDupeIndex();
+
+    void invalidateSortKeys();
+    void onSortKeysReady();
+
 private:
     bool filterAcceptsRowInternal( int sourceRow, PlayableItem* pi, const QModelIndex& sourceParent, PlayableProxyModelFilterMemo& memo ) const;
     bool nameFilterAcceptsRow( int sourceRow, PlayableItem* pi, const QModelIndex& sourceParent ) const;
-    bool dupeFilterAcceptsRow( int sourceRow, PlayableItem* pi, const QModelIndex& sourceParent, PlayableProxyModelFilterMemo& memo ) const;
+    bool dupeFilterAcceptsRow( int sourceRow, PlayableItem* pi, const QModelIndex& sourceParent ) const;
+    void truncateDupeIndex( const QModelIndex& sourceParent, int row );
+    static QString dupeKey( PlayableItem* pi );
     bool visibilityFilterAcceptsRow( int sourceRow, const QModelIndex& sourceParent, PlayableProxyModelFilterMemo& memo ) const;
 
     bool lessThan( int column, const Tomahawk::query_ptr& left, const Tomahawk::query_ptr& right ) const;
@@ -146,6 +177,20 @@ private:
     bool m_hideDupeItems;
     int m_maxVisibleItems;
 
+    // keyed by the parent's PlayableItem, 0 for top level rows
+    mutable QHash< void*, PlayableProxyModelDupeIndex > m_dupeIndexes;
+    mutable QString m_dupeIndexPattern;
+
+    // Sorted position of every top level source row for m_sortPositionsColumn, empty if unknown
+    QVector< int > m_sortPositions;
+    int m_sortPositionsColumn;
+    QFutureWatcher< QVector< int > > m_sortWatcher;
+    int m_pendingSortColumn;
+    Qt::SortOrder m_pendingSortOrder;
+    // Bumped whenever source rows get inserted, removed or moved
+    int m_sortGeneration;
+    int m_pendingSortGeneration;
+
     QHash< PlayableItemStyle, QList<PlayableModel::Columns> > m_headerStyle;
     PlayableItemStyle m_style;
 };
@@ -0,0 +1,320 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PlayableSortKeys.h"
+
+#include "playlist/PlayableModel.h"
+#include "Query.h"
+#include "Result.h"
+#include "Track.h"
+
+#include <QFuture>
+#include <QHash>
+#include <QThread>
+#include <qtconcurrentmap.h>
+#include <qtconcurrentrun.h>
+
+#include <algorithm>
+
+// Below this many rows per thread splitting the sort up isn't worth it
+#define MIN_ROWS_PER_CHUNK 4096
+
+namespace
+{
+
+struct Key
+{
+    int text1;
+    int text2;
+    double number1;
+    double number2;
+    int text3;
+    int row;
+
+    bool operator<( const Key& other ) const
+    {
+        if ( text1 != other.text1 )
+            return text1 < other.text1;
+        if ( text2 != other.text2 )
+            return text2 < other.text2;
+        if ( number1 != other.number1 )
+            return number1 < other.number1;
+        if ( number2 != other.number2 )
+            return number2 < other.number2;
+        if ( text3 != other.text3 )
+            return text3 < other.text3;
+
+        return row < other.row;
+    }
+};
+
+
+/// Orders ids of distinct strings by their text
+struct TextLess
+{
+    TextLess( const QVector< QString >& texts, bool localeAware )
+        : texts( texts )
+        , localeAware( localeAware )
+    {
+    }
+
+    bool operator()( int a, int b ) const
+    {
+        if ( localeAware )
+            return QString::localeAwareCompare( texts.at( a ), texts.at( b ) ) < 0;
+
+        return texts.at( a ) < texts.at( b );
+    }
+
+    const QVector< QString >& texts;
+    bool localeAware;
+};
+
+
+/// Replaces every string of a field with its position among all distinct strings of that field.
+class TextRanker
+{
+public:
+    typedef QVector< int > result_type;
+
+    TextRanker( const QVector< PlayableSortKeys::Row >& rows, QString PlayableSortKeys::Row::* field, bool localeAware )
+        : m_rows( rows )
+        , m_field( field )
+        , m_localeAware( localeAware )
+    {
+    }
+
+    QVector< int > operator()() const
+    {
+        QHash< QString, int > ids;
+        QVector< QString > distinct;
+        QVector< int > textIds( m_rows.count() );
+        for ( int i = 0; i < m_rows.count(); i++ )
+        {
+            const QString& text = m_rows.at( i ).*m_field;
+            QHash< QString, int >::const_iterator it = ids.constFind( text );
+            if ( it == ids.constEnd() )
+            {
+                it = ids.insert( text, distinct.count() );
+                distinct << text;
+            }
+            textIds[ i ] = it.value();
+        }
+
+        // Collections have a lot fewer distinct artists and albums than tracks,
+        // so this is where the expensive string comparisons are spent
+        QVector< int > order( distinct.count() );
+        for ( int i = 0; i < order.count(); i++ )
+            order[ i ] = i;
+
+        const TextLess less( distinct, m_localeAware );
+        std::sort( order.begin(), order.end(), less );
+
+        // Strings that collate equally get the same rank
+        QVector< int > ranks( distinct.count() );
+        int rank = 0;
+        for ( int i = 0; i < order.count(); i++ )
+        {
+            if ( i > 0 && less( order.at( i - 1 ), order.at( i ) ) )
+                rank++;
+
+            ranks[ order.at( i ) ] = rank;
+        }
+
+        for ( int i = 0; i < textIds.count(); i++ )
+            textIds[ i ] = ranks.at( textIds.at( i ) );
+
+        return textIds;
+    }
+
+private:
+    const QVector< PlayableSortKeys::Row >& m_rows;
+    QString PlayableSortKeys::Row::* m_field;
+    bool m_localeAware;
+};
+
+
+struct SortChunk
+{
+    Key* begin;
+    Key* end;
+};
+
+
+void
+sortChunk( SortChunk& chunk )
+{
+    std::sort( chunk.begin, chunk.end );
+}
+
+
+void
+mergeChunks( QPair< SortChunk, SortChunk >& chunks )
+{
+    std::inplace_merge( chunks.first.begin, chunks.second.begin, chunks.second.end );
+}
+
+}
+
+
+PlayableSortKeys::Row
+PlayableSortKeys::extract( int column, const Tomahawk::query_ptr& query )
+{
+    // Keep this in sync with PlayableProxyModel::lessThan()
+    Row row;
+    const Tomahawk::track_ptr track = query->track();
+
+    Tomahawk::result_ptr result;
+    if ( !query->results().isEmpty() )
+        result = query->results().first();
+
+    switch ( column )
+    {
+        case PlayableModel::Artist:
+            row.text1 = track->artistSortname();
+            row.text2 = track->albumSortname();
+            row.number1 = track->discnumber();
+            row.number2 = track->albumpos();
+            break;
+
+        case PlayableModel::Composer:
+            row.text1 = track->composerSortname();
+            row.text2 = track->albumSortname();
+            row.number1 = track->discnumber();
+            row.number2 = track->albumpos();
+            break;
+
+        case PlayableModel::Album:
+            row.text1 = track->albumSortname();
+            row.number1 = track->discnumber();
+            row.number2 = track->albumpos();
+            break;
+
+        case PlayableModel::Bitrate:
+            row.number1 = result ? result->bitrate() : 0;
+            break;
+
+        case PlayableModel::Duration:
+            row.number1 = track->duration();
+            break;
+
+        case PlayableModel::Age:
+            row.number1 = result ? result->modificationTime() : 0;
+            break;
+
+        case PlayableModel::Year:
+            row.number1 = result ? result->track()->year() : 0;
+            break;
+
+        case PlayableModel::Filesize:
+            row.number1 = result ? result->size() : 0;
+            break;
+
+        case PlayableModel::Score:
+            row.number1 = result ? result->score() : 0;
+            break;
+
+        case PlayableModel::Origin:
+            row.text1 = result ? result->friendlySource().toLower() : QString();
+            break;
+
+        case PlayableModel::AlbumPos:
+            row.number1 = track->discnumber();
+            row.number2 = track->albumpos();
+            row.text3 = track->track();
+            break;
+
+        default:
+            row.text3 = track->track();
+            break;
+    }
+
+    return row;
+}
+
+
+bool
+PlayableSortKeys::isLocaleAware( int column )
+{
+    return column != PlayableModel::Origin;
+}
+
+
+QVector< int >
+PlayableSortKeys::sort( const QVector< Row >& rows, bool localeAware )
+{
+    // Rank the three text fields concurrently
+    QFuture< QVector< int > > text1 = QtConcurrent::run( TextRanker( rows, &Row::text1, localeAware ) );
+    QFuture< QVector< int > > text2 = QtConcurrent::run( TextRanker( rows, &Row::text2, localeAware ) );
+    const QVector< int > text3 = TextRanker( rows, &Row::text3, localeAware )();
+
+    const QVector< int > text1Ranks = text1.result();
+    const QVector< int > text2Ranks = text2.result();
+
+    QVector< Key > keys( rows.count() );
+    for ( int i = 0; i < rows.count(); i++ )
+    {
+        Key& key = keys[ i ];
+        key.text1 = text1Ranks.at( i );
+        key.text2 = text2Ranks.at( i );
+        key.number1 = rows.at( i ).number1;
+        key.number2 = rows.at( i ).number2;
+        key.text3 = text3.at( i );
+        key.row = i;
+    }
+
+    // Sort chunks in parallel, then merge them pairwise
+    const int threads = qMax( 1, QThread::idealThreadCount() );
+    const int chunkCount = qMax( 1, qMin( threads, keys.count() / MIN_ROWS_PER_CHUNK ) );
+
+    QList< SortChunk > chunks;
+    Key* data = keys.data();
+    for ( int i = 0; i < chunkCount; i++ )
+    {
+        SortChunk chunk;
+        chunk.begin = data + (qint64)keys.count() * i / chunkCount;
+        chunk.end = data + (qint64)keys.count() * ( i + 1 ) / chunkCount;
+        chunks << chunk;
+    }
+
+    QtConcurrent::blockingMap( chunks, sortChunk );
+
+    while ( chunks.count() > 1 )
+    {
+        QList< QPair< SortChunk, SortChunk > > pairs;
+        QList< SortChunk > merged;
+        for ( int i = 0; i + 1 < chunks.count(); i += 2 )
+        {
+            pairs << qMakePair( chunks.at( i ), chunks.at( i + 1 ) );
+
+            SortChunk chunk;
+            chunk.begin = chunks.at( i ).begin;
+            chunk.end = chunks.at( i + 1 ).end;
+            merged << chunk;
+        }
+        if ( chunks.count() % 2 )
+            merged << chunks.last();
+
+        QtConcurrent::blockingMap( pairs, mergeChunks );
+        chunks = merged;
+    }
+
+    QVector< int > positions( keys.count() );
+    for ( int i = 0; i < keys.count(); i++ )
+        positions[ keys.at( i ).row ] = i;
+
+    return positions;
+}
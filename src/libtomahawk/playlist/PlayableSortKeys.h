@@ -0,0 +1,64 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYABLESORTKEYS_H
+#define PLAYABLESORTKEYS_H
+
+#include "Typedefs.h"
+#include "DllMacro.h"
+
+#include <QString>
+#include <QVector>
+
+/**
+ * Sorts the rows of a PlayableModel by a column without touching the
+ * queries during the sort.
+ *
+ * The sort values of each row are extracted once (in the GUI thread, since
+ * that's where tracks and results live). Strings are then replaced by their
+ * position in the locale aware order of all distinct strings of that field,
+ * which leaves a compact array of numbers that can be sorted in parallel,
+ * off the GUI thread. The result is the position of every row.
+ */
+class DLLEXPORT PlayableSortKeys
+{
+public:
+    // Sort values of a row, compared in declaration order. Unused fields stay empty.
+    struct Row
+    {
+        Row() : number1( 0 ), number2( 0 ) {}
+
+        QString text1;
+        QString text2;
+        double number1;
+        double number2;
+        QString text3;
+    };
+
+    /// Collects the values PlayableProxyModel::lessThan() compares for column.
+    static Row extract( int column, const Tomahawk::query_ptr& query );
+
+    /// Whether the text of column is compared locale aware or plain.
+    static bool isLocaleAware( int column );
+
+    /**
+     * Returns the sorted position of every row. Ties keep the original row
+     * order. Thread-safe, meant to be run with QtConcurrent.
+     */
+    static QVector< int > sort( const QVector< Row >& rows, bool localeAware );
+};
+
+#endif // PLAYABLESORTKEYS_H
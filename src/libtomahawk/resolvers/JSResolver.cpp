@@ -26,6 +26,7 @@
 #include "jobview/JobStatusView.h"
 #include "jobview/JobStatusModel.h"
 #include "jobview/ErrorStatusMessage.h"
+#include "utils/Json.h"
 #include "utils/Logger.h"
 #include "utils/NetworkAccessManager.h"
 #include "utils/TomahawkUtilsGui.h"
@@ -558,7 +559,61 @@ JSResolver::resolve( const Tomahawk::query_ptr& query )
 
     QList< Tomahawk::result_ptr > results = parseResultVariantList( reslist );
 
-    Tomahawk::Pipeline::instance()->reportResults( qid, results );
+    Tomahawk::Pipeline::instance()->reportResults( qid, this, results );
+}
+
+
+void
+JSResolver::resolveBatch( const QList< Tomahawk::query_ptr >& queries )
+{
+    if ( QThread::currentThread() != thread() )
+    {
+        QMetaObject::invokeMethod( this, "resolveBatch", Qt::QueuedConnection, Q_ARG( QList< Tomahawk::query_ptr >, queries ) );
+        return;
+    }
+
+    QVariantList list;
+    foreach ( const Tomahawk::query_ptr& query, queries )
+    {
+        QVariantMap m;
+        m[ "qid" ] = query->id();
+
+        if ( query->isFullTextQuery() )
+        {
+            m[ "fulltext" ] = query->fullTextQuery();
+        }
+        else
+        {
+            m[ "artist" ] = query->queryTrack()->artist();
+            m[ "album" ] = query->queryTrack()->album();
+            m[ "track" ] = query->queryTrack()->track();
+        }
+
+        list << m;
+    }
+
+    // One evaluation for the whole batch, see Tomahawk.resolveBatch in tomahawk.js
+    const QString eval = QString( "Tomahawk.resolveBatch( %1 );" )
+                            .arg( QString::fromUtf8( TomahawkUtils::toJson( list ) ) );
+
+    const QVariantList answers = evaluateJavaScriptWithResult( eval ).toList();
+    for ( int i = 0; i < answers.count(); i++ )
+    {
+        const QVariantMap m = answers.at( i ).toMap();
+        if ( m.isEmpty() )
+        {
+            // if the resolver doesn't return anything, async api is used
+            continue;
+        }
+
+        // Answers come back in query order, a custom resolveBatch may leave out the qid
+        QString qid = m.value( "qid" ).toString();
+        if ( qid.isEmpty() && i < queries.count() )
+            qid = queries.at( i )->id();
+        QList< Tomahawk::result_ptr > results = parseResultVariantList( m.value( "results" ).toList() );
+
+        Tomahawk::Pipeline::instance()->reportResults( qid, this, results );
+    }
 }
 
 
@@ -81,6 +81,7 @@ public:
 
 public slots:
     void resolve( const Tomahawk::query_ptr& query ) override;
+    void resolveBatch( const QList< Tomahawk::query_ptr >& queries ) override;
     void stop() override;
     void start() override;
 
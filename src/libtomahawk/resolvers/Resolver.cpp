@@ -17,3 +17,14 @@
  */
 
 #include "Resolver.h"
+
+
+using namespace Tomahawk;
+
+
+void
+Resolver::resolveBatch( const QList< query_ptr >& queries )
+{
+    foreach ( const query_ptr& query, queries )
+        resolve( query );
+}
@@ -50,6 +50,13 @@ public:
 
 public slots:
     virtual void resolve( const Tomahawk::query_ptr& query ) = 0;
+
+    /**
+     * Resolve several queries in one go. The default implementation calls
+     * resolve() for each query, resolvers that can answer a whole batch in
+     * a single round trip should override this.
+     */
+    virtual void resolveBatch( const QList< Tomahawk::query_ptr >& queries );
 };
 
 } //ns
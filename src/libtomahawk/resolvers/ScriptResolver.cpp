@@ -54,6 +54,7 @@ ScriptResolver::ScriptResolver( const QString& exe )
     , m_stopped( true )
     , m_configSent( false )
     , m_deleting( false )
+    , m_batchResolve( false )
     , m_error( Tomahawk::ExternalResolver::NoError )
 {
     tLog() << Q_FUNC_INFO << "Created script resolver:" << exe;
@@ -281,57 +282,12 @@ ScriptResolver::handleMsg( const QByteArray& msg )
     }
     else if ( msgtype == "results" )
     {
-        const QString qid = m.value( "qid" ).toString();
-        QList< Tomahawk::result_ptr > results;
-        const QVariantList reslist = m.value( "results" ).toList();
-
-        foreach( const QVariant& rv, reslist )
-        {
-            QVariantMap m = rv.toMap();
-            tDebug( LOGVERBOSE ) << "Found result:" << m;
-
-            Tomahawk::track_ptr track = Tomahawk::Track::get( m.value( "artist" ).toString(),
-                                                              m.value( "track" ).toString(),
-                                                              m.value( "album" ).toString(),
-                                                              m.value( "albumartist" ).toString(),
-                                                              m.value( "duration" ).toUInt(),
-                                                              QString(),
-                                                              m.value( "albumpos" ).toUInt(),
-                                                              m.value( "discnumber" ).toUInt() );
-            if ( !track )
-                continue;
-
-            Tomahawk::result_ptr rp = Tomahawk::Result::get( m.value( "url" ).toString(), track );
-            if ( !rp )
-                continue;
-
-            rp->setBitrate( m.value( "bitrate" ).toUInt() );
-            rp->setSize( m.value( "size" ).toUInt() );
-            rp->setRID( uuid() );
-            rp->setFriendlySource( m_name );
-            rp->setPurchaseUrl( m.value( "purchaseUrl" ).toString() );
-            rp->setLinkUrl( m.value( "linkUrl" ).toString() );
-
-            //FIXME
-            if ( m.contains( "year" ) )
-            {
-                QVariantMap attr;
-                attr[ "releaseyear" ] = m.value( "year" );
-//                rp->track()->setAttributes( attr );
-            }
-
-            rp->setMimetype( m.value( "mimetype" ).toString() );
-            if ( rp->mimetype().isEmpty() )
-            {
-                rp->setMimetype( TomahawkUtils::extensionToMimetype( m.value( "extension" ).toString() ) );
-                Q_ASSERT( !rp->mimetype().isEmpty() );
-            }
-
-            rp->setResolvedBy( this );
-            results << rp;
-        }
-
-        Tomahawk::Pipeline::instance()->reportResults( qid, results );
+        handleResults( m );
+    }
+    else if ( msgtype == "batchresults" )
+    {
+        foreach ( const QVariant& rv, m.value( "batch" ).toList() )
+            handleResults( rv.toMap() );
     }
     else
     {
@@ -341,6 +297,63 @@ ScriptResolver::handleMsg( const QByteArray& msg )
 }
 
 
+void
+ScriptResolver::handleResults( const QVariantMap& msg )
+{
+    const QString qid = msg.value( "qid" ).toString();
+    QList< Tomahawk::result_ptr > results;
+    const QVariantList reslist = msg.value( "results" ).toList();
+
+    foreach( const QVariant& rv, reslist )
+    {
+        QVariantMap m = rv.toMap();
+        tDebug( LOGVERBOSE ) << "Found result:" << m;
+
+        Tomahawk::track_ptr track = Tomahawk::Track::get( m.value( "artist" ).toString(),
+                                                          m.value( "track" ).toString(),
+                                                          m.value( "album" ).toString(),
+                                                          m.value( "albumartist" ).toString(),
+                                                          m.value( "duration" ).toUInt(),
+                                                          QString(),
+                                                          m.value( "albumpos" ).toUInt(),
+                                                          m.value( "discnumber" ).toUInt() );
+        if ( !track )
+            continue;
+
+        Tomahawk::result_ptr rp = Tomahawk::Result::get( m.value( "url" ).toString(), track );
+        if ( !rp )
+            continue;
+
+        rp->setBitrate( m.value( "bitrate" ).toUInt() );
+        rp->setSize( m.value( "size" ).toUInt() );
+        rp->setRID( uuid() );
+        rp->setFriendlySource( m_name );
+        rp->setPurchaseUrl( m.value( "purchaseUrl" ).toString() );
+        rp->setLinkUrl( m.value( "linkUrl" ).toString() );
+
+        //FIXME
+        if ( m.contains( "year" ) )
+        {
+            QVariantMap attr;
+            attr[ "releaseyear" ] = m.value( "year" );
+//            rp->track()->setAttributes( attr );
+        }
+
+        rp->setMimetype( m.value( "mimetype" ).toString() );
+        if ( rp->mimetype().isEmpty() )
+        {
+            rp->setMimetype( TomahawkUtils::extensionToMimetype( m.value( "extension" ).toString() ) );
+            Q_ASSERT( !rp->mimetype().isEmpty() );
+        }
+
+        rp->setResolvedBy( this );
+        results << rp;
+    }
+
+    Tomahawk::Pipeline::instance()->reportResults( qid, this, results );
+}
+
+
 void
 ScriptResolver::cmdExited( int code, QProcess::ExitStatus status )
 {
@@ -376,9 +389,42 @@ ScriptResolver::cmdExited( int code, QProcess::ExitStatus status )
 void
 ScriptResolver::resolve( const Tomahawk::query_ptr& query )
 {
-    QVariantMap m;
+    QVariantMap m = queryToVariantMap( query );
     m.insert( "_msgtype", "rq" );
 
+    const QByteArray msg = TomahawkUtils::toJson( QVariant( m ) );
+    sendMsg( msg );
+}
+
+
+void
+ScriptResolver::resolveBatch( const QList< Tomahawk::query_ptr >& queries )
+{
+    // Resolvers have to announce that they understand batched requests
+    if ( !m_batchResolve )
+    {
+        Tomahawk::Resolver::resolveBatch( queries );
+        return;
+    }
+
+    QVariantList batch;
+    foreach ( const Tomahawk::query_ptr& query, queries )
+        batch << queryToVariantMap( query );
+
+    QVariantMap m;
+    m.insert( "_msgtype", "rqbatch" );
+    m.insert( "batch", batch );
+
+    const QByteArray msg = TomahawkUtils::toJson( QVariant( m ) );
+    sendMsg( msg );
+}
+
+
+QVariantMap
+ScriptResolver::queryToVariantMap( const Tomahawk::query_ptr& query ) const
+{
+    QVariantMap m;
+
     if ( query->isFullTextQuery() )
     {
         m.insert( "fulltext", query->fullTextQuery() );
@@ -395,8 +441,7 @@ ScriptResolver::resolve( const Tomahawk::query_ptr& query )
             m.insert( "resultHint", query->resultHint() );
     }
 
-    const QByteArray msg = TomahawkUtils::toJson( QVariant( m ) );
-    sendMsg( msg );
+    return m;
 }
 
 
@@ -408,6 +453,7 @@ ScriptResolver::doSetup( const QVariantMap& m )
     m_name    = m.value( "name" ).toString();
     m_weight  = m.value( "weight", 0 ).toUInt();
     m_timeout = m.value( "timeout", 5 ).toUInt() * 1000;
+    m_batchResolve = m.value( "batchresolve", false ).toBool();
     bool compressed = m.value( "compressed", "false" ).toString() == "true";
 
     bool ok;
@@ -72,6 +72,7 @@ signals:
 public slots:
     void stop() Q_DECL_OVERRIDE;
     void resolve( const Tomahawk::query_ptr& query ) Q_DECL_OVERRIDE;
+    void resolveBatch( const QList< Tomahawk::query_ptr >& queries ) Q_DECL_OVERRIDE;
     void start() Q_DECL_OVERRIDE;
 
     // TODO: implement. Or not. Not really an issue while Spotify doesn't do browsable personal cloud storage.
@@ -90,6 +91,8 @@ private:
     void sendConfig();
 
     void handleMsg( const QByteArray& msg );
+    void handleResults( const QVariantMap& msg );
+    QVariantMap queryToVariantMap( const Tomahawk::query_ptr& query ) const;
     void sendMsg( const QByteArray& msg );
     void doSetup( const QVariantMap& m );
     void setupConfWidget( const QVariantMap& m );
@@ -106,7 +109,7 @@ private:
     quint32 m_msgsize;
     QByteArray m_msg;
 
-    bool m_ready, m_stopped, m_configSent, m_deleting;
+    bool m_ready, m_stopped, m_configSent, m_deleting, m_batchResolve;
     ExternalResolver::ErrorState m_error;
 };
 
@@ -0,0 +1,236 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EditDistance.h"
+
+#include <QVarLengthArray>
+
+#include <string.h>
+
+// Patterns up to this length fit into one machine word
+#define MAX_BITPARALLEL_LENGTH 64
+// Slots in the per call character -> bitmask table, must be a power of two larger than MAX_BITPARALLEL_LENGTH
+#define PEQ_TABLE_SIZE 128
+// Rows of the fallback matrix up to this length live on the stack
+#define MAX_STACK_ROW_LENGTH 256
+
+namespace
+{
+
+/// Bitmasks of the positions each character occurs at in the pattern, in a small open addressing table.
+class PatternMasks
+{
+public:
+    PatternMasks( const QChar* pattern, int length )
+    {
+        memset( m_used, 0, sizeof( m_used ) );
+
+        for ( int i = 0; i < length; i++ )
+        {
+            const ushort c = pattern[ i ].unicode();
+            int slot = hash( c );
+            while ( m_used[ slot ] && m_chars[ slot ] != c )
+                slot = ( slot + 1 ) & ( PEQ_TABLE_SIZE - 1 );
+
+            if ( !m_used[ slot ] )
+            {
+                m_used[ slot ] = true;
+                m_chars[ slot ] = c;
+                m_masks[ slot ] = 0;
+            }
+            m_masks[ slot ] |= Q_UINT64_C( 1 ) << i;
+        }
+    }
+
+    quint64 mask( QChar ch ) const
+    {
+        const ushort c = ch.unicode();
+        for ( int slot = hash( c ); m_used[ slot ]; slot = ( slot + 1 ) & ( PEQ_TABLE_SIZE - 1 ) )
+        {
+            if ( m_chars[ slot ] == c )
+                return m_masks[ slot ];
+        }
+
+        return 0;
+    }
+
+private:
+    static int hash( ushort c )
+    {
+        return ( c * 2654435761u ) >> 25;
+    }
+
+    bool m_used[ PEQ_TABLE_SIZE ];
+    ushort m_chars[ PEQ_TABLE_SIZE ];
+    quint64 m_masks[ PEQ_TABLE_SIZE ];
+};
+
+
+/**
+ * Hyyrö's bit-vector edit distance with transpositions. The pattern is the
+ * shorter string, each column of the DP matrix is computed in a few word
+ * operations. maxDistance < 0 means unbounded.
+ */
+int
+bitParallelDistance( const QChar* pattern, int n, const QChar* text, int m, int maxDistance )
+{
+    const PatternMasks masks( pattern, n );
+
+    const quint64 last = Q_UINT64_C( 1 ) << ( n - 1 );
+    quint64 vp = ( n == 64 ) ? ~Q_UINT64_C( 0 ) : ( ( Q_UINT64_C( 1 ) << n ) - 1 );
+    quint64 vn = 0;
+    quint64 d0 = 0;
+    quint64 pmPrevious = 0;
+    int score = n;
+
+    for ( int j = 0; j < m; j++ )
+    {
+        const quint64 pm = masks.mask( text[ j ] );
+
+        // Transposition of two adjacent characters, not within the first two of either string
+        quint64 tr = 0;
+        if ( j >= 2 )
+            tr = ( ( ( ~d0 & pm ) << 1 ) & pmPrevious ) & ~Q_UINT64_C( 3 );
+
+        quint64 x = pm | vn;
+        d0 = ( ( ( x & vp ) + vp ) ^ vp ) | x | tr;
+
+        const quint64 hp = vn | ~( d0 | vp );
+        const quint64 hn = d0 & vp;
+        if ( hp & last )
+            score++;
+        else if ( hn & last )
+            score--;
+
+        x = ( hp << 1 ) | 1;
+        vn = x & d0;
+        vp = ( hn << 1 ) | ~( x | d0 );
+        pmPrevious = pm;
+
+        // Every remaining column can lower the score by one at most
+        if ( maxDistance >= 0 && score - ( m - j - 1 ) > maxDistance )
+            return maxDistance + 1;
+    }
+
+    return score;
+}
+
+
+/// The classic dynamic programming solution, keeping only the three rows it needs.
+int
+matrixDistance( const QChar* source, int n, const QChar* target, int m, int maxDistance )
+{
+    QVarLengthArray< int, MAX_STACK_ROW_LENGTH * 3 > buffer( ( m + 1 ) * 3 );
+    int* beforePrevious = buffer.data();
+    int* previous = beforePrevious + m + 1;
+    int* current = previous + m + 1;
+
+    for ( int j = 0; j <= m; j++ )
+        previous[ j ] = j;
+
+    for ( int i = 1; i <= n; i++ )
+    {
+        const QChar s_i = source[ i - 1 ];
+        current[ 0 ] = i;
+        int rowMinimum = i;
+
+        for ( int j = 1; j <= m; j++ )
+        {
+            const QChar t_j = target[ j - 1 ];
+
+            int cell = previous[ j - 1 ] + ( s_i == t_j ? 0 : 1 );
+            cell = qMin( cell, current[ j - 1 ] + 1 );
+            cell = qMin( cell, previous[ j ] + 1 );
+
+            if ( i > 2 && j > 2 && source[ i - 2 ] == t_j && s_i == target[ j - 2 ] )
+                cell = qMin( cell, beforePrevious[ j - 2 ] + 1 );
+
+            current[ j ] = cell;
+            rowMinimum = qMin( rowMinimum, cell );
+        }
+
+        // Distances never shrink from one row to the next
+        if ( maxDistance >= 0 && rowMinimum > maxDistance )
+            return maxDistance + 1;
+
+        int* recycled = beforePrevious;
+        beforePrevious = previous;
+        previous = current;
+        current = recycled;
+    }
+
+    if ( maxDistance >= 0 && previous[ m ] > maxDistance )
+        return maxDistance + 1;
+
+    return previous[ m ];
+}
+
+
+int
+distance( const QChar* source, int n, const QChar* target, int m, int maxDistance )
+{
+    // The distance is symmetric, the shorter string becomes the pattern
+    if ( n > m )
+    {
+        qSwap( source, target );
+        qSwap( n, m );
+    }
+
+    if ( maxDistance >= 0 && m - n > maxDistance )
+        return maxDistance + 1;
+    if ( n == 0 )
+        return m;
+
+    if ( n <= MAX_BITPARALLEL_LENGTH )
+        return bitParallelDistance( source, n, target, m, maxDistance );
+
+    return matrixDistance( source, n, target, m, maxDistance );
+}
+
+}
+
+
+namespace TomahawkUtils
+{
+
+int
+editDistance( const QString& source, const QString& target )
+{
+    return distance( source.constData(), source.length(), target.constData(), target.length(), -1 );
+}
+
+
+int
+editDistance( const QChar* source, int sourceLength, const QChar* target, int targetLength )
+{
+    return distance( source, sourceLength, target, targetLength, -1 );
+}
+
+
+int
+boundedEditDistance( const QString& source, const QString& target, int maxDistance )
+{
+    return distance( source.constData(), source.length(), target.constData(), target.length(), qMax( 0, maxDistance ) );
+}
+
+
+int
+boundedEditDistance( const QChar* source, int sourceLength, const QChar* target, int targetLength, int maxDistance )
+{
+    return distance( source, sourceLength, target, targetLength, qMax( 0, maxDistance ) );
+}
+
+}
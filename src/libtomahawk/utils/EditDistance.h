@@ -0,0 +1,47 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOMAHAWKUTILS_EDITDISTANCE_H
+#define TOMAHAWKUTILS_EDITDISTANCE_H
+
+#include "DllMacro.h"
+
+#include <QString>
+
+namespace TomahawkUtils
+{
+    /**
+     * Number of insertions, deletions, substitutions and transpositions of
+     * two adjacent characters needed to turn source into target. Like the
+     * matrix implementation this replaces, transpositions only count from
+     * the third character of both strings on.
+     *
+     * Uses a bit-parallel algorithm (Myers/Hyyrö) when the shorter string
+     * has at most 64 characters and doesn't allocate memory for names of
+     * any sensible length.
+     */
+    DLLEXPORT int editDistance( const QString& source, const QString& target );
+    DLLEXPORT int editDistance( const QChar* source, int sourceLength, const QChar* target, int targetLength );
+
+    /**
+     * Same as editDistance(), but gives up as soon as the distance is
+     * known to be larger than maxDistance and returns maxDistance + 1.
+     */
+    DLLEXPORT int boundedEditDistance( const QString& source, const QString& target, int maxDistance );
+    DLLEXPORT int boundedEditDistance( const QChar* source, int sourceLength, const QChar* target, int targetLength, int maxDistance );
+}
+
+#endif // TOMAHAWKUTILS_EDITDISTANCE_H
@@ -0,0 +1,313 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MmapIODevice.h"
+
+#include "utils/Logger.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+#include <string.h>
+
+#if defined( Q_OS_LINUX )
+    #include <sys/vfs.h>
+#elif defined( Q_OS_MAC ) || defined( Q_OS_FREEBSD )
+    #include <sys/param.h>
+    #include <sys/mount.h>
+#elif defined( Q_OS_WIN )
+    #include <windows.h>
+#endif
+
+#ifdef Q_OS_UNIX
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// How far ahead of the reader we ask the kernel to page the file in
+#define READ_AHEAD 8 * 1024 * 1024
+
+#ifdef Q_OS_LINUX
+// Filesystem magic numbers from linux/magic.h, not all of them are in older headers
+static const quint32 NETWORK_FS_TYPES[] = {
+    0x6969,     // NFS
+    0x517B,     // SMB
+    0xFF534D42, // CIFS
+    0xFE534D42, // SMB2
+    0x564C,     // NCP
+    0x5346414F, // AFS
+    0x73757245, // CODA
+    0x01021997, // 9P
+    0x00C36400, // CEPH
+    0x65735546  // FUSE, sshfs and friends
+};
+#endif
+
+
+MmapIODevice::MmapIODevice( const QString& path, QObject* parent )
+    : QIODevice( parent )
+    , m_file( path )
+    , m_map( 0 )
+    , m_size( 0 )
+    , m_advisedUntil( 0 )
+{
+}
+
+
+MmapIODevice::~MmapIODevice()
+{
+    close();
+}
+
+
+QIODevice*
+MmapIODevice::openFile( const QString& path, QObject* parent )
+{
+    if ( isMappable( path ) )
+    {
+        MmapIODevice* device = new MmapIODevice( path, parent );
+        if ( device->open( QIODevice::ReadOnly ) )
+            return device;
+
+        delete device;
+    }
+
+    QFile* file = new QFile( path, parent );
+    if ( !file->open( QIODevice::ReadOnly ) )
+    {
+        delete file;
+        return 0;
+    }
+
+    return file;
+}
+
+
+bool
+MmapIODevice::isMappable( const QString& path )
+{
+#if defined( Q_OS_LINUX )
+    struct statfs fs;
+    if ( statfs( QFile::encodeName( path ).constData(), &fs ) != 0 )
+        return false;
+
+    for ( unsigned int i = 0; i < sizeof( NETWORK_FS_TYPES ) / sizeof( *NETWORK_FS_TYPES ); i++ )
+    {
+        if ( (quint32)fs.f_type == NETWORK_FS_TYPES[ i ] )
+            return false;
+    }
+
+    return true;
+#elif defined( Q_OS_MAC ) || defined( Q_OS_FREEBSD )
+    struct statfs fs;
+    if ( statfs( QFile::encodeName( path ).constData(), &fs ) != 0 )
+        return false;
+
+    return fs.f_flags & MNT_LOCAL;
+#elif defined( Q_OS_WIN )
+    const QString native = QDir::toNativeSeparators( QFileInfo( path ).absoluteFilePath() );
+    if ( native.startsWith( "\\\\" ) )
+        return false;
+
+    const QString root = native.left( 3 );
+    return GetDriveTypeW( reinterpret_cast< const wchar_t* >( root.utf16() ) ) != DRIVE_REMOTE;
+#else
+    Q_UNUSED( path );
+    return false;
+#endif
+}
+
+
+bool
+MmapIODevice::open( OpenMode mode )
+{
+    if ( mode & QIODevice::WriteOnly )
+        return false;
+
+    if ( !m_file.open( QIODevice::ReadOnly ) )
+        return false;
+
+    m_size = m_file.size();
+    m_map = m_size > 0 ? m_file.map( 0, m_size ) : 0;
+    if ( !m_map )
+    {
+        tDebug() << Q_FUNC_INFO << "Could not map" << m_file.fileName() << m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    madvise( m_map, m_size, MADV_SEQUENTIAL );
+#endif
+    m_advisedUntil = 0;
+    adviseReadAhead( 0 );
+
+    // Nothing to gain from QIODevice's buffer, it would only add another copy
+    return QIODevice::open( QIODevice::ReadOnly | QIODevice::Unbuffered );
+}
+
+
+void
+MmapIODevice::close()
+{
+    if ( !isOpen() )
+        return;
+
+    QIODevice::close();
+
+    if ( m_map )
+        m_file.unmap( m_map );
+    m_map = 0;
+    m_size = 0;
+    m_buffer.clear();
+    m_file.close();
+}
+
+
+bool
+MmapIODevice::isSequential() const
+{
+    return false;
+}
+
+
+qint64
+MmapIODevice::size() const
+{
+    return m_size;
+}
+
+
+bool
+MmapIODevice::seek( qint64 pos )
+{
+    if ( pos < 0 || pos > m_size )
+        return false;
+
+    return QIODevice::seek( pos );
+}
+
+
+qint64
+MmapIODevice::readPointer( const char** data, qint64 maxSize )
+{
+    const qint64 pos = this->pos();
+    const qint64 length = qMin( maxSize, m_size - pos );
+    if ( !isOpen() || length <= 0 )
+        return 0;
+
+    if ( !checkMapping( pos + length ) )
+    {
+        m_buffer.resize( length );
+        const qint64 read = readData( m_buffer.data(), length );
+        if ( read <= 0 )
+            return read;
+
+        *data = m_buffer.constData();
+        QIODevice::seek( pos + read );
+        return read;
+    }
+
+    *data = reinterpret_cast< const char* >( m_map + pos );
+    adviseReadAhead( pos + length );
+    QIODevice::seek( pos + length );
+
+    return length;
+}
+
+
+qint64
+MmapIODevice::readData( char* data, qint64 maxSize )
+{
+    const qint64 pos = this->pos();
+    const qint64 length = qMin( maxSize, m_size - pos );
+    if ( !isOpen() || length <= 0 )
+        return 0;
+
+    if ( !checkMapping( pos + length ) )
+    {
+        // m_size is what is left of the file now
+        if ( pos >= m_size || !m_file.seek( pos ) )
+            return 0;
+
+        return m_file.read( data, qMin( maxSize, m_size - pos ) );
+    }
+
+    memcpy( data, m_map + pos, length );
+    adviseReadAhead( pos + length );
+
+    return length;
+}
+
+
+bool
+MmapIODevice::checkMapping( qint64 end )
+{
+    if ( !m_map )
+        return false;
+
+#ifdef Q_OS_UNIX
+    // Pages past the end of a truncated file raise SIGBUS, make sure the file still reaches that far
+    struct stat st;
+    if ( fstat( m_file.handle(), &st ) != 0 || st.st_size >= end )
+        return true;
+
+    tLog() << Q_FUNC_INFO << m_file.fileName() << "shrank from" << m_size << "to" << (qint64)st.st_size << "bytes, reading it without the mapping";
+
+    m_file.unmap( m_map );
+    m_map = 0;
+    m_size = st.st_size;
+    m_advisedUntil = 0;
+    return false;
+#else
+    // Windows doesn't truncate files that are mapped
+    Q_UNUSED( end );
+    return true;
+#endif
+}
+
+
+qint64
+MmapIODevice::writeData( const char* data, qint64 maxSize )
+{
+    Q_UNUSED( data );
+    Q_UNUSED( maxSize );
+    return -1;
+}
+
+
+void
+MmapIODevice::adviseReadAhead( qint64 pos )
+{
+#ifdef Q_OS_UNIX
+    // Keep at least half a window paged in ahead of the reader. After a seek
+    // backwards the pages are most likely still around, don't bother then.
+    if ( pos + READ_AHEAD / 2 < m_advisedUntil )
+        return;
+
+    static const qint64 pageSize = sysconf( _SC_PAGESIZE );
+    const qint64 start = qMax( pos, m_advisedUntil ) / pageSize * pageSize;
+    const qint64 end = qMin( m_size, pos + READ_AHEAD );
+    if ( start >= end )
+        return;
+
+    madvise( m_map + start, end - start, MADV_WILLNEED );
+    m_advisedUntil = end;
+#else
+    Q_UNUSED( pos );
+#endif
+}
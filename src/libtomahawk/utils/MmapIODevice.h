@@ -0,0 +1,93 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MMAPIODEVICE_H
+#define MMAPIODEVICE_H
+
+#include "DllMacro.h"
+
+#include <QFile>
+#include <QIODevice>
+
+/**
+ * Read-only device on top of a memory mapped local file.
+ *
+ * Besides the usual read(), readPointer() gives access to the mapping
+ * itself, so readers like MediaStream don't have to copy the data.
+ * The kernel is told we read sequentially and asked to read ahead of the
+ * current position.
+ *
+ * If the file shrinks while it is mapped, e.g. because a tagger rewrites
+ * it in place, the device notices before it reads past the new end and
+ * reads the rest of it from the file instead.
+ */
+class DLLEXPORT MmapIODevice : public QIODevice
+{
+Q_OBJECT
+
+public:
+    explicit MmapIODevice( const QString& path, QObject* parent = 0 );
+    virtual ~MmapIODevice();
+
+    /**
+     * Opens the file for reading, mapped if possible. Files on network
+     * filesystems or ones that can't be mapped are opened as a plain QFile.
+     * Returns 0 if the file can't be opened at all.
+     */
+    static QIODevice* openFile( const QString& path, QObject* parent = 0 );
+
+    /**
+     * false for files on NFS, SMB and the like, mapping them only hides I/O
+     * errors in page faults.
+     *
+     * Mind that touching a mapped page past the end of a file that was
+     * truncated raises SIGBUS. Every read checks the file size first, so
+     * only a truncation in the moment between that check and the reader
+     * being done with the data can still hit it.
+     */
+    static bool isMappable( const QString& path );
+
+    virtual bool open( OpenMode mode );
+    virtual void close();
+
+    virtual bool isSequential() const;
+    virtual qint64 size() const;
+    virtual bool seek( qint64 pos );
+
+    /**
+     * Points data to up to maxSize bytes at the current position and moves
+     * on, like read() without the copy. The data stays valid until the next
+     * call or until the device is closed.
+     */
+    qint64 readPointer( const char** data, qint64 maxSize );
+
+protected:
+    virtual qint64 readData( char* data, qint64 maxSize );
+    virtual qint64 writeData( const char* data, qint64 maxSize );
+
+private:
+    bool checkMapping( qint64 end );
+    void adviseReadAhead( qint64 pos );
+
+    QFile m_file;
+    uchar* m_map;
+    // what readPointer() hands out once the mapping is gone
+    QByteArray m_buffer;
+    qint64 m_size;
+    qint64 m_advisedUntil;
+};
+
+#endif // MMAPIODEVICE_H
@@ -0,0 +1,362 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StreamCache.h"
+
+#include "utils/Logger.h"
+#include "utils/TomahawkUtils.h"
+#include "Result.h"
+#include "TomahawkSettings.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMap>
+#include <QMutexLocker>
+
+// Suffix of entries that are still being written
+#define PART_SUFFIX ".part"
+// Don't let a single track take more than this share of the cache
+#define MAX_ENTRY_SHARE 4
+
+using namespace Tomahawk;
+
+StreamCache* StreamCache::s_instance = 0;
+
+
+StreamCacheWriter::StreamCacheWriter( StreamCache* cache, const QString& key, const QString& path, qint64 expectedSize, qint64 maxSize )
+    : m_cache( cache )
+    , m_key( key )
+    , m_file( path )
+    , m_expectedSize( expectedSize )
+    , m_maxSize( maxSize )
+    , m_written( 0 )
+    , m_done( false )
+{
+    if ( !m_file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+        tLog() << Q_FUNC_INFO << "Could not create stream cache file:" << path;
+        abandon();
+    }
+}
+
+
+StreamCacheWriter::~StreamCacheWriter()
+{
+    abandon();
+}
+
+
+void
+StreamCacheWriter::write( qint64 offset, const char* data, qint64 length )
+{
+    if ( m_done || length <= 0 )
+        return;
+
+    if ( offset > m_written )
+    {
+        // Somebody seeked ahead, the part in between will never come by
+        abandon();
+        return;
+    }
+
+    const qint64 skip = m_written - offset;
+    if ( skip >= length )
+        return;
+
+    if ( m_written + length - skip > m_maxSize || m_file.write( data + skip, length - skip ) != length - skip )
+    {
+        abandon();
+        return;
+    }
+
+    m_written += length - skip;
+}
+
+
+void
+StreamCacheWriter::finish( qint64 transferSize )
+{
+    if ( m_done )
+        return;
+
+    if ( m_written == 0 || ( m_expectedSize > 0 && m_written != m_expectedSize ) || ( transferSize > 0 && m_written != transferSize ) )
+    {
+        tDebug() << Q_FUNC_INFO << "Stream ended incomplete, not caching it:" << m_written << "of" << qMax( m_expectedSize, transferSize ) << "bytes";
+        abandon();
+        return;
+    }
+
+    m_done = true;
+    m_file.close();
+    m_cache->commit( m_key, m_file.fileName(), m_written );
+}
+
+
+void
+StreamCacheWriter::abandon()
+{
+    if ( m_done )
+        return;
+
+    m_done = true;
+    m_file.close();
+    m_file.remove();
+    m_cache->abandon( m_key );
+}
+
+
+StreamCache*
+StreamCache::instance()
+{
+    if ( !s_instance )
+        s_instance = new StreamCache();
+
+    return s_instance;
+}
+
+
+StreamCache::StreamCache()
+    : QObject( 0 )
+    , m_cacheBaseDir( TomahawkSettings::instance()->storageCacheLocation() + "/StreamCache/" )
+    , m_maxSize( (qint64)TomahawkSettings::instance()->streamCacheSize() * 1024 * 1024 )
+    , m_manifest( m_cacheBaseDir + "manifest.ini", QSettings::IniFormat )
+    , m_totalSize( 0 )
+{
+    load();
+}
+
+
+StreamCache::~StreamCache()
+{
+    m_manifest.sync();
+}
+
+
+void
+StreamCache::load()
+{
+    QDir dir( m_cacheBaseDir );
+    if ( !dir.exists() && !dir.mkpath( m_cacheBaseDir ) )
+    {
+        tLog() << Q_FUNC_INFO << "Could not create stream cache dir:" << m_cacheBaseDir;
+        m_maxSize = 0;
+        return;
+    }
+
+    m_manifest.beginGroup( "accessed" );
+    foreach ( const QFileInfo& fi, dir.entryInfoList( QDir::Files ) )
+    {
+        if ( fi.suffix() == "ini" )
+            continue;
+
+        // Leftovers of streams that were interrupted by a shutdown
+        if ( fi.fileName().endsWith( PART_SUFFIX ) )
+        {
+            QFile::remove( fi.absoluteFilePath() );
+            continue;
+        }
+
+        Entry entry;
+        entry.size = fi.size();
+        entry.accessed = m_manifest.value( fi.fileName(), fi.lastModified().toMSecsSinceEpoch() ).toLongLong();
+
+        m_entries.insert( fi.fileName(), entry );
+        m_totalSize += entry.size;
+    }
+
+    // Forget about files that are gone
+    foreach ( const QString& key, m_manifest.childKeys() )
+    {
+        if ( !m_entries.contains( key ) )
+            m_manifest.remove( key );
+    }
+    m_manifest.endGroup();
+
+    tDebug() << Q_FUNC_INFO << "Stream cache has" << m_entries.count() << "tracks," << m_totalSize << "bytes";
+
+    // The size limit might have been lowered
+    evict( QString() );
+}
+
+
+bool
+StreamCache::isEnabled() const
+{
+    return m_maxSize > 0;
+}
+
+
+QString
+StreamCache::cacheKey( const Tomahawk::result_ptr& result )
+{
+    if ( result.isNull() )
+        return QString();
+
+    const QString url = result->url();
+    if ( url.isEmpty() || TomahawkUtils::isLocalResult( url ) || TomahawkUtils::isRtmpResult( url ) )
+        return QString();
+
+    // The same url might point to a different file later on, include what we know about the file
+    const QString identity = QString( "%1\t%2\t%3" ).arg( url ).arg( result->size() ).arg( result->modificationTime() );
+    return QString::fromLatin1( QCryptographicHash::hash( identity.toUtf8(), QCryptographicHash::Sha1 ).toHex() );
+}
+
+
+bool
+StreamCache::isCacheable( const Tomahawk::result_ptr& result ) const
+{
+    return isEnabled() && !cacheKey( result ).isEmpty() && result->size() <= m_maxSize / MAX_ENTRY_SHARE;
+}
+
+
+QString
+StreamCache::pathForKey( const QString& key ) const
+{
+    return m_cacheBaseDir + key;
+}
+
+
+QString
+StreamCache::lookup( const Tomahawk::result_ptr& result )
+{
+    if ( !isEnabled() )
+        return QString();
+
+    const QString key = cacheKey( result );
+    if ( key.isEmpty() )
+        return QString();
+
+    QMutexLocker locker( &m_mutex );
+
+    QHash< QString, Entry >::iterator it = m_entries.find( key );
+    if ( it == m_entries.end() || !QFile::exists( pathForKey( key ) ) )
+    {
+        if ( it != m_entries.end() )
+        {
+            m_totalSize -= it.value().size;
+            m_entries.erase( it );
+        }
+
+        m_stats.misses++;
+        return QString();
+    }
+
+    it.value().accessed = QDateTime::currentMSecsSinceEpoch();
+    m_manifest.setValue( "accessed/" + key, it.value().accessed );
+
+    m_stats.hits++;
+    m_stats.bytesSaved += it.value().size;
+
+    tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Playing from stream cache:" << result->url();
+    return pathForKey( key );
+}
+
+
+StreamCacheWriter*
+StreamCache::writer( const Tomahawk::result_ptr& result )
+{
+    if ( !isEnabled() )
+        return 0;
+
+    const QString key = cacheKey( result );
+    if ( key.isEmpty() )
+        return 0;
+
+    const qint64 maxEntrySize = m_maxSize / MAX_ENTRY_SHARE;
+    if ( result->size() > maxEntrySize )
+        return 0;
+
+    {
+        QMutexLocker locker( &m_mutex );
+        if ( m_entries.contains( key ) || m_filling.contains( key ) )
+            return 0;
+
+        m_filling << key;
+    }
+
+    return new StreamCacheWriter( this, key, pathForKey( key ) + PART_SUFFIX, result->size(), maxEntrySize );
+}
+
+
+void
+StreamCache::commit( const QString& key, const QString& partPath, qint64 size )
+{
+    QMutexLocker locker( &m_mutex );
+    m_filling.remove( key );
+
+    const QString path = pathForKey( key );
+    QFile::remove( path );
+    if ( !QFile::rename( partPath, path ) )
+    {
+        tLog() << Q_FUNC_INFO << "Could not move stream cache file into place:" << path;
+        QFile::remove( partPath );
+        return;
+    }
+
+    Entry entry;
+    entry.size = size;
+    entry.accessed = QDateTime::currentMSecsSinceEpoch();
+    m_entries.insert( key, entry );
+    m_totalSize += size;
+    m_manifest.setValue( "accessed/" + key, entry.accessed );
+
+    tDebug( LOGVERBOSE ) << Q_FUNC_INFO << "Cached stream" << key << size << "bytes";
+    evict( key );
+}
+
+
+void
+StreamCache::abandon( const QString& key )
+{
+    QMutexLocker locker( &m_mutex );
+    m_filling.remove( key );
+}
+
+
+void
+StreamCache::evict( const QString& keep )
+{
+    if ( m_totalSize <= m_maxSize )
+        return;
+
+    QMap< qint64, QString > byAccess;
+    QHash< QString, Entry >::const_iterator it = m_entries.constBegin();
+    for ( ; it != m_entries.constEnd(); ++it )
+    {
+        if ( it.key() != keep )
+            byAccess.insertMulti( it.value().accessed, it.key() );
+    }
+
+    QMap< qint64, QString >::const_iterator oldest = byAccess.constBegin();
+    for ( ; oldest != byAccess.constEnd() && m_totalSize > m_maxSize; ++oldest )
+    {
+        const QString& key = oldest.value();
+
+        QFile::remove( pathForKey( key ) );
+        m_totalSize -= m_entries.take( key ).size;
+        m_manifest.remove( "accessed/" + key );
+    }
+}
+
+
+StreamCacheStats
+StreamCache::stats() const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_stats;
+}
@@ -0,0 +1,160 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STREAMCACHE_H
+#define STREAMCACHE_H
+
+#include "DllMacro.h"
+#include "Typedefs.h"
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QSettings>
+
+namespace Tomahawk
+{
+
+class StreamCache;
+
+struct StreamCacheStats
+{
+    StreamCacheStats()
+        : hits( 0 )
+        , misses( 0 )
+        , bytesSaved( 0 )
+    {}
+
+    double hitRate() const { return hits + misses > 0 ? (double)hits / ( hits + misses ) : 0.0; }
+
+    quint64 hits;
+    quint64 misses;
+    //! bytes that were read from the cache instead of the network
+    qint64 bytesSaved;
+};
+
+/**
+ * Fills one cache entry with the bytes of a stream while it is played.
+ *
+ * Data has to be written in order, re-reading what was already written is
+ * fine. Skipping ahead leaves a gap we can't fill and drops the entry.
+ * Only once the stream reached its end the entry becomes visible to
+ * StreamCache::lookup(). Deleting an unfinished writer drops the entry,
+ * which is what has to happen for a transfer that failed.
+ *
+ * Not thread-safe, but may be used from a different thread than the
+ * StreamCache itself.
+ */
+class DLLEXPORT StreamCacheWriter
+{
+public:
+    ~StreamCacheWriter();
+
+    void write( qint64 offset, const char* data, qint64 length );
+    // transferSize is what the transfer announced, e.g. its Content-Length, 0 if unknown
+    void finish( qint64 transferSize = 0 );
+
+private:
+    friend class StreamCache;
+    StreamCacheWriter( StreamCache* cache, const QString& key, const QString& path, qint64 expectedSize, qint64 maxSize );
+
+    void abandon();
+
+    StreamCache* m_cache;
+    QString m_key;
+    QFile m_file;
+    qint64 m_expectedSize;
+    qint64 m_maxSize;
+    qint64 m_written;
+    bool m_done;
+};
+
+/**
+ * Keeps remote tracks we played on disk, so playing them again doesn't need
+ * to stream them from the network or a peer again.
+ *
+ * Entries are keyed by the identity of the result (its url, size and
+ * modification time) and evicted least recently used first, once the cache
+ * grows above TomahawkSettings::streamCacheSize().
+ *
+ * Thread-safe.
+ */
+class DLLEXPORT StreamCache : public QObject
+{
+Q_OBJECT
+
+public:
+    static StreamCache* instance();
+    virtual ~StreamCache();
+
+    bool isEnabled() const;
+
+    // Empty if streams of this result can't be cached, e.g. local files
+    static QString cacheKey( const Tomahawk::result_ptr& result );
+
+    // Whether playing the result could read it from or add it to the cache
+    bool isCacheable( const Tomahawk::result_ptr& result ) const;
+
+    /**
+     * Path of the complete cached copy of the result, or empty if there is
+     * none. Every call for a cacheable result counts as a hit or a miss.
+     */
+    QString lookup( const Tomahawk::result_ptr& result );
+
+    /**
+     * A writer to fill the cache with the stream of this result, or 0 if it
+     * is already cached, currently being cached or can't be cached.
+     * The caller owns the writer.
+     */
+    StreamCacheWriter* writer( const Tomahawk::result_ptr& result );
+
+    StreamCacheStats stats() const;
+
+private:
+    friend class StreamCacheWriter;
+
+    struct Entry
+    {
+        qint64 size;
+        qint64 accessed;
+    };
+
+    StreamCache();
+    static StreamCache* s_instance;
+
+    void load();
+    QString pathForKey( const QString& key ) const;
+    void commit( const QString& key, const QString& partPath, qint64 size );
+    void abandon( const QString& key );
+    // Does not lock the mutex
+    void evict( const QString& keep );
+
+    QString m_cacheBaseDir;
+    qint64 m_maxSize;
+    QSettings m_manifest;
+
+    mutable QMutex m_mutex;
+    QHash< QString, Entry > m_entries;
+    QSet< QString > m_filling;
+    qint64 m_totalSize;
+    StreamCacheStats m_stats;
+};
+
+}
+
+#endif // STREAMCACHE_H
@@ -161,6 +161,7 @@ namespace TomahawkUtils
 
     DLLEXPORT void msleep( unsigned int ms );
     DLLEXPORT bool newerVersion( const QString& oldVersion, const QString& newVersion );
+    /// See editDistance() in EditDistance.h
     DLLEXPORT int levenshtein( const QString& source, const QString& target );
 
     DLLEXPORT quint64 infosystemRequestId();
@@ -0,0 +1,92 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOMAHAWK_MOCKRESOLVER_H
+#define TOMAHAWK_MOCKRESOLVER_H
+
+#include "libtomahawk/FuncTimeout.h"
+#include "libtomahawk/Pipeline.h"
+#include "libtomahawk/Query.h"
+#include "libtomahawk/Result.h"
+#include "libtomahawk/resolvers/Resolver.h"
+
+/*
+    Shared by the pipeline tests and tomahawk-pipeline-bench. Kept free of
+    Q_OBJECT so both can include it without their own moc step.
+*/
+
+
+/**
+ * Answers every query after a fixed latency, with no results or, if it
+ * solves, with a perfect match.
+ */
+class MockResolver : public Tomahawk::Resolver
+{
+public:
+    MockResolver( const QString& name, unsigned int latency, unsigned int timeout = 0, bool solves = false )
+        : m_name( name )
+        , m_latency( latency )
+        , m_timeout( timeout )
+        , m_solves( solves )
+    {
+    }
+
+    virtual QString name() const { return m_name; }
+    virtual unsigned int weight() const { return 50; }
+    virtual unsigned int timeout() const { return m_timeout; }
+
+    virtual void resolve( const Tomahawk::query_ptr& query )
+    {
+        new Tomahawk::FuncTimeout( m_latency, std::bind( &MockResolver::report, this, query ), this );
+    }
+
+private:
+    void report( const Tomahawk::query_ptr& query )
+    {
+        QList< Tomahawk::result_ptr > results;
+        if ( m_solves )
+        {
+            const QString url = QString( "mock://%1/%2" ).arg( m_name ).arg( query->id() );
+            Tomahawk::result_ptr result = Tomahawk::Result::get( url, query->queryTrack() );
+            result->setResolvedBy( this );
+            results << result;
+        }
+
+        Tomahawk::Pipeline::instance()->reportResults( query->id(), this, results );
+    }
+
+    QString m_name;
+    unsigned int m_latency;
+    unsigned int m_timeout;
+    bool m_solves;
+};
+
+
+inline QList< Tomahawk::query_ptr >
+syntheticQueries( int count )
+{
+    QList< Tomahawk::query_ptr > queries;
+    for ( int i = 0; i < count; i++ )
+    {
+        queries << Tomahawk::Query::get( QString( "Artist %1" ).arg( i % 97 ),
+                                         QString( "Track %1" ).arg( i ),
+                                         QString( "Album %1" ).arg( i % 13 ) );
+    }
+
+    return queries;
+}
+
+#endif // TOMAHAWK_MOCKRESOLVER_H
@@ -0,0 +1,192 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOMAHAWK_TESTCONNECTIONMUX_H
+#define TOMAHAWK_TESTCONNECTIONMUX_H
+
+#include <QtTest>
+
+#include "libtomahawk/network/ConnectionMux.h"
+#include "libtomahawk/network/Msg.h"
+
+#define TEST_WINDOW ( 64 * 1024 )
+#define TEST_FRAME_SIZE ( 16 * 1024 )
+
+class TestConnectionMux : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QByteArray pattern( int length )
+    {
+        QByteArray ba( length, '\0' );
+        for ( int i = 0; i < length; i++ )
+            ba[ i ] = (char)( i * 7 + length );
+        return ba;
+    }
+
+    static QList< msg_ptr > someMsgs()
+    {
+        QList< msg_ptr > msgs;
+        msgs << Msg::factory( "{\"method\":\"hello\"}", Msg::JSON );
+        // Bigger than the window, needs several rounds of credit
+        msgs << Msg::factory( pattern( 150 * 1024 ), Msg::RAW );
+        msgs << Msg::factory( QByteArray(), Msg::RAW );
+        msgs << Msg::factory( pattern( 1000 ), Msg::RAW | Msg::FRAGMENT );
+        return msgs;
+    }
+
+private slots:
+    void testFrameRoundTrip()
+    {
+        const msg_ptr frame = ConnectionMux::frame( ConnectionMux::DATA, 0x01020304, "payload" );
+        QVERIFY( ConnectionMux::isFrame( frame ) );
+        QCOMPARE( frame->length(), (quint32)( 5 + 7 ) );
+
+        ConnectionMux::FrameType type;
+        quint32 id;
+        QByteArray data;
+        QVERIFY( ConnectionMux::parseFrame( frame, type, id, data ) );
+        QCOMPARE( type, ConnectionMux::DATA );
+        QCOMPARE( id, (quint32)0x01020304 );
+        QCOMPARE( data, QByteArray( "payload" ) );
+
+        // Control frames may come without data
+        QVERIFY( ConnectionMux::parseFrame( ConnectionMux::frame( ConnectionMux::CLOSE, 7 ), type, id, data ) );
+        QCOMPARE( type, ConnectionMux::CLOSE );
+        QCOMPARE( id, (quint32)7 );
+        QVERIFY( data.isEmpty() );
+    }
+
+    void testInvalidFrames()
+    {
+        ConnectionMux::FrameType type;
+        quint32 id;
+        QByteArray data;
+
+        // Regular msgs of the control connection
+        QVERIFY( !ConnectionMux::parseFrame( Msg::factory( "{\"method\":\"ping\"}", Msg::JSON ), type, id, data ) );
+        QVERIFY( !ConnectionMux::parseFrame( Msg::factory( "12345678", Msg::RAW ), type, id, data ) );
+        // Too short for the header
+        QVERIFY( !ConnectionMux::parseFrame( Msg::factory( "1234", Msg::SETUP | Msg::RAW ), type, id, data ) );
+    }
+
+    void testNothingSentBeforeAccept()
+    {
+        ConnectionMuxChannel channel( 1, 0, TEST_WINDOW );
+        channel.queue( Msg::factory( "abc", Msg::RAW ) );
+        QVERIFY( !channel.canSend() );
+
+        channel.setAccepted( true );
+        QVERIFY( channel.canSend() );
+    }
+
+    void testTransferWithinWindow()
+    {
+        ConnectionMuxChannel sender( 1, 0, TEST_WINDOW );
+        ConnectionMuxChannel receiver( 1, 0, TEST_WINDOW );
+        sender.setAccepted( true );
+        receiver.setAccepted( true );
+
+        const QList< msg_ptr > sent = someMsgs();
+        qint64 total = 0;
+        foreach ( const msg_ptr& msg, sent )
+        {
+            sender.queue( msg );
+            total += Msg::headerSize() + msg->length();
+        }
+        QCOMPARE( sender.bytesQueued(), total );
+
+        QList< msg_ptr > received;
+        qint64 inFlight = 0;
+        int acks = 0;
+        while ( sender.bytesQueued() > 0 )
+        {
+            // Credit comes back before the window runs out
+            QVERIFY( sender.canSend() );
+
+            const QByteArray data = sender.takeData( TEST_FRAME_SIZE );
+            QVERIFY( !data.isEmpty() );
+            QVERIFY( data.length() <= TEST_FRAME_SIZE );
+            QVERIFY( sender.sendCredit() >= 0 );
+
+            inFlight += data.length();
+            QVERIFY( inFlight <= TEST_WINDOW );
+
+            received << receiver.receive( data );
+
+            const quint32 ack = receiver.takeAck();
+            if ( ack > 0 )
+            {
+                QVERIFY( ack >= TEST_WINDOW / 2 );
+                inFlight -= ack;
+                sender.addCredit( ack );
+                acks++;
+            }
+        }
+
+        QVERIFY( acks > 1 );
+        QCOMPARE( sender.bytesQueued(), (qint64)0 );
+        QCOMPARE( received.count(), sent.count() );
+        for ( int i = 0; i < sent.count(); i++ )
+        {
+            QCOMPARE( received.at( i )->flags(), sent.at( i )->flags() );
+            QCOMPARE( received.at( i )->payload(), sent.at( i )->payload() );
+        }
+    }
+
+    void testCreditStopsSender()
+    {
+        ConnectionMuxChannel sender( 2, 0, TEST_WINDOW );
+        sender.setAccepted( true );
+        sender.queue( Msg::factory( pattern( 3 * TEST_WINDOW ), Msg::RAW ) );
+
+        qint64 sent = 0;
+        while ( sender.canSend() )
+            sent += sender.takeData( TEST_FRAME_SIZE ).length();
+
+        QCOMPARE( sent, (qint64)TEST_WINDOW );
+        QVERIFY( sender.takeData( TEST_FRAME_SIZE ).isEmpty() );
+
+        sender.addCredit( 1000 );
+        QVERIFY( sender.canSend() );
+        QCOMPARE( sender.takeData( TEST_FRAME_SIZE ).length(), 1000 );
+        QVERIFY( !sender.canSend() );
+    }
+
+    void testAckThreshold()
+    {
+        ConnectionMuxChannel sender( 3, 0, 4 * TEST_WINDOW );
+        ConnectionMuxChannel receiver( 3, 0, TEST_WINDOW );
+        sender.setAccepted( true );
+        sender.queue( Msg::factory( pattern( TEST_WINDOW ), Msg::RAW ) );
+
+        // Not worth a frame below half the window
+        QVERIFY( receiver.receive( sender.takeData( TEST_WINDOW / 2 - 1 ) ).isEmpty() );
+        QCOMPARE( receiver.takeAck(), 0u );
+
+        receiver.receive( sender.takeData( 1 ) );
+        QCOMPARE( receiver.takeAck(), (quint32)( TEST_WINDOW / 2 ) );
+        QCOMPARE( receiver.takeAck(), 0u );
+
+        // The rest completes the msg
+        const QList< msg_ptr > msgs = receiver.receive( sender.takeData( 4 * TEST_WINDOW ) );
+        QCOMPARE( msgs.count(), 1 );
+        QCOMPARE( msgs.first()->payload(), pattern( TEST_WINDOW ) );
+    }
+};
+
+#endif // TOMAHAWK_TESTCONNECTIONMUX_H
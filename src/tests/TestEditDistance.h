@@ -0,0 +1,198 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOMAHAWK_TESTEDITDISTANCE_H
+#define TOMAHAWK_TESTEDITDISTANCE_H
+
+#include <QtTest>
+#include <QStringList>
+#include <QVector>
+
+#include "libtomahawk/utils/EditDistance.h"
+
+
+class TestEditDistance : public QObject
+{
+    Q_OBJECT
+
+private:
+    // The matrix implementation TomahawkUtils::levenshtein used before,
+    // kept as a reference so scores can't drift.
+    static int legacyLevenshtein( const QString& source, const QString& target )
+    {
+        const int n = source.length();
+        const int m = target.length();
+
+        if ( n == 0 )
+            return m;
+        if ( m == 0 )
+            return n;
+
+        QVector< QVector<int> > matrix( n + 1, QVector<int>( m + 1 ) );
+        for ( int i = 0; i <= n; i++ )
+            matrix[i][0] = i;
+        for ( int j = 0; j <= m; j++ )
+            matrix[0][j] = j;
+
+        for ( int i = 1; i <= n; i++ )
+        {
+            for ( int j = 1; j <= m; j++ )
+            {
+                const int cost = source[i - 1] == target[j - 1] ? 0 : 1;
+
+                int cell = qMin( matrix[i][j - 1] + 1, matrix[i - 1][j - 1] + cost );
+                cell = qMin( cell, matrix[i - 1][j] + 1 );
+
+                if ( i > 2 && j > 2 )
+                {
+                    int trans = matrix[i - 2][j - 2] + 1;
+                    if ( source[i - 2] != target[j - 1] )
+                        trans++;
+                    if ( source[i - 1] != target[j - 2] )
+                        trans++;
+                    if ( cell > trans )
+                        cell = trans;
+                }
+
+                matrix[i][j] = cell;
+            }
+        }
+
+        return matrix[n][m];
+    }
+
+    static QString randomString( int length, int alphabet )
+    {
+        QString s;
+        s.reserve( length );
+        for ( int i = 0; i < length; i++ )
+            s.append( QChar( 'a' + qrand() % alphabet ) );
+        return s;
+    }
+
+    static QStringList names()
+    {
+        return QStringList() << "the beatles" << "beatles" << "the beetles"
+                             << "radiohead" << "radio head" << "portishead"
+                             << "sigur ros" << "sigur rós" << "nine inch nails"
+                             << "paranoid android" << "paranoid androids"
+                             << "karma police" << "everything in its right place"
+                             << "yellow submarine" << "a day in the life";
+    }
+
+private slots:
+    void initTestCase()
+    {
+        qsrand( 42 );
+    }
+
+    void testKnownDistances_data()
+    {
+        QTest::addColumn< QString >( "source" );
+        QTest::addColumn< QString >( "target" );
+        QTest::addColumn< int >( "distance" );
+
+        QTest::newRow( "empty" ) << QString() << QString() << 0;
+        QTest::newRow( "empty source" ) << QString() << QString( "abc" ) << 3;
+        QTest::newRow( "empty target" ) << QString( "abc" ) << QString() << 3;
+        QTest::newRow( "equal" ) << QString( "radiohead" ) << QString( "radiohead" ) << 0;
+        QTest::newRow( "kitten" ) << QString( "kitten" ) << QString( "sitting" ) << 3;
+        QTest::newRow( "insertion" ) << QString( "beatles" ) << QString( "the beatles" ) << 4;
+        QTest::newRow( "unicode" ) << QString::fromUtf8( "sigur rós" ) << QString( "sigur ros" ) << 1;
+        QTest::newRow( "transposition" ) << QString( "xab" ) << QString( "xba" ) << 1;
+        // Transpositions of the first two characters are not recognized
+        QTest::newRow( "leading transposition" ) << QString( "ab" ) << QString( "ba" ) << 2;
+    }
+
+    void testKnownDistances()
+    {
+        QFETCH( QString, source );
+        QFETCH( QString, target );
+        QFETCH( int, distance );
+
+        QCOMPARE( TomahawkUtils::editDistance( source, target ), distance );
+        QCOMPARE( TomahawkUtils::editDistance( target, source ), distance );
+    }
+
+    void testMatchesLegacy()
+    {
+        for ( int k = 0; k < 5000; k++ )
+        {
+            const QString source = randomString( qrand() % 13, 2 + k % 4 );
+            const QString target = randomString( qrand() % 13, 2 + k % 4 );
+
+            QCOMPARE( TomahawkUtils::editDistance( source, target ), legacyLevenshtein( source, target ) );
+        }
+    }
+
+    void testMatchesLegacyLong()
+    {
+        // Longer than a machine word on both sides, exercises the matrix fallback
+        for ( int k = 0; k < 200; k++ )
+        {
+            const QString source = randomString( 60 + qrand() % 80, 3 );
+            const QString target = randomString( 60 + qrand() % 80, 3 );
+
+            QCOMPARE( TomahawkUtils::editDistance( source, target ), legacyLevenshtein( source, target ) );
+        }
+    }
+
+    void testBounded()
+    {
+        for ( int k = 0; k < 3000; k++ )
+        {
+            const bool longStrings = ( k % 10 == 0 );
+            const QString source = randomString( longStrings ? 50 + qrand() % 50 : qrand() % 13, 3 );
+            const QString target = randomString( longStrings ? 50 + qrand() % 50 : qrand() % 13, 3 );
+            const int maxDistance = qrand() % 8;
+
+            const int distance = legacyLevenshtein( source, target );
+            QCOMPARE( TomahawkUtils::boundedEditDistance( source, target, maxDistance ), qMin( distance, maxDistance + 1 ) );
+        }
+    }
+
+    void benchmarkLegacy()
+    {
+        const QStringList n = names();
+        int sum = 0;
+
+        QBENCHMARK
+        {
+            foreach ( const QString& a, n )
+                foreach ( const QString& b, n )
+                    sum += legacyLevenshtein( a, b );
+        }
+
+        QVERIFY( sum >= 0 );
+    }
+
+    void benchmarkEditDistance()
+    {
+        const QStringList n = names();
+        int sum = 0;
+
+        QBENCHMARK
+        {
+            foreach ( const QString& a, n )
+                foreach ( const QString& b, n )
+                    sum += TomahawkUtils::editDistance( a, b );
+        }
+
+        QVERIFY( sum >= 0 );
+    }
+};
+
+#endif // TOMAHAWK_TESTEDITDISTANCE_H
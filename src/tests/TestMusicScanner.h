@@ -0,0 +1,142 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOMAHAWK_TESTMUSICSCANNER_H
+#define TOMAHAWK_TESTMUSICSCANNER_H
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "filemetadata/MusicScanner.h"
+#include "Source.h"
+#include "SourceList.h"
+
+#define TEST_BATCH_SIZE 10
+#define TEST_FILES 25
+
+
+/**
+ * Finishes every commit right away, while the rest of the scan is still
+ * being read.
+ */
+class ImmediateCommitScanner : public MusicScanner
+{
+public:
+    ImmediateCommitScanner( const QStringList& paths )
+        : MusicScanner( MusicScanner::DirScan, paths, TEST_BATCH_SIZE )
+        , commands( 0 )
+    {
+    }
+
+    int commands;
+
+protected:
+    virtual void runCommand( const Tomahawk::dbcmd_ptr& cmd )
+    {
+        commands++;
+        QMetaObject::invokeMethod( cmd.data(), "finished", Qt::DirectConnection );
+    }
+};
+
+
+class TestMusicScanner : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QByteArray id3Frame( const char* id, const QString& text )
+    {
+        const QByteArray data = QByteArray( 1, '\0' ) + text.toLatin1();
+
+        QByteArray frame( id, 4 );
+        char size[ 4 ];
+        qToBigEndian( (quint32)data.length(), (uchar*)size );
+        frame.append( size, 4 );
+        frame.append( QByteArray( 2, '\0' ) );
+        return frame + data;
+    }
+
+    // An ID3v2.3 tag followed by a few silent MPEG-1 Layer 3 frames
+    static void writeMp3( const QString& path, const QString& artist, const QString& title )
+    {
+        const QByteArray frames = id3Frame( "TPE1", artist ) + id3Frame( "TIT2", title );
+
+        QByteArray tag( "ID3\x03\x00\x00", 6 );
+        // synchsafe size
+        tag.append( (char)( ( frames.length() >> 21 ) & 0x7f ) );
+        tag.append( (char)( ( frames.length() >> 14 ) & 0x7f ) );
+        tag.append( (char)( ( frames.length() >> 7 ) & 0x7f ) );
+        tag.append( (char)( frames.length() & 0x7f ) );
+        tag.append( frames );
+
+        // 128 kbit/s at 44.1 kHz, 417 bytes each
+        QByteArray mpegFrame( 417, '\0' );
+        mpegFrame[ 0 ] = (char)0xff;
+        mpegFrame[ 1 ] = (char)0xfb;
+        mpegFrame[ 2 ] = (char)0x90;
+        mpegFrame[ 3 ] = (char)0x00;
+
+        QFile file( path );
+        QVERIFY( file.open( QIODevice::WriteOnly ) );
+        file.write( tag );
+        for ( int i = 0; i < 10; i++ )
+            file.write( mpegFrame );
+    }
+
+private slots:
+    void initTestCase()
+    {
+        SourceList::instance()->setLocal( Tomahawk::source_ptr( new Tomahawk::Source( 0, "test" ) ) );
+    }
+
+    void testReadTags()
+    {
+        QTemporaryDir dir;
+        QVERIFY( dir.isValid() );
+
+        const QString path = dir.path() + "/track.mp3";
+        writeMp3( path, "Artist", "Title" );
+
+        const QVariantMap m = MusicScanner::readTags( QFileInfo( path ) ).toMap();
+        QCOMPARE( m.value( "artist" ).toString(), QString( "Artist" ) );
+        QCOMPARE( m.value( "track" ).toString(), QString( "Title" ) );
+    }
+
+    void testScanMoreThanOneBatch()
+    {
+        QTemporaryDir dir;
+        QVERIFY( dir.isValid() );
+
+        for ( int i = 0; i < TEST_FILES; i++ )
+            writeMp3( dir.path() + QString( "/track%1.mp3" ).arg( i ), "Artist", QString( "Track %1" ).arg( i ) );
+
+        ImmediateCommitScanner scanner( QStringList() << dir.path() );
+        QSignalSpy finished( &scanner, SIGNAL( finished() ) );
+
+        QMetaObject::invokeMethod( &scanner, "scan", Qt::QueuedConnection );
+        QVERIFY( finished.wait( 30000 ) );
+
+        // Finished only once everything was read and committed
+        QCOMPARE( scanner.readerStats().files, (unsigned int)TEST_FILES );
+        QCOMPARE( scanner.committerStats().files, (unsigned int)TEST_FILES );
+        QCOMPARE( scanner.commands, ( TEST_FILES + TEST_BATCH_SIZE - 1 ) / TEST_BATCH_SIZE );
+
+        QTest::qWait( 100 );
+        QCOMPARE( finished.count(), 1 );
+    }
+};
+
+#endif // TOMAHAWK_TESTMUSICSCANNER_H
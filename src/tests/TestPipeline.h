@@ -0,0 +1,123 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOMAHAWK_TESTPIPELINE_H
+#define TOMAHAWK_TESTPIPELINE_H
+
+#include <QtTest>
+
+#include "tests/MockResolver.h"
+
+
+class TestPipeline : public QObject
+{
+    Q_OBJECT
+
+private:
+    bool waitForIdle( Tomahawk::Pipeline* pipeline, int timeout )
+    {
+        QEventLoop loop;
+        QTimer timer;
+        timer.setSingleShot( true );
+        connect( pipeline, SIGNAL( idle() ), &loop, SLOT( quit() ) );
+        connect( &timer, SIGNAL( timeout() ), &loop, SLOT( quit() ) );
+        timer.start( timeout );
+        loop.exec();
+
+        return timer.isActive();
+    }
+
+private slots:
+    void testSlowResolverDoesNotStallQueue()
+    {
+        Tomahawk::Pipeline pipeline;
+        MockResolver fast( "fast", 1 );
+        MockResolver slow( "slow", 50, 200 );
+        pipeline.addResolver( &fast );
+        pipeline.addResolver( &slow );
+        pipeline.start();
+
+        const QList< Tomahawk::query_ptr > queries = syntheticQueries( 200 );
+        pipeline.resolve( queries, false );
+        QVERIFY( waitForIdle( &pipeline, 60000 ) );
+
+        foreach ( const Tomahawk::query_ptr& q, queries )
+            QVERIFY( q->resolvingFinished() );
+
+        foreach ( const Tomahawk::Pipeline::ResolverStats& stats, pipeline.resolverStats() )
+        {
+            QCOMPARE( stats.inFlight, 0u );
+            QCOMPARE( stats.backlog, 0u );
+            QCOMPARE( stats.completed + stats.timeouts, (quint64)queries.count() );
+        }
+
+        pipeline.removeResolver( &fast );
+        pipeline.removeResolver( &slow );
+    }
+
+    void testInteractiveLane()
+    {
+        Tomahawk::Pipeline pipeline;
+        MockResolver fast( "fast", 1 );
+        pipeline.addResolver( &fast );
+
+        pipeline.resolve( syntheticQueries( 50 ), false );
+        const Tomahawk::query_ptr q = Tomahawk::Query::get( "Interactive Artist", "Interactive Track", QString() );
+        pipeline.resolve( q, true );
+
+        QCOMPARE( pipeline.queueDepth( true ), 1u );
+        QCOMPARE( pipeline.queueDepth( false ), 50u );
+
+        pipeline.start();
+        QVERIFY( pipeline.isResolving( q ) );
+        QVERIFY( waitForIdle( &pipeline, 60000 ) );
+
+        pipeline.removeResolver( &fast );
+    }
+
+    void testSolvedQueryDropsQueuedWork()
+    {
+        Tomahawk::Pipeline pipeline;
+        MockResolver solver( "solver", 0, 0, true );
+        MockResolver slow( "slow", 100 );
+        pipeline.addResolver( &solver );
+        pipeline.addResolver( &slow );
+        pipeline.start();
+
+        const QList< Tomahawk::query_ptr > queries = syntheticQueries( 100 );
+        pipeline.resolve( queries, false );
+        QVERIFY( waitForIdle( &pipeline, 60000 ) );
+
+        foreach ( const Tomahawk::query_ptr& q, queries )
+        {
+            QVERIFY( q->solved() );
+            QVERIFY( q->resolvingFinished() );
+        }
+
+        // The slow resolver only got what fit into its slots before the solver answered
+        foreach ( const Tomahawk::Pipeline::ResolverStats& stats, pipeline.resolverStats() )
+        {
+            QCOMPARE( stats.backlog, 0u );
+            if ( stats.name == "slow" )
+                QVERIFY( stats.dispatched < (quint64)queries.count() );
+        }
+
+        pipeline.removeResolver( &solver );
+        pipeline.removeResolver( &slow );
+    }
+};
+
+#endif // TOMAHAWK_TESTPIPELINE_H
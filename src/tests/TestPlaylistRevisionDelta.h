@@ -0,0 +1,131 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOMAHAWK_TESTPLAYLISTREVISIONDELTA_H
+#define TOMAHAWK_TESTPLAYLISTREVISIONDELTA_H
+
+#include <QtTest>
+
+#include "database/PlaylistRevisionDelta.h"
+
+using namespace Tomahawk;
+
+
+class TestPlaylistRevisionDelta : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QStringList randomSubset( const QStringList& guids )
+    {
+        QStringList subset;
+        foreach ( const QString& guid, guids )
+        {
+            if ( qrand() % 3 )
+                subset.insert( subset.isEmpty() ? 0 : qrand() % ( subset.count() + 1 ), guid );
+        }
+        return subset;
+    }
+
+    static void verifyRoundTrip( const QStringList& from, const QStringList& to )
+    {
+        QVariantList ops;
+        QVERIFY( PlaylistRevisionDelta::diff( from, to, ops ) );
+
+        QStringList result;
+        QVERIFY( PlaylistRevisionDelta::apply( from, QList< QVariantList >() << ops, result ) );
+        QCOMPARE( result, to );
+    }
+
+private slots:
+    void initTestCase()
+    {
+        qsrand( 7 );
+    }
+
+    void testSimpleEdits()
+    {
+        const QStringList base = QStringList() << "a" << "b" << "c" << "d";
+        QVariantList ops;
+
+        QVERIFY( PlaylistRevisionDelta::diff( base, base, ops ) );
+        QVERIFY( ops.isEmpty() );
+
+        // Appending one entry is a single insert
+        QVERIFY( PlaylistRevisionDelta::diff( base, QStringList( base ) << "e", ops ) );
+        QCOMPARE( ops.count(), 1 );
+        QCOMPARE( ops.first().toList().value( 0 ).toString(), QString( "+" ) );
+
+        // Moving the last entry to the front is a single move
+        QVERIFY( PlaylistRevisionDelta::diff( base, QStringList() << "d" << "a" << "b" << "c", ops ) );
+        QCOMPARE( ops.count(), 1 );
+        QCOMPARE( ops.first().toList().value( 0 ).toString(), QString( ">" ) );
+
+        verifyRoundTrip( base, QStringList() );
+        verifyRoundTrip( QStringList(), base );
+        verifyRoundTrip( base, QStringList() << "d" << "c" << "b" << "a" );
+    }
+
+    void testRandomEdits()
+    {
+        QStringList guids;
+        for ( int i = 0; i < 40; i++ )
+            guids << QString::number( i );
+
+        for ( int i = 0; i < 500; i++ )
+            verifyRoundTrip( randomSubset( guids ), randomSubset( guids ) );
+    }
+
+    void testChainedDeltas()
+    {
+        QStringList guids;
+        for ( int i = 0; i < 40; i++ )
+            guids << QString::number( i );
+
+        const QStringList base = randomSubset( guids );
+        QStringList current = base;
+        QList< QVariantList > deltas;
+        for ( int i = 0; i < 20; i++ )
+        {
+            const QStringList next = randomSubset( guids );
+            QVariantList ops;
+            QVERIFY( PlaylistRevisionDelta::diff( current, next, ops ) );
+            deltas << ops;
+            current = next;
+        }
+
+        QStringList result;
+        QVERIFY( PlaylistRevisionDelta::apply( base, deltas, result ) );
+        QCOMPARE( result, current );
+    }
+
+    void testInvalid()
+    {
+        QVariantList ops;
+        QVERIFY( !PlaylistRevisionDelta::diff( QStringList() << "a" << "a", QStringList() << "a", ops ) );
+        QVERIFY( !PlaylistRevisionDelta::diff( QStringList() << "a", QStringList() << "b" << "b", ops ) );
+
+        // Removing or moving an entry that isn't there, inserting one that is
+        QStringList result;
+        const QStringList base = QStringList() << "a" << "b";
+        QVERIFY( !PlaylistRevisionDelta::apply( base, QList< QVariantList >() << ( QVariantList() << QVariant( QVariantList() << "-" << "c" ) ), result ) );
+        QVERIFY( !PlaylistRevisionDelta::apply( base, QList< QVariantList >() << ( QVariantList() << QVariant( QVariantList() << ">" << "c" << "a" ) ), result ) );
+        QVERIFY( !PlaylistRevisionDelta::apply( base, QList< QVariantList >() << ( QVariantList() << QVariant( QVariantList() << "+" << "a" << "b" ) ), result ) );
+        QVERIFY( !PlaylistRevisionDelta::apply( base, QList< QVariantList >() << ( QVariantList() << QVariant( QVariantList() << "+" << "c" << "x" ) ), result ) );
+    }
+};
+
+#endif // TOMAHAWK_TESTPLAYLISTREVISIONDELTA_H
@@ -67,6 +67,7 @@
 #include "utils/Logger.h"
 #include "utils/TomahawkUtilsGui.h"
 #include "utils/TomahawkCache.h"
+#include "utils/StreamCache.h"
 #include "widgets/SplashWidget.h"
 
 #include "resolvers/JSResolver.h"
@@ -318,6 +319,7 @@ TomahawkApp::~TomahawkApp()
         delete m_infoSystem.data();
 
     delete TomahawkUtils::Cache::instance();
+    delete Tomahawk::StreamCache::instance();
 
     tDebug( LOGVERBOSE ) << "Finished shutdown.";
 }
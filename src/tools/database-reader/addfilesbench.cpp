@@ -0,0 +1,148 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "database/Database.h"
+#include "database/DatabaseCommand_AddFiles.h"
+#include "database/DatabaseImpl.h"
+#include "database/LocalCollection.h"
+#include "Source.h"
+#include "SourceList.h"
+#include "Typedefs.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+
+#include <iostream>
+
+#define DEFAULT_FILES 100000
+// Shape of the synthetic collection: artists with albums with tracks
+#define TRACKS_PER_ALBUM 12
+#define ALBUMS_PER_ARTIST 5
+
+
+class Tasks : public QObject
+{
+Q_OBJECT
+public:
+    Tasks( int files )
+        : m_files( files )
+        , m_execTime( 0 )
+    {
+    }
+
+    Q_INVOKABLE void startDatabase( QString dbpath )
+    {
+        m_database = QSharedPointer< Tomahawk::Database >( new Tomahawk::Database( dbpath ) );
+        connect( m_database.data(), SIGNAL( ready() ), SLOT( startImport() ), Qt::QueuedConnection );
+        m_database->loadIndex();
+    }
+
+public slots:
+    void startImport()
+    {
+        Tomahawk::source_ptr src( new Tomahawk::Source( 0, m_database->impl()->dbid() ) );
+        Tomahawk::collection_ptr coll( new Tomahawk::LocalCollection( src ) );
+        src->addCollection( coll );
+        SourceList::instance()->setLocal( src );
+
+        QVariantList files;
+        files.reserve( m_files );
+        for ( int i = 0; i < m_files; i++ )
+        {
+            const int album = i / TRACKS_PER_ALBUM;
+            const int artist = album / ALBUMS_PER_ARTIST;
+
+            QVariantMap m;
+            m["url"] = QString( "file:///music/artist%1/album%2/track%3.mp3" ).arg( artist ).arg( album ).arg( i );
+            m["mtime"] = 1400000000 + i;
+            m["size"] = 5 * 1024 * 1024;
+            m["hash"] = QString();
+            m["mimetype"] = "audio/mpeg";
+            m["duration"] = 180 + i % 120;
+            m["bitrate"] = 320;
+            m["artist"] = QString( "Artist %1" ).arg( artist );
+            m["albumartist"] = QString( "Artist %1" ).arg( artist );
+            m["album"] = QString( "Album %1" ).arg( album );
+            m["track"] = QString( "Track %1" ).arg( i );
+            m["albumpos"] = i % TRACKS_PER_ALBUM + 1;
+            m["composer"] = QString();
+            m["discnumber"] = 1;
+            m["year"] = 1960 + artist % 60;
+            files << m;
+        }
+
+        Tomahawk::DatabaseCommand_AddFiles* cmd = new Tomahawk::DatabaseCommand_AddFiles( files, src );
+        connect( cmd, SIGNAL( finished() ), SLOT( onFinished() ), Qt::QueuedConnection );
+        connect( cmd, SIGNAL( committed() ), SLOT( onCommitted() ), Qt::QueuedConnection );
+
+        m_timer.start();
+        m_database->enqueue( Tomahawk::dbcmd_ptr( cmd ) );
+    }
+
+    void onFinished()
+    {
+        m_execTime = m_timer.elapsed();
+    }
+
+    void onCommitted()
+    {
+        // Includes the commit, the search index update is only enqueued by then
+        const qint64 total = qMax< qint64 >( 1, m_timer.elapsed() );
+
+        std::cout << "Inserted " << m_files << " files in " << m_execTime << " ms, "
+                  << "committed after " << total << " ms "
+                  << "(" << m_files * 1000 / total << " files/s)" << std::endl;
+
+        QCoreApplication::quit();
+    }
+
+private:
+    int m_files;
+    QSharedPointer< Tomahawk::Database > m_database;
+    QElapsedTimer m_timer;
+    qint64 m_execTime;
+};
+
+// Include needs to go here as Tasks needs to be defined before.
+#include "addfilesbench.moc"
+
+
+int main( int argc, char* argv[] )
+{
+    if ( argc < 2 || argc > 3 )
+    {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "\ttomahawk-addfiles-bench <database> [files]" << std::endl;
+        std::cout << std::endl;
+        std::cout << "\tdatabase\tA scratch database, synthetic files will be added to it" << std::endl;
+        std::cout << "\tfiles\tHow many files to import in one command, defaults to " << DEFAULT_FILES << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    QApplication app( argc, argv );
+
+    const int files = argc == 3 ? QString::fromLocal8Bit( argv[2] ).toInt() : DEFAULT_FILES;
+    if ( files < 1 )
+    {
+        std::cerr << "Invalid number of files" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Tasks tasks( files );
+    QMetaObject::invokeMethod( &tasks, "startDatabase", Qt::QueuedConnection, Q_ARG( QString, QString::fromLocal8Bit( argv[1] ) ) );
+
+    return app.exec();
+}
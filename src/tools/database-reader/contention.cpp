@@ -0,0 +1,246 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "database/Database.h"
+#include "database/DatabaseCommand.h"
+#include "database/DatabaseImpl.h"
+#include "database/LocalCollection.h"
+#include "filemetadata/MusicScanner.h"
+#include "Source.h"
+#include "SourceList.h"
+#include "Typedefs.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTimer>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#define MAX_OUTSTANDING_PROBES 8
+#define PROBE_INTERVAL 10
+
+
+/**
+ * A read-only command doing roughly what DatabaseCommand_AllTracks does,
+ * timing how long it takes to get through the whole collection.
+ */
+class ReadProbe : public Tomahawk::DatabaseCommand
+{
+Q_OBJECT
+public:
+    ReadProbe() : duration( 0 ), rows( 0 ) {}
+
+    QString commandname() const override { return "readprobe"; }
+    bool doesMutates() const override { return false; }
+
+    void exec( Tomahawk::DatabaseImpl* lib ) override
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        TomahawkSqlQuery query = lib->newquery();
+        query.exec( "SELECT artist.name, track.name, album.name, file.url "
+                    "FROM file, file_join, artist, track "
+                    "LEFT JOIN album ON album.id = file_join.album "
+                    "WHERE file.id = file_join.file AND "
+                    "artist.id = file_join.artist AND "
+                    "track.id = file_join.track" );
+        while ( query.next() )
+            rows++;
+
+        duration = timer.elapsed();
+    }
+
+    qint64 duration;
+    int rows;
+};
+
+
+/**
+ * Queued behind all commits of the scanner on the read-write worker.
+ */
+class WriteBarrier : public Tomahawk::DatabaseCommand
+{
+Q_OBJECT
+public:
+    QString commandname() const override { return "writebarrier"; }
+    bool doesMutates() const override { return true; }
+    void exec( Tomahawk::DatabaseImpl* ) override {}
+};
+
+
+class Tasks : public QObject
+{
+Q_OBJECT
+public:
+    Tasks( const QString& path )
+        : m_path( path )
+        , m_outstanding( 0 )
+        , m_scanner( 0 )
+        , m_scanning( true )
+    {
+    }
+
+    Q_INVOKABLE void startDatabase( QString dbpath )
+    {
+        m_database = QSharedPointer< Tomahawk::Database >( new Tomahawk::Database( dbpath ) );
+        connect( m_database.data(), SIGNAL( ready() ), SLOT( startScan() ), Qt::QueuedConnection );
+        m_database->loadIndex();
+    }
+
+public slots:
+    void startScan()
+    {
+        Tomahawk::source_ptr src( new Tomahawk::Source( 0, m_database->impl()->dbid() ) );
+        Tomahawk::collection_ptr coll( new Tomahawk::LocalCollection( src ) );
+        src->addCollection( coll );
+        SourceList::instance()->setLocal( src );
+
+        m_scanner = new MusicScanner( MusicScanner::DirScan, QStringList() << m_path, 0 );
+        m_scanner->moveToThread( &m_scannerThread );
+        connect( m_scanner, SIGNAL( finished() ), SLOT( onScanFinished() ), Qt::QueuedConnection );
+        m_scannerThread.start();
+
+        m_timer.start();
+        QMetaObject::invokeMethod( m_scanner, "scan", Qt::QueuedConnection );
+
+        connect( &m_probeTimer, SIGNAL( timeout() ), SLOT( probe() ) );
+        m_probeTimer.start( PROBE_INTERVAL );
+    }
+
+    void probe()
+    {
+        while ( m_outstanding < MAX_OUTSTANDING_PROBES )
+        {
+            ReadProbe* cmd = new ReadProbe();
+            connect( cmd, SIGNAL( finished() ), SLOT( onProbeFinished() ), Qt::QueuedConnection );
+            m_outstanding++;
+            m_database->enqueue( Tomahawk::dbcmd_ptr( cmd ) );
+        }
+    }
+
+    void onProbeFinished()
+    {
+        ReadProbe* cmd = qobject_cast< ReadProbe* >( sender() );
+        m_outstanding--;
+
+        if ( m_scanning )
+            m_latencies.push_back( cmd->duration );
+        else if ( !m_outstanding )
+            report();
+    }
+
+    void onScanFinished()
+    {
+        m_scanTime = m_timer.elapsed();
+
+        WriteBarrier* cmd = new WriteBarrier();
+        connect( cmd, SIGNAL( finished() ), SLOT( onCommitFinished() ), Qt::QueuedConnection );
+        m_database->enqueue( Tomahawk::dbcmd_ptr( cmd ) );
+    }
+
+    void onCommitFinished()
+    {
+        m_commitTime = m_timer.elapsed();
+        m_scanning = false;
+        m_probeTimer.stop();
+
+        if ( !m_outstanding )
+            report();
+    }
+
+private:
+    void report()
+    {
+        std::sort( m_latencies.begin(), m_latencies.end() );
+
+        std::cout << "Scan finished after " << m_scanTime << " ms, "
+                  << "all commits done after " << m_commitTime << " ms" << std::endl;
+
+        if ( m_latencies.empty() )
+        {
+            std::cout << "No read commands finished while the scanner was committing" << std::endl;
+        }
+        else
+        {
+            qint64 total = 0;
+            for ( size_t i = 0; i < m_latencies.size(); i++ )
+                total += m_latencies[ i ];
+
+            std::cout << m_latencies.size() << " read commands ran in parallel, latency in ms:"
+                      << " avg " << total / (qint64)m_latencies.size()
+                      << " p50 " << m_latencies[ m_latencies.size() / 2 ]
+                      << " p95 " << m_latencies[ m_latencies.size() * 95 / 100 ]
+                      << " max " << m_latencies.back() << std::endl;
+        }
+
+        m_scannerThread.quit();
+        m_scannerThread.wait();
+        delete m_scanner;
+
+        QCoreApplication::quit();
+    }
+
+    QString m_path;
+    QSharedPointer< Tomahawk::Database > m_database;
+    int m_outstanding;
+
+    QThread m_scannerThread;
+    MusicScanner* m_scanner;
+    bool m_scanning;
+
+    QTimer m_probeTimer;
+    QElapsedTimer m_timer;
+    qint64 m_scanTime;
+    qint64 m_commitTime;
+    std::vector< qint64 > m_latencies;
+};
+
+// Include needs to go here as Tasks needs to be defined before.
+#include "contention.moc"
+
+
+int main( int argc, char* argv[] )
+{
+    if ( argc != 3 )
+    {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "\ttomahawk-db-contention <database> <path>" << std::endl;
+        std::cout << std::endl;
+        std::cout << "\tdatabase\tA scratch database, the files found in path will be added to it" << std::endl;
+        std::cout << "\tpath\tA directory to scan while read commands run in parallel" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    QApplication app( argc, argv );
+
+    qRegisterMetaType< QDir >( "QDir" );
+    qRegisterMetaType< QFileInfo >( "QFileInfo" );
+
+    if ( !QFileInfo( argv[2] ).isDir() )
+    {
+        std::cerr << "Given path is not a directory" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Tasks tasks( QFileInfo( argv[2] ).canonicalFilePath() );
+    QMetaObject::invokeMethod( &tasks, "startDatabase", Qt::QueuedConnection, Q_ARG( QString, QString::fromLocal8Bit( argv[1] ) ) );
+
+    return app.exec();
+}
@@ -0,0 +1,121 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "database/fuzzyindex/FuzzyIndex.h"
+#include "Query.h"
+#include "TomahawkVersion.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#define DEFAULT_INDEX_SIZE 500000
+#define DEFAULT_DELTA_SIZE 1000
+#define TRACKS_PER_ARTIST 20
+
+
+static Tomahawk::IndexData
+trackData( unsigned int id )
+{
+    Tomahawk::IndexData data;
+    data.id = id;
+    data.artistId = id / TRACKS_PER_ARTIST + 1;
+    data.artist = QString( "Benchmark Artist %1" ).arg( data.artistId );
+    data.track = QString( "Benchmark Track Number %1" ).arg( id );
+
+    return data;
+}
+
+
+/**
+ * Measures how long it takes to get a small delta into a big fuzzy index and
+ * how searches behave while that happens.
+ *
+ * Usage: tomahawk-fuzzyindex-bench [index size] [delta size]
+ */
+int main( int argc, char* argv[] )
+{
+    QCoreApplication app( argc, argv );
+    app.setOrganizationName( TOMAHAWK_ORGANIZATION_NAME );
+
+    const QStringList args = app.arguments();
+    const unsigned int indexSize = args.count() > 1 ? args.at( 1 ).toUInt() : DEFAULT_INDEX_SIZE;
+    const unsigned int deltaSize = args.count() > 2 ? args.at( 2 ).toUInt() : DEFAULT_DELTA_SIZE;
+
+    FuzzyIndex index( 0, "fuzzyindex-benchmark.lucene", true );
+
+    QElapsedTimer timer;
+    timer.start();
+
+    index.beginIndexing( true );
+    for ( unsigned int i = 1; i <= indexSize; i++ )
+        index.appendFields( trackData( i ) );
+    index.endIndexing();
+
+    std::cout << "Initial index of " << indexSize << " tracks built in " << timer.elapsed() << "ms" << std::endl;
+
+    // Keep searching for a track of the existing index while the delta goes in
+    const Tomahawk::query_ptr query = Tomahawk::Query::get( trackData( indexSize / 2 ).artist,
+                                                            trackData( indexSize / 2 ).track,
+                                                            QString(), QString(), false );
+    std::atomic< bool > updating( true );
+    std::atomic< int > searches( 0 );
+    std::atomic< int > failedSearches( 0 );
+    std::atomic< qint64 > slowestSearch( 0 );
+
+    std::thread searcher( [&]()
+    {
+        QElapsedTimer searchTimer;
+        while ( updating )
+        {
+            searchTimer.start();
+            if ( index.search( query ).isEmpty() )
+                failedSearches++;
+
+            slowestSearch = qMax( slowestSearch.load(), searchTimer.elapsed() );
+            searches++;
+        }
+    } );
+
+    timer.restart();
+
+    index.beginIndexing();
+    for ( unsigned int i = indexSize + 1; i <= indexSize + deltaSize; i++ )
+        index.appendFields( trackData( i ) );
+    index.endIndexing();
+
+    const qint64 updateTime = timer.elapsed();
+    updating = false;
+    searcher.join();
+
+    const Tomahawk::query_ptr newQuery = Tomahawk::Query::get( trackData( indexSize + deltaSize ).artist,
+                                                               trackData( indexSize + deltaSize ).track,
+                                                               QString(), QString(), false );
+    const bool deltaVisible = index.search( newQuery ).contains( indexSize + deltaSize );
+
+    std::cout << "Delta of " << deltaSize << " tracks committed in " << updateTime << "ms" << std::endl;
+    std::cout << "New tracks searchable after update: " << ( deltaVisible ? "yes" : "no" ) << std::endl;
+    std::cout << searches << " searches during the update, " << failedSearches << " without results, "
+              << "slowest took " << slowestSearch << "ms" << std::endl;
+
+    index.deleteIndex();
+
+    return deltaVisible && !failedSearches ? 0 : 1;
+}
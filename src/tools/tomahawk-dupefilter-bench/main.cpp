@@ -0,0 +1,146 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "playlist/PlayableItem.h"
+#include "playlist/PlayableModel.h"
+#include "playlist/PlayableProxyModel.h"
+#include "Query.h"
+#include "Track.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QSortFilterProxyModel>
+#include <QStringList>
+
+#include <iostream>
+
+// The quadratic implementation gets unbearably slow above this
+#define MAX_LEGACY_ROWS 20000
+
+
+/**
+ * The dupe filter as PlayableProxyModel implemented it before it kept an
+ * index: every row scans all rows before it and filters each match again.
+ */
+class LegacyDupeProxyModel : public QSortFilterProxyModel
+{
+public:
+    LegacyDupeProxyModel( PlayableModel* model )
+        : QSortFilterProxyModel()
+        , m_model( model )
+    {
+    }
+
+protected:
+    bool filterAcceptsRow( int sourceRow, const QModelIndex& sourceParent ) const
+    {
+        PlayableItem* pi = m_model->itemFromIndex( m_model->index( sourceRow, 0, sourceParent ) );
+        if ( !pi )
+            return false;
+
+        for ( int i = 0; i < sourceRow; i++ )
+        {
+            PlayableItem* di = m_model->itemFromIndex( m_model->index( i, 0, sourceParent ) );
+            if ( !di )
+                continue;
+
+            if ( pi->query()->equals( di->query() ) && filterAcceptsRow( i, sourceParent ) )
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+    PlayableModel* m_model;
+};
+
+
+static void
+benchmark( int rows )
+{
+    // Roughly 30% of the rows are dupes of an earlier one, like in a collection with a few duplicate files
+    const int distinct = qMax( 1, rows * 7 / 10 );
+
+    QList< Tomahawk::query_ptr > queries;
+    for ( int i = 0; i < rows; i++ )
+    {
+        const int n = ( i * 7919 ) % distinct;
+        queries << Tomahawk::Query::get( QString( "Artist %1" ).arg( n % 500 ),
+                                         QString( "Track %1" ).arg( n ),
+                                         QString( "Album %1" ).arg( n % 2000 ),
+                                         QString(), false );
+    }
+
+    PlayableModel model( 0, false );
+    model.appendQueries( queries );
+
+    QElapsedTimer timer;
+    timer.start();
+
+    PlayableProxyModel proxy;
+    proxy.setHideDupeItems( true );
+    proxy.setSourcePlayableModel( &model );
+    const int visible = proxy.rowCount();
+    const qint64 indexed = timer.elapsed();
+
+    // Filtering again after e.g. the filter pattern changed
+    timer.restart();
+    proxy.setHideDupeItems( false );
+    proxy.setHideDupeItems( true );
+    const qint64 refiltered = timer.elapsed();
+
+    std::cout << rows << " rows, " << visible << " visible: indexed " << indexed << "ms, refilter " << refiltered << "ms";
+
+    if ( rows <= MAX_LEGACY_ROWS )
+    {
+        timer.restart();
+        LegacyDupeProxyModel legacy( &model );
+        legacy.setSourceModel( &model );
+        const int legacyVisible = legacy.rowCount();
+
+        std::cout << ", legacy " << timer.elapsed() << "ms" << ( legacyVisible == visible ? "" : " (MISMATCH)" );
+    }
+    else
+    {
+        std::cout << ", legacy skipped";
+    }
+
+    std::cout << std::endl;
+}
+
+
+int
+main( int argc, char* argv[] )
+{
+    QApplication app( argc, argv );
+
+    QList< int > sizes;
+    sizes << 1000 << 5000 << 10000 << 20000 << 50000;
+
+    // Row counts can be passed on the command line instead
+    if ( app.arguments().count() > 1 )
+    {
+        sizes.clear();
+        foreach ( const QString& arg, app.arguments().mid( 1 ) )
+            sizes << arg.toInt();
+    }
+
+    foreach ( int rows, sizes )
+        benchmark( rows );
+
+    return 0;
+}
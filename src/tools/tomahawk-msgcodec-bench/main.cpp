@@ -0,0 +1,162 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/MsgProcessor.h"
+#include "utils/Json.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QUuid>
+#include <QVariantMap>
+
+#include <iostream>
+
+#define MIN_RUNTIME_MS 500
+
+
+/**
+ * Builds an addfiles dbop like the ones a collection scan puts into the
+ * oplog, padded with files until it is at least targetSize bytes large.
+ */
+static QByteArray
+addFilesOp( int targetSize, int seed )
+{
+    static const char* const artists[] = { "Nine Inch Nails", "Radiohead", "Portishead", "Boards of Canada", "Aphex Twin" };
+    static const char* const albums[] = { "The Fragile", "Kid A", "Dummy", "Geogaddi", "Selected Ambient Works 85-92" };
+
+    QVariantList files;
+    QVariantMap op;
+    op[ "command" ] = "addfiles";
+    op[ "guid" ] = QUuid::createUuid().toString();
+
+    QByteArray json;
+    int i = 0;
+    do
+    {
+        const int n = seed + i++;
+        const QString artist = artists[ n % 5 ];
+        const QString album = albums[ ( n / 5 ) % 5 ];
+        const QString track = QString( "Track number %1" ).arg( n );
+
+        QVariantMap m;
+        m[ "url" ] = QString( "file:///home/user/Music/%1/%2/%3 - %4.mp3" ).arg( artist ).arg( album ).arg( n % 20, 2, 10, QChar( '0' ) ).arg( track );
+        m[ "mtime" ] = 1400000000 + n * 37;
+        m[ "size" ] = 3000000 + n * 7919 % 9000000;
+        m[ "mimetype" ] = "audio/mpeg";
+        m[ "duration" ] = 120 + n % 300;
+        m[ "bitrate" ] = 320;
+        m[ "artist" ] = artist;
+        m[ "album" ] = album;
+        m[ "track" ] = track;
+        m[ "albumpos" ] = n % 20;
+        m[ "year" ] = 1990 + n % 25;
+        m[ "albumartist" ] = artist;
+        m[ "composer" ] = "";
+        m[ "discnumber" ] = 1;
+        m[ "hash" ] = "";
+        files << m;
+
+        op[ "files" ] = files;
+        json = TomahawkUtils::toJson( op );
+    }
+    while ( json.length() < targetSize );
+
+    return json;
+}
+
+
+static void
+benchmark( const QByteArray& payload, MsgProcessor::Codec codec )
+{
+    QByteArray compressed;
+    QElapsedTimer timer;
+    int runs = 0;
+
+    timer.start();
+    do
+    {
+        compressed = MsgProcessor::compress( payload, codec );
+        runs++;
+    }
+    while ( timer.elapsed() < MIN_RUNTIME_MS );
+    const double compressUs = timer.nsecsElapsed() / 1000.0 / runs;
+
+    QByteArray uncompressed;
+    runs = 0;
+    timer.restart();
+    do
+    {
+        uncompressed = MsgProcessor::uncompress( compressed, codec );
+        runs++;
+    }
+    while ( timer.elapsed() < MIN_RUNTIME_MS );
+    const double uncompressUs = timer.nsecsElapsed() / 1000.0 / runs;
+
+    std::cout << qPrintable( MsgProcessor::codecName( codec ).leftJustified( 6 ) )
+              << " size " << payload.length() << " -> " << compressed.length()
+              << " (" << 100.0 * compressed.length() / payload.length() << "%)"
+              << ", compress " << compressUs << "us (" << payload.length() / compressUs << " MB/s)"
+              << ", uncompress " << uncompressUs << "us (" << payload.length() / uncompressUs << " MB/s)"
+              << ( uncompressed == payload ? "" : " MISMATCH" ) << std::endl;
+}
+
+
+int
+main( int argc, char* argv[] )
+{
+    QCoreApplication app( argc, argv );
+
+    QList< int > sizes;
+    sizes << 256 << 1024 << 4 * 1024 << 64 * 1024 << 1024 * 1024;
+
+    // Sizes in bytes can be passed on the command line instead
+    if ( app.arguments().count() > 1 )
+    {
+        sizes.clear();
+        foreach ( const QString& arg, app.arguments().mid( 1 ) )
+            sizes << arg.toInt();
+    }
+
+    foreach ( int size, sizes )
+    {
+        const QByteArray payload = addFilesOp( size, size );
+
+        // Baseline: what MsgProcessor used for every peer before codecs were negotiated
+        QElapsedTimer timer;
+        int runs = 0;
+        QByteArray compressed;
+        timer.start();
+        do
+        {
+            compressed = qCompress( payload, 9 );
+            runs++;
+        }
+        while ( timer.elapsed() < MIN_RUNTIME_MS );
+        const double us = timer.nsecsElapsed() / 1000.0 / runs;
+
+        std::cout << "zlib-9 size " << payload.length() << " -> " << compressed.length()
+                  << " (" << 100.0 * compressed.length() / payload.length() << "%)"
+                  << ", compress " << us << "us (" << payload.length() / us << " MB/s)" << std::endl;
+
+        foreach ( const QString& name, MsgProcessor::supportedCodecs() )
+            benchmark( payload, MsgProcessor::codecFromName( name ) );
+
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tests/MockResolver.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+
+#include <iostream>
+
+#define DEFAULT_QUERIES 5000
+// Give up on a run after this long, something is stuck
+#define MAX_RUN_TIME 300000
+
+
+static void
+benchmark( int count )
+{
+    Tomahawk::Pipeline pipeline;
+    MockResolver database( "database", 0 );
+    MockResolver fast( "fast", 2, 5000 );
+    MockResolver slow( "slow", 20, 5000 );
+    pipeline.addResolver( &database );
+    pipeline.addResolver( &fast );
+    pipeline.addResolver( &slow );
+    pipeline.start();
+
+    const QList< Tomahawk::query_ptr > queries = syntheticQueries( count );
+
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot( true );
+    QObject::connect( &pipeline, SIGNAL( idle() ), &loop, SLOT( quit() ) );
+    QObject::connect( &timer, SIGNAL( timeout() ), &loop, SLOT( quit() ) );
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    timer.start( MAX_RUN_TIME );
+    pipeline.resolve( queries, false );
+    loop.exec();
+
+    std::cout << "Resolved " << count << " queries in " << elapsed.elapsed() << "ms"
+              << ( timer.isActive() ? "" : " (TIMED OUT)" ) << std::endl;
+
+    foreach ( const Tomahawk::Pipeline::ResolverStats& stats, pipeline.resolverStats() )
+    {
+        std::cout << "\t" << stats.name.toStdString()
+                  << " budget: " << stats.budget
+                  << " latency: " << stats.averageLatency << "ms"
+                  << " completed: " << stats.completed
+                  << " timeouts: " << stats.timeouts << std::endl;
+    }
+
+    pipeline.removeResolver( &database );
+    pipeline.removeResolver( &fast );
+    pipeline.removeResolver( &slow );
+}
+
+
+int
+main( int argc, char* argv[] )
+{
+    QApplication app( argc, argv );
+
+    QList< int > sizes;
+    sizes << DEFAULT_QUERIES;
+
+    // Query counts can be passed on the command line instead
+    if ( app.arguments().count() > 1 )
+    {
+        sizes.clear();
+        foreach ( const QString& arg, app.arguments().mid( 1 ) )
+            sizes << arg.toInt();
+    }
+
+    foreach ( int count, sizes )
+        benchmark( count );
+
+    return 0;
+}
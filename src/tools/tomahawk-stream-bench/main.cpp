@@ -0,0 +1,199 @@
+/* === This file is part of Tomahawk Player - <http://tomahawk-player.org> ===
+ *
+ *   Tomahawk is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Tomahawk is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Tomahawk. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network/BufferIoDevice.h"
+#include "network/Msg.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QtEndian>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#define DEFAULT_SIZE_MB 50
+#define SEND_WINDOW 256 * 1024
+#define READ_SIZE 64 * 1024
+
+
+/**
+ * Pushes a file through a loopback TCP connection the way StreamConnection
+ * does: one framed "data" msg per block with a bounded send window. The
+ * receiving side feeds a BufferIODevice, which a second thread drains like
+ * the audio engine would.
+ */
+class Transfer : public QObject
+{
+Q_OBJECT
+public:
+    Transfer( const QByteArray& source )
+        : m_source( source )
+        , m_sourceDev( &m_source )
+        , m_receiver( 0 )
+        , m_device( source.length() )
+        , m_block( 0 )
+    {
+        m_sourceDev.open( QIODevice::ReadOnly );
+        m_device.open( QIODevice::ReadOnly );
+
+        m_server.listen( QHostAddress::LocalHost );
+        connect( &m_server, SIGNAL( newConnection() ), SLOT( onNewConnection() ) );
+        connect( &m_sender, SIGNAL( connected() ), SLOT( sendSome() ) );
+        connect( &m_sender, SIGNAL( bytesWritten( qint64 ) ), SLOT( sendSome() ) );
+    }
+
+    void start()
+    {
+        m_timer.start();
+        m_sender.connectToHost( QHostAddress::LocalHost, m_server.serverPort() );
+    }
+
+    BufferIODevice* device() { return &m_device; }
+    qint64 elapsed() const { return m_timer.elapsed(); }
+
+public slots:
+    void sendSome()
+    {
+        while ( m_sender.bytesToWrite() < SEND_WINDOW && !m_sourceDev.atEnd() )
+        {
+            QByteArray ba = "data";
+            ba.append( m_sourceDev.read( BufferIODevice::blockSize() ) );
+
+            const char flags = m_sourceDev.atEnd() ? Msg::RAW : Msg::RAW | Msg::FRAGMENT;
+            Msg::factory( ba, flags )->write( &m_sender );
+        }
+    }
+
+    void onNewConnection()
+    {
+        m_receiver = m_server.nextPendingConnection();
+        connect( m_receiver, SIGNAL( readyRead() ), SLOT( onReadyRead() ) );
+    }
+
+    void onReadyRead()
+    {
+        m_pending.append( m_receiver->readAll() );
+
+        int pos = 0;
+        while ( m_pending.length() - pos >= Msg::headerSize() )
+        {
+            const quint32 length = qFromBigEndian< quint32 >( (const uchar*) m_pending.constData() + pos );
+            if ( m_pending.length() - pos - Msg::headerSize() < (int)length )
+                break;
+
+            const char* payload = m_pending.constData() + pos + Msg::headerSize();
+            m_device.addData( m_block++, QByteArray::fromRawData( payload + 4, length - 4 ) );
+            pos += Msg::headerSize() + length;
+        }
+
+        m_pending.remove( 0, pos );
+    }
+
+private:
+    QByteArray m_source;
+    QBuffer m_sourceDev;
+    QTcpServer m_server;
+    QTcpSocket m_sender;
+    QTcpSocket* m_receiver;
+    QByteArray m_pending;
+
+    BufferIODevice m_device;
+    int m_block;
+    QElapsedTimer m_timer;
+};
+
+#include "main.moc"
+
+
+/**
+ * Usage: tomahawk-stream-bench [file]
+ *
+ * Without a file 50 MB of incompressible data stand in for a FLAC file.
+ */
+int main( int argc, char* argv[] )
+{
+    QCoreApplication app( argc, argv );
+
+    QByteArray source;
+    const QStringList args = app.arguments();
+    if ( args.count() > 1 )
+    {
+        QFile file( args.at( 1 ) );
+        if ( !file.open( QIODevice::ReadOnly ) )
+        {
+            std::cerr << "Could not open " << qPrintable( args.at( 1 ) ) << std::endl;
+            return 1;
+        }
+        source = file.readAll();
+    }
+    else
+    {
+        source.resize( DEFAULT_SIZE_MB * 1024 * 1024 );
+        quint32 seed = 42;
+        for ( int i = 0; i < source.length(); i++ )
+        {
+            seed = seed * 1664525 + 1013904223;
+            source[ i ] = seed >> 24;
+        }
+    }
+
+    Transfer transfer( source );
+    std::atomic< qint64 > consumed( 0 );
+    std::atomic< qint64 > consumedAt( 0 );
+
+    // Drain the device from another thread, like the audio engine does
+    QCryptographicHash received( QCryptographicHash::Md5 );
+    std::thread reader( [&]()
+    {
+        QByteArray buffer( READ_SIZE, 0 );
+        BufferIODevice* device = transfer.device();
+        while ( consumed < source.length() )
+        {
+            const qint64 read = device->read( buffer.data(), buffer.length() );
+            if ( read <= 0 )
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            received.addData( buffer.constData(), read );
+            consumed += read;
+        }
+
+        consumedAt = transfer.elapsed();
+        QMetaObject::invokeMethod( &app, "quit", Qt::QueuedConnection );
+    } );
+
+    transfer.start();
+    app.exec();
+    reader.join();
+
+    const bool intact = ( received.result() == QCryptographicHash::hash( source, QCryptographicHash::Md5 ) );
+    const double seconds = qMax< qint64 >( 1, consumedAt ) / 1000.0;
+
+    std::cout << "Transferred " << source.length() / 1024 / 1024 << " MB in " << consumedAt << "ms ("
+              << source.length() / 1024.0 / 1024.0 / seconds << " MB/s)" << std::endl;
+    std::cout << "Data intact: " << ( intact ? "yes" : "no" ) << std::endl;
+
+    return intact ? 0 : 1;
+}
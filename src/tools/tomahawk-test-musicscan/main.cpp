@@ -2,6 +2,7 @@
 
 #include <QCoreApplication>
 #include <QFileInfo>
+#include <QStringList>
 
 #include <iostream>
 
@@ -9,21 +10,59 @@ void
 usage()
 {
     std::cout << "Usage:" << std::endl;
-    std::cout << "\ttomahawk-test-musicscan <path>" << std::endl;
+    std::cout << "\ttomahawk-test-musicscan [--bench] [--cpu-threads <n>] [--io-threads <n>] <path>" << std::endl;
     std::cout << std::endl;
     std::cout << "\tpath\tEither an audio file or a directory" << std::endl;
+    std::cout << "\t--bench\tDon't log every file, report files/sec of each scanner stage instead" << std::endl;
+    std::cout << "\t--cpu-threads, --io-threads\tSize of the tag reader pool" << std::endl;
 }
 
+
+void
+printStage( const char* name, const ScanStageStats& stats )
+{
+    std::cout << name << "\t" << stats.files << " files in " << stats.elapsed() << " ms"
+              << "\t" << (qint64)stats.filesPerSecond() << " files/sec" << std::endl;
+}
+
+
 int
 main( int argc, char* argv[] )
 {
-    if ( argc != 2 )
+    QCoreApplication a( argc, argv );
+
+    bool bench = false;
+    int cpuThreads = -1;
+    int ioThreads = -1;
+    QString path;
+
+    QStringList args = a.arguments();
+    args.removeFirst();
+    while ( !args.isEmpty() )
+    {
+        const QString arg = args.takeFirst();
+        if ( arg == "--bench" )
+            bench = true;
+        else if ( arg == "--cpu-threads" && !args.isEmpty() )
+            cpuThreads = args.takeFirst().toInt();
+        else if ( arg == "--io-threads" && !args.isEmpty() )
+            ioThreads = args.takeFirst().toInt();
+        else if ( path.isEmpty() )
+            path = arg;
+        else
+        {
+            path.clear();
+            break;
+        }
+    }
+
+    if ( path.isEmpty() )
     {
         usage();
+        exit(EXIT_FAILURE);
     }
 
-    QCoreApplication a( argc, argv );
-    QFileInfo pathInfo( argv[1] );
+    QFileInfo pathInfo( path );
 
     if ( !pathInfo.exists() )
     {
@@ -40,6 +79,7 @@ main( int argc, char* argv[] )
         // Register needed metatypes
         qRegisterMetaType< QDir >( "QDir" );
         qRegisterMetaType< QFileInfo >( "QFileInfo" );
+        qRegisterMetaType< QFileInfoList >( "QFileInfoList" );
 
         // Create the MusicScanner instance
         QStringList paths;
@@ -48,7 +88,8 @@ main( int argc, char* argv[] )
 
         // We want a dry-run of the scanner and not update any internal data.
         scanner.setDryRun( true );
-        scanner.setVerbose( true );
+        scanner.setVerbose( !bench );
+        scanner.setReaderThreads( cpuThreads, ioThreads );
 
         // Start the MusicScanner in its own thread
         QThread scannerThread( 0 );
@@ -61,6 +102,14 @@ main( int argc, char* argv[] )
 
         // Wait until the scanner has done its work.
         scannerThread.wait();
+
+        if ( bench )
+        {
+            // In a dry run the committer only batches, nothing goes to the database
+            printStage( "list", scanner.listerStats() );
+            printStage( "read", scanner.readerStats() );
+            printStage( "commit", scanner.committerStats() );
+        }
     }
     else
     {